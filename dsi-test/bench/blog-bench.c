@@ -0,0 +1,249 @@
+/*
+ * blog-bench - deferred-format binary log against printf() on the caller
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "blog.h"
+#include "harness.h"
+
+/* messages between two looks at the clock, and drains */
+#define BATCH 1024
+
+/* The drained text without the timestamps */
+static char *strip(char *text)
+{
+	char *in = text, *out = text;
+
+	while (*in) {
+		if (*in == '[') {
+			in = strchr(in, ']');
+			if (!in)
+				break;
+			in += 2;
+			continue;
+		}
+		while (*in && (*out++ = *in++) != '\n')
+			;
+	}
+	*out = '\0';
+	return text;
+}
+
+static char *drain_text(int binary)
+{
+	char *text = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&text, &len);
+	FILE *tmp;
+
+	if (binary) {
+		tmp = tmpfile();
+		blog_drain_binary(fileno(tmp));
+		lseek(fileno(tmp), 0, SEEK_SET);
+		blog_decode(fileno(tmp), f);
+		fclose(tmp);
+	} else {
+		blog_drain(f);
+	}
+	fclose(f);
+	return strip(text);
+}
+
+static void log_sample(void)
+{
+	uint8_t b = 0xab;
+	int16_t h = -2;
+
+	blog("no arguments\n");
+	blog("%d %i %u %x %X %o %c|\n", -5, 7, 3000000000u, 0xbeef, 0xcafe, 8,
+	     'z');
+	blog("%hhx %hd %ld %lld %llx %zu\n", b, h, -1L, -1234567890123LL,
+	     0x1122334455667788ULL, (size_t)42);
+	blog("%08x|%-6d|%+d|%5.2f|%e|%g%%\n", 0x1234, 12, 5, 3.14159, 1e-9,
+	     0.5);
+	blog("%s=%d\n", "answer", 42);
+	blog("%d %d %d %d %d %d %d %d\n", 1, 2, 3, 4, 5, 6, 7, 8);
+}
+
+static const char expected[] =
+	"no arguments\n"
+	"-5 7 3000000000 beef CAFE 10 z|\n"
+	"ab -2 -1 -1234567890123 1122334455667788 42\n"
+	"00001234|12    |+5| 3.14|1.000000e-09|0.5%\n"
+	"answer=42\n"
+	"1 2 3 4 5 6 7 8\n";
+
+static void *log_thread(void *arg)
+{
+	int i, k = (intptr_t)arg;
+
+	for (i = 0; i < 1000; i++)
+		blog("%d %d\n", k, i);
+	return NULL;
+}
+
+static int verify(void)
+{
+	struct blog_stats st, st2;
+	pthread_t th[4];
+	char *text, *line;
+	int e, i, k, last[4], err = 0;
+
+	log_sample();
+	text = drain_text(0);
+	e = strcmp(text, expected);
+	printf("formatting: %s\n", e ? "FAILED" : "ok");
+	if (e)
+		printf("%s", text);
+	err |= e;
+	free(text);
+
+	log_sample();
+	text = drain_text(1);
+	/* the decoder does not follow pointers into another process */
+	e = strncmp(text, expected, strstr(expected, "answer") - expected) ||
+	    !strstr(text, "<string at 0x");
+	printf("binary file: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+	free(text);
+
+	/* several rings come out in time order, each in its own order */
+	for (k = 0; k < 4; k++)
+		pthread_create(&th[k], NULL, log_thread, (void *)(intptr_t)k);
+	for (k = 0; k < 4; k++)
+		pthread_join(th[k], NULL);
+	text = drain_text(0);
+	memset(last, -1, sizeof(last));
+	e = 0;
+	for (line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+		if (sscanf(line, "%d %d", &k, &i) != 2 || k < 0 || k > 3 ||
+		    i != last[k] + 1)
+			e = 1;
+		else
+			last[k] = i;
+	}
+	for (k = 0; k < 4; k++)
+		e |= last[k] != 999;
+	printf("threads: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+	free(text);
+
+	/* a full ring drops, it does not block */
+	blog_get_stats(&st);
+	for (i = 0; i < 100000; i++)
+		blog("%d\n", i);
+	blog_get_stats(&st2);
+	e = !(st2.dropped - st.dropped) ||
+	    st2.logged - st.logged + st2.dropped - st.dropped != 100000;
+	printf("full ring: %s, %llu dropped\n", e ? "FAILED" : "ok",
+	       (unsigned long long)(st2.dropped - st.dropped));
+	err |= e;
+	blog_drain(NULL);
+
+	if (err)
+		fprintf(stderr, "blog: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+static void report(const char *name, const char *note, uint64_t t,
+		   uint64_t n)
+{
+	printf("%-28s %7.1f ns/message%s\n", name, (double)t / n, note);
+	bench_report(name, t, n, 0);
+}
+
+static void bench(void)
+{
+	FILE *null = fopen("/dev/null", "w");
+	struct blog_stats st;
+	uint64_t t0, t, d, n;
+	char buf[128];
+	int i;
+
+	/* the drain keeps up, as a drain thread would */
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n += BATCH) {
+		for (i = 0; i < BATCH; i++)
+			blog("DSI write %x %x\n", 0x38, n + i);
+		blog_drain(null);
+	}
+	blog_drain(null);
+	t = bench_now_ns() - t0;
+	report("blog + drain", ", drain included", t, n);
+
+	/* the same without the time spent draining */
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n += BATCH) {
+		for (i = 0; i < BATCH; i++)
+			blog("DSI write %x %x\n", 0x38, n + i);
+		d = bench_now_ns();
+		blog_drain(null);
+		t0 += bench_now_ns() - d;
+	}
+	report("blog, caller", "", t, n);
+	blog_drain(null);
+
+	blog_enabled = 0;
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n += BATCH)
+		for (i = 0; i < BATCH; i++)
+			blog("DSI write %x %x\n", 0x38, n + i);
+	report("blog, disabled", "", t, n);
+	blog_enabled = 1;
+
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n += BATCH)
+		for (i = 0; i < BATCH; i++)
+			snprintf(buf, sizeof(buf), "DSI write %x %x\n", 0x38,
+				 (unsigned int)(n + i));
+	report("snprintf", "", t, n);
+
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n += BATCH)
+		for (i = 0; i < BATCH; i++)
+			fprintf(null, "DSI write %x %x\n", 0x38,
+				(unsigned int)(n + i));
+	fflush(null);
+	t = bench_now_ns() - t0;
+	report("fprintf to /dev/null", "", t, n);
+
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n += BATCH)
+		for (i = 0; i < BATCH; i++) {
+			fprintf(null, "DSI write %x %x\n", 0x38,
+				(unsigned int)(n + i));
+			fflush(null);
+		}
+	report("printf, line buffered", "", t, n);
+
+	blog_get_stats(&st);
+	printf("%llu logged, %llu dropped, %u rings\n",
+	       (unsigned long long)st.logged, (unsigned long long)st.dropped,
+	       st.threads);
+	fclose(null);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "")) != -1) {
+		fprintf(stderr, "Use: \"%s\"\n", argv[0]);
+		exit(1);
+	}
+	if (verify())
+		return 1;
+	bench_start("blog-bench");
+	bench();
+	return bench_finish() ? 2 : 0;
+}
@@ -0,0 +1,482 @@
+/*
+ * broker-bench - UAL_BUS_BROKER clients in several processes, against a
+ * file standing for the registers
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "ual.h"
+#include "harness.h"
+
+#define REGS_SIZE (1 << 16)
+#define REG_SHARED 0x100
+#define NPROC 4
+
+static const char *name = "broker-bench";
+static struct ual_broker *broker;
+
+static void *run(void *arg)
+{
+	ual_broker_run(broker);
+	return NULL;
+}
+
+static struct ual_bar_tkn *attach_to(const char *broker_name)
+{
+	struct ual_desc_broker desc = {broker_name};
+	struct ual_bar_tkn *dev = ual_open(UAL_BUS_BROKER, &desc);
+
+	if (!dev)
+		fprintf(stderr, "%s: %s\n", broker_name, ual_strerror(errno));
+	return dev;
+}
+
+static struct ual_bar_tkn *attach(void)
+{
+	return attach_to(name);
+}
+
+/*
+ * Each process owns a byte of the shared register and counts in it; the
+ * old value tells whether somebody else's update put back a stale byte.
+ */
+static unsigned int count_field(struct ual_bar_tkn *dev, volatile uint32_t *p,
+				int k, int n)
+{
+	uint32_t mask = 0xff << (8 * k), old;
+	unsigned int lost = 0;
+	int i;
+
+	for (i = 1; i <= n; i++) {
+		if (dev) {
+			old = ual_rmwl(dev, REG_SHARED, mask,
+				       (i & 0xff) << (8 * k));
+		} else {
+			old = *p;
+			/* the window the broker closes */
+			if (!(i & 63))
+				sched_yield();
+			*p = (old & ~mask) | ((i & 0xff) << (8 * k));
+		}
+		lost += ((old >> (8 * k)) & 0xff) != ((i - 1) & 0xff);
+	}
+	return lost;
+}
+
+struct sharer {
+	struct ual_bar_tkn *dev;
+	int k;
+	unsigned int lost;
+	pthread_t thread;
+};
+
+static void *share(void *arg)
+{
+	struct sharer *t = arg;
+
+	t->lost = count_field(t->dev, NULL, t->k, 100000);
+	return NULL;
+}
+
+/* Lost updates with NPROC threads on one token: they share its slot */
+static int share_token(unsigned int *lost)
+{
+	struct sharer t[NPROC];
+	struct ual_bar_tkn *dev = attach();
+	int k;
+
+	if (!dev)
+		return -1;
+	ual_writel(dev, REG_SHARED, 0);
+	for (k = 0; k < NPROC; k++) {
+		t[k].dev = dev;
+		t[k].k = k;
+		pthread_create(&t[k].thread, NULL, share, &t[k]);
+	}
+	*lost = 0;
+	for (k = 0; k < NPROC; k++) {
+		pthread_join(t[k].thread, NULL);
+		*lost += t[k].lost;
+	}
+	ual_close(dev);
+	return 0;
+}
+
+/* Lost updates with NPROC processes, through the broker or not */
+static int contend(const char *path, int use_broker, unsigned int *lost)
+{
+	struct ual_bar_tkn *dev = NULL;
+	volatile uint32_t *regs = NULL;
+	int k, fd, status, pipefd[2];
+	unsigned int l;
+	pid_t pid[NPROC];
+
+	*lost = 0;
+	if (pipe(pipefd))
+		return -1;
+	for (k = 0; k < NPROC; k++) {
+		pid[k] = fork();
+		if (pid[k])
+			continue;
+		if (use_broker) {
+			dev = attach();
+			if (!dev)
+				_exit(1);
+			ual_rmwl(dev, REG_SHARED, 0xff << (8 * k), 0);
+		} else {
+			fd = open(path, O_RDWR);
+			regs = mmap(NULL, REGS_SIZE, PROT_READ | PROT_WRITE,
+				    MAP_SHARED, fd, 0);
+			if (regs == MAP_FAILED)
+				_exit(1);
+			regs += REG_SHARED / 4;
+		}
+		l = count_field(dev, regs, k, 200000);
+		if (write(pipefd[1], &l, sizeof(l)) != sizeof(l))
+			_exit(1);
+		if (dev)
+			ual_close(dev);
+		_exit(0);
+	}
+	close(pipefd[1]);
+	while (read(pipefd[0], &l, sizeof(l)) == sizeof(l))
+		*lost += l;
+	close(pipefd[0]);
+	status = 0;
+	for (k = 0; k < NPROC; k++) {
+		waitpid(pid[k], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			return -1;
+	}
+	return 0;
+}
+
+/* A client blocked in ual_rmwl() on a broker that does not serve */
+struct blocked {
+	struct ual_bar_tkn *dev;
+	uint32_t value;
+	int err;
+	pthread_t thread;
+};
+
+static void *block(void *arg)
+{
+	struct blocked *c = arg;
+
+	errno = 0;
+	c->value = ual_rmwl(c->dev, 0x10, 0xff, 1);
+	c->err = errno;
+	return NULL;
+}
+
+static void hung(int sig)
+{
+	static const char msg[] = "broker: client still blocked, FAILED\n";
+
+	if (write(2, msg, sizeof(msg) - 1) < 0)
+		_exit(2);
+	_exit(1);
+}
+
+/*
+ * The broker goes away while a client waits for it: destroyed, or killed
+ * in a process of its own. The client must fail with EPIPE, and keep
+ * failing, instead of waiting for ever.
+ */
+static int orphan(const char *path, int crash)
+{
+	static const char *orphan_name = "broker-bench-orphan";
+	struct ual_broker *b = NULL;
+	struct blocked c;
+	int pipefd[2], e;
+	pid_t pid = 0;
+	char ready;
+
+	if (crash) {
+		if (pipe(pipefd))
+			return -1;
+		pid = fork();
+		if (!pid) {
+			b = ual_broker_create(orphan_name, path, 0, REGS_SIZE);
+			if (!b || write(pipefd[1], "1", 1) != 1)
+				_exit(1);
+			pause();
+			_exit(0);
+		}
+		close(pipefd[1]);
+		e = read(pipefd[0], &ready, 1) != 1;
+		close(pipefd[0]);
+		if (e)
+			return -1;
+	} else {
+		/* over the segment the killed one left behind */
+		b = ual_broker_create(orphan_name, path, 0, REGS_SIZE);
+		if (!b)
+			return -1;
+	}
+
+	c.dev = attach_to(orphan_name);
+	if (!c.dev)
+		return -1;
+	pthread_create(&c.thread, NULL, block, &c);
+	usleep(50000);
+	if (crash) {
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+	} else {
+		ual_broker_destroy(b);
+	}
+	signal(SIGALRM, hung);
+	alarm(2);
+	pthread_join(c.thread, NULL);
+	alarm(0);
+
+	e = c.value != 0xffffffff || c.err != EPIPE;
+	errno = 0;
+	e |= ual_readl(c.dev, 0x10) != 0xffffffff || errno != EPIPE;
+	ual_close(c.dev);
+	return e ? -1 : 0;
+}
+
+static int verify(const char *path)
+{
+	static uint32_t a[3000], b[3000];
+	struct ual_broker_stats st;
+	struct ual_bar_tkn *dev, *other;
+	unsigned int lost;
+	uint32_t v;
+	uint64_t t0;
+	int i, e, err = 0;
+	pid_t pid;
+
+	dev = attach();
+	other = attach();
+	if (!dev || !other)
+		return -1;
+
+	/* reads come after the writes posted before them */
+	for (i = 0; i < 1000; i++)
+		ual_writel(dev, 0x1000 + i * 4, i * 2654435761u);
+	for (i = 0, e = 0; i < 1000; i++)
+		e |= ual_readl(dev, 0x1000 + i * 4) != i * 2654435761u;
+	for (i = 0; i < 1000; i++)
+		ual_writel(dev, 0x10, i);
+	e |= ual_readl(dev, 0x10) != 999;
+	ual_writew(dev, 0x20, 0xabcd);
+	ual_writeb(dev, 0x23, 0x7f);
+	e |= ual_readl(dev, 0x20) != 0x7f00abcd;
+	/* and show up in the other clients once executed */
+	e |= ual_readl(other, 0x20) != 0x7f00abcd;
+	printf("write ordering: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	ual_writel(dev, 0x30, 0x12345678);
+	ual_readl(dev, 0x30);	/* the posted write lands before the rmw */
+	v = ual_rmwl(other, 0x30, 0xff00, 0xab00);
+	e = v != 0x12345678 || ual_readl(dev, 0x30) != 0x1234ab78;
+	printf("rmw: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	/* files keep the last value written to the FIFO */
+	for (i = 0; i < 3000; i++)
+		a[i] = i * 40503u;
+	e = ual_writel_fifo(dev, 0x40, a, 3000, UAL_FIFO_NO_LEVEL) != 3000 ||
+	    ual_readl_fifo(dev, 0x40, b, 3000, UAL_FIFO_NO_LEVEL) != 3000;
+	for (i = 0; i < 3000; i++)
+		e |= b[i] != a[2999];
+	/* 64-bit entries as word pairs, never split across requests */
+	e |= ual_writeq_fifo(dev, 0x40, (uint64_t *)a, 1500,
+			     UAL_FIFO_NO_LEVEL) != 1500 ||
+	     ual_readq_fifo(dev, 0x40, (uint64_t *)b, 1500,
+			    UAL_FIFO_NO_LEVEL) != 1500;
+	for (i = 0; i < 3000; i++)
+		e |= b[i] != a[2999];
+	printf("fifo through the ring: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	errno = 0;
+	v = ual_readl(dev, REGS_SIZE - 2);
+	e = v != 0xffffffff || errno != EFAULT;
+	ual_writel(dev, REGS_SIZE, 1);
+	e |= ual_readl(dev, 0x10) != 999;
+	printf("errors: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	e = contend(path, 1, &lost) || lost;
+	printf("rmw from %d processes: %s, %u lost updates\n", NPROC,
+	       e ? "FAILED" : "ok", lost);
+	err |= e;
+
+	e = share_token(&lost) || lost;
+	printf("rmw from %d threads on one token: %s, %u lost updates\n",
+	       NPROC, e ? "FAILED" : "ok", lost);
+	err |= e;
+
+	/* a client killed before ual_close() gives its slot back */
+	pid = fork();
+	if (!pid) {
+		if (!attach())
+			_exit(1);
+		_exit(0);
+	}
+	waitpid(pid, NULL, 0);
+	t0 = bench_now_ns();
+	do {
+		usleep(10000);
+		ual_broker_get_stats(broker, &st);
+	} while (st.clients != 2 && bench_now_ns() - t0 < 1000000000);
+	e = st.clients != 2;
+	printf("dead client: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	/* a second broker does not take the name of a live one */
+	errno = 0;
+	e = ual_broker_create(name, path, 0, REGS_SIZE) != NULL ||
+	    errno != EADDRINUSE;
+	ual_writel(dev, 0x10, 1000);
+	e |= ual_readl(dev, 0x10) != 1000;
+	printf("name in use: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	e = orphan(path, 1);
+	printf("broker killed under a waiting client: %s\n",
+	       e ? "FAILED" : "ok");
+	err |= e;
+	e = orphan(path, 0);
+	printf("broker destroyed under a waiting client: %s\n",
+	       e ? "FAILED" : "ok");
+	err |= e;
+
+	ual_close(other);
+	ual_close(dev);
+	if (err)
+		fprintf(stderr, "broker: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+static void report(const char *what, uint64_t t, uint64_t n,
+		   const struct ual_broker_stats *s0)
+{
+	struct ual_broker_stats st;
+
+	ual_broker_get_stats(broker, &st);
+	printf("%-24s %8.1f ns, %5.3f broker sleeps/op\n", what,
+	       (double)t / n, (double)(st.sleeps - s0->sleeps) / n);
+	bench_report(what, t, n, 0);
+}
+
+static void bench(const char *path)
+{
+	struct ual_broker_stats s0;
+	struct ual_bar_tkn *dev = attach();
+	volatile uint32_t *regs;
+	unsigned int lost;
+	uint64_t t0, t, n;
+	uint32_t sum = 0;
+	int fd;
+
+	if (!dev)
+		return;
+	fd = open(path, O_RDONLY);
+	regs = mmap(NULL, REGS_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (regs == MAP_FAILED)
+		return;
+
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		sum += regs[4];
+	printf("%-24s %8.1f ns\n", "plain mmap load", (double)t / n);
+	bench_report("plain mmap load", t, n, 0);
+
+	ual_broker_get_stats(broker, &s0);
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		sum += ual_readl(dev, 0x10);
+	report("broker readl", t, n, &s0);
+
+	ual_broker_get_stats(broker, &s0);
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		ual_writel(dev, 0x10, n);
+	ual_readl(dev, 0x10);
+	t = bench_now_ns() - t0;
+	report("broker writel (posted)", t, n, &s0);
+
+	ual_broker_get_stats(broker, &s0);
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		ual_rmwl(dev, 0x10, 0xff, n);
+	report("broker rmwl", t, n, &s0);
+
+	if (!contend(path, 0, &lost))
+		printf("plain mmap rmw from %d processes: %u lost updates\n",
+		       NPROC, lost);
+	if (!contend(path, 1, &lost))
+		printf("broker rmw from %d processes: %u lost updates\n",
+		       NPROC, lost);
+
+	munmap((void *)regs, REGS_SIZE);
+	ual_close(dev);
+	if (sum == 1)
+		printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "/tmp/broker-bench.regs";
+	pthread_t thread;
+	int c, fd, err;
+
+	while ((c = getopt(argc, argv, "f:")) != -1) {
+		switch (c) {
+		case 'f':
+			path = optarg;
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-f file]\"\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, REGS_SIZE)) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+	broker = ual_broker_create(name, path, 0, REGS_SIZE);
+	if (!broker) {
+		fprintf(stderr, "%s: %s\n", name, ual_strerror(errno));
+		exit(1);
+	}
+	pthread_create(&thread, NULL, run, NULL);
+
+	err = verify(path);
+	if (!err) {
+		bench_start("broker-bench");
+		bench(path);
+		err = bench_finish() ? 2 : 0;
+	}
+
+	ual_broker_stop(broker);
+	pthread_join(thread, NULL);
+	ual_broker_destroy(broker);
+	unlink(path);
+	return err < 0 ? 1 : err;
+}
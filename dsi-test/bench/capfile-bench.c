@@ -0,0 +1,300 @@
+/*
+ * capfile-bench - time to first draw of a deep capture file
+ *
+ * License: LGPLv2.1
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "capfile.h"
+#include "harness.h"
+
+#define BATCH (1 << 20)
+
+static int cols = 640, rows = 480;
+
+/* A slow sine with noise and two single-sample glitches */
+static int16_t sample(uint64_t i, uint64_t n)
+{
+	uint32_t h = i * 2654435761u;
+
+	if (i == n * 7 / 13)
+		return 32767;
+	if (i == n * 11 / 17)
+		return -32768;
+	return 20000 * sin(i * 2 * M_PI / 1e7) + (h >> 20) - 2048;
+}
+
+static int write_file(const char *path, uint64_t n)
+{
+	struct cap_info info = {1, 16, 1e-9, 0, 0, 0};
+	struct cap_channel ch = {"CH1", 1e-4, 0};
+	int16_t *buf = malloc(BATCH * sizeof(*buf));
+	const void *src[1] = {buf};
+	struct cap_writer *w;
+	uint64_t i, k, j, t0;
+	int fd;
+
+	w = cap_create(path, &info, &ch);
+	if (!w || !buf) {
+		perror(path);
+		return -1;
+	}
+	t0 = bench_now_ns();
+	for (i = 0; i < n; i += k) {
+		k = n - i < BATCH ? n - i : BATCH;
+		for (j = 0; j < k; j++)
+			buf[j] = sample(i + j, n);
+		if (cap_write(w, src, k)) {
+			perror("cap_write");
+			return -1;
+		}
+	}
+	if (cap_finish(w)) {
+		perror("cap_finish");
+		return -1;
+	}
+	fd = open(path, O_RDONLY);
+	fsync(fd);
+	close(fd);
+	printf("write %lluM samples: %.2f s (including generation)\n",
+	       (unsigned long long)n / 1000000, (bench_now_ns() - t0) / 1e9);
+	free(buf);
+	return 0;
+}
+
+/* Drops the file from the page cache so that the next access is cold */
+static void evict(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/* Every column must be the exact envelope of the entries it overlaps */
+static int check(struct cap_file *f, uint64_t n, uint64_t first,
+		 uint64_t count)
+{
+	struct decim_span *out = malloc(cols * sizeof(*out));
+	uint64_t a, b, lo, hi, g, j;
+	int16_t *buf, mn, mx;
+	int c, err = 0;
+	long r;
+
+	r = cap_render(f, 0, out, cols, first, count);
+	if (r < 0) {
+		free(out);
+		return -1;
+	}
+	g = r;
+	lo = first / g * g;
+	hi = (first + count + g - 1) / g * g;
+	if (hi > n)
+		hi = n;
+	buf = malloc((hi - lo) * sizeof(*buf));
+	if (cap_read(f, 0, lo, buf, hi - lo) != hi - lo)
+		err = 1;
+	for (j = lo; j < hi && !err; j += 4099)
+		err |= buf[j - lo] != sample(j, n);
+	for (c = 0; c < cols && !err; c++) {
+		a = first + (uint64_t)c * count / cols;
+		b = first + (uint64_t)(c + 1) * count / cols;
+		if (b == a)
+			b = a + 1;
+		a = a / g * g;
+		b = (b + g - 1) / g * g;
+		if (b > n)
+			b = n;
+		mn = INT16_MAX;
+		mx = INT16_MIN;
+		for (j = a; j < b; j++) {
+			if (buf[j - lo] < mn)
+				mn = buf[j - lo];
+			if (buf[j - lo] > mx)
+				mx = buf[j - lo];
+		}
+		err |= out[c].min != mn || out[c].max != mx;
+	}
+	free(buf);
+	free(out);
+	if (err)
+		fprintf(stderr, "capfile: verification FAILED at %llu + %llu\n",
+			(unsigned long long)first, (unsigned long long)count);
+	return err ? -1 : 0;
+}
+
+static int verify(struct cap_file *f, uint64_t n)
+{
+	static const uint64_t counts[] = {1, 100, 640, 6400, 40000, 41000,
+					  655360, 1000000, 10485760};
+	struct cap_info info;
+	size_t k;
+	int err = 0, i;
+
+	cap_get_info(f, &info);
+	if (info.samples != n || info.bits != 16 || info.channels != 1 ||
+	    strcmp(cap_get_channel(f, 0)->name, "CH1")) {
+		fprintf(stderr, "capfile: header mismatch\n");
+		return -1;
+	}
+	for (k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+		if (counts[k] > n)
+			continue;
+		err |= check(f, n, 0, counts[k]);
+		err |= check(f, n, n - counts[k], counts[k]);
+		for (i = 0; i < 3; i++)
+			err |= check(f, n, (uint64_t)rand() * rand() %
+				     (n - counts[k] + 1), counts[k]);
+	}
+	/* the overview has to show both glitches */
+	if (n <= 200000000)
+		err |= check(f, n, 0, n);
+	return err;
+}
+
+static void first_draw(const char *path, uint64_t n,
+		       struct pixconv_surface *fb)
+{
+	struct pixconv_rect area = {0, 0, fb->width, fb->height};
+	struct decim_span *spans = malloc(cols * sizeof(*spans));
+	struct cap_file *f;
+	uint64_t t0, t1, t2;
+	int16_t *buf;
+	long g;
+
+	evict(path);
+	t0 = bench_now_ns();
+	f = cap_open(path);
+	t1 = bench_now_ns();
+	g = cap_render(f, 0, spans, cols, 0, n);
+	decim_connect(spans, cols);
+	decim_draw(fb, &area, spans, -32768, 32767, 0xffff00);
+	t2 = bench_now_ns();
+	printf("cold first draw, pyramid:  %8.2f ms (open %.2f ms, %ld samples/entry)\n",
+	       (t2 - t0) / 1e6, (t1 - t0) / 1e6, g);
+	bench_report("cold first draw, pyramid", t2 - t0, 1, 0);
+	cap_close(f);
+
+	/* What this replaces: load the record, then decimate it */
+	buf = malloc(n * sizeof(*buf));
+	if (!buf) {
+		printf("cold first draw, full read: not enough memory\n");
+		free(spans);
+		return;
+	}
+	evict(path);
+	t0 = bench_now_ns();
+	f = cap_open(path);
+	cap_read(f, 0, 0, buf, n);
+	decim_minmax_s16(spans, cols, buf, n);
+	decim_connect(spans, cols);
+	decim_draw(fb, &area, spans, -32768, 32767, 0xffff00);
+	t2 = bench_now_ns();
+	printf("cold first draw, full read: %7.2f ms\n", (t2 - t0) / 1e6);
+	bench_report("cold first draw, full read", t2 - t0, 1, 0);
+	cap_close(f);
+	free(buf);
+	free(spans);
+}
+
+static void warm(const char *path, uint64_t n)
+{
+	static const uint64_t counts[] = {6400, 640000, 10000000, 0};
+	struct decim_span *spans = malloc(cols * sizeof(*spans));
+	struct cap_file *f = cap_open(path);
+	uint64_t t0, t, count, first;
+	char name[64];
+	size_t k;
+	int iter;
+	long g = 0;
+
+	for (k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+		count = counts[k] && counts[k] < n ? counts[k] : n;
+		first = 0;
+		iter = 0;
+		t0 = bench_now_ns();
+		do {
+			/* pan across the record one screen at a time */
+			g = cap_render(f, 0, spans, cols, first, count);
+			first += count;
+			if (first + count > n)
+				first = 0;
+			iter++;
+			t = bench_now_ns() - t0;
+		} while (t < 300000000ULL);
+		printf("warm render %10llu samples: %8.1f us/frame (%ld samples/entry)\n",
+		       (unsigned long long)count, t / 1e3 / iter, g);
+		snprintf(name, sizeof(name), "warm render %llu samples",
+			 (unsigned long long)count);
+		bench_report(name, t, iter, 0);
+	}
+	cap_close(f);
+	free(spans);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "/tmp/capfile-bench.cap";
+	uint64_t n = 100000000;
+	struct pixconv_surface fb;
+	struct cap_file *f;
+	int c, keep = 0, reuse = 0, err;
+
+	while ((c = getopt(argc, argv, "o:n:w:kr")) != -1) {
+		switch (c) {
+		case 'o': path = optarg; break;
+		case 'n': n = strtoull(optarg, NULL, 0); break;
+		case 'w': cols = atoi(optarg); break;
+		case 'k': keep = 1; break;
+		case 'r': reuse = keep = 1; break;
+		default:
+			fprintf(stderr, "Use: \"%s [-o file] [-n samples] [-w columns] [-k keep file] [-r reuse kept file]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	if (n < 1) {
+		fprintf(stderr, "need at least one sample\n");
+		exit(1);
+	}
+
+	if (!reuse && write_file(path, n))
+		return 1;
+	f = cap_open(path);
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	err = verify(f, n);
+	cap_close(f);
+	if (err)
+		return 1;
+
+	fb.width = cols;
+	fb.height = rows;
+	fb.stride = cols * 3;
+	fb.fmt = PIXCONV_RGB888;
+	fb.ptr = calloc(rows, fb.stride);
+
+	bench_start("capfile-bench");
+	first_draw(path, n, &fb);
+	warm(path, n);
+
+	free(fb.ptr);
+	if (!keep)
+		unlink(path);
+	return bench_finish() ? 2 : 0;
+}
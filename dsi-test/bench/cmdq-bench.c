@@ -0,0 +1,241 @@
+/*
+ * cmdq-bench - several threads submitting to one DCS command queue, then
+ * dsi_cmdq_flush(), on the behavioral model
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ual.h"
+#include "dsi_core.h"
+#include "dsi_model.h"
+#include "dsi_cmdq.h"
+#include "harness.h"
+
+#define MAX_PRODUCERS 16
+
+/* dsi_core.c talks to whatever ubar is */
+static struct ual_bar_tkn *ubar;
+
+void dsi_write(uint32_t reg, uint32_t val)
+{
+	ual_writel(ubar, reg, val);
+}
+
+uint32_t dsi_read(uint32_t reg)
+{
+	return ual_readl(ubar, reg);
+}
+
+int dsi_wait(uint32_t reg, uint32_t mask, uint32_t value)
+{
+	struct timespec timeout = {0, DSI_WAIT_TIMEOUT_MS * 1000000};
+
+	return ual_readl_poll(ubar, reg, mask, value, &timeout, NULL) ? -1 : 0;
+}
+
+struct producer {
+	struct dsi_cmdq *q;
+	int id;
+	int count;
+	uint64_t full; /* submissions refused with EAGAIN */
+	pthread_t thread;
+};
+
+static atomic_ulong done_status[4];
+
+static void done(void *arg, int status)
+{
+	atomic_fetch_add(&done_status[status], 1);
+}
+
+/* Generic short writes carrying (producer, sequence), and a brightness
+   change now and then for the coalescing */
+static void *produce(void *arg)
+{
+	struct producer *p = arg;
+	struct dsi_cmd cmd;
+	int i;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.ptype = 0x23; /* generic short write, 2 parameters */
+	for (i = 0; i < p->count; i++) {
+		cmd.key = DSI_CMDQ_KEY_NONE;
+		cmd.data[0] = p->id;
+		cmd.data[1] = i;
+		if (i % 8 == 7) {
+			cmd.ptype = DSI_DCS_SHORT_WRITE_1;
+			cmd.key = DCS_WRITE_DISPLAY_BRIGHTNESS;
+			cmd.data[0] = DCS_WRITE_DISPLAY_BRIGHTNESS;
+		}
+		while (dsi_cmdq_submit(p->q, &cmd, done, NULL)) {
+			p->full++;
+			sched_yield();
+		}
+		cmd.ptype = 0x23;
+	}
+	return NULL;
+}
+
+static int no_gap(void *arg)
+{
+	return -1;
+}
+
+/* A batch whose frame gap never came must fail without reaching the link */
+static int check_no_gap(struct dsi_model *m)
+{
+	struct dsi_cmdq_config cfg = {.depth = 8, .wait_frame = no_gap};
+	struct dsi_cmdq *q;
+	int n, err;
+
+	q = dsi_cmdq_create(&cfg);
+	if (!q)
+		return -1;
+	dsi_model_clear(m);
+	memset(done_status, 0, sizeof(done_status));
+	dsi_cmdq_dcs(q, DCS_SET_DISPLAY_ON, NULL, 0, done, NULL);
+	dsi_cmdq_brightness(q, 0x80);
+	dsi_cmdq_flush(q);
+	dsi_cmdq_destroy(q);
+
+	dsi_model_packets(m, &n);
+	err = n || done_status[DSI_CMDQ_FAILED] != 1;
+	printf("failed frame wait: %s\n", err ? "FAILED" : "ok");
+	return err ? -1 : 0;
+}
+
+static void hung(int sig)
+{
+	static const char msg[] = "cmdq: dsi_cmdq_flush() hung, FAILED\n";
+
+	if (write(2, msg, sizeof(msg) - 1) < 0)
+		_exit(2);
+	_exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct dsi_cmdq_config cfg = {.depth = 64};
+	struct dsi_model_config mcfg;
+	struct producer p[MAX_PRODUCERS];
+	const struct dsi_model_packet *pkt;
+	int c, i, k, n, producers = 4, count = 4000, rounds = 20, err = 0;
+	int next[MAX_PRODUCERS];
+	unsigned long total, sent, full = 0;
+	struct dsi_model *m;
+	struct dsi_cmdq *q;
+	uint64_t t0, t;
+
+	while ((c = getopt(argc, argv, "p:n:r:")) != -1) {
+		switch (c) {
+		case 'p':
+			producers = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-p <producers>] [-n <commands each>] [-r <rounds>]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	if (producers < 1 || producers > MAX_PRODUCERS || count < 1 ||
+	    rounds < 1) {
+		fprintf(stderr, "cmdq-bench: invalid arguments\n");
+		exit(1);
+	}
+
+	memset(&mcfg, 0, sizeof(mcfg));
+	mcfg.max_packets = producers * count;
+	m = dsi_model_create(&mcfg);
+	ubar = m ? dsi_model_open(m) : NULL;
+	if (!ubar) {
+		fprintf(stderr, "cmdq-bench: %s\n", ual_strerror(errno));
+		exit(1);
+	}
+	dsi_write(REG_DSI_TICKDIV, 2);
+	q = dsi_cmdq_create(&cfg);
+	if (!q) {
+		fprintf(stderr, "cmdq-bench: %s\n", strerror(errno));
+		exit(1);
+	}
+	signal(SIGALRM, hung);
+
+	t = 0;
+	for (k = 0; k < rounds && !err; k++) {
+		dsi_model_clear(m);
+		memset(done_status, 0, sizeof(done_status));
+		t0 = bench_now_ns();
+		for (i = 0; i < producers; i++) {
+			p[i].q = q;
+			p[i].id = i;
+			p[i].count = count;
+			p[i].full = 0;
+			pthread_create(&p[i].thread, NULL, produce, &p[i]);
+		}
+		for (i = 0; i < producers; i++) {
+			pthread_join(p[i].thread, NULL);
+			full += p[i].full;
+		}
+		/* a lost wake-up leaves commands in the ring for good */
+		alarm(10);
+		dsi_cmdq_flush(q);
+		alarm(0);
+		t += bench_now_ns() - t0;
+
+		/* every command retired once, each producer's in its order */
+		total = done_status[DSI_CMDQ_SENT] +
+			done_status[DSI_CMDQ_COALESCED];
+		sent = done_status[DSI_CMDQ_SENT];
+		pkt = dsi_model_packets(m, &n);
+		if (total != (unsigned long)producers * count || sent != n)
+			err = 1;
+		memset(next, 0, sizeof(next));
+		for (i = 0; i < n && !err; i++) {
+			if (pkt[i].dt != 0x23)
+				continue;
+			c = pkt[i].wc & 0xff;
+			if (c >= producers ||
+			    (pkt[i].wc >> 8) != (next[c] & 0xff))
+				err = 1;
+			next[c]++;
+			if (next[c] % 8 == 7)
+				next[c]++;
+		}
+	}
+	printf("%d producers, %d commands each, %d rounds: %s\n", producers,
+	       count, k, err ? "FAILED" : "ok");
+	printf("%-28s %7.1f ns/command, %lu submissions found the ring full\n",
+	       "submit to flush", (double)t / ((uint64_t)k * producers * count),
+	       full);
+	if (!err && check_no_gap(m))
+		err = 1;
+	if (!err) {
+		bench_start("cmdq-bench");
+		bench_report("submit to flush", t,
+			     (uint64_t)k * producers * count, 0);
+		err = bench_finish() ? 2 : 0;
+	}
+
+	dsi_cmdq_destroy(q);
+	ual_close(ubar);
+	dsi_model_destroy(m);
+	return err;
+}
@@ -0,0 +1,226 @@
+/*
+ * compositor-bench - bytes written per frame, full repaint vs damage
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "compositor.h"
+#include "harness.h"
+
+static int width = 640, height = 960, frames = 600, buffers = 3;
+
+static uint64_t cpu_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* Simulated v_frmbuf_rd, a frame start every millisecond */
+static atomic_uint isr;
+static atomic_int stop;
+static uint32_t regs[32];
+
+static uint32_t frmbuf_read(void *priv, uint32_t addr, enum ual_data_width dw)
+{
+	return addr == REG_FRMBUF_ISR ? atomic_load(&isr) : regs[addr / 4 % 32];
+}
+
+static void frmbuf_write(void *priv, uint32_t addr, uint32_t value,
+			 enum ual_data_width dw)
+{
+	if (addr == REG_FRMBUF_ISR)
+		atomic_fetch_xor(&isr, value);
+	else
+		regs[addr / 4 % 32] = value;
+}
+
+static void *ticker(void *arg)
+{
+	struct timespec t = {0, 1000000};
+
+	while (!atomic_load(&stop)) {
+		nanosleep(&t, NULL);
+		atomic_fetch_or(&isr, FRMBUF_IRQ_AP_READY);
+	}
+	return NULL;
+}
+
+static struct pixconv_surface *surface(int w, int h, enum pixconv_format fmt)
+{
+	struct pixconv_surface *s = malloc(sizeof(*s));
+
+	s->width = w;
+	s->height = h;
+	s->fmt = fmt;
+	s->stride = w * pixconv_bpp(fmt);
+	s->ptr = calloc(h, s->stride);
+	return s;
+}
+
+static void fill(struct pixconv_surface *s, const struct pixconv_rect *r,
+		 uint32_t rgb)
+{
+	int x, y, bpp = pixconv_bpp(s->fmt);
+	uint8_t *p;
+
+	for (y = r->y; y < r->y + r->h; y++) {
+		p = s->ptr + y * s->stride + r->x * bpp;
+		for (x = 0; x < r->w; x++, p += bpp) {
+			if (s->fmt == PIXCONV_XRGB8888) {
+				p[0] = rgb; p[1] = rgb >> 8; p[2] = rgb >> 16;
+				p[3] = 0xff;
+			} else {
+				p[0] = rgb >> 16; p[1] = rgb >> 8; p[2] = rgb;
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct ual_desc_sim sregs = {0x10000, 0, NULL, frmbuf_read, frmbuf_write};
+	struct ual_desc_sim smem = {0, };
+	struct dsi_panel_config panel = {0, };
+	struct frmbuf_config cfg = {0, };
+	struct pixconv_surface *bg, *wave, *readout, *menu, shot;
+	struct compositor_layer *lwave, *lread, *lmenu;
+	struct frmbuf_buffer *back, snap;
+	struct compositor_stats st;
+	struct compositor *comp;
+	struct frmbuf *fb;
+	struct pixconv_rect r;
+	pthread_t tick;
+	uint64_t t0, cpu = 0;
+	int c, i, x, y, prev_y = -1, bad = 0;
+
+	while ((c = getopt(argc, argv, "w:h:n:b:")) != -1) {
+		switch (c) {
+		case 'w': width = atoi(optarg); break;
+		case 'h': height = atoi(optarg); break;
+		case 'n': frames = atoi(optarg); break;
+		case 'b': buffers = atoi(optarg); break;
+		default:
+			fprintf(stderr, "Use: \"%s [-w width] [-h height] [-n frames] [-b buffers]\"\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	/* a single buffer never comes back from scanout */
+	if (buffers < 2 || buffers > FRMBUF_MAX_BUFFERS) {
+		fprintf(stderr, "buffers: 2 to %d\n", FRMBUF_MAX_BUFFERS);
+		return 1;
+	}
+
+	panel.width = width;
+	panel.height = height;
+	smem.size = (width * 3 + 64) * height * buffers + 0x10000;
+	cfg.regs = ual_open(UAL_BUS_SIM, &sregs);
+	cfg.mem = ual_open(UAL_BUS_SIM, &smem);
+	cfg.mem_phys = 0x1f000000;
+	cfg.mem_size = smem.size;
+	cfg.num_buffers = buffers;
+	fb = frmbuf_open(&cfg, &panel);
+	if (!fb) {
+		perror("frmbuf_open");
+		return 1;
+	}
+	pthread_create(&tick, NULL, ticker, NULL);
+
+	/* graticule background, waveform area, a keyed readout and a menu */
+	bg = surface(width, height, PIXCONV_RGB888);
+	for (y = 0; y < height; y++)
+		for (x = 0; x < width; x++)
+			if (x % 50 == 0 || y % 50 == 0)
+				memset(bg->ptr + y * bg->stride + x * 3, 0x60, 3);
+	wave = surface(width - 40, height / 2, PIXCONV_XRGB8888);
+	readout = surface(160, 24, PIXCONV_RGB888);
+	menu = surface(width / 3, height / 3, PIXCONV_RGB888);
+	r = (struct pixconv_rect){0, 0, menu->width, menu->height};
+	fill(menu, &r, 0x203040);
+
+	comp = compositor_create(width, height);
+	compositor_layer_create(comp, COMPOSITOR_Z_BACKGROUND, bg, 0, 0, 0, 0);
+	lwave = compositor_layer_create(comp, COMPOSITOR_Z_WAVEFORM, wave, 20,
+					height / 4, 0, 0);
+	lread = compositor_layer_create(comp, COMPOSITOR_Z_OVERLAY, readout, 20, 20,
+					COMPOSITOR_LAYER_KEYED, 0x000000);
+	lmenu = compositor_layer_create(comp, COMPOSITOR_Z_MENU, menu,
+					width - menu->width, height / 3, 0, 0);
+	compositor_layer_show(lmenu, 0);
+
+	shot = *bg;
+	shot.ptr = malloc(bg->stride * height);
+	snap = (struct frmbuf_buffer){-1, shot.ptr, 0, width, height, shot.stride};
+
+	for (i = 0; i < frames; i++) {
+		/* the trace sweeps down one band of the waveform layer */
+		y = (i * 7) % (wave->height - 8);
+		if (prev_y >= 0) {
+			r = (struct pixconv_rect){0, prev_y, wave->width, 8};
+			fill(wave, &r, 0x000000);
+			compositor_layer_damage(lwave, &r);
+		}
+		r = (struct pixconv_rect){0, y, wave->width, 8};
+		fill(wave, &r, 0xffff00);
+		compositor_layer_damage(lwave, &r);
+		prev_y = y;
+
+		if (i % 10 == 0) {
+			r = (struct pixconv_rect){0, 0, (i / 10) % 160, 24};
+			fill(readout, &r, 0x00ff00);
+			compositor_layer_damage(lread, &r);
+		}
+		if (i % 200 == 100)
+			compositor_layer_show(lmenu, 1);
+		if (i % 200 == 160)
+			compositor_layer_show(lmenu, 0);
+
+		back = frmbuf_get_back(fb);
+		t0 = cpu_ns();
+		compositor_compose(comp, back);
+		cpu += cpu_ns() - t0;
+
+		compositor_compose(comp, &snap);
+		for (y = 0; y < height; y++)
+			bad += !!memcmp(back->ptr + y * back->stride,
+					shot.ptr + y * shot.stride, width * 3);
+
+		frmbuf_queue(fb, back);
+	}
+
+	atomic_store(&stop, 1);
+	pthread_join(tick, NULL);
+
+	compositor_get_stats(comp, &st);
+	printf("%dx%d, %d buffers, %d frames\n", width, height, buffers, frames);
+	printf("full repaint %10.0f B/frame\n", (double)width * height * 3);
+	printf("damage       %10.0f B/frame %8.1f us/frame\n",
+	       (double)st.bytes_written / st.frames, cpu / 1e3 / frames);
+	if (bad)
+		fprintf(stderr, "compositor: %d rows differ from a full composition\n",
+			bad);
+	else {
+		bench_start("compositor-bench");
+		bench_report("damage, cpu per frame", cpu, frames,
+			     st.bytes_written / st.frames);
+		bad = bench_finish() ? -1 : 0;
+	}
+
+	compositor_destroy(comp);
+	frmbuf_close(fb);
+	ual_close(cfg.regs);
+	ual_close(cfg.mem);
+	return bad < 0 ? 2 : bad ? 1 : 0;
+}
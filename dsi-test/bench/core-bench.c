@@ -0,0 +1,351 @@
+/*
+ * core-bench - libual accessors, ual_event_wait() and the dsi_core packet
+ * path, through the common harness
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <getopt.h>
+
+#include "ual.h"
+#include "dsi_core.h"
+#include "dsi_model.h"
+#include "harness.h"
+
+#define BLOCK 16384 /* 32bit values of a bulk transfer */
+
+/* dsi_core.c talks to whatever ubar is */
+static struct ual_bar_tkn *ubar;
+
+void dsi_write(uint32_t reg, uint32_t val)
+{
+	ual_writel(ubar, reg, val);
+}
+
+uint32_t dsi_read(uint32_t reg)
+{
+	return ual_readl(ubar, reg);
+}
+
+int dsi_wait(uint32_t reg, uint32_t mask, uint32_t value)
+{
+	struct timespec timeout = {0, DSI_WAIT_TIMEOUT_MS * 1000000};
+
+	return ual_readl_poll(ubar, reg, mask, value, &timeout, NULL) ? -1 : 0;
+}
+
+static volatile uint32_t sink;
+static uint32_t buf[BLOCK];
+
+static void b_readl(void *arg, uint64_t n)
+{
+	uint32_t s = 0;
+
+	while (n--)
+		s += ual_readl(arg, 0x10);
+	sink = s;
+}
+
+static void b_writel(void *arg, uint64_t n)
+{
+	while (n--)
+		ual_writel(arg, 0x10, n);
+}
+
+static void b_readl_n(void *arg, uint64_t n)
+{
+	while (n--)
+		ual_readl_n(arg, 0, buf, BLOCK);
+}
+
+static void b_writel_n(void *arg, uint64_t n)
+{
+	while (n--)
+		ual_writel_n(arg, 0, buf, BLOCK);
+}
+
+static void b_readl_fifo(void *arg, uint64_t n)
+{
+	while (n--)
+		ual_readl_fifo(arg, 0x20, buf, BLOCK, UAL_FIFO_NO_LEVEL);
+}
+
+static void b_memcpy(void *arg, uint64_t n)
+{
+	while (n--) {
+		memcpy(buf, arg, sizeof(buf));
+		__asm__ __volatile__("" : : "r"(buf) : "memory");
+	}
+}
+
+/* Register file behind the hooks: the path of the busses without a
+ * mapping, and a status bit for ual_event_wait() */
+struct hooked {
+	uint32_t regs[BLOCK];
+	uint64_t reads;
+};
+
+static uint32_t hook_read(void *priv, uint32_t addr, enum ual_data_width dw)
+{
+	struct hooked *h = priv;
+
+	/* 0x100 reads as ready every other time */
+	if (addr == 0x100)
+		return h->reads++ & 1;
+	return h->regs[addr / 4 % BLOCK];
+}
+
+static void hook_write(void *priv, uint32_t addr, uint32_t value,
+		       enum ual_data_width dw)
+{
+	struct hooked *h = priv;
+
+	h->regs[addr / 4 % BLOCK] = value;
+}
+
+static void b_event_ready(void *arg, uint64_t n)
+{
+	struct timespec period = {0, 50000}, timeout;
+
+	while (n--) {
+		timeout.tv_sec = 1;
+		timeout.tv_nsec = 0;
+		/* the value at 0x10 has bit 0 set */
+		ual_event_wait(arg, 0x10, 1, &period, &timeout);
+	}
+}
+
+static void b_event_period(void *arg, uint64_t n)
+{
+	struct timespec period = {0, 50000}, timeout;
+
+	while (n--) {
+		timeout.tv_sec = 1;
+		timeout.tv_nsec = 0;
+		/* not ready, one period, ready */
+		ual_event_wait(arg, 0x100, 1, &period, &timeout);
+	}
+}
+
+static void b_ecc(void *arg, uint64_t n)
+{
+	uint8_t s = 0;
+
+	while (n--)
+		s += dsi_ecc(n & 0xffffff);
+	sink = s;
+}
+
+struct crc_arg {
+	int len;
+	uint8_t data[1024];
+};
+
+static void b_crc_len(void *arg, uint64_t n)
+{
+	struct crc_arg *c = arg;
+	uint16_t s = 0;
+
+	while (n--)
+		s += dsi_crc(c->data, c->len);
+	sink = s;
+}
+
+static void b_lp_short(void *arg, uint64_t n)
+{
+	while (n--)
+		dsi_send_lp_short(0x15, n, n >> 8);
+	dsi_model_clear(arg);
+}
+
+static void b_long_write(void *arg, uint64_t n)
+{
+	static const uint8_t data[64];
+
+	while (n--)
+		dsi_long_write(1, data, sizeof(data));
+	dsi_model_clear(arg);
+}
+
+/* Published header/ECC pairs: DCS commands and sync events as the spec's
+   examples and panel datasheets list them */
+static const struct {
+	uint8_t h[3], ecc;
+} ecc_vectors[] = {
+	{{0x05, 0x11, 0x00}, 0x36},	/* exit_sleep_mode */
+	{{0x05, 0x29, 0x00}, 0x1c},	/* set_display_on */
+	{{0x05, 0x28, 0x00}, 0x06},	/* set_display_off */
+	{{0x05, 0x10, 0x00}, 0x2c},	/* enter_sleep_mode */
+	{{0x01, 0x00, 0x00}, 0x07},	/* VSync start */
+	{{0x21, 0x00, 0x00}, 0x12},	/* HSync start */
+};
+#define N_ECC_VECTORS (sizeof(ecc_vectors) / sizeof(ecc_vectors[0]))
+
+/* dsi_ecc() and dsi_crc() on known answers, and the model's own ECC,
+   written from the spec's equations, on what dsi_core.c sends */
+static int verify(struct dsi_model *m)
+{
+	static const uint8_t data[] = "123456789";
+	const struct dsi_model_packet *p;
+	int i, n, e, err = 0;
+
+	for (i = 0, e = 0; i < N_ECC_VECTORS; i++)
+		e |= dsi_ecc(ecc_vectors[i].h[0] | ecc_vectors[i].h[1] << 8 |
+			     ecc_vectors[i].h[2] << 16) != ecc_vectors[i].ecc;
+	/* CRC-16/MCRF4XX check value */
+	e |= dsi_crc(data, 9) != 0x6f91;
+	printf("dsi_ecc, dsi_crc known answers: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	ubar = dsi_model_open(m);
+	dsi_write(REG_DSI_TICKDIV, 2);
+	for (i = 0; i < N_ECC_VECTORS; i++)
+		dsi_send_lp_short(ecc_vectors[i].h[0], ecc_vectors[i].h[1],
+				  ecc_vectors[i].h[2]);
+	for (i = 0; i < 256; i++)
+		dsi_send_lp_short(0x15, i * 37, i * 101);
+	dsi_long_write(0, data, 9);
+	p = dsi_model_packets(m, &n);
+	e = n != N_ECC_VECTORS + 257;
+	for (i = 0; i < n; i++)
+		e |= !p[i].ecc_ok || p[i].truncated;
+	printf("model ECC on sent packets: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+	dsi_model_clear(m);
+	ual_close(ubar);
+
+	if (err)
+		fprintf(stderr, "core: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+static void accessors(const char *bus, struct ual_bar_tkn *dev, int writes)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "%s readl", bus);
+	bench_run(name, b_readl, dev, 0);
+	if (writes) {
+		snprintf(name, sizeof(name), "%s writel", bus);
+		bench_run(name, b_writel, dev, 0);
+	}
+	snprintf(name, sizeof(name), "%s readl_n 64k", bus);
+	bench_run(name, b_readl_n, dev, sizeof(buf));
+	if (writes) {
+		snprintf(name, sizeof(name), "%s writel_n 64k", bus);
+		bench_run(name, b_writel_n, dev, sizeof(buf));
+		/* a FIFO at 0x20, nothing to pop on plain memory */
+		snprintf(name, sizeof(name), "%s readl_fifo 64k", bus);
+		bench_run(name, b_readl_fifo, dev, sizeof(buf));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct ual_desc_sim sim = {BLOCK * 4};
+	struct ual_desc_rawmem raw;
+	struct ual_bar_tkn *mem, *hooks, *dev;
+	struct hooked *h = calloc(1, sizeof(*h));
+	struct crc_arg crc;
+	struct dsi_model *m;
+	uint64_t raw_base = 0;
+	void *src = calloc(1, sizeof(buf));
+	int c, have_raw = 0, ret;
+
+	while ((c = getopt(argc, argv, "m:" BENCH_OPTS)) != -1) {
+		if (c == 'm' && sscanf(optarg, "0x%"SCNx64, &raw_base) == 1) {
+			have_raw = 1;
+			continue;
+		}
+		if (bench_option(c, optarg)) {
+			fprintf(stderr, "Use: \"%s [-m 0xphys] [options]\"\n",
+				argv[0]);
+			fprintf(stderr, "\t-m 0x<phys>: also read 64k of "
+				"/dev/mem from there\n");
+			bench_usage();
+			exit(1);
+		}
+	}
+
+	mem = ual_open(UAL_BUS_SIM, &sim);
+	sim.read = hook_read;
+	sim.write = hook_write;
+	sim.priv = h;
+	hooks = ual_open(UAL_BUS_SIM, &sim);
+	m = dsi_model_create(NULL);
+	if (!mem || !hooks || !m || !h || !src) {
+		fprintf(stderr, "core-bench: %s\n", ual_strerror(errno));
+		exit(1);
+	}
+
+	if (verify(m))
+		exit(1);
+
+	bench_start("core-bench");
+
+	bench_run("memcpy 64k", b_memcpy, src, sizeof(buf));
+	accessors("sim", mem, 1);
+	accessors("sim hooks", hooks, 1);
+
+	/* what the probes in ual_readl_n() cost, off and on */
+	if (!ual_probe_enable(UAL_PROBE_CLOCK))
+		bench_run("sim readl, clock probes", b_readl, mem, 0);
+	if (!ual_probe_enable(UAL_PROBE_CYCLES))
+		bench_run("sim readl, cycle probes", b_readl, mem, 0);
+	else
+		bench_skip("sim readl, cycle probes", strerror(errno));
+	if (!ual_probe_enable(UAL_PROBE_PERF))
+		bench_run("sim readl, perf probes", b_readl, mem, 0);
+	else
+		bench_skip("sim readl, perf probes", strerror(errno));
+	ual_probe_enable(UAL_PROBE_OFF);
+
+	/* reads only: nothing says what writes would do there */
+	if (have_raw) {
+		memset(&raw, 0, sizeof(raw));
+		raw.offset = raw_base;
+		raw.size = sizeof(buf);
+		dev = ual_open(UAL_BUS_RAWMEM, &raw);
+		if (dev) {
+			accessors("rawmem", dev, 0);
+			ual_close(dev);
+		} else {
+			bench_skip("rawmem", ual_strerror(errno));
+		}
+	} else {
+		bench_skip("rawmem", "no -m address");
+	}
+
+	ual_writel(mem, 0x10, 1);
+	bench_run("ual_event_wait ready", b_event_ready, mem, 0);
+	bench_run("ual_event_wait 50us period", b_event_period, hooks, 0);
+
+	bench_run("dsi_ecc", b_ecc, NULL, 0);
+	memset(crc.data, 0x5a, sizeof(crc.data));
+	crc.len = 64;
+	bench_run("dsi_crc 64", b_crc_len, &crc, 64);
+	crc.len = 1024;
+	bench_run("dsi_crc 1k", b_crc_len, &crc, 1024);
+
+	ubar = dsi_model_open(m);
+	dsi_write(REG_DSI_TICKDIV, 2);
+	bench_run("dsi_send_lp_short (model)", b_lp_short, m, 0);
+	bench_run("dsi_long_write 64 (model)", b_long_write, m, 0);
+	ual_close(ubar);
+
+	ret = bench_finish();
+
+	dsi_model_destroy(m);
+	ual_close(hooks);
+	ual_close(mem);
+	free(h);
+	free(src);
+	return ret ? 2 : 0;
+}
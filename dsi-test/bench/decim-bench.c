@@ -0,0 +1,197 @@
+/*
+ * decim-bench - min/max column decimation and rasterization throughput
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "decimate.h"
+#include "harness.h"
+
+static int cols = 640, rows = 480;
+
+static void ref_s16(struct decim_span *out, int cols, const int16_t *src,
+		    size_t n)
+{
+	size_t a, b, i;
+	int c;
+
+	for (c = 0; c < cols; c++) {
+		a = (uint64_t)c * n / cols;
+		b = (uint64_t)(c + 1) * n / cols;
+		if (b == a)
+			b = a + 1;
+		out[c].min = INT16_MAX;
+		out[c].max = INT16_MIN;
+		for (i = a; i < b; i++) {
+			if (src[i] < out[c].min)
+				out[c].min = src[i];
+			if (src[i] > out[c].max)
+				out[c].max = src[i];
+		}
+	}
+}
+
+/* NEON results must match the plain loops for any length and alignment */
+static int verify(void)
+{
+	static const size_t lens[] = {1, 7, 31, 32, 33, 100, 640, 641, 12345,
+				      99999};
+	struct decim_span a[800], b[800];
+	int16_t *s16 = malloc(100001 * sizeof(*s16)), *w;
+	int8_t *s8 = malloc(100001), *v;
+	size_t i, k;
+	int err = 0;
+
+	for (i = 0; i < 100001; i++) {
+		s16[i] = rand();
+		s8[i] = rand();
+	}
+	for (k = 0; k < sizeof(lens) / sizeof(lens[0]); k++) {
+		w = s16 + (k & 1);
+		v = s8 + (k & 1);
+		decim_minmax_s16(a, 800, w, lens[k]);
+		ref_s16(b, 800, w, lens[k]);
+		err |= memcmp(a, b, sizeof(a));
+
+		for (i = 0; i < lens[k]; i++)
+			w[i] = v[i];
+		decim_minmax_s8(a, 800, v, lens[k]);
+		ref_s16(b, 800, w, lens[k]);
+		err |= memcmp(a, b, sizeof(a));
+	}
+
+	free(s16);
+	free(s8);
+	if (err)
+		fprintf(stderr, "decim: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+/* What this replaces: a vertical line from each sample to the next */
+static void naive_draw(struct pixconv_surface *fb, const int16_t *src,
+		       size_t n, int lo, int hi)
+{
+	int prev = -1, x, y, y0, y1;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		x = (uint64_t)i * fb->width / n;
+		y = (hi - src[i]) * (fb->height - 1) / (hi - lo);
+		y0 = prev < 0 || prev > y ? y : prev;
+		y1 = prev > y ? prev : y;
+		for (; y0 <= y1; y0++)
+			memset(fb->ptr + y0 * fb->stride + x * 3, 0xff, 3);
+		prev = y;
+	}
+}
+
+static void bench(size_t n, int bits, struct pixconv_surface *fb)
+{
+	struct pixconv_rect area = {0, 0, fb->width, fb->height};
+	struct decim_span *spans = malloc(cols * sizeof(*spans));
+	int16_t *s16 = NULL;
+	int8_t *s8 = NULL;
+	uint64_t t0, t, td = 0;
+	char name[64];
+	size_t i;
+	int iter = 0;
+	void *buf;
+
+	buf = malloc(n * bits / 8);
+	if (!buf) {
+		printf("%4zuM %2d-bit: not enough memory\n", n / 1000000, bits);
+		free(spans);
+		return;
+	}
+	if (bits == 8)
+		s8 = buf;
+	else
+		s16 = buf;
+	for (i = 0; i < n; i++) {
+		int v = 100 * sin(i * 2 * M_PI / 100000.0) + (rand() & 15);
+
+		if (bits == 8)
+			s8[i] = v;
+		else
+			s16[i] = v * 256;
+	}
+
+	t0 = bench_now_ns();
+	do {
+		if (bits == 8)
+			decim_minmax_s8(spans, cols, s8, n);
+		else
+			decim_minmax_s16(spans, cols, s16, n);
+		t = bench_now_ns();
+		decim_connect(spans, cols);
+		decim_draw(fb, &area, spans, bits == 8 ? -128 : -32768,
+			   bits == 8 ? 127 : 32767, 0xffff00);
+		td += bench_now_ns() - t;
+		iter++;
+		t = bench_now_ns() - t0;
+	} while (t < 500000000ULL);
+
+	printf("%4zuM %2d-bit %4d cols %8.1f Msamples/s %8.2f ms/record %6.1f us draw\n",
+	       n / 1000000, bits, cols, (double)n * iter * 1e3 / (t - td),
+	       (t - td) / 1e6 / iter, td / 1e3 / iter);
+	snprintf(name, sizeof(name), "%zuM %d-bit %d cols", n / 1000000, bits,
+		 cols);
+	bench_report(name, t - td, (uint64_t)n * iter, bits / 8);
+
+	if (n == 1000000 && bits == 16) {
+		t0 = bench_now_ns();
+		naive_draw(fb, s16, n, -32768, 32767);
+		t = bench_now_ns() - t0;
+		printf("%4zuM %2d-bit naive     %8.1f Msamples/s %8.2f ms/record\n",
+		       n / 1000000, bits, n * 1e3 / t, t / 1e6);
+		bench_report("1M 16-bit naive", t, n, bits / 8);
+	}
+
+	free(buf);
+	free(spans);
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t sizes[] = {1000000, 10000000, 100000000};
+	struct pixconv_surface fb;
+	int c, i, max = 3;
+
+	while ((c = getopt(argc, argv, "w:h:m:")) != -1) {
+		switch (c) {
+		case 'w': cols = atoi(optarg); break;
+		case 'h': rows = atoi(optarg); break;
+		case 'm': max = atoi(optarg); break;
+		default:
+			fprintf(stderr, "Use: \"%s [-w columns] [-h rows] [-m 1|2|3 record sizes]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	if (verify())
+		return 1;
+
+	fb.width = cols;
+	fb.height = rows;
+	fb.stride = cols * 3;
+	fb.fmt = PIXCONV_RGB888;
+	fb.ptr = calloc(rows, fb.stride);
+
+	bench_start("decim-bench");
+	for (i = 0; i < max && i < 3; i++) {
+		bench(sizes[i], 8, &fb);
+		bench(sizes[i], 16, &fb);
+	}
+
+	free(fb.ptr);
+	return bench_finish() ? 2 : 0;
+}
@@ -0,0 +1,402 @@
+/*
+ * decode-bench - edge-driven UART/SPI/I2C decoding vs per-sample decoders
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "decode.h"
+#include "harness.h"
+
+/* channels of the capture */
+#define CH_RX	0
+#define CH_SCLK	1
+#define CH_MOSI	2
+#define CH_MISO	3
+#define CH_CS	4
+#define CH_SCL	5
+#define CH_SDA	6
+
+#define MAX_ANNOT (4 << 20)
+
+static double cpu_hz;
+static size_t samples = 32 << 20;
+static uint8_t *cap;
+static size_t expect[3];	/* bytes generated per protocol */
+
+static const struct dec_uart_config uart_cfg = {86.8, 8, DEC_PARITY_EVEN, 1, 0};
+static const struct dec_spi_config spi_cfg = {0, 0, 8, 0, 0};
+
+static inline int lv(size_t i, int ch)
+{
+	return cap[i] >> ch & 1;
+}
+
+/* Drives the channels in mask to the levels in 'levels' for [*t, end) */
+static void drive(size_t *t, size_t end, int mask, int levels)
+{
+	size_t i;
+
+	if (end > samples)
+		end = samples;
+	for (i = *t; i < end; i++)
+		cap[i] = (cap[i] & ~mask) | (levels & mask);
+	*t = end;
+}
+
+/* 115200 baud at 10 MS/s, 8E1, idle gaps */
+static void gen_uart(void)
+{
+	double t = 1000, bl = uart_cfg.bit_len;
+	int b, v, bits[11];
+	size_t s;
+
+	s = 0;
+	drive(&s, samples, 1 << CH_RX, 1 << CH_RX);
+	while (t + 12 * bl < samples) {
+		v = rand() & 0xff;
+		bits[0] = 0;
+		for (b = 0; b < 8; b++)
+			bits[1 + b] = v >> b & 1;
+		bits[9] = __builtin_parity(v);
+		bits[10] = 1;
+		for (b = 0; b < 11; b++) {
+			s = t + b * bl + 0.5;
+			drive(&s, t + (b + 1) * bl + 0.5, 1 << CH_RX,
+			      bits[b] << CH_RX);
+		}
+		expect[0]++;
+		t += 11 * bl + rand() % 3000;
+	}
+}
+
+/* Mode 0, 1 MHz clock at 10 MS/s, bursts of 1 to 4 bytes */
+static void gen_spi(void)
+{
+	int mask = 1 << CH_SCLK | 1 << CH_MOSI | 1 << CH_MISO | 1 << CH_CS;
+	int k, b, o, i, lvl;
+	size_t t = 0;
+
+	drive(&t, 500, mask, 1 << CH_CS);
+	while (t + 500 < samples) {
+		drive(&t, t + 5, mask, 0);
+		for (k = 1 + rand() % 4; k; k--) {
+			o = rand() & 0xff;
+			i = rand() & 0xff;
+			for (b = 7; b >= 0; b--) {
+				lvl = (o >> b & 1) << CH_MOSI |
+				      (i >> b & 1) << CH_MISO;
+				drive(&t, t + 5, mask, lvl);
+				drive(&t, t + 5, mask, lvl | 1 << CH_SCLK);
+			}
+			expect[1]++;
+		}
+		drive(&t, t + 5, mask, 0);
+		drive(&t, t + 50 + rand() % 450, mask, 1 << CH_CS);
+	}
+	drive(&t, samples, mask, 1 << CH_CS);
+}
+
+/* 100 kHz at 10 MS/s: address and 1 to 3 data bytes per transfer */
+static void i2c_bit(size_t *t, int v)
+{
+	int mask = 1 << CH_SCL | 1 << CH_SDA;
+	int sda = cap[*t - 1] & 1 << CH_SDA;
+
+	drive(t, *t + 25, mask, sda);
+	drive(t, *t + 25, mask, v << CH_SDA);
+	drive(t, *t + 50, mask, v << CH_SDA | 1 << CH_SCL);
+}
+
+static void gen_i2c(void)
+{
+	int mask = 1 << CH_SCL | 1 << CH_SDA;
+	int k, b, v;
+	size_t t = 0;
+
+	drive(&t, 1000, mask, mask);
+	while (t + 5000 < samples) {
+		drive(&t, t + 25, mask, 1 << CH_SCL);
+		for (k = 2 + rand() % 3; k; k--) {
+			v = rand() & 0xff;
+			for (b = 7; b >= 0; b--)
+				i2c_bit(&t, v >> b & 1);
+			i2c_bit(&t, k == 1 && (rand() & 1));
+			expect[2]++;
+		}
+		i2c_bit(&t, 0);		/* stop: SDA low, then up */
+		t -= 25;
+		drive(&t, t + 25, mask, 1 << CH_SCL);
+		drive(&t, t + 100 + rand() % 1000, mask, mask);
+	}
+	drive(&t, samples, mask, mask);
+}
+
+/*
+ * Per-sample decoders with the same rules
+ */
+static long ref_uart(struct dec_annot *out)
+{
+	const struct dec_uart_config *c = &uart_cfg;
+	double bl = c->bit_len;
+	size_t i = 1, cnt = 0, stop;
+	int b, v, ones, flags;
+
+	while (i < samples) {
+		if (lv(i, CH_RX) == lv(i - 1, CH_RX) || lv(i, CH_RX)) {
+			i++;
+			continue;
+		}
+		if (i + 11 * bl > samples)
+			break;
+		if (lv(i + (size_t)(0.5 * bl), CH_RX)) {
+			i++;
+			continue;
+		}
+		v = ones = 0;
+		for (b = 0; b < 8; b++) {
+			if (lv(i + (size_t)((1.5 + b) * bl), CH_RX)) {
+				v |= 1 << b;
+				ones++;
+			}
+		}
+		ones += lv(i + (size_t)(9.5 * bl), CH_RX);
+		flags = ones & 1 ? DEC_F_PARITY : 0;
+		stop = i + (size_t)(10.5 * bl);
+		if (!lv(stop, CH_RX))
+			flags |= DEC_F_FRAME;
+		out[cnt].start = i;
+		out[cnt].end = i + (size_t)(11 * bl);
+		out[cnt].value = v;
+		out[cnt].type = DEC_UART;
+		out[cnt++].flags = flags;
+		i = stop + 1;
+	}
+	return cnt;
+}
+
+static long ref_spi(struct dec_annot *out)
+{
+	unsigned int vo = 0, vi = 0;
+	size_t i, cnt = 0, start = 0;
+	int nbits = 0;
+
+	for (i = 1; i < samples; i++) {
+		if (lv(i, CH_CS) != lv(i - 1, CH_CS))
+			nbits = 0;
+		if (lv(i, CH_SCLK) == lv(i - 1, CH_SCLK) || !lv(i, CH_SCLK) ||
+		    lv(i, CH_CS))
+			continue;
+		if (!nbits) {
+			start = i;
+			vo = vi = 0;
+		}
+		vo = vo << 1 | lv(i, CH_MOSI);
+		vi = vi << 1 | lv(i, CH_MISO);
+		if (++nbits == 8) {
+			out[cnt].start = start;
+			out[cnt].end = i;
+			out[cnt].value = vo;
+			out[cnt].type = DEC_SPI_MOSI;
+			out[cnt++].flags = 0;
+			out[cnt] = out[cnt - 1];
+			out[cnt].value = vi;
+			out[cnt++].type = DEC_SPI_MISO;
+			nbits = 0;
+		}
+	}
+	return cnt;
+}
+
+static long ref_i2c(struct dec_annot *out)
+{
+	size_t i, cnt = 0, start = 0;
+	int active = 0, addr = 0, nbits = 0, v = 0, flags;
+	struct dec_annot *a;
+
+	for (i = 1; i < samples; i++) {
+		if (lv(i, CH_SCL) != lv(i - 1, CH_SCL) && lv(i, CH_SCL) &&
+		    active) {
+			if (!nbits) {
+				start = i;
+				v = 0;
+			}
+			if (nbits < 8) {
+				v = v << 1 | lv(i, CH_SDA);
+			} else {
+				a = &out[cnt++];
+				flags = lv(i, CH_SDA) ? DEC_F_NACK : 0;
+				a->start = start;
+				a->end = i;
+				a->value = addr ? v >> 1 : v;
+				a->type = addr ? DEC_I2C_ADDR : DEC_I2C_DATA;
+				a->flags = flags | (addr && (v & 1) ?
+						    DEC_F_READ : 0);
+				addr = 0;
+				nbits = -1;
+			}
+			nbits++;
+		}
+		if (lv(i, CH_SDA) != lv(i - 1, CH_SDA) && lv(i, CH_SCL)) {
+			a = &out[cnt];
+			a->start = a->end = i;
+			a->value = 0;
+			a->flags = 0;
+			if (!lv(i, CH_SDA)) {
+				a->type = DEC_I2C_START;
+				cnt++;
+				active = addr = 1;
+				nbits = 0;
+			} else if (active) {
+				a->type = DEC_I2C_STOP;
+				cnt++;
+				active = 0;
+			}
+		}
+	}
+	return cnt;
+}
+
+static int split_ok(uint32_t **lines)
+{
+	size_t i;
+	int c;
+
+	for (i = 0; i < samples; i++)
+		for (c = 0; c < 8; c++)
+			if ((lines[c][i / 32] >> (i % 32) & 1) != lv(i, c))
+				return 0;
+	return 1;
+}
+
+static const char *names[] = {"UART", "SPI", "I2C"};
+
+static long run(int p, uint32_t **l, struct dec_annot *out)
+{
+	switch (p) {
+	case 0:
+		return dec_uart(&uart_cfg, l[CH_RX], samples, out, MAX_ANNOT);
+	case 1:
+		return dec_spi(&spi_cfg, l[CH_SCLK], l[CH_MOSI], l[CH_MISO],
+			       l[CH_CS], samples, out, MAX_ANNOT);
+	}
+	return dec_i2c(l[CH_SCL], l[CH_SDA], samples, out, MAX_ANNOT);
+}
+
+static long ref(int p, struct dec_annot *out)
+{
+	switch (p) {
+	case 0:
+		return ref_uart(out);
+	case 1:
+		return ref_spi(out);
+	}
+	return ref_i2c(out);
+}
+
+/* Decoded data items, to compare with what was generated */
+static size_t items(const struct dec_annot *a, long n)
+{
+	size_t k = 0;
+	long i;
+
+	for (i = 0; i < n; i++)
+		k += a[i].type == DEC_UART || a[i].type == DEC_SPI_MOSI ||
+		     a[i].type == DEC_I2C_ADDR || a[i].type == DEC_I2C_DATA;
+	return k;
+}
+
+int main(int argc, char **argv)
+{
+	struct dec_annot *a, *b;
+	uint32_t *lines[8];
+	uint64_t t0, t, t_ref;
+	char name[64];
+	long n, nr;
+	int c, p, iter, err = 0;
+
+	cpu_hz = bench_cpu_hz();
+	while ((c = getopt(argc, argv, "f:n:")) != -1) {
+		switch (c) {
+		case 'f':
+			cpu_hz = atof(optarg) * 1e6;
+			break;
+		case 'n':
+			samples = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-f cpu-MHz] [-n samples]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	cap = calloc(samples, 1);
+	for (c = 0; c < 8; c++)
+		lines[c] = malloc((samples + 31) / 32 * sizeof(uint32_t));
+	a = malloc(MAX_ANNOT * sizeof(*a));
+	b = malloc(MAX_ANNOT * sizeof(*b));
+	gen_uart();
+	gen_spi();
+	gen_i2c();
+
+	iter = 0;
+	t0 = bench_now_ns();
+	do {
+		dec_split(cap, samples, lines);
+		iter++;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000ULL);
+	t /= iter;
+	if (!split_ok(lines)) {
+		fprintf(stderr, "decode: split FAILED\n");
+		return 1;
+	}
+	printf("%zu samples, 8 channels, cycles per second: %.0f\n", samples,
+	       cpu_hz);
+	printf("split   %8.1f Ms/s %6.2f cycles/sample\n", samples * 1e3 / t,
+	       cpu_hz * t / 1e9 / samples);
+	bench_start("decode-bench");
+	bench_report("split", t, samples, 1);
+
+	for (p = 0; p < 3; p++) {
+		iter = 0;
+		t0 = bench_now_ns();
+		do {
+			n = run(p, lines, a);
+			iter++;
+			t = bench_now_ns() - t0;
+		} while (t < 300000000ULL);
+		t /= iter;
+
+		t0 = bench_now_ns();
+		nr = ref(p, b);
+		t_ref = bench_now_ns() - t0;
+
+		c = n != nr || memcmp(a, b, n * sizeof(*a)) ||
+		    items(a, n) != expect[p];
+		err |= c;
+		printf("%-5s %7ld items %9.1f Ms/s %6.3f cycles/sample  per-sample %7.1f Ms/s  x%.1f%s\n",
+		       names[p], n, samples * 1e3 / t,
+		       cpu_hz * t / 1e9 / samples, samples * 1e3 / t_ref,
+		       (double)t_ref / t, c ? "  MISMATCH" : "");
+		bench_report(names[p], t, samples, 1);
+		snprintf(name, sizeof(name), "%s per-sample", names[p]);
+		bench_report(name, t_ref, samples, 1);
+	}
+	if (bench_finish() && !err)
+		err = 2;
+
+	free(cap);
+	for (c = 0; c < 8; c++)
+		free(lines[c]);
+	free(a);
+	free(b);
+	return err;
+}
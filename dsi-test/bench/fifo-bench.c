@@ -0,0 +1,162 @@
+/*
+ * fifo-bench - draining a streaming FIFO: a call per word vs burst reads
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "ual.h"
+#include "sring.h"
+#include "harness.h"
+
+#define FIFO_DATA	0x00
+#define FIFO_LEVEL	0x08
+
+static unsigned int burst = 1024;
+
+/* Simulated ADC FIFO: a counter behind one address, and its level */
+static uint32_t fifo_next, fifo_level, fifo_written;
+
+static uint32_t fifo_read(void *priv, uint32_t addr, enum ual_data_width dw)
+{
+	if (addr == FIFO_LEVEL)
+		return fifo_level;
+	fifo_level--;
+	return fifo_next++;
+}
+
+static void fifo_write(void *priv, uint32_t addr, uint32_t value,
+		       enum ual_data_width dw)
+{
+	fifo_written += addr == FIFO_DATA && value == fifo_written;
+}
+
+static int verify(void)
+{
+	struct ual_desc_sim d = {0x1000, 0, NULL, fifo_read, fifo_write};
+	struct ual_bar_tkn *bar = ual_open(UAL_BUS_SIM, &d);
+	struct sring *ring = sring_create(256);
+	uint32_t l[100];
+	uint64_t q[4];
+	size_t len, i;
+	const uint32_t *p;
+	int err = 0;
+
+	/* early return on the level register, nothing read past it */
+	fifo_next = 0;
+	fifo_level = 37;
+	err |= ual_readl_fifo(bar, FIFO_DATA, l, 100, FIFO_LEVEL) != 37;
+	for (i = 0; i < 37; i++)
+		err |= l[i] != i;
+	err |= fifo_next != 37;
+
+	fifo_level = 8;
+	err |= ual_readq_fifo(bar, FIFO_DATA, q, 4, UAL_FIFO_NO_LEVEL) != 4;
+	err |= q[0] != (37 | 38ULL << 32);
+
+	for (i = 0; i < 100; i++)
+		l[i] = i;
+	fifo_written = 0;
+	err |= ual_writel_fifo(bar, FIFO_DATA, l, 100, UAL_FIFO_NO_LEVEL) != 100;
+	err |= fifo_written != 100;
+
+	/* 64-bit entries go out as two words at the data address */
+	q[0] = 100 | 101ULL << 32;
+	q[1] = 102 | 103ULL << 32;
+	err |= ual_writeq_fifo(bar, FIFO_DATA, q, 2, UAL_FIFO_NO_LEVEL) != 2;
+	err |= fifo_written != 104;
+
+	/* 256 byte ring: the first drain stops at 64 words, the rest stays */
+	fifo_next = 0;
+	fifo_level = 100;
+	err |= sring_drain_ual_fifo(ring, bar, FIFO_DATA, FIFO_LEVEL) != 64;
+	err |= fifo_level != 36;
+	p = sring_peek(ring, &len);
+	err |= len != 256 || p[63] != 63;
+	sring_release(ring, 40 * 4);
+	err |= sring_drain_ual_fifo(ring, bar, FIFO_DATA, FIFO_LEVEL) != 36;
+	p = sring_peek(ring, &len);
+	err |= len != 24 * 4 || p[23] != 63;
+	sring_release(ring, len);
+	p = sring_peek(ring, &len);
+	err |= len != 36 * 4 || p[0] != 64 || p[35] != 99;
+
+	sring_destroy(ring);
+	ual_close(bar);
+	if (err)
+		fprintf(stderr, "fifo: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+static void report(const char *name, uint64_t words, uint64_t t)
+{
+	printf("%-22s %8.1f Mwords/s %8.1f MB/s\n", name, words * 1e3 / t,
+	       words * 4e3 / t);
+	bench_report(name, t, words, 4);
+}
+
+int main(int argc, char **argv)
+{
+	struct ual_desc_sim mem = {0x1000, };
+	struct ual_bar_tkn *bar;
+	uint32_t *buf;
+	uint64_t t0, t, words;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:")) != -1) {
+		switch (c) {
+		case 'b': burst = atoi(optarg); break;
+		default:
+			fprintf(stderr, "Use: \"%s [-b burst-words]\"\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (verify())
+		return 1;
+
+	bench_start("fifo-bench");
+	/* plain memory behind the mapping: the cost of the access loop */
+	bar = ual_open(UAL_BUS_SIM, &mem);
+	buf = malloc(burst * sizeof(*buf));
+	printf("bursts of %u words from one mapped address\n", burst);
+
+	words = 0;
+	t0 = bench_now_ns();
+	do {
+		for (i = 0; i < burst; i++)
+			buf[i] = ual_readl(bar, FIFO_DATA);
+		words += burst;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000ULL);
+	report("ual_readl per word", words, t);
+
+	words = 0;
+	t0 = bench_now_ns();
+	do {
+		words += ual_readl_fifo(bar, FIFO_DATA, buf, burst,
+					UAL_FIFO_NO_LEVEL);
+		t = bench_now_ns() - t0;
+	} while (t < 300000000ULL);
+	report("ual_readl_fifo", words, t);
+
+	words = 0;
+	t0 = bench_now_ns();
+	do {
+		words += ual_readq_fifo(bar, FIFO_DATA, (uint64_t *)buf,
+					burst / 2, UAL_FIFO_NO_LEVEL) * 2;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000ULL);
+	report("ual_readq_fifo", words, t);
+
+	free(buf);
+	ual_close(bar);
+	return bench_finish() ? 2 : 0;
+}
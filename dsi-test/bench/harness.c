@@ -0,0 +1,310 @@
+/*
+ * harness - warmup, repetitions and statistics for the microbenchmarks
+ *
+ * License: LGPLv2.1
+ */
+
+/*
+ * Every benchmark is calibrated first: the number of operations is
+ * doubled until a batch takes a tenth of a repetition, then scaled to a
+ * whole one. The batch then runs for the warmup time untimed (caches,
+ * branch predictors, page faults, CPU frequency) and for a number of
+ * timed repetitions; the result is the time per operation of each
+ * repetition, summarised by its minimum, median, mean and standard
+ * deviation. The median is what gets compared: a repetition hit by an
+ * interrupt or a migration moves the mean, not the median.
+ *
+ * With -j the results go to stdout as JSON, one result per line, which
+ * -b reads back: the medians of an earlier run, on this host or on the
+ * target, are printed next to the new ones and bench_finish() counts
+ * the results more than 5% slower.
+ *
+ * Most benchmarks time their own loops and print their own units; they
+ * hand each result to bench_report() too. Their option letters clash
+ * with the harness's, so the environment stands in for -j and -b:
+ * BENCH_JSON names a file for the JSON, BENCH_BASELINE one to compare
+ * with. That is what "make bench-run" uses for the whole suite.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "harness.h"
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT ""
+#endif
+
+#define BENCH_MAX_REPS 1000
+#define BENCH_MAX_BASELINE 256
+#define BENCH_SLOWER 1.05
+
+#define BENCH_TARGET_HZ 666666667.0 /* Zynq-7000 -1 speed grade */
+
+static int reps = 10, rep_ms = 20, warmup_ms = 100, json;
+static const char *filter, *baseline_path;
+static FILE *out; /* where the JSON goes */
+static char suite_name[64];
+static int results, slower;
+
+static struct {
+	char name[64];
+	double median;
+} baseline[BENCH_MAX_BASELINE];
+static int n_baseline;
+
+uint64_t bench_now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+double bench_cpu_hz(void)
+{
+	FILE *f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq",
+			"r");
+	unsigned long khz;
+	double hz = BENCH_TARGET_HZ;
+
+	if (!f)
+		return hz;
+	if (fscanf(f, "%lu", &khz) == 1)
+		hz = khz * 1000.0;
+	fclose(f);
+	return hz;
+}
+
+int bench_option(int c, const char *arg)
+{
+	switch (c) {
+	case 'r':
+		reps = atoi(arg);
+		if (reps < 1 || reps > BENCH_MAX_REPS)
+			reps = 10;
+		return 0;
+	case 't':
+		rep_ms = atoi(arg) > 0 ? atoi(arg) : 20;
+		return 0;
+	case 'w':
+		warmup_ms = atoi(arg) >= 0 ? atoi(arg) : 100;
+		return 0;
+	case 'j':
+		json = 1;
+		return 0;
+	case 'b':
+		baseline_path = arg;
+		return 0;
+	case 'f':
+		filter = arg;
+		return 0;
+	}
+	return -1;
+}
+
+void bench_usage(void)
+{
+	fprintf(stderr,
+		"\t-r <n>: timed repetitions (default 10)\n"
+		"\t-t <ms>: length of a repetition (default 20)\n"
+		"\t-w <ms>: warmup (default 100)\n"
+		"\t-j: JSON on stdout\n"
+		"\t-b <file>: compare with the JSON of an earlier run\n"
+		"\t-f <text>: only the benchmarks whose name contains text\n");
+}
+
+/* Only our own output is read back: one result per line */
+static void load_baseline(const char *path)
+{
+	char line[512], *p;
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		return;
+	}
+	while (fgets(line, sizeof(line), f) && n_baseline < BENCH_MAX_BASELINE) {
+		p = strstr(line, "\"name\": \"");
+		if (!p || sscanf(p + 9, "%63[^\"]",
+				 baseline[n_baseline].name) != 1)
+			continue;
+		p = strstr(line, "\"ns_median\": ");
+		if (p && sscanf(p + 13, "%lf",
+				&baseline[n_baseline].median) == 1)
+			n_baseline++;
+	}
+	fclose(f);
+}
+
+static double baseline_median(const char *name)
+{
+	int i;
+
+	for (i = 0; i < n_baseline; i++)
+		if (!strcmp(baseline[i].name, name))
+			return baseline[i].median;
+	return 0;
+}
+
+void bench_start(const char *suite)
+{
+	const char *path;
+
+	if (!baseline_path)
+		baseline_path = getenv("BENCH_BASELINE");
+	if (baseline_path)
+		load_baseline(baseline_path);
+	path = getenv("BENCH_JSON");
+	if (json)
+		out = stdout;
+	else if (path && !(out = fopen(path, "w")))
+		perror(path);
+	if (out)
+		fprintf(out, "{\"suite\": \"%s\", \"commit\": \"%s\", "
+			"\"cpus\": %ld, \"reps\": %d, \"rep_ms\": %d, "
+			"\"warmup_ms\": %d,\n \"results\": [", suite,
+			BENCH_COMMIT, sysconf(_SC_NPROCESSORS_ONLN), reps,
+			rep_ms, warmup_ms);
+	snprintf(suite_name, sizeof(suite_name), "%s", suite);
+}
+
+/* The table is the harness's only for benchmarks it runs itself */
+static void header(void)
+{
+	static int done;
+
+	if (json || done++)
+		return;
+	printf("%s: %d x %d ms after %d ms of warmup\n", suite_name, reps,
+	       rep_ms, warmup_ms);
+	printf("%-34s %11s %8s %11s %10s%s\n", "", "median", "stddev", "min",
+	       "", n_baseline ? "   baseline" : "");
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void json_result(const char *name, uint64_t n, double min,
+			double median, double mean, double stddev,
+			uint64_t bytes)
+{
+	fprintf(out, "%s\n  {\"name\": \"%s\", \"iters\": %llu, "
+		"\"ns_min\": %.3f, \"ns_median\": %.3f, "
+		"\"ns_mean\": %.3f, \"ns_stddev\": %.3f",
+		results ? "," : "", name, (unsigned long long)n, min, median,
+		mean, stddev);
+	if (bytes)
+		fprintf(out, ", \"mb_s\": %.1f", bytes * 1e3 / median);
+	fprintf(out, "}");
+}
+
+void bench_run(const char *name, bench_fn fn, void *arg, uint64_t bytes)
+{
+	static double t[BENCH_MAX_REPS];
+	uint64_t n, t0, dt, rep_ns = rep_ms * 1000000ULL;
+	double mean = 0, var = 0, median, base;
+	int i;
+
+	if (filter && !strstr(name, filter))
+		return;
+	header();
+
+	for (n = 1; ; n *= 2) {
+		t0 = bench_now_ns();
+		fn(arg, n);
+		dt = bench_now_ns() - t0;
+		if (dt >= rep_ns / 10 || n >= 1ULL << 40)
+			break;
+	}
+	n = dt ? n * rep_ns / dt : n;
+	if (!n)
+		n = 1;
+
+	t0 = bench_now_ns();
+	while (bench_now_ns() - t0 < warmup_ms * 1000000ULL)
+		fn(arg, n);
+
+	for (i = 0; i < reps; i++) {
+		t0 = bench_now_ns();
+		fn(arg, n);
+		t[i] = (double)(bench_now_ns() - t0) / n;
+		mean += t[i];
+	}
+	mean /= reps;
+	for (i = 0; i < reps; i++)
+		var += (t[i] - mean) * (t[i] - mean);
+	var = reps > 1 ? var / (reps - 1) : 0;
+	qsort(t, reps, sizeof(t[0]), cmp_double);
+	median = reps & 1 ? t[reps / 2] : (t[reps / 2 - 1] + t[reps / 2]) / 2;
+	base = baseline_median(name);
+	slower += base && median > base * BENCH_SLOWER;
+
+	if (out)
+		json_result(name, n, t[0], median, mean, sqrt(var), bytes);
+	if (!json) {
+		printf("%-34s %8.1f ns %7.1f%% %8.1f ns", name, median,
+		       mean ? 100 * sqrt(var) / mean : 0, t[0]);
+		if (bytes)
+			printf(" %6.0f MB/s", bytes * 1e3 / median);
+		else
+			printf(" %11s", "");
+		if (base)
+			printf(" %+9.1f%%", 100 * (median - base) / base);
+		printf("\n");
+	}
+	results++;
+	fflush(stdout);
+}
+
+void bench_report(const char *name, uint64_t ns, uint64_t ops,
+		  uint64_t bytes)
+{
+	double t, base;
+
+	if (filter && !strstr(name, filter))
+		return;
+	t = ops ? (double)ns / ops : 0;
+	base = baseline_median(name);
+	if (base && t > base * BENCH_SLOWER) {
+		slower++;
+		fprintf(json ? stderr : stdout,
+			"%s: %.1f ns, %+.1f%% on the baseline\n", name, t,
+			100 * (t - base) / base);
+	}
+	if (out)
+		json_result(name, ops, t, t, t, 0, bytes);
+	results++;
+	fflush(stdout);
+}
+
+void bench_skip(const char *name, const char *why)
+{
+	if (filter && !strstr(name, filter))
+		return;
+	/* the JSON only has what was measured */
+	header();
+	if (!json)
+		printf("%-34s skipped: %s\n", name, why);
+}
+
+int bench_finish(void)
+{
+	if (out)
+		fprintf(out, "\n]}\n");
+	if (out && out != stdout)
+		fclose(out);
+	out = NULL;
+	if (!json && n_baseline)
+		printf("%d of %d slower than the baseline by more than %.0f%%\n",
+		       slower, results, (BENCH_SLOWER - 1) * 100);
+	return slower;
+}
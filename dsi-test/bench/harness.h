@@ -0,0 +1,42 @@
+/*
+ * harness - warmup, repetitions and statistics for the microbenchmarks
+ *
+ * License: LGPLv2.1
+ */
+
+#ifndef __BENCH_HARNESS_H
+#define __BENCH_HARNESS_H
+
+#include <stdint.h>
+
+/* Runs the measured operation n times */
+typedef void (*bench_fn)(void *arg, uint64_t n);
+
+/* getopt() letters the harness handles, to append to the program's own */
+#define BENCH_OPTS "r:t:w:jb:f:"
+
+/* Returns 0 when c is one of BENCH_OPTS, -1 otherwise */
+int bench_option(int c, const char *arg);
+/* Prints the BENCH_OPTS part of the usage */
+void bench_usage(void);
+
+void bench_start(const char *suite);
+/* bytes is what one operation moves, 0 when throughput means nothing */
+void bench_run(const char *name, bench_fn fn, void *arg, uint64_t bytes);
+void bench_skip(const char *name, const char *why);
+/*
+ * A result the benchmark timed itself: ops operations of bytes each in
+ * ns. It goes into the JSON and is compared with the baseline, and is
+ * only printed when slower than that: the benchmark prints its own.
+ */
+void bench_report(const char *name, uint64_t ns, uint64_t ops,
+		  uint64_t bytes);
+/* Returns the number of results slower than the baseline allows */
+int bench_finish(void);
+
+/* CLOCK_MONOTONIC in ns */
+uint64_t bench_now_ns(void);
+/* The fastest the CPU clocks, or the target's when cpufreq says nothing */
+double bench_cpu_hz(void);
+
+#endif
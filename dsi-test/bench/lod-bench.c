@@ -0,0 +1,260 @@
+/*
+ * lod-bench - zoom and pan cost on deep records with a min/max pyramid
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "lod.h"
+#include "harness.h"
+
+#define FIFO_DATA 0xff000
+#define FIFO_LEVEL 0xff004
+
+static int cols = 640;
+
+/* Simulated acquisition: a window of 16-bit sample pairs and a FIFO */
+static uint32_t fifo_next, fifo_level;
+
+static int16_t wave(uint32_t i)
+{
+	return 20000 * sin(i * 2 * M_PI / 100000.0) + (rand() & 255);
+}
+
+static uint32_t sim_read(void *priv, uint32_t addr, enum ual_data_width dw)
+{
+	uint32_t i;
+
+	if (addr == FIFO_LEVEL)
+		return fifo_level;
+	if (addr == FIFO_DATA) {
+		fifo_level--;
+		i = fifo_next++;
+	} else {
+		i = addr / 4;
+	}
+	return (uint16_t)(i * 7) | (uint32_t)(uint16_t)(i * 7 + 3) << 16;
+}
+
+static void sim_write(void *priv, uint32_t addr, uint32_t value,
+		      enum ual_data_width dw)
+{
+}
+
+/* Every column must be the exact envelope of the entries it overlaps */
+static int check(struct lod *l, uint64_t first, uint64_t count)
+{
+	struct decim_span *out = malloc(cols * sizeof(*out));
+	uint64_t a, b, g, j;
+	const void *buf;
+	int16_t v, mn, mx;
+	size_t n;
+	int c, err = 0;
+	long r;
+
+	buf = lod_samples(l, &n);
+	r = lod_render(l, out, cols, first, count);
+	if (r < 0) {
+		free(out);
+		return -1;
+	}
+	g = r;
+	for (c = 0; c < cols && !err; c++) {
+		a = first + (uint64_t)c * count / cols;
+		b = first + (uint64_t)(c + 1) * count / cols;
+		if (b == a)
+			b = a + 1;
+		a = a / g * g;
+		b = (b + g - 1) / g * g;
+		if (b > n)
+			b = n;
+		mn = INT16_MAX;
+		mx = INT16_MIN;
+		for (j = a; j < b; j++) {
+			v = ((const int16_t *)buf)[j];
+			if (v < mn)
+				mn = v;
+			if (v > mx)
+				mx = v;
+		}
+		err |= out[c].min != mn || out[c].max != mx;
+	}
+	free(out);
+	return err;
+}
+
+static int verify(void)
+{
+	static const uint64_t counts[] = {1, 100, 640, 6400, 40000, 41000,
+					  163840, 655360, 1000003};
+	struct ual_desc_sim d = {0x100000, 0, NULL, sim_read, sim_write};
+	struct ual_bar_tkn *bar = ual_open(UAL_BUS_SIM, &d);
+	int16_t *src = malloc(1000003 * sizeof(*src));
+	const int16_t *p;
+	struct lod *l;
+	size_t i, k, n, m;
+	int f, err = 0, t;
+
+	for (i = 0; i < 1000003; i++)
+		src[i] = wave(i);
+	for (f = 4; f <= 16; f += 12) {
+		/* appended in odd pieces, checked along the way */
+		l = lod_create(16, 1000003, f);
+		for (i = 0; i < 1000003; i += m) {
+			m = rand() % 70000;
+			m = lod_append(l, src + i, m);
+			if (rand() % 4 == 0) {
+				lod_samples(l, &n);
+				if (n)
+					err |= check(l, 0, n);
+			}
+		}
+		err |= lod_append(l, src, 10) != 0;
+		for (k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+			err |= check(l, 0, counts[k]);
+			err |= check(l, 1000003 - counts[k], counts[k]);
+			for (t = 0; t < 3; t++)
+				err |= check(l, rand() % (1000003 - counts[k] + 1),
+					     counts[k]);
+		}
+		err |= lod_render(l, NULL, cols, 1000000, 4) != -1;
+		lod_destroy(l);
+	}
+
+	/* the bus paths land in the record and in the pyramid */
+	l = lod_create(16, 4096, 4);
+	err |= lod_fill_ual(l, bar, 0, 1000) != 1000;
+	fifo_next = 1000;
+	fifo_level = 500;
+	err |= lod_drain_ual_fifo(l, bar, FIFO_DATA, FIFO_LEVEL) != 500;
+	fifo_level = 5000;
+	err |= lod_drain_ual_fifo(l, bar, FIFO_DATA, FIFO_LEVEL) != 548;
+	p = lod_samples(l, &n);
+	err |= n != 4096;
+	for (i = 0; i < n; i++)
+		err |= p[i] != (int16_t)(i / 2 * 7 + (i & 1) * 3);
+	err |= check(l, 0, n) || check(l, 100, 3000);
+	lod_destroy(l);
+
+	err |= lod_create(12, 100, 4) != NULL || lod_create(8, 100, 8) != NULL;
+
+	ual_close(bar);
+	free(src);
+	if (err)
+		fprintf(stderr, "lod: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+static void bench(size_t n, int factor)
+{
+	struct decim_span *spans = malloc(cols * sizeof(*spans));
+	int16_t *src = malloc(n * sizeof(*src));
+	const int16_t *rec;
+	uint64_t t0, t, count, first, tr, tl;
+	char name[64];
+	struct lod *l;
+	size_t i, m;
+	int iter;
+	long g;
+
+	l = lod_create(16, n, factor);
+	if (!l || !src) {
+		printf("%4zuM: not enough memory\n", n / 1000000);
+		lod_destroy(l);
+		free(src);
+		free(spans);
+		return;
+	}
+	for (i = 0; i < n; i++)
+		src[i] = wave(i);
+
+	/* streaming in as 64k sample reads, against the plain copy */
+	t0 = bench_now_ns();
+	for (i = 0; i < n; i += 65536)
+		lod_append(l, src + i, n - i < 65536 ? n - i : 65536);
+	t = bench_now_ns() - t0;
+	rec = lod_samples(l, &m);
+	/* the same data again, the record does not change */
+	t0 = bench_now_ns();
+	memcpy((void *)rec, src, n * sizeof(*src));
+	tr = bench_now_ns() - t0;
+	printf("%4zuM factor %2d: fill %6.2f ns/sample (copy alone %.2f)\n",
+	       n / 1000000, factor, (double)t / n, (double)tr / n);
+	snprintf(name, sizeof(name), "%zuM factor %d fill", n / 1000000,
+		 factor);
+	bench_report(name, t, n, sizeof(*src));
+
+	for (count = n; count >= (uint64_t)cols * 16; count /= 10) {
+		/* pan one tenth of a screen per frame */
+		first = 0;
+		iter = 0;
+		t0 = bench_now_ns();
+		do {
+			g = lod_render(l, spans, cols, first, count);
+			first += count / 10;
+			if (first + count > n)
+				first = 0;
+			iter++;
+			t = bench_now_ns() - t0;
+		} while (t < 300000000ULL);
+		tl = t / iter;
+
+		/* what this replaces: decimating the view from the samples */
+		first = 0;
+		iter = 0;
+		t0 = bench_now_ns();
+		do {
+			decim_minmax_s16(spans, cols, rec + first, count);
+			first += count / 10;
+			if (first + count > n)
+				first = 0;
+			iter++;
+			t = bench_now_ns() - t0;
+		} while (t < 300000000ULL);
+		tr = t / iter;
+		printf("      view %10llu: %8.1f us/frame (%6ld/entry), raw %10.1f us/frame, %7.1fx\n",
+		       (unsigned long long)count, tl / 1e3, g, tr / 1e3,
+		       (double)tr / tl);
+		snprintf(name, sizeof(name), "%zuM factor %d view %llu",
+			 n / 1000000, factor, (unsigned long long)count);
+		bench_report(name, tl, 1, 0);
+	}
+
+	lod_destroy(l);
+	free(src);
+	free(spans);
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t sizes[] = {1000000, 10000000, 100000000};
+	int c, i, max = 3;
+
+	while ((c = getopt(argc, argv, "w:m:")) != -1) {
+		switch (c) {
+		case 'w': cols = atoi(optarg); break;
+		case 'm': max = atoi(optarg); break;
+		default:
+			fprintf(stderr, "Use: \"%s [-w columns] [-m 1|2|3 record sizes]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	if (verify())
+		return 1;
+
+	bench_start("lod-bench");
+	for (i = 0; i < max && i < 3; i++) {
+		bench(sizes[i], 4);
+		bench(sizes[i], 16);
+	}
+	return bench_finish() ? 2 : 0;
+}
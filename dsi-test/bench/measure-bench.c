@@ -0,0 +1,345 @@
+/*
+ * measure-bench - single-pass measurements vs one pass per measurement
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "measure.h"
+#include "harness.h"
+
+static double cpu_hz;
+static size_t samples = 16 << 20;
+
+/* Noisy trapezoid: period 1000.7 samples, 30 % duty, 20 sample edges */
+static void make_signal(int16_t *s16, int8_t *s8, size_t n)
+{
+	double per = 1000.7, ph;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		ph = fmod(i, per);
+		if (ph < 20)
+			ph = ph / 20;
+		else if (ph < 300)
+			ph = 1;
+		else if (ph < 320)
+			ph = 1 - (ph - 300) / 20;
+		else
+			ph = 0;
+		s16[i] = -20000 + 40000 * ph + rand() % 601 - 300;
+		s8[i] = s16[i] >> 8;
+	}
+}
+
+static int at(const void *src, int bits, size_t i)
+{
+	return bits == 8 ? ((const int8_t *)src)[i] :
+			   ((const int16_t *)src)[i];
+}
+
+static double cross(const void *src, int bits, size_t j, double thr)
+{
+	int a = at(src, bits, j), b = at(src, bits, j + 1);
+
+	return j + (thr - a) / (b - a);
+}
+
+/*
+ * The naive way: a pass for the levels, one for the mean, one for the
+ * RMS and a per-sample state machine for the timings. Volts per LSB and
+ * sample period are 1.
+ */
+static void reference(const void *src, int bits, size_t n,
+		      struct meas_result *r)
+{
+	double sum = 0, sq = 0, amp, lo, hi, mid, t10, t50, t90;
+	double r_first = 0, r_last = 0, f_first = 0, f_last = 0;
+	double rise = 0, fall = 0, high = 0;
+	unsigned int nr = 0, nf = 0, nhigh = 0;
+	int min = INT32_MAX, max = INT32_MIN, x, st = -1;
+	size_t i, j10 = 0, j50 = 0;
+
+	memset(r, 0, sizeof(*r));
+	for (i = 0; i < n; i++) {
+		x = at(src, bits, i);
+		if (x < min)
+			min = x;
+		if (x > max)
+			max = x;
+	}
+	for (i = 0; i < n; i++)
+		sum += at(src, bits, i);
+	for (i = 0; i < n; i++) {
+		x = at(src, bits, i);
+		sq += (double)x * x;
+	}
+	r->min = min;
+	r->max = max;
+	r->vpp = max - min;
+	r->mean = sum / n;
+	r->rms = sqrt(sq / n);
+
+	amp = max - min;
+	lo = min + 0.1 * amp;
+	hi = min + 0.9 * amp;
+	mid = min + 0.5 * amp;
+	for (i = 0; i < n && amp >= 4; i++) {
+		x = at(src, bits, i);
+		if (st != 1 && x <= lo) {
+			if (st < 0)
+				st = 0;
+			j10 = i;
+		}
+		if (st != 1 && x <= mid)
+			j50 = i;
+		if (st == 1 && x >= hi)
+			j10 = i;
+		if (st == 1 && x >= mid)
+			j50 = i;
+		if (st < 0 && x >= hi) {
+			st = 1;
+			j10 = j50 = i;
+		} else if (st == 0 && x >= hi) {
+			t90 = cross(src, bits, i - 1, hi);
+			t50 = cross(src, bits, j50, mid);
+			t10 = cross(src, bits, j10, lo);
+			rise += t90 - t10;
+			if (!nr++)
+				r_first = t50;
+			r_last = t50;
+			st = 1;
+			j10 = j50 = i;
+		} else if (st == 1 && x <= lo) {
+			t10 = cross(src, bits, i - 1, lo);
+			t50 = cross(src, bits, j50, mid);
+			t90 = cross(src, bits, j10, hi);
+			fall += t10 - t90;
+			if (!nf++)
+				f_first = t50;
+			f_last = t50;
+			if (nr) {
+				high += t50 - r_last;
+				nhigh++;
+			}
+			st = 0;
+			j10 = j50 = i;
+		}
+	}
+	r->rising = nr;
+	r->falling = nf;
+	r->period = nr >= 2 ? (r_last - r_first) / (nr - 1) :
+		    nf >= 2 ? (f_last - f_first) / (nf - 1) : 0;
+	r->freq = r->period > 0 ? 1 / r->period : 0;
+	r->duty = nhigh && r->period > 0 ? 100 * high / nhigh / r->period : 0;
+	r->rise = nr ? rise / nr : 0;
+	r->fall = nf ? fall / nf : 0;
+}
+
+static int close_to(double a, double b)
+{
+	return fabs(a - b) <= 1e-9 * (fabs(a) + fabs(b)) + 1e-9;
+}
+
+static int same(const struct meas_result *a, const struct meas_result *b)
+{
+	return close_to(a->min, b->min) && close_to(a->max, b->max) &&
+	       close_to(a->vpp, b->vpp) && close_to(a->mean, b->mean) &&
+	       close_to(a->rms, b->rms) && close_to(a->freq, b->freq) &&
+	       close_to(a->period, b->period) && close_to(a->rise, b->rise) &&
+	       close_to(a->fall, b->fall) && close_to(a->duty, b->duty) &&
+	       a->rising == b->rising && a->falling == b->falling;
+}
+
+static int verify(const int16_t *s16, const int8_t *s8)
+{
+	struct meas_config cfg = {MEAS_ALL, 16, 1, 0, 1, 1};
+	struct meas_result r, ref;
+	struct meas_roll *roll;
+	struct meas *m1, *m2;
+	size_t n = 3 << 20, len, pushed, win = 100000, first, end;
+	const void *src;
+	int bits, err = 0;
+
+	for (bits = 8; bits <= 16; bits += 8) {
+		src = bits == 8 ? (const void *)s8 : (const void *)s16;
+		cfg.bits = bits;
+		cfg.threads = 1;
+		m1 = meas_create(&cfg);
+		cfg.threads = 2;
+		m2 = meas_create(&cfg);
+
+		/* odd length: a partial last block */
+		reference(src, bits, n - 13, &ref);
+		meas_run(m1, src, n - 13, &r);
+		err |= !same(&r, &ref) || r.valid != MEAS_ALL;
+		meas_run(m2, src, n - 13, &r);
+		err |= !same(&r, &ref);
+		err |= fabs(r.period - 1000.7) > 0.05 ||
+		       fabs(r.duty - 30.0) > 0.5;
+
+		/* roll window after chunks of odd sizes */
+		roll = meas_roll_create(&cfg, win);
+		for (pushed = 0; pushed < 1000000; pushed += len) {
+			len = 1 + rand() % 5000;
+			meas_roll_push(roll, (const uint8_t *)src +
+				       pushed * bits / 8, len);
+			if (rand() % 50)
+				continue;
+			/* the complete blocks, at most a window of them */
+			meas_roll_result(roll, &r);
+			end = (pushed + len) / 64 * 64;
+			first = end > (win + 63) / 64 * 64 ?
+				end - (win + 63) / 64 * 64 : 0;
+			reference((const uint8_t *)src + first * bits / 8,
+				  bits, end - first, &ref);
+			err |= !same(&r, &ref);
+		}
+		meas_roll_destroy(roll);
+		meas_destroy(m1);
+		meas_destroy(m2);
+	}
+
+	/* units: 1 mV per LSB, -0.5 V offset, 1 GS/s */
+	cfg.bits = 16;
+	cfg.threads = 1;
+	cfg.volts_per_lsb = 0.001;
+	cfg.offset = -0.5;
+	cfg.sample_period = 1e-9;
+	m1 = meas_create(&cfg);
+	meas_run(m1, s16, n, &r);
+	reference(s16, 16, n, &ref);
+	err |= !close_to(r.max, ref.max * 0.001 - 0.5) ||
+	       !close_to(r.mean, ref.mean * 0.001 - 0.5) ||
+	       !close_to(r.period, ref.period * 1e-9) ||
+	       fabs(r.rms - 0.001 * sqrt(ref.rms * ref.rms -
+					 1000 * ref.mean + 250000)) > 1e-9;
+	meas_destroy(m1);
+
+	if (err)
+		fprintf(stderr, "measure: verification FAILED\n");
+	return err;
+}
+
+static void report(int bits, const char *name, uint64_t t, double base)
+{
+	char full[64];
+
+	printf("%-26s %8.1f Ms/s %6.2f cycles/sample", name,
+	       samples * 1e3 / t, cpu_hz * t / 1e9 / samples);
+	if (base)
+		printf("  x%.1f", base / t);
+	printf("\n");
+	snprintf(full, sizeof(full), "%d-bit %s", bits, name);
+	bench_report(full, t, samples, bits / 8);
+}
+
+static uint64_t time_run(struct meas *m, const void *src)
+{
+	struct meas_result r;
+	uint64_t t0 = bench_now_ns(), t;
+	int iter = 0;
+
+	do {
+		meas_run(m, src, samples, &r);
+		iter++;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000ULL);
+	return t / iter;
+}
+
+int main(int argc, char **argv)
+{
+	struct meas_config cfg = {MEAS_ALL, 16, 1, 0, 1, 1};
+	struct meas_result r;
+	struct meas_roll *roll;
+	struct meas *m;
+	uint64_t t0, t_ref, t;
+	size_t pushed, results;
+	int16_t *s16;
+	int8_t *s8;
+	int c, bits;
+
+	cpu_hz = bench_cpu_hz();
+	while ((c = getopt(argc, argv, "f:n:")) != -1) {
+		switch (c) {
+		case 'f':
+			cpu_hz = atof(optarg) * 1e6;
+			break;
+		case 'n':
+			samples = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-f cpu-MHz] [-n samples]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	if (samples < (4 << 20)) {
+		fprintf(stderr, "need at least 4M samples\n");
+		exit(1);
+	}
+	s16 = malloc(samples * sizeof(*s16));
+	s8 = malloc(samples);
+	make_signal(s16, s8, samples);
+	if (verify(s16, s8))
+		return 1;
+
+	printf("%zu samples, all measurements, cycles per second: %.0f\n",
+	       samples, cpu_hz);
+	bench_start("measure-bench");
+	for (bits = 16; bits >= 8; bits -= 8) {
+		const void *src = bits == 8 ? (void *)s8 : (void *)s16;
+
+		printf("%d-bit:\n", bits);
+		cfg.bits = bits;
+		t0 = bench_now_ns();
+		reference(src, bits, samples, &r);
+		t_ref = bench_now_ns() - t0;
+		report(bits, "pass per measurement", t_ref, 0);
+
+		cfg.threads = 1;
+		m = meas_create(&cfg);
+		report(bits, "single pass", time_run(m, src), t_ref);
+		meas_destroy(m);
+
+		cfg.threads = 2;
+		m = meas_create(&cfg);
+		report(bits, "single pass, 2 threads", time_run(m, src),
+		       t_ref);
+		meas_destroy(m);
+	}
+
+	/* roll: 1M sample window fed 4k at a time, and results from it */
+	cfg.bits = 16;
+	cfg.threads = 1;
+	roll = meas_roll_create(&cfg, 1 << 20);
+	t0 = bench_now_ns();
+	for (pushed = 0; pushed + 4096 <= samples; pushed += 4096)
+		meas_roll_push(roll, s16 + pushed, 4096);
+	t = bench_now_ns() - t0;
+	results = 0;
+	t0 = bench_now_ns();
+	do {
+		meas_roll_result(roll, &r);
+		results++;
+		t_ref = bench_now_ns() - t0;
+	} while (t_ref < 300000000ULL);
+	printf("roll, 1M window: %.1f Ms/s pushed, %.1f us per result (%u edges)\n",
+	       pushed * 1e3 / t, t_ref / 1e3 / results, r.rising + r.falling);
+	bench_report("roll push", t, pushed, sizeof(*s16));
+	bench_report("roll result", t_ref, results, 0);
+	meas_roll_destroy(roll);
+
+	free(s16);
+	free(s8);
+	return bench_finish() ? 2 : 0;
+}
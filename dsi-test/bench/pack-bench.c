@@ -0,0 +1,353 @@
+/*
+ * pack-bench - delta/bit-pack compression ratio and throughput
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "pack.h"
+#include "harness.h"
+
+static double card_mbs = 20;
+
+static double noise(void)
+{
+	return (rand() + rand() + rand() - 1.5 * RAND_MAX) / RAND_MAX;
+}
+
+/* Synthetic stand-ins for captures, in ADC counts of the given width */
+enum wave { SINE, SQUARE, LOGIC, NOISE, FLAT, NWAVES };
+static const char *const wave_names[] = {"sine", "square", "logic",
+					 "noise", "flat"};
+
+static void gen(enum wave wv, int bits, void *dst, size_t n)
+{
+	double full = bits == 8 ? 127 : 32767, lsb = bits == 8 ? 1 : 8;
+	double v = 0, ring = 0;
+	size_t i;
+	int s;
+
+	for (i = 0; i < n; i++) {
+		switch (wv) {
+		case SINE:
+			/* 1 kHz at 1 GS/s, 3/4 scale, an LSB or two of noise
+			   (13 effective bits at 16) */
+			v = 0.75 * full * sin(i * 2 * M_PI / 1e6) +
+			    1.5 * lsb * noise();
+			break;
+		case SQUARE:
+			/* 1 MHz with a damped 50 MHz ring after every edge */
+			s = i % 1000 < 500 ? 1 : -1;
+			if (i % 500 == 0)
+				ring = 0.2 * full * s;
+			ring *= 0.97;
+			v = 0.6 * full * s + ring * cos(i * 2 * M_PI / 20) +
+			    lsb * noise();
+			break;
+		case LOGIC:
+			/* a clock, a counter and random data lines, sampled
+			   at 16 times the clock */
+			v = (int8_t)((i >> 4 & 1) | (i >> 8 & 6) |
+				     (((i >> 5) * 2654435761u) >> 29) << 3);
+			if (bits == 16)
+				v *= 256;
+			break;
+		case NOISE:
+			v = (rand() & 0xffff) - 32768.0;
+			if (bits == 8)
+				v /= 256;
+			break;
+		default:
+			v = 12;
+			break;
+		}
+		if (v > full)
+			v = full;
+		if (v < -full - 1)
+			v = -full - 1;
+		if (bits == 8)
+			((int8_t *)dst)[i] = lrint(v);
+		else
+			((int16_t *)dst)[i] = lrint(v);
+	}
+}
+
+/* The format written out bit by bit */
+static size_t ref_encode(const void *src, int bits, size_t n, uint8_t *dst)
+{
+	uint16_t z[PACK_GROUP], d;
+	int16_t prev, x;
+	size_t i, j, o = 2, len, pos;
+	int w, b, l;
+	unsigned int all;
+
+	prev = bits == 8 ? *(const int8_t *)src : *(const int16_t *)src;
+	memcpy(dst, &prev, 2);
+	for (i = 0; i < n; i += PACK_GROUP) {
+		len = n - i < PACK_GROUP ? n - i : PACK_GROUP;
+		all = 0;
+		for (j = 0; j < PACK_GROUP; j++) {
+			z[j] = 0;
+			if (j >= len)
+				continue;
+			x = bits == 8 ? ((const int8_t *)src)[i + j] :
+			    ((const int16_t *)src)[i + j];
+			d = bits == 8 ? (uint16_t)(int8_t)(x - prev) : x - prev;
+			prev = x;
+			z[j] = (int16_t)d < 0 ? 2 * (uint16_t)~d + 1 : 2 * d;
+			all |= z[j];
+		}
+		for (w = 0; all >> w; w++)
+			;
+		dst[o++] = w;
+		memset(dst + o, 0, 16 * w);
+		for (j = 0; j < PACK_GROUP; j++) {
+			l = j % 8;
+			for (b = 0; b < w; b++) {
+				pos = (j / 8) * w + b;
+				if (z[j] >> b & 1)
+					dst[o + ((pos / 16) * 8 + l) * 2 +
+					    pos % 16 / 8] |= 1 << (pos % 8);
+			}
+		}
+		o += 16 * w;
+	}
+	return o;
+}
+
+/* Files: written in odd pieces, read back at random places */
+static int verify_file(const char *path)
+{
+	int16_t *src = malloc(300000 * 2), *dst = malloc(300000 * 2);
+	struct pack_writer *w = pack_create(path, 16, 1024);
+	struct pack_stats st;
+	struct pack_file *f;
+	uint64_t samples;
+	size_t i, k, first;
+	int err = !w, bits;
+
+	gen(SQUARE, 16, src, 300000);
+	for (i = 0; w && i < 300000; i += k) {
+		k = rand() % 5000;
+		k = k < 300000 - i ? k : 300000 - i;
+		err |= pack_write(w, src + i, k);
+	}
+	err |= !w || pack_finish(w, &st);
+	err |= st.samples != 300000 || st.raw_bytes != 600000;
+	f = pack_open(path);
+	if (!f) {
+		unlink(path);
+		return -1;
+	}
+	pack_get_info(f, &bits, &samples);
+	err |= bits != 16 || samples != 300000;
+	for (i = 0; i < 50; i++) {
+		first = rand() % 300000;
+		k = rand() % 20000;
+		err |= pack_read(f, first, dst, k) !=
+		       (long)(k < 300000 - first ? k : 300000 - first);
+		err |= memcmp(dst, src + first,
+			      (k < 300000 - first ? k : 300000 - first) * 2);
+	}
+	err |= pack_read(f, 0, dst, 300000) != 300000 ||
+	       memcmp(dst, src, 600000);
+	pack_close(f);
+	unlink(path);
+	free(src);
+	free(dst);
+	return err;
+}
+
+static int verify(const char *path)
+{
+	static const size_t lens[] = {1, 2, 127, 128, 129, 1000, 65536, 65541};
+	uint8_t *enc = malloc(PACK_BOUND(65541)), *ref = malloc(PACK_BOUND(65541));
+	int16_t *src = malloc(65541 * 2), *dec = malloc(65541 * 2 + 1);
+	size_t k, len;
+	long r;
+	int wv, bits, err = 0;
+
+	for (wv = 0; wv < NWAVES; wv++) {
+		for (bits = 8; bits <= 16; bits += 8) {
+			gen(wv, bits, src, 65541);
+			for (k = 0; k < sizeof(lens) / sizeof(lens[0]); k++) {
+				len = pack_encode(src, bits, lens[k], enc);
+				err |= len > PACK_BOUND(lens[k]);
+				err |= ref_encode(src, bits, lens[k], ref) != len ||
+				       memcmp(enc, ref, len);
+				memset(dec, 0x55, 65541 * 2 + 1);
+				r = pack_decode(enc, len, bits, lens[k], dec);
+				err |= r != (long)len ||
+				       memcmp(dec, src, lens[k] * bits / 8);
+				/* nothing past the samples touched */
+				err |= ((uint8_t *)dec)[lens[k] * bits / 8] != 0x55;
+				if (len > 2)
+					err |= pack_decode(enc, len - 1, bits,
+							   lens[k], dec) != -1;
+			}
+		}
+	}
+	/* the extremes, where the differences wrap */
+	for (k = 0; k < 1000; k++)
+		src[k] = k & 1 ? 32767 : -32768;
+	len = pack_encode(src, 16, 1000, enc);
+	err |= pack_decode(enc, len, 16, 1000, dec) != (long)len ||
+	       memcmp(dec, src, 2000);
+
+	err |= verify_file(path);
+
+	free(enc);
+	free(ref);
+	free(src);
+	free(dec);
+	if (err)
+		fprintf(stderr, "pack: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+static void bench_codec(enum wave wv, int bits, size_t n)
+{
+	void *src = malloc(n * bits / 8), *dec = malloc(n * bits / 8);
+	uint8_t *enc = malloc(PACK_BOUND(PACK_DEFAULT_BLOCK) *
+			      (n / PACK_DEFAULT_BLOCK + 1));
+	size_t i, k, total = 0, off;
+	uint64_t t0, te, td;
+	char name[64];
+	int iter = 0;
+
+	gen(wv, bits, src, n);
+	t0 = bench_now_ns();
+	do {
+		for (i = 0, off = 0; i < n; i += PACK_DEFAULT_BLOCK) {
+			k = n - i < PACK_DEFAULT_BLOCK ? n - i : PACK_DEFAULT_BLOCK;
+			off += pack_encode((uint8_t *)src + i * bits / 8, bits,
+					   k, enc + off);
+		}
+		total = off;
+		iter++;
+		te = bench_now_ns() - t0;
+	} while (te < 300000000ULL);
+	te /= iter;
+
+	iter = 0;
+	t0 = bench_now_ns();
+	do {
+		for (i = 0, off = 0; i < n; i += PACK_DEFAULT_BLOCK) {
+			k = n - i < PACK_DEFAULT_BLOCK ? n - i : PACK_DEFAULT_BLOCK;
+			off += pack_decode(enc + off, total - off, bits, k,
+					   (uint8_t *)dec + i * bits / 8);
+		}
+		iter++;
+		td = bench_now_ns() - t0;
+	} while (td < 300000000ULL);
+	td /= iter;
+
+	printf("%-6s %2d-bit: ratio %5.2f  encode %7.1f MB/s  decode %7.1f MB/s\n",
+	       wave_names[wv], bits, (double)n * bits / 8 / total,
+	       n * bits / 8 * 1e3 / te, n * bits / 8 * 1e3 / td);
+	snprintf(name, sizeof(name), "%s %d-bit encode", wave_names[wv], bits);
+	bench_report(name, te, n, bits / 8);
+	snprintf(name, sizeof(name), "%s %d-bit decode", wave_names[wv], bits);
+	bench_report(name, td, n, bits / 8);
+	free(src);
+	free(dec);
+	free(enc);
+}
+
+/* Raw write() of a capture against the packing writer, both to disk */
+static void bench_file(const char *path, enum wave wv, int bits, size_t n)
+{
+	size_t batch = 1 << 20, i, k, bytes = bits / 8;
+	uint8_t *src = malloc(batch * bytes);
+	struct pack_writer *w;
+	struct pack_stats st;
+	uint64_t t0, traw, tpack;
+	double card_raw, card_pack;
+	char name[64];
+	int fd;
+
+	gen(wv, bits, src, batch);
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	t0 = bench_now_ns();
+	for (i = 0; i < n; i += k) {
+		k = n - i < batch ? n - i : batch;
+		if (write(fd, src, k * bytes) != (ssize_t)(k * bytes))
+			perror("write");
+	}
+	fsync(fd);
+	traw = bench_now_ns() - t0;
+	close(fd);
+
+	t0 = bench_now_ns();
+	w = pack_create(path, bits, 0);
+	for (i = 0; i < n; i += k) {
+		k = n - i < batch ? n - i : batch;
+		if (pack_write(w, src, k))
+			perror("pack_write");
+	}
+	if (pack_finish(w, &st))
+		perror("pack_finish");
+	fd = open(path, O_RDONLY);
+	fsync(fd);
+	close(fd);
+	tpack = bench_now_ns() - t0;
+
+	/* on a card, whichever of encoding and writing is slower sets the pace */
+	card_raw = n * bytes / (card_mbs * 1e6);
+	card_pack = st.packed_bytes / (card_mbs * 1e6);
+	if (card_pack < st.encode_ns / 1e9)
+		card_pack = st.encode_ns / 1e9;
+	printf("%-6s %2d-bit %zuM: here raw %6.1f MB/s, packed %6.1f MB/s (%.1f ms encoding, %llu stalls); at %.0f MB/s card %.1f s -> %.1f s\n",
+	       wave_names[wv], bits, n >> 20, n * bytes * 1e3 / traw,
+	       n * bytes * 1e3 / tpack, st.encode_ns / 1e6,
+	       (unsigned long long)st.stalls, card_mbs, card_raw, card_pack);
+	snprintf(name, sizeof(name), "%s %d-bit file, raw", wave_names[wv],
+		 bits);
+	bench_report(name, traw, n, bytes);
+	snprintf(name, sizeof(name), "%s %d-bit file, packed", wave_names[wv],
+		 bits);
+	bench_report(name, tpack, n, bytes);
+	unlink(path);
+	free(src);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "/tmp/pack-bench.pk";
+	size_t n = 16 << 20, fn = 128 << 20;
+	int c, wv, bits;
+
+	while ((c = getopt(argc, argv, "o:n:f:c:")) != -1) {
+		switch (c) {
+		case 'o': path = optarg; break;
+		case 'n': n = strtoull(optarg, NULL, 0); break;
+		case 'f': fn = strtoull(optarg, NULL, 0); break;
+		case 'c': card_mbs = atof(optarg); break;
+		default:
+			fprintf(stderr, "Use: \"%s [-o file] [-n samples in memory] [-f samples to file] [-c card MB/s]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	if (verify(path))
+		return 1;
+
+	bench_start("pack-bench");
+	for (wv = 0; wv < NWAVES; wv++)
+		for (bits = 8; bits <= 16; bits += 8)
+			bench_codec(wv, bits, n);
+	for (wv = 0; wv < FLAT; wv++)
+		bench_file(path, wv, 8, fn);
+	return bench_finish() ? 2 : 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * persist-bench - cost of one persistence frame: add, decay, render
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "persist.h"
+#include "harness.h"
+
+static int width = 640, height = 480, frames = 500, samples = 100000;
+
+/* Saturation, decay and the LUT must give exact values */
+static int verify(void)
+{
+	struct pixconv_surface s = {NULL, 8, 4, 8 * 3, PIXCONV_RGB888};
+	struct decim_span sp[8];
+	struct pixconv_rect dmg;
+	uint32_t lut[PERSIST_LUT_SIZE];
+	struct persist *p = persist_create(8, 4);
+	uint8_t px[8 * 4 * 3];
+	int i, err = 0;
+
+	s.ptr = px;
+	persist_lut_mono(lut, 0xffffff);
+	persist_set_lut(p, lut, 8);
+	for (i = 0; i < 8; i++) {
+		sp[i].min = 0;
+		sp[i].max = i < 4 ? 3 : 0;	/* rows 0-3 / row 3 only */
+	}
+
+	/* 300 * 250 saturates at 0xffff */
+	for (i = 0; i < 300; i++)
+		persist_add(p, sp, 8, 0, 3, 250);
+	memset(px, 0x55, sizeof(px));
+	err |= persist_render(p, &s, 0, 0, &dmg) != 4;
+	err |= px[0] != 0xff || px[3 * 3 * 8 + 7 * 3] != 0xff;	/* row 3 */
+	err |= px[7 * 3] != 0;					/* row 0 */
+	err |= dmg.y != 0 || dmg.h != 4;
+
+	/* one half: 0xffff -> 0x7fff */
+	persist_decay(p, 0x8000);
+	persist_render(p, &s, 0, 0, NULL);
+	err |= px[0] != 0x7f;
+
+	/* nothing left after enough decays, and no rows to render then */
+	for (i = 0; i < 20; i++)
+		persist_decay(p, 0x8000);
+	persist_render(p, &s, 0, 0, NULL);
+	err |= px[0] != 0;
+	persist_decay(p, 0x8000);
+	err |= persist_render(p, &s, 0, 0, NULL) != 0;
+
+	persist_destroy(p);
+	if (err)
+		fprintf(stderr, "persist: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct decim_span *spans;
+	struct pixconv_surface fb;
+	struct persist *p;
+	int16_t *rec;
+	uint64_t t, ta = 0, td = 0, tr = 0, rows = 0;
+	double ph;
+	int c, i, f;
+
+	while ((c = getopt(argc, argv, "w:h:n:s:")) != -1) {
+		switch (c) {
+		case 'w': width = atoi(optarg); break;
+		case 'h': height = atoi(optarg); break;
+		case 'n': frames = atoi(optarg); break;
+		case 's': samples = atoi(optarg); break;
+		default:
+			fprintf(stderr, "Use: \"%s [-w width] [-h height] [-n frames] [-s samples]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	if (verify())
+		return 1;
+
+	bench_start("persist-bench");
+	fb.width = width;
+	fb.height = height;
+	fb.stride = width * 3;
+	fb.fmt = PIXCONV_RGB888;
+	fb.ptr = calloc(height, fb.stride);
+	rec = malloc(samples * sizeof(*rec));
+	spans = malloc(width * sizeof(*spans));
+	p = persist_create(width, height);
+
+	for (f = 0; f < frames; f++) {
+		/* a jittering, noisy sine: the classic eye pattern */
+		ph = (rand() % 100) / 400.0;
+		for (i = 0; i < samples; i++)
+			rec[i] = 20000 * sin(ph + i * 8 * M_PI / samples) +
+				 (rand() % 2000) - 1000;
+		decim_minmax_s16(spans, width, rec, samples);
+
+		t = bench_now_ns();
+		persist_add(p, spans, width, -32768, 32767, 64);
+		ta += bench_now_ns() - t;
+		t = bench_now_ns();
+		persist_decay(p, 62259);	/* 0.95 */
+		td += bench_now_ns() - t;
+		t = bench_now_ns();
+		rows += persist_render(p, &fb, 0, 0, NULL);
+		tr += bench_now_ns() - t;
+	}
+
+	printf("%dx%d, %d frames\n", width, height, frames);
+	printf("add    %8.1f us/frame\n", ta / 1e3 / frames);
+	printf("decay  %8.1f us/frame\n", td / 1e3 / frames);
+	printf("render %8.1f us/frame, %.0f of %d rows\n", tr / 1e3 / frames,
+	       (double)rows / frames, height);
+	bench_report("add", ta, frames, 0);
+	bench_report("decay", td, frames, 0);
+	bench_report("render", tr, frames, 0);
+
+	persist_destroy(p);
+	free(spans);
+	free(rec);
+	free(fb.ptr);
+	return bench_finish() ? 2 : 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * pixconv-bench - pixel format conversion throughput
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "pixconv.h"
+#include "harness.h"
+
+static double cpu_hz;
+
+static struct pixconv_surface *surface(int w, int h, enum pixconv_format fmt,
+				       int pad)
+{
+	struct pixconv_surface *s = malloc(sizeof(*s));
+	int i;
+
+	s->width = w;
+	s->height = h;
+	s->fmt = fmt;
+	/* pad > 0 gives an odd stride to exercise unaligned rows */
+	s->stride = w * pixconv_bpp(fmt) + pad;
+	s->ptr = malloc(s->stride * h);
+	for (i = 0; i < s->stride * h; i++)
+		s->ptr[i] = rand();
+	return s;
+}
+
+static void bench(const char *name, int w, int h, enum pixconv_format sf,
+		  enum pixconv_format df, const struct pixconv_rect *rect)
+{
+	struct pixconv_surface *src = surface(w, h, sf, 0);
+	struct pixconv_surface *dst = surface(w, h, df, 0);
+	uint64_t t0, t, pixels = 0;
+	char full[64];
+	int iter = 0;
+
+	pixconv_blit(dst, src, rect, rect ? 1 : 0); /* warm up caches/TLB */
+	t0 = bench_now_ns();
+	do {
+		pixels += pixconv_blit(dst, src, rect, rect ? 1 : 0);
+		iter++;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000ULL);
+
+	printf("%-18s %4dx%-4d %-6s %8.1f Mpix/s %6.3f pix/cycle %8.1f us/frame\n",
+	       name, w, h, rect ? "dirty" : "full", pixels * 1e3 / t,
+	       pixels * 1e9 / t / cpu_hz, t / 1e3 / iter);
+	snprintf(full, sizeof(full), "%s %dx%d %s", name, w, h,
+		 rect ? "dirty" : "full");
+	bench_report(full, t, pixels, 0);
+
+	free(src->ptr);
+	free(dst->ptr);
+	free(src);
+	free(dst);
+}
+
+/* Round trips and 565 corner values must be exact on any unaligned stride */
+static int verify(void)
+{
+	struct pixconv_surface *a = surface(37, 5, PIXCONV_RGB888, 1);
+	struct pixconv_surface *b = surface(37, 5, PIXCONV_XRGB8888, 3);
+	struct pixconv_surface *c = surface(37, 5, PIXCONV_RGB888, 5);
+	struct pixconv_surface *d = surface(37, 5, PIXCONV_RGB565, 1);
+	uint16_t px565[3] = {0xffff, 0x0000, 0xf81f};
+	uint8_t out[9], exp[9] = {0xff, 0xff, 0xff, 0, 0, 0, 0xff, 0, 0xff};
+	int y, err = 0;
+
+	pixconv_blit(b, a, NULL, 0);
+	pixconv_blit(c, b, NULL, 0);
+	for (y = 0; y < 5; y++)
+		err |= memcmp(a->ptr + y * a->stride, c->ptr + y * c->stride,
+			      37 * 3);
+
+	pixconv_blit(d, a, NULL, 0);
+	pixconv_blit(c, d, NULL, 0);
+	for (y = 0; y < 5 * 37 * 3; y++)
+		if ((a->ptr[y / 111 * a->stride + y % 111] ^
+		     c->ptr[y / 111 * c->stride + y % 111]) & 0xe0)
+			err |= 1;
+
+	pixconv_rgb565_to_rgb888(out, px565, 3);
+	err |= memcmp(out, exp, 9);
+
+	if (err)
+		fprintf(stderr, "pixconv: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const int sizes[][2] = {{640, 960}, {800, 1280}};
+	int c, i;
+
+	cpu_hz = bench_cpu_hz();
+	while ((c = getopt(argc, argv, "f:")) != -1) {
+		switch (c) {
+		case 'f':
+			cpu_hz = atof(optarg) * 1e6;
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-f cpu-MHz]\"\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (verify())
+		return 1;
+
+	printf("cycles per second: %.0f\n", cpu_hz);
+	bench_start("pixconv-bench");
+	for (i = 0; i < 2; i++) {
+		int w = sizes[i][0], h = sizes[i][1];
+		/* waveform area update: about a tenth of the screen */
+		struct pixconv_rect dirty = {w / 8, h / 4, w * 3 / 4, h / 8};
+
+		bench("xrgb8888->rgb888", w, h, PIXCONV_XRGB8888, PIXCONV_RGB888,
+		      NULL);
+		bench("xrgb8888->rgb888", w, h, PIXCONV_XRGB8888, PIXCONV_RGB888,
+		      &dirty);
+		bench("rgb565->rgb888", w, h, PIXCONV_RGB565, PIXCONV_RGB888,
+		      NULL);
+		bench("rgb888->xrgb8888", w, h, PIXCONV_RGB888, PIXCONV_XRGB8888,
+		      NULL);
+		bench("rgb888->rgb565", w, h, PIXCONV_RGB888, PIXCONV_RGB565,
+		      NULL);
+	}
+
+	return bench_finish() ? 2 : 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * rec-bench - acquisition loop latency while recording to disk
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "recorder.h"
+#include "harness.h"
+
+static void pattern(uint8_t *p, size_t len, uint64_t off)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		p[i] = (off + i) * 131 >> 3;
+}
+
+static int verify_file(const char *path, int direct)
+{
+	struct rec_config cfg = {65536, 4, 16 << 20, direct};
+	size_t total = (10 << 20) + 123, i, j, k, len;
+	uint8_t *src = malloc(total), *back = malloc(total);
+	struct rec_stats st;
+	struct recorder *r;
+	struct stat sb;
+	void *dst;
+	int fd, err = 0;
+
+	pattern(src, total, 0);
+	r = rec_open(path, &cfg);
+	if (!r) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < total; i += k) {
+		k = rand() % 100000;
+		k = k < total - i ? k : total - i;
+		/* wait for the disk here, the point is the content */
+		for (j = 0; j < k; j += len) {
+			len = k - j;
+			dst = rec_reserve(r, &len);
+			if (!len) {
+				usleep(100);
+				continue;
+			}
+			memcpy(dst, src + i + j, len);
+			rec_commit(r, len);
+		}
+	}
+	err |= rec_close(r, &st);
+	fd = open(path, O_RDONLY);
+	err |= fstat(fd, &sb) || (size_t)sb.st_size != total;
+	err |= read(fd, back, total) != (ssize_t)total || memcmp(src, back, total);
+	err |= st.written != total;
+	close(fd);
+	unlink(path);
+	printf("file, O_DIRECT %s: %s\n", direct ? (st.direct ? "in use" :
+	       "not supported here") : "off", err ? "FAILED" : "ok");
+	free(src);
+	free(back);
+	return err;
+}
+
+static int pipe_rd;
+static uint64_t pipe_got;
+
+static void *drain_pipe(void *arg)
+{
+	char buf[65536];
+	ssize_t k;
+
+	while ((k = read(pipe_rd, buf, sizeof(buf))) > 0)
+		pipe_got += k;
+	return NULL;
+}
+
+/* A disk that stops: the producer must carry on and count the loss */
+static int verify_stall(void)
+{
+	struct rec_config cfg = {65536, 4, 0, 0};
+	uint8_t *chunk = calloc(1, 16384);
+	struct rec_stats st;
+	struct recorder *r;
+	uint64_t t, max = 0, stored = 0;
+	pthread_t th;
+	char path[64];
+	int fds[2], i, err = 0;
+
+	if (pipe(fds))
+		return -1;
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fds[1]);
+	r = rec_open(path, &cfg);
+	close(fds[1]);
+	if (!r) {
+		perror(path);
+		return -1;
+	}
+	/* 4 MB into 256 kB of buffers and a 64 kB pipe nobody reads */
+	for (i = 0; i < 256; i++) {
+		t = bench_now_ns();
+		stored += rec_write(r, chunk, 16384);
+		t = bench_now_ns() - t;
+		if (t > max)
+			max = t;
+	}
+	rec_get_stats(r, &st);
+	err |= st.dropped + stored != 256 * 16384 || !st.drops;
+
+	pipe_rd = fds[0];
+	pthread_create(&th, NULL, drain_pipe, NULL);
+	err |= rec_close(r, &st);
+	pthread_join(th, NULL);
+	close(fds[0]);
+	err |= pipe_got != stored || st.written != stored;
+	printf("stalled disk: %llu of %d kB stored, slowest call %.1f us: %s\n",
+	       (unsigned long long)stored >> 10, 256 * 16, max / 1e3,
+	       err ? "FAILED" : "ok");
+	free(chunk);
+	return err;
+}
+
+static int verify(const char *path)
+{
+	int err = 0;
+
+	err |= verify_file(path, 0);
+	err |= verify_file(path, 1);
+	err |= verify_stall();
+	if (err)
+		fprintf(stderr, "rec: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+/* An acquisition loop handing off a chunk every period */
+static void bench(const char *path, int mode, double rate, double secs)
+{
+	static const char *const names[] = {"write() inline", "recorder",
+					    "recorder O_DIRECT"};
+	size_t chunk = 65536, stored = 0;
+	uint64_t period = chunk * 1e9 / rate, next, t, max = 0, total = 0;
+	uint64_t n = secs * rate / chunk, i, late = 0;
+	struct rec_config cfg = {1 << 20, 16, n * chunk, mode == 2};
+	struct recorder *r = NULL;
+	struct rec_stats st;
+	struct timespec ts;
+	uint8_t *src = malloc(chunk);
+	char name[64];
+	int fd = -1;
+
+	pattern(src, chunk, 0);
+	if (mode)
+		r = rec_open(path, &cfg);
+	else
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	next = bench_now_ns();
+	for (i = 0; i < n; i++) {
+		t = bench_now_ns();
+		if (mode)
+			stored += rec_write(r, src, chunk);
+		else
+			stored += write(fd, src, chunk);
+		t = bench_now_ns() - t;
+		total += t;
+		if (t > max)
+			max = t;
+		/* a FIFO of 4 chunks would have overflowed */
+		late += t > 4 * period;
+		next += period;
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+	t = bench_now_ns();
+	if (mode) {
+		rec_close(r, &st);
+	} else {
+		fsync(fd);
+		close(fd);
+	}
+	t = bench_now_ns() - t;
+	printf("%-18s %5.0f MB/s: handoff avg %7.1f us max %8.1f us, %llu overflows, %5.1f%% stored, %.0f ms to close",
+	       names[mode], rate / 1e6, total / 1e3 / n, max / 1e3,
+	       (unsigned long long)late, 100.0 * stored / (n * chunk), t / 1e6);
+	if (mode)
+		printf(", disk max %.1f ms, %d queued%s", st.max_write_ns / 1e6,
+		       st.max_queued, mode == 2 && !st.direct ?
+		       " (no O_DIRECT)" : "");
+	printf("\n");
+	snprintf(name, sizeof(name), "%s handoff", names[mode]);
+	bench_report(name, total, n, chunk);
+	unlink(path);
+	free(src);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "/tmp/rec-bench.bin";
+	double rate = 200e6, secs = 3;
+	int c, mode;
+
+	while ((c = getopt(argc, argv, "o:r:t:")) != -1) {
+		switch (c) {
+		case 'o': path = optarg; break;
+		case 'r': rate = atof(optarg) * 1e6; break;
+		case 't': secs = atof(optarg); break;
+		default:
+			fprintf(stderr, "Use: \"%s [-o file] [-r MB/s] [-t seconds]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	if (verify(path))
+		return 1;
+
+	bench_start("rec-bench");
+	for (mode = 0; mode < 3; mode++)
+		bench(path, mode, rate, secs);
+	return bench_finish() ? 2 : 0;
+}
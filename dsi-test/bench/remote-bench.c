@@ -0,0 +1,390 @@
+/*
+ * remote-bench - UAL_BUS_REMOTE over a loopback socket, against the
+ * simulated bus
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ual.h"
+#include "dsi_core.h"
+#include "dsi_model.h"
+#include "harness.h"
+
+/* dsi_core.c talks to whatever ubar is */
+static struct ual_bar_tkn *ubar;
+static int naive;
+
+void dsi_write(uint32_t reg, uint32_t val)
+{
+	ual_writel(ubar, reg, val);
+}
+
+uint32_t dsi_read(uint32_t reg)
+{
+	return ual_readl(ubar, reg);
+}
+
+int dsi_wait(uint32_t reg, uint32_t mask, uint32_t value)
+{
+	struct timespec timeout = {0, DSI_WAIT_TIMEOUT_MS * 1000000};
+
+	if (!naive)
+		return ual_readl_poll(ubar, reg, mask, value, &timeout,
+				      NULL) ? -1 : 0;
+	/* what dsi_lp_write_byte() used to do */
+	while ((dsi_read(reg) & mask) != value)
+		;
+	return 0;
+}
+
+struct server {
+	struct ual_bar_tkn *dev;
+	uint64_t size;
+	char path[64];
+	int lfd;
+	pthread_t thread;
+};
+
+static void *serve(void *arg)
+{
+	struct server *s = arg;
+	int fd;
+
+	while ((fd = accept(s->lfd, NULL, NULL)) >= 0) {
+		ual_remote_serve(s->dev, s->size, fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+static int server_start(struct server *s, struct ual_bar_tkn *dev,
+			uint64_t size, const char *path)
+{
+	struct sockaddr_un sa;
+
+	s->dev = dev;
+	s->size = size;
+	snprintf(s->path, sizeof(s->path), "%s", path);
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+	unlink(path);
+	s->lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s->lfd < 0 || bind(s->lfd, (struct sockaddr *)&sa, sizeof(sa)) ||
+	    listen(s->lfd, 4)) {
+		perror(path);
+		return -1;
+	}
+	return pthread_create(&s->thread, NULL, serve, s);
+}
+
+static void server_stop(struct server *s)
+{
+	/* wakes accept() up */
+	shutdown(s->lfd, SHUT_RDWR);
+	pthread_join(s->thread, NULL);
+	close(s->lfd);
+	unlink(s->path);
+}
+
+static struct ual_bar_tkn *connect_to(const char *path)
+{
+	struct ual_desc_remote remote = {path};
+	struct ual_bar_tkn *dev = ual_open(UAL_BUS_REMOTE, &remote);
+
+	if (!dev)
+		fprintf(stderr, "%s: %s\n", path, ual_strerror(errno));
+	return dev;
+}
+
+#define MEM_SIZE (1 << 20)
+#define SHARERS 4
+
+struct sharer {
+	struct ual_bar_tkn *dev;
+	int k;
+	int bad;
+	pthread_t thread;
+};
+
+/* Writes and reads back its own word: a mismatched answer shows */
+static void *share(void *arg)
+{
+	struct sharer *t = arg;
+	uint32_t addr = 0x200 + t->k * 4, v;
+	int i;
+
+	for (i = 0; i < 2000; i++) {
+		v = t->k << 24 | i;
+		ual_writel(t->dev, addr, v);
+		t->bad += ual_readl(t->dev, addr) != v;
+	}
+	return NULL;
+}
+
+static int verify_regs(const char *path)
+{
+	static uint32_t a[100000], b[100000];
+	struct sharer s[SHARERS];
+	struct timespec t;
+	struct ual_bar_tkn *dev = connect_to(path);
+	uint16_t w[3] = {0x1111, 0x2222, 0x3333}, wb[3];
+	uint32_t v, fifo[16];
+	uint64_t t0;
+	int i, e, err = 0;
+
+	if (!dev)
+		return -1;
+
+	ual_writel(dev, 0x10, 0xdeadbeef);
+	ual_writew(dev, 0x20, 0xabcd);
+	ual_writeb(dev, 0x23, 0x7f);
+	ual_writew_n(dev, 0x30, w, 3);
+	ual_readw_n(dev, 0x30, wb, 3);
+	e = ual_readl(dev, 0x10) != 0xdeadbeef ||
+	    ual_readw(dev, 0x20) != 0xabcd || ual_readb(dev, 0x23) != 0x7f ||
+	    ual_readl(dev, 0x20) != 0x7f00abcd || memcmp(w, wb, sizeof(w));
+	printf("single accesses: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	/* several requests each way */
+	for (i = 0; i < 100000; i++)
+		a[i] = i * 2654435761u;
+	ual_writel_n(dev, 0x1000, a, 100000);
+	ual_readl_n(dev, 0x1000, b, 100000);
+	e = memcmp(a, b, sizeof(a));
+	printf("blocks: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	/* plain memory keeps the last value written to the FIFO */
+	e = ual_writel_fifo(dev, 0x40, a, 16, UAL_FIFO_NO_LEVEL) != 16 ||
+	    ual_readl_fifo(dev, 0x40, fifo, 16, UAL_FIFO_NO_LEVEL) != 16;
+	for (i = 0; i < 16; i++)
+		e |= fifo[i] != a[15];
+	/* 64-bit entries are word pairs at the same address */
+	e |= ual_writeq_fifo(dev, 0x40, (uint64_t *)a, 8,
+			     UAL_FIFO_NO_LEVEL) != 8 ||
+	     ual_readq_fifo(dev, 0x40, (uint64_t *)fifo, 8,
+			    UAL_FIFO_NO_LEVEL) != 8;
+	for (i = 0; i < 16; i++)
+		e |= fifo[i] != a[15];
+	printf("fifo: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	ual_writel(dev, 0x100, 0x35);
+	t.tv_sec = 0;
+	t.tv_nsec = 10000000;
+	e = ual_readl_poll(dev, 0x100, 0xf, 5, &t, &v) || v != 0x35 ||
+	    !t.tv_nsec;
+	t.tv_nsec = 20000000;
+	t0 = bench_now_ns();
+	e |= !ual_readl_poll(dev, 0x100, 0xf, 6, &t, &v) || errno != ETIME ||
+	     v != 0x35 || t.tv_sec || t.tv_nsec || bench_now_ns() - t0 < 20000000;
+	/* longer than the server's slice: asked again for the rest */
+	t.tv_sec = 1;
+	t.tv_nsec = 500000000;
+	t0 = bench_now_ns();
+	e |= !ual_readl_poll(dev, 0x100, 0xf, 6, &t, &v) || errno != ETIME ||
+	     t.tv_sec || t.tv_nsec || bench_now_ns() - t0 < 1500000000;
+	printf("poll on the server: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	/* a bad posted write shows up with the next answer */
+	ual_writel(dev, MEM_SIZE, 1);
+	errno = 0;
+	v = ual_readl(dev, 0x10);
+	e = v != 0xdeadbeef || errno != EFAULT;
+	errno = 0;
+	v = ual_readl(dev, MEM_SIZE - 2);
+	e |= v != 0xffffffff || errno != EFAULT;
+	e |= ual_readl(dev, 0x10) != 0xdeadbeef;
+	printf("errors: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	/* threads sharing the token share its stream */
+	for (i = 0; i < SHARERS; i++) {
+		s[i].dev = dev;
+		s[i].k = i;
+		s[i].bad = 0;
+		pthread_create(&s[i].thread, NULL, share, &s[i]);
+	}
+	for (i = 0, e = 0; i < SHARERS; i++) {
+		pthread_join(s[i].thread, NULL);
+		e |= s[i].bad;
+	}
+	printf("threads on one token: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	ual_close(dev);
+	return err;
+}
+
+/* Packets sent through the remote bus reach the model intact */
+static int verify_model(const char *path, struct dsi_model *m)
+{
+	const struct dsi_model_packet *p;
+	int i, n, mode, e, err = 0;
+
+	for (mode = 0; mode < 2; mode++) {
+		ubar = connect_to(path);
+		if (!ubar)
+			return -1;
+		naive = mode;
+		dsi_model_clear(m);
+		dsi_write(REG_DSI_TICKDIV, 2);
+		for (i = 0; i < 10; i++)
+			dsi_send_lp_short(0x15, i, 0x80 + i);
+		/* the answer comes after every posted write before it */
+		dsi_read(REG_DSI_CTL);
+		p = dsi_model_packets(m, &n);
+		e = n != 10;
+		for (i = 0; i < n && !e; i++)
+			e |= p[i].dt != 0x15 || (p[i].wc & 0xff) != i ||
+			     p[i].wc >> 8 != 0x80 + i || !p[i].ecc_ok;
+		printf("lp packets, %s: %s\n", mode ? "naive loop" :
+		       "poll on the server", e ? "FAILED" : "ok");
+		err |= e;
+		ual_close(ubar);
+	}
+	return err;
+}
+
+static int verify(const char *mem_path, const char *model_path,
+		  struct dsi_model *m)
+{
+	int err = 0;
+
+	err |= verify_regs(mem_path);
+	err |= verify_model(model_path, m);
+	if (err)
+		fprintf(stderr, "remote: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+static void bench_access(struct ual_bar_tkn *dev, const char *name)
+{
+	static uint32_t buf[65536];
+	uint64_t t0, t, n;
+	char full[64];
+	int i;
+
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		ual_readl(dev, 0x10);
+	printf("%-10s readl               %8.2f us\n", name, t / 1e3 / n);
+	snprintf(full, sizeof(full), "%s readl", name);
+	bench_report(full, t, n, 4);
+
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		ual_writel(dev, 0x10, n);
+	ual_readl(dev, 0x10);
+	t = bench_now_ns() - t0;
+	printf("%-10s writel (posted)     %8.2f us\n", name, t / 1e3 / n);
+	snprintf(full, sizeof(full), "%s writel", name);
+	bench_report(full, t, n, 4);
+
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		for (i = 0; i < 4096; i++)
+			buf[i] = ual_readl(dev, 0x1000 + i * 4);
+	printf("%-10s 16 kB, readl each   %8.1f MB/s\n", name,
+	       n * 16384 * 1e3 / t);
+	snprintf(full, sizeof(full), "%s 16 kB, readl each", name);
+	bench_report(full, t, n, 16384);
+
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		ual_readl_n(dev, 0x1000, buf, 65536);
+	printf("%-10s 256 kB, readl_n     %8.1f MB/s\n", name,
+	       n * 262144 * 1e3 / t);
+	snprintf(full, sizeof(full), "%s 256 kB, readl_n", name);
+	bench_report(full, t, n, 262144);
+}
+
+static void bench_lp(struct dsi_model *m, const char *path, int mode)
+{
+	static const char *const names[] = {"local model", "remote, naive loop",
+					    "remote, poll on server"};
+	struct dsi_model_stats st;
+	uint64_t t0, t, n, reads;
+
+	ubar = mode ? connect_to(path) : dsi_model_open(m);
+	naive = mode == 1;
+	dsi_write(REG_DSI_TICKDIV, 2);
+	dsi_model_get_stats(m, &st);
+	reads = st.reads;
+	t0 = bench_now_ns();
+	for (n = 0; (t = bench_now_ns() - t0) < 300000000; n++)
+		dsi_send_lp_short(0x15, n, n >> 8);
+	dsi_read(REG_DSI_CTL);
+	t = bench_now_ns() - t0;
+	dsi_model_get_stats(m, &st);
+	/* an LP short packet is 5 bytes */
+	printf("%-24s %7.2f us/lp byte, %5.1f model reads/byte\n",
+	       names[mode], t / 1e3 / (n * 5),
+	       (double)(st.reads - reads) / (n * 5));
+	bench_report(names[mode], t, n * 5, 1);
+	ual_close(ubar);
+	dsi_model_clear(m);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mem_path = "/tmp/remote-bench-mem.sock";
+	const char *model_path = "/tmp/remote-bench-dsi.sock";
+	struct ual_desc_sim sim = {MEM_SIZE};
+	struct ual_bar_tkn *mem, *model_bar, *dev;
+	struct server s_mem, s_model;
+	struct dsi_model *m;
+	int c, mode;
+
+	while ((c = getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's':
+			mem_path = optarg;
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-s socket]\"\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	mem = ual_open(UAL_BUS_SIM, &sim);
+	m = dsi_model_create(NULL);
+	model_bar = dsi_model_open(m);
+	if (!mem || !m || !model_bar ||
+	    server_start(&s_mem, mem, MEM_SIZE, mem_path) ||
+	    server_start(&s_model, model_bar, 0x100, model_path))
+		exit(1);
+
+	if (verify(mem_path, model_path, m))
+		return 1;
+
+	bench_start("remote-bench");
+	bench_access(mem, "local");
+	dev = connect_to(mem_path);
+	bench_access(dev, "remote");
+	ual_close(dev);
+	for (mode = 0; mode < 3; mode++)
+		bench_lp(m, model_path, mode);
+
+	server_stop(&s_mem);
+	server_stop(&s_model);
+	ual_close(mem);
+	ual_close(model_bar);
+	dsi_model_destroy(m);
+	return bench_finish() ? 2 : 0;
+}
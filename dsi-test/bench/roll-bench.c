@@ -0,0 +1,313 @@
+/*
+ * roll-bench - roll mode: full redraw vs memmove vs scanout panning
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <stdatomic.h>
+
+#include "frmbuf.h"
+#include "roll.h"
+#include "harness.h"
+
+static int width = 640, height = 960, step = 8, steps = 2000, refresh = 60;
+static int16_t *trace;
+static int trace_len;
+
+static uint64_t cpu_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* Background, a dotted graticule every 50 columns and the trace */
+static void draw_cols(void *arg, uint8_t *dst, int stride, int h,
+		      uint64_t first, int n)
+{
+	int x, y;
+	uint8_t *p;
+
+	for (y = 0; y < h; y++, dst += stride) {
+		for (x = 0, p = dst; x < n; x++, p += 3) {
+			uint64_t c = first + x;
+
+			if (trace[c % trace_len] == y) {
+				p[0] = 0xff; p[1] = 0xff; p[2] = 0x00;
+			} else if (c % 50 == 0 && y % 4 == 0) {
+				p[0] = p[1] = p[2] = 0x60;
+			} else {
+				p[0] = p[1] = p[2] = 0x10;
+			}
+		}
+	}
+}
+
+struct result {
+	const char *name;
+	double cpu_us, rd, wr;
+};
+
+static void report(struct result *r)
+{
+	double mbs = (r->rd + r->wr) * refresh / 1e6;
+
+	printf("%-12s %10.1f us/step %10.0f B rd %10.0f B wr  %8.1f MB/s @ %d Hz\n",
+	       r->name, r->cpu_us, r->rd, r->wr, mbs, refresh);
+	bench_report(r->name, r->cpu_us * 1e3 * steps, steps, r->rd + r->wr);
+}
+
+static void bench_full(struct result *r, uint8_t *fb, int stride)
+{
+	uint64_t t0, col;
+	int i;
+
+	t0 = cpu_ns();
+	for (i = 0, col = step; i < steps; i++, col += step)
+		draw_cols(NULL, fb, stride, height,
+			  col > width ? col - width : 0, width);
+	r->cpu_us = (cpu_ns() - t0) / 1e3 / steps;
+	r->rd = 0;
+	r->wr = (double)width * 3 * height;
+}
+
+static void bench_memmove(struct result *r, uint8_t *fb, int stride)
+{
+	uint64_t t0, col;
+	int i, y, keep = (width - step) * 3;
+
+	t0 = cpu_ns();
+	for (i = 0, col = 0; i < steps; i++, col += step) {
+		for (y = 0; y < height; y++)
+			memmove(fb + y * stride, fb + y * stride + step * 3, keep);
+		draw_cols(NULL, fb + keep, stride, height, col, step);
+	}
+	r->cpu_us = (cpu_ns() - t0) / 1e3 / steps;
+	r->rd = (double)keep * height;
+	r->wr = (double)keep * height + step * 3.0 * height;
+}
+
+/* Simulated v_frmbuf_rd: AP_READY is raised on demand by the benchmark */
+static atomic_uint isr;
+static uint32_t regs[32];
+
+static uint32_t frmbuf_read(void *priv, uint32_t addr, enum ual_data_width dw)
+{
+	return addr == REG_FRMBUF_ISR ? atomic_load(&isr) : regs[addr / 4 % 32];
+}
+
+static void frmbuf_write(void *priv, uint32_t addr, uint32_t value,
+			 enum ual_data_width dw)
+{
+	if (addr == REG_FRMBUF_ISR)
+		atomic_fetch_xor(&isr, value);
+	else
+		regs[addr / 4 % 32] = value;
+}
+
+/* One simulated frame start, handled by the frmbuf IRQ thread before this
+   returns. The count is sampled before AP_READY goes up: the thread may
+   take the frame before frmbuf_wait_vsync() would have started waiting. */
+static void frame(struct frmbuf *fb)
+{
+	struct timespec ts = {0, 20000};
+	struct frmbuf_stats st;
+	uint64_t n;
+
+	frmbuf_get_stats(fb, &st);
+	n = st.frames;
+	atomic_fetch_or(&isr, FRMBUF_IRQ_AP_READY);
+	do {
+		nanosleep(&ts, NULL);
+		frmbuf_get_stats(fb, &st);
+	} while (st.frames == n);
+}
+
+/* Once the requested window is live, the scanout must show the last width
+   columns drawn, as a full redraw of them would */
+static int check_window(struct frmbuf *fb, uint64_t col, uint8_t *ref)
+{
+	const struct frmbuf_buffer *b = frmbuf_front(fb);
+	int x = (col - step) % width + step, i, y;
+
+	for (i = 0; i < 4 && frmbuf_pan_live(fb) != x; i++)
+		frame(fb);
+	if (frmbuf_pan_live(fb) != x)
+		return -1;
+	draw_cols(NULL, ref, width * 3, height, col - width, width);
+	for (y = 0; y < height; y++)
+		if (memcmp(b->ptr + y * b->stride + x * 3, ref + y * width * 3,
+			   width * 3))
+			return -1;
+	return 0;
+}
+
+static int bench_roll(struct result *r)
+{
+	struct ual_desc_sim sregs = {0x10000, 0, NULL, frmbuf_read, frmbuf_write};
+	struct ual_desc_sim smem = {0, };
+	struct dsi_panel_config panel = {0, };
+	struct frmbuf_config cfg = {0, };
+	struct roll_stats st;
+	struct frmbuf *fb;
+	struct roll *roll;
+	uint64_t cpu = 0, t0, col = 0;
+	int done = 0, n, checked = 0, bad = 0;
+	uint8_t *ref = malloc(width * 3 * height);
+
+	panel.width = width;
+	panel.height = height;
+	smem.size = (2 * width * 3 + 64) * height + 0x10000;
+
+	cfg.regs = ual_open(UAL_BUS_SIM, &sregs);
+	cfg.mem = ual_open(UAL_BUS_SIM, &smem);
+	cfg.mem_phys = 0x1f000000;
+	cfg.mem_size = smem.size;
+	cfg.num_buffers = 1;
+	cfg.virt_width = 2 * width;
+
+	fb = frmbuf_open(&cfg, &panel);
+	if (!fb) {
+		perror("frmbuf_open");
+		return -1;
+	}
+	roll = roll_create(fb, step, draw_cols, NULL);
+	if (!roll) {
+		perror("roll_create");
+		return -1;
+	}
+
+	while (done < steps) {
+		t0 = cpu_ns();
+		n = roll_advance(roll);
+		cpu += cpu_ns() - t0;
+		done += n;
+		col += n * step;
+		/* one frame per call */
+		frame(fb);
+		/* a sample of the steps, past the first lap */
+		if (n && col >= 2 * width && done % 97 == 0) {
+			bad += check_window(fb, col, ref) != 0;
+			checked++;
+		}
+	}
+	free(ref);
+
+	roll_get_stats(roll, &st);
+	r->cpu_us = cpu / 1e3 / steps;
+	r->rd = (double)st.bytes_read / st.steps;
+	r->wr = (double)st.bytes_written / st.steps;
+	printf("roll: %llu steps, %llu wraps, %llu waits\n",
+	       (unsigned long long)st.steps, (unsigned long long)st.wraps,
+	       (unsigned long long)st.waits);
+	printf("roll: %d scanout windows checked against a redraw: %s\n",
+	       checked, bad ? "FAILED" : "ok");
+
+	roll_destroy(roll);
+	frmbuf_close(fb);
+	ual_close(cfg.regs);
+	ual_close(cfg.mem);
+	return bad ? -1 : 0;
+}
+
+/* Pan limits and a pan requested just before a flip, on a small two-buffer
+   frmbuf whose rows are padded well past virt_width */
+static int check_pan(void)
+{
+	struct ual_desc_sim sregs = {0x10000, 0, NULL, frmbuf_read, frmbuf_write};
+	struct ual_desc_sim smem = {0x10000, };
+	struct dsi_panel_config panel = {0, };
+	struct frmbuf_config cfg = {0, };
+	struct frmbuf_buffer *b;
+	struct frmbuf *fb;
+	int bad = 0;
+
+	panel.width = 64;
+	panel.height = 4;
+	cfg.regs = ual_open(UAL_BUS_SIM, &sregs);
+	cfg.mem = ual_open(UAL_BUS_SIM, &smem);
+	cfg.mem_phys = 0x1f000000;
+	cfg.mem_size = smem.size;
+	cfg.num_buffers = 2;
+	cfg.virt_width = 72;
+
+	fb = frmbuf_open(&cfg, &panel);
+	if (!fb) {
+		perror("frmbuf_open");
+		return -1;
+	}
+	/* 72 pixels fill 216 of the 256 bytes per row */
+	bad += frmbuf_pan(fb, 8) != 0;
+	bad += frmbuf_pan(fb, 16) == 0;
+
+	b = frmbuf_get_back(fb);
+	frmbuf_queue(fb, b);
+	frame(fb);
+	bad += regs[REG_FRMBUF_ADDR / 4] != b->phys + 8 * 3;
+	frame(fb);
+	bad += frmbuf_front(fb) != b || frmbuf_pan_live(fb) != 8;
+
+	printf("roll: pan limit and pan across a flip: %s\n",
+	       bad ? "FAILED" : "ok");
+	frmbuf_close(fb);
+	ual_close(cfg.regs);
+	ual_close(cfg.mem);
+	return bad ? -1 : 0;
+}
+
+static void help(char *name)
+{
+	fprintf(stderr, "Use: \"%s [-w width] [-h height] [-s step] [-n steps] [-r refresh]\"\n",
+		name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct result res[3] = {{"full-redraw"}, {"memmove"}, {"pan"}};
+	uint8_t *fb;
+	int c, i, stride;
+
+	while ((c = getopt(argc, argv, "w:h:s:n:r:")) != -1) {
+		switch (c) {
+		case 'w': width = atoi(optarg); break;
+		case 'h': height = atoi(optarg); break;
+		case 's': step = atoi(optarg); break;
+		case 'n': steps = atoi(optarg); break;
+		case 'r': refresh = atoi(optarg); break;
+		default: help(argv[0]);
+		}
+	}
+
+	trace_len = 4096;
+	trace = malloc(trace_len * sizeof(*trace));
+	for (i = 0; i < trace_len; i++)
+		trace[i] = height / 2 + (height / 3) * sin(i * 2 * M_PI / 700.0);
+
+	stride = width * 3;
+	fb = calloc(height, stride);
+
+	printf("%dx%d, %d columns per step, %d steps\n", width, height, step,
+	       steps);
+	bench_full(&res[0], fb, stride);
+	bench_memmove(&res[1], fb, stride);
+	if (bench_roll(&res[2]) || check_pan())
+		return 1;
+
+	bench_start("roll-bench");
+	for (i = 0; i < 3; i++)
+		report(&res[i]);
+
+	free(fb);
+	free(trace);
+	return bench_finish() ? 2 : 0;
+}
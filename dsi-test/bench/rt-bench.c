@@ -0,0 +1,194 @@
+/*
+ * rt-bench - what ual_rt_setup() and ual_rt_alloc() buy a thread that
+ * must wake up every period, next to a CPU hog on the same core
+ *
+ * License: LGPLv2.1
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "ual.h"
+#include "harness.h"
+
+#define BUF_SIZE (8 << 20)
+
+static long minor_faults(void)
+{
+	struct rusage r;
+
+	getrusage(RUSAGE_THREAD, &r);
+	return r.ru_minflt;
+}
+
+/* ns per page to write a buffer the first time, and the faults taken */
+static double first_touch(char *p, size_t size, long *faults)
+{
+	uint64_t t0;
+	long f0 = minor_faults();
+	size_t i;
+
+	t0 = bench_now_ns();
+	for (i = 0; i < size; i += 4096)
+		p[i] = 1;
+	*faults = minor_faults() - f0;
+	return (double)(bench_now_ns() - t0) / (size / 4096);
+}
+
+static int verify(void)
+{
+	static const struct {
+		const char *spec;
+		int ok, cpu, priority;
+	} parse[] = {
+		{"1:80", 1, 1, 80},
+		{"0", 1, 0, 0},
+		{"-1:10", 1, -1, 10},
+		{"1:", 0},
+		{"1:100", 0},
+		{"x", 0},
+		{"1:80x", 0},
+	};
+	struct ual_rt_config c;
+	long faults;
+	char *p;
+	int i, e, err = 0;
+
+	for (i = 0, e = 0; i < sizeof(parse) / sizeof(parse[0]); i++) {
+		if (ual_rt_parse(&c, parse[i].spec) != (parse[i].ok ? 0 : -1))
+			e = 1;
+		else if (parse[i].ok && (c.cpu != parse[i].cpu ||
+					 c.priority != parse[i].priority))
+			e = 1;
+	}
+	printf("ual_rt_parse: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	p = ual_rt_alloc(BUF_SIZE);
+	e = !p;
+	if (p) {
+		first_touch(p, BUF_SIZE, &faults);
+		/* against 2048 pages; the clock and this code may fault a
+		   page or two the first time they run */
+		e = faults > 4;
+		ual_rt_free(p, BUF_SIZE);
+	}
+	printf("ual_rt_alloc prefaulted: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	if (err)
+		fprintf(stderr, "rt: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+/* Busy on cpu until killed */
+static pid_t hog(int cpu)
+{
+	cpu_set_t set;
+	pid_t pid = fork();
+
+	if (pid)
+		return pid;
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+	for (;;)
+		__asm__ __volatile__("" : : : "memory");
+}
+
+static void jitter(const char *name, unsigned int loops)
+{
+	struct timespec period = {0, 1000000};
+	struct ual_rt_jitter j;
+	char full[64];
+
+	if (ual_rt_jitter(&period, loops, &j)) {
+		printf("%-24s %s\n", name, strerror(errno));
+		return;
+	}
+	printf("%-24s mean %7.1f us, 99%% %7.1f us, max %8.1f us, %4llu missed, %3llu preempted, %llu faults\n",
+	       name, j.mean / 1e3, j.p99 / 1e3, j.max / 1e3,
+	       (unsigned long long)j.missed, (unsigned long long)j.preempted,
+	       (unsigned long long)j.minor_faults);
+	snprintf(full, sizeof(full), "%s, mean late", name);
+	bench_report(full, j.mean, 1, 0);
+	snprintf(full, sizeof(full), "%s, 99%% late", name);
+	bench_report(full, j.p99, 1, 0);
+}
+
+int main(int argc, char **argv)
+{
+	struct ual_rt_config rt;
+	unsigned int loops = 1000;
+	const char *spec = "0:80";
+	long faults;
+	double t;
+	pid_t pid;
+	char *p;
+	int c;
+
+	while ((c = getopt(argc, argv, "r:n:")) != -1) {
+		switch (c) {
+		case 'r':
+			spec = optarg;
+			break;
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-r <cpu>[:<priority>]] [-n <wake-ups>]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	if (ual_rt_parse(&rt, spec)) {
+		fprintf(stderr, "rt-bench: invalid setup '%s'\n", spec);
+		exit(1);
+	}
+	if (verify())
+		return 1;
+
+	bench_start("rt-bench");
+	p = malloc(BUF_SIZE);
+	t = first_touch(p, BUF_SIZE, &faults);
+	printf("%-24s %7.1f ns/page, %ld faults\n", "first touch, malloc", t,
+	       faults);
+	bench_report("first touch, malloc", t * (BUF_SIZE / 4096),
+		     BUF_SIZE / 4096, 4096);
+	free(p);
+	p = ual_rt_alloc(BUF_SIZE);
+	t = first_touch(p, BUF_SIZE, &faults);
+	printf("%-24s %7.1f ns/page, %ld faults\n", "first touch, rt_alloc", t,
+	       faults);
+	bench_report("first touch, rt_alloc", t * (BUF_SIZE / 4096),
+		     BUF_SIZE / 4096, 4096);
+	ual_rt_free(p, BUF_SIZE);
+
+	jitter("1 ms, idle", loops);
+	pid = hog(rt.cpu);
+	jitter("1 ms, hog", loops);
+	if (ual_rt_setup(&rt)) {
+		printf("%-24s %s\n", "ual_rt_setup", strerror(errno));
+	} else {
+		jitter("1 ms, hog, rt", loops);
+		fflush(stdout);
+		ual_rt_dump(1, NULL);
+	}
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return bench_finish() ? 2 : 0;
+}
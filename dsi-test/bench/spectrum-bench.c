@@ -0,0 +1,239 @@
+/*
+ * spectrum-bench - real FFT spectrum frames per second, 1k to 64k points
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "spectrum.h"
+#include "harness.h"
+
+static double cpu_hz;
+static int average = 8;
+
+static void tone(int16_t *s, int n, double bin, double amp, int noise)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		s[i] = lrint(amp * sin(2 * M_PI * bin * i / n)) +
+		       (noise ? rand() % (2 * noise + 1) - noise : 0);
+}
+
+/* Against a direct DFT in double precision, rectangular window */
+static int check_dft(int n)
+{
+	struct spectrum *s = spec_create(n, SPEC_WIN_RECT, 1);
+	int16_t *x = malloc(n * sizeof(*x));
+	const float *pw;
+	double re, im, ref, max = 0, err = 0;
+	int i, k;
+
+	for (i = 0; i < n; i++)
+		x[i] = rand() % 65536 - 32768;
+	spec_add_s16(s, x);
+	pw = spec_power(s);
+	for (k = 0; k <= n / 2; k++) {
+		re = im = 0;
+		for (i = 0; i < n; i++) {
+			re += x[i] * cos(2 * M_PI * (double)i * k / n);
+			im -= x[i] * sin(2 * M_PI * (double)i * k / n);
+		}
+		ref = (re * re + im * im) / ((double)n * n) *
+		      (k && k < n / 2 ? 4 : 1);
+		if (ref > max)
+			max = ref;
+		if (fabs(pw[k] - ref) > err)
+			err = fabs(pw[k] - ref);
+	}
+	free(x);
+	spec_destroy(s);
+	return err > max * 1e-5;
+}
+
+static int verify(void)
+{
+	struct spectrum *s = spec_create(4096, SPEC_WIN_HANN, 4);
+	int16_t *x = malloc(4096 * sizeof(*x));
+	float *db = malloc(2049 * sizeof(*db)), pw0;
+	int err = 0, k;
+
+	err |= check_dft(1024) << 0;	/* radix-4 stages and a radix-2 one */
+	err |= check_dft(2048) << 1;	/* radix-4 only */
+
+	/* 10000 on a bin: 100000000 there, -10.31 dBFS */
+	tone(x, 4096, 100, 10000, 0);
+	spec_add_s16(s, x);
+	pw0 = spec_power(s)[100];
+	err |= (fabs(pw0 - 1e8) > 1e8 * 1e-4) << 2;
+	spec_db(s, db, 32768);
+	err |= (fabs(db[100] - 20 * log10(10000 / 32768.0)) > 0.002) << 3;
+	for (k = 0; k <= 2048; k++)
+		if (fabs(db[k] - 10 * log10(fmax(spec_power(s)[k] /
+						  (32768.0 * 32768.0), 1e-20))) > 0.002)
+			err |= 1 << 4;
+
+	/* the same frame again leaves the average where it is */
+	spec_add_s16(s, x);
+	err |= (fabs(spec_power(s)[100] - pw0) > pw0 * 1e-6) << 5;
+	err |= (spec_frames(s) != 2) << 6;
+
+	/* flat-top reads the amplitude half way between bins too */
+	spec_set_window(s, SPEC_WIN_FLATTOP);
+	tone(x, 4096, 100.5, 10000, 0);
+	spec_add_s16(s, x);
+	spec_db(s, db, 32768);
+	err |= (fabs(fmax(db[100], db[101]) - 20 * log10(10000 / 32768.0)) >
+		0.05) << 7;
+	err |= (spec_frames(s) != 1) << 8;
+
+	/* -92 dB sidelobes: far from the tone only the floor remains */
+	spec_set_window(s, SPEC_WIN_BLACKMAN_HARRIS);
+	tone(x, 4096, 100.5, 30000, 0);
+	spec_add_s16(s, x);
+	spec_db(s, db, 32768);
+	for (k = 200; k <= 2048; k++)
+		if (db[k] > -95)
+			err |= 1 << 9;
+
+	free(x);
+	free(db);
+	spec_destroy(s);
+	if (err)
+		fprintf(stderr, "spectrum: verification FAILED (%#x)\n", err);
+	return err;
+}
+
+/* The generic way: complex radix-2 on all n points, twiddles on the fly */
+static void generic_fft(float *re, float *im, int n)
+{
+	int i, j, k, len;
+	float tr, ti, wr, wi, ur, ui, t;
+
+	for (i = 1, j = 0; i < n; i++) {
+		for (k = n >> 1; j & k; k >>= 1)
+			j ^= k;
+		j |= k;
+		if (i < j) {
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+	for (len = 2; len <= n; len <<= 1) {
+		for (k = 0; k < len / 2; k++) {
+			wr = cosf(-2 * M_PI * k / len);
+			wi = sinf(-2 * M_PI * k / len);
+			for (i = k; i < n; i += len) {
+				j = i + len / 2;
+				ur = re[i];
+				ui = im[i];
+				tr = re[j] * wr - im[j] * wi;
+				ti = re[j] * wi + im[j] * wr;
+				re[i] = ur + tr;
+				im[i] = ui + ti;
+				re[j] = ur - tr;
+				im[j] = ui - ti;
+			}
+		}
+	}
+}
+
+static double generic_frame(const int16_t *x, float *re, float *im,
+			    float *db, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		re[i] = x[i] * (0.5 - 0.5 * cos(2 * M_PI * i / n));
+		im[i] = 0;
+	}
+	generic_fft(re, im, n);
+	for (i = 0; i <= n / 2; i++)
+		db[i] = 10 * log10f(re[i] * re[i] + im[i] * im[i] + 1e-20f);
+	return db[1];
+}
+
+static void bench(int n)
+{
+	struct spectrum *s = spec_create(n, SPEC_WIN_HANN, average);
+	int16_t *x = malloc(n * sizeof(*x));
+	float *re = malloc(n * sizeof(*re)), *im = malloc(n * sizeof(*im));
+	float *db = malloc((n / 2 + 1) * sizeof(*db));
+	uint64_t t0, t, frames;
+	volatile double sink = 0;
+	char name[64];
+	double fps, gfps;
+
+	tone(x, n, n / 10.3, 12000, 100);
+
+	frames = 0;
+	t0 = bench_now_ns();
+	do {
+		spec_add_s16(s, x);
+		spec_db(s, db, 32768);
+		frames++;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000ULL);
+	fps = frames * 1e9 / t;
+	snprintf(name, sizeof(name), "%d points", n);
+	bench_report(name, t, frames, 0);
+
+	frames = 0;
+	t0 = bench_now_ns();
+	do {
+		sink += generic_frame(x, re, im, db, n);
+		frames++;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000ULL);
+	gfps = frames * 1e9 / t;
+	snprintf(name, sizeof(name), "%d points, generic", n);
+	bench_report(name, t, frames, 0);
+
+	printf("%6d points  %9.1f frames/s %8.1f us %6.1f cycles/point  generic %8.1f frames/s  x%.1f\n",
+	       n, fps, 1e6 / fps, cpu_hz / fps / n, gfps, fps / gfps);
+
+	free(x);
+	free(re);
+	free(im);
+	free(db);
+	spec_destroy(s);
+}
+
+int main(int argc, char **argv)
+{
+	int c, n;
+
+	cpu_hz = bench_cpu_hz();
+	while ((c = getopt(argc, argv, "a:f:")) != -1) {
+		switch (c) {
+		case 'a':
+			average = atoi(optarg);
+			break;
+		case 'f':
+			cpu_hz = atof(optarg) * 1e6;
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-a average] [-f cpu-MHz]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	if (verify())
+		return 1;
+
+	printf("Hann window, %d frame average, s16 in, dB out, cycles per second: %.0f\n",
+	       average, cpu_hz);
+	bench_start("spectrum-bench");
+	for (n = SPEC_MIN_POINTS; n <= SPEC_MAX_POINTS; n *= 2)
+		bench(n);
+	spec_release_plans();
+	return bench_finish() ? 2 : 0;
+}
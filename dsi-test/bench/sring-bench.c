@@ -0,0 +1,224 @@
+/*
+ * sring-bench - SPSC ring hand-off vs a mutex guarded queue
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "sring.h"
+#include "harness.h"
+
+static size_t ring_size = 1 << 20, chunk = 4096;
+static uint64_t total = 1ULL << 30;
+
+struct run {
+	const char *name;
+	struct sring *ring;
+	struct ual_bar_tkn *bar;
+	uint64_t bytes, errors, worst_ns;
+
+	/* baseline queue */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint8_t *buf;
+	size_t head, tail;
+};
+
+/* Producer: sequence numbers, or bulk reads from the UAL mapping */
+static void *sring_producer(void *arg)
+{
+	struct run *r = arg;
+	uint32_t *w = malloc(chunk), seq = 0;
+	uint64_t sent = 0, t, dt;
+	size_t i, n;
+
+	while (sent < total) {
+		/* a real readout would drop (and count) data here */
+		if (sring_level(r->ring) + chunk > ring_size) {
+			sched_yield();
+			continue;
+		}
+		t = bench_now_ns();
+		if (r->bar) {
+			n = sring_fill_ual(r->ring, r->bar, 0, chunk / 4) * 4;
+		} else {
+			for (i = 0; i < chunk / 4; i++)
+				w[i] = seq + i;
+			n = sring_write(r->ring, w, chunk);
+			seq += n / 4;
+		}
+		dt = bench_now_ns() - t;
+		if (dt > r->worst_ns)
+			r->worst_ns = dt;
+		sent += n;
+	}
+	free(w);
+	return NULL;
+}
+
+static void sring_consumer(struct run *r)
+{
+	const uint32_t *p;
+	uint32_t seq = 0;
+	size_t len, i;
+
+	while (r->bytes < total) {
+		p = sring_peek(r->ring, &len);
+		if (!len) {
+			sched_yield();
+			continue;
+		}
+		if (!r->bar)
+			for (i = 0; i < len / 4; i++, seq++)
+				r->errors += p[i] != seq;
+		sring_release(r->ring, len);
+		r->bytes += len;
+	}
+}
+
+/* Baseline queue copies, in two pieces across the end of the buffer */
+static void ring_copy(uint8_t *ring, size_t off, void *p, size_t len, int in)
+{
+	size_t first = ring_size - off < len ? ring_size - off : len;
+
+	if (in) {
+		memcpy(ring + off, p, first);
+		memcpy(ring, (uint8_t *)p + first, len - first);
+	} else {
+		memcpy(p, ring + off, first);
+		memcpy((uint8_t *)p + first, ring, len - first);
+	}
+}
+
+static void *mutex_producer(void *arg)
+{
+	struct run *r = arg;
+	uint32_t *w = malloc(chunk), seq = 0;
+	uint64_t sent = 0, t, dt;
+	size_t i;
+
+	while (sent < total) {
+		for (i = 0; i < chunk / 4; i++)
+			w[i] = seq++;
+		t = bench_now_ns();
+		pthread_mutex_lock(&r->lock);
+		while (r->head - r->tail + chunk > ring_size)
+			pthread_cond_wait(&r->cond, &r->lock);
+		ring_copy(r->buf, r->head % ring_size, w, chunk, 1);
+		r->head += chunk;
+		pthread_cond_signal(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+		dt = bench_now_ns() - t;
+		if (dt > r->worst_ns)
+			r->worst_ns = dt;
+		sent += chunk;
+	}
+	free(w);
+	return NULL;
+}
+
+static void mutex_consumer(struct run *r)
+{
+	uint32_t seq = 0, *p;
+	size_t i;
+
+	p = malloc(chunk);
+	while (r->bytes < total) {
+		pthread_mutex_lock(&r->lock);
+		while (r->head == r->tail)
+			pthread_cond_wait(&r->cond, &r->lock);
+		ring_copy(r->buf, r->tail % ring_size, p, chunk, 0);
+		r->tail += chunk;
+		pthread_cond_signal(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+		for (i = 0; i < chunk / 4; i++, seq++)
+			r->errors += p[i] != seq;
+		r->bytes += chunk;
+	}
+	free(p);
+}
+
+static void bench(struct run *r, void *(*producer)(void *),
+		  void (*consumer)(struct run *))
+{
+	struct sring_stats st = {0, };
+	pthread_t th;
+	uint64_t t0, t;
+
+	t0 = bench_now_ns();
+	pthread_create(&th, NULL, producer, r);
+	consumer(r);
+	pthread_join(th, NULL);
+	t = bench_now_ns() - t0;
+
+	if (r->ring)
+		sring_get_stats(r->ring, &st);
+	printf("%-12s %8.1f MB/s  worst producer call %8.1f us  errors %llu  overruns %llu\n",
+	       r->name, r->bytes * 1e3 / t, r->worst_ns / 1e3,
+	       (unsigned long long)r->errors, (unsigned long long)st.overruns);
+	bench_report(r->name, t, r->bytes / chunk, chunk);
+}
+
+int main(int argc, char **argv)
+{
+	struct ual_desc_sim sim = {0, };
+	struct run r;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:c:n:")) != -1) {
+		switch (c) {
+		case 's': ring_size = strtoul(optarg, NULL, 0); break;
+		case 'c': chunk = strtoul(optarg, NULL, 0); break;
+		case 'n': total = strtoull(optarg, NULL, 0) << 20; break;
+		default:
+			fprintf(stderr, "Use: \"%s [-s ring-bytes] [-c chunk-bytes] [-n MiB]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	chunk &= ~(size_t)3;
+	total -= total % chunk;
+
+	printf("ring %zu B, chunks of %zu B, %llu MiB\n", ring_size, chunk,
+	       (unsigned long long)(total >> 20));
+	bench_start("sring-bench");
+
+	memset(&r, 0, sizeof(r));
+	r.name = "sring";
+	r.ring = sring_create(ring_size);
+	if (!r.ring) {
+		perror("sring_create");
+		return 1;
+	}
+	bench(&r, sring_producer, sring_consumer);
+	sring_destroy(r.ring);
+
+	/* acquisition window on a simulated bus, plain memory behind it */
+	memset(&r, 0, sizeof(r));
+	r.name = "sring-ual";
+	r.ring = sring_create(ring_size);
+	sim.size = chunk;
+	r.bar = ual_open(UAL_BUS_SIM, &sim);
+	bench(&r, sring_producer, sring_consumer);
+	ual_close(r.bar);
+	sring_destroy(r.ring);
+
+	memset(&r, 0, sizeof(r));
+	r.name = "mutex-queue";
+	pthread_mutex_init(&r.lock, NULL);
+	pthread_cond_init(&r.cond, NULL);
+	r.buf = malloc(ring_size);
+	bench(&r, mutex_producer, mutex_consumer);
+	free(r.buf);
+
+	return bench_finish() ? 2 : 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * trigger-bench - trigger search vs a per-sample scalar reference
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "trigger.h"
+#include "harness.h"
+
+#define MAX_EVENTS 100000
+
+static double cpu_hz;
+static size_t samples = 16 << 20;
+
+/*
+ * The reference walks every sample through the state machine. Falling
+ * slopes are rising ones on the negated signal.
+ */
+static long ref_all(const struct trig_config *c, const void *src, int bits,
+		    size_t n, size_t *idx, uint32_t *wid, size_t max)
+{
+	int neg = c->slope == TRIG_FALLING ? -1 : 1;
+	int L = neg * c->level, arm = L - c->hysteresis;
+	int lo = neg > 0 ? c->low : -c->high, hi = neg > 0 ? c->high : -c->low;
+	int st = 0, v, match;
+	size_t i, t0 = 0, cnt = 0;
+	uint32_t w;
+
+	for (i = 0; i < n && cnt < max; i++) {
+		v = neg * (bits == 8 ? ((const int8_t *)src)[i] :
+			   ((const int16_t *)src)[i]);
+		switch (c->type) {
+		case TRIG_EDGE:
+			if (!st && v < arm) {
+				st = 1;
+			} else if (st && v >= L) {
+				idx[cnt++] = i;
+				st = 0;
+			}
+			break;
+		case TRIG_LEVEL:
+			if (!st && v >= L) {
+				idx[cnt++] = i;
+				st = 1;
+			} else if (st && v < L) {
+				st = 0;
+			}
+			break;
+		case TRIG_PULSE:
+			if (st == 0 && v < arm) {
+				st = 1;
+			} else if (st == 1 && v >= L) {
+				t0 = i;
+				st = 2;
+			} else if (st == 2 && v < arm) {
+				w = i - t0;
+				switch (c->width_cmp) {
+				case TRIG_WIDTH_LESS:
+					match = w < c->width_min;
+					break;
+				case TRIG_WIDTH_GREATER:
+					match = w > c->width_max;
+					break;
+				case TRIG_WIDTH_INSIDE:
+					match = w >= c->width_min &&
+						w <= c->width_max;
+					break;
+				default:
+					match = w < c->width_min ||
+						w > c->width_max;
+					break;
+				}
+				if (match) {
+					wid[cnt] = w;
+					idx[cnt++] = i;
+				}
+				st = 1;
+			}
+			break;
+		case TRIG_RUNT:
+			if (st == 0 && v < lo) {
+				st = 1;
+			} else if (st == 1 && v >= lo) {
+				t0 = i;
+				st = v >= hi ? 3 : 2;
+			} else if (st == 2 && v >= hi) {
+				st = 3;
+			} else if (st == 2 && v < lo) {
+				wid[cnt] = i - t0;
+				idx[cnt++] = i;
+				st = 1;
+			} else if (st == 3 && v < lo) {
+				st = 1;
+			}
+			break;
+		}
+	}
+	return cnt;
+}
+
+/* Sine with noise, narrow glitches and runts every few thousand samples */
+static void make_signal(int16_t *s16, int8_t *s8, size_t n)
+{
+	size_t i, k;
+
+	for (i = 0; i < n; i++)
+		s16[i] = 20000 * sin(i * 2 * M_PI / 50000.0) +
+			 (rand() % 1001) - 500;
+	for (i = 1000; i + 40 < n; i += 3000 + rand() % 5000) {
+		int amp = (rand() & 1) ? 12000 : 30000;
+
+		for (k = 0; k < 5 + rand() % 30; k++)
+			s16[i + k] = amp;
+	}
+	for (i = 0; i < n; i++)
+		s8[i] = s16[i] >> 8;
+}
+
+static const char *names[] = {"edge", "level", "pulse", "runt"};
+
+static int bench(const struct trig_config *c, const void *src, int bits)
+{
+	static struct trig_event ev[MAX_EVENTS];
+	static size_t idx[MAX_EVENTS];
+	static uint32_t wid[MAX_EVENTS];
+	long n_lib = 0, n_ref;
+	uint64_t t0, t_lib, t_ref;
+	char name[64];
+	int l, iter = 0, err = 0;
+	long k;
+
+	t0 = bench_now_ns();
+	do {
+		n_lib = bits == 8 ?
+			trig_find_all_s8(c, src, samples, ev, MAX_EVENTS) :
+			trig_find_all_s16(c, src, samples, ev, MAX_EVENTS);
+		iter++;
+		t_lib = bench_now_ns() - t0;
+	} while (t_lib < 300000000ULL);
+	t_lib /= iter;
+
+	t0 = bench_now_ns();
+	n_ref = ref_all(c, src, bits, samples, idx, wid, MAX_EVENTS);
+	t_ref = bench_now_ns() - t0;
+
+	err = n_lib != n_ref;
+	for (k = 0; !err && k < n_lib; k++) {
+		err |= ev[k].index != idx[k];
+		err |= c->type >= TRIG_PULSE && ev[k].width != wid[k];
+		err |= ev[k].time > ev[k].index ||
+		       ev[k].time < (double)ev[k].index - 1;
+	}
+
+	l = c->slope == TRIG_FALLING;
+	printf("%-5s %-7s %2d-bit %7ld events  %8.1f Ms/s %6.2f s/cycle  ref %8.1f Ms/s  x%.1f%s\n",
+	       names[c->type], l ? "falling" : "rising", bits, n_lib,
+	       samples * 1e3 / t_lib, samples * 1e9 / t_lib / cpu_hz,
+	       samples * 1e3 / t_ref, (double)t_ref / t_lib,
+	       err ? "  MISMATCH" : "");
+	snprintf(name, sizeof(name), "%s %s %d-bit", names[c->type],
+		 l ? "falling" : "rising", bits);
+	bench_report(name, t_lib, samples, bits / 8);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	struct trig_config cfg[8];
+	int16_t *s16;
+	int8_t *s8;
+	int c, i, err = 0;
+
+	cpu_hz = bench_cpu_hz();
+	while ((c = getopt(argc, argv, "f:n:")) != -1) {
+		switch (c) {
+		case 'f':
+			cpu_hz = atof(optarg) * 1e6;
+			break;
+		case 'n':
+			samples = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Use: \"%s [-f cpu-MHz] [-n samples]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+
+	s16 = malloc(samples * sizeof(*s16));
+	s8 = malloc(samples);
+	make_signal(s16, s8, samples);
+
+	memset(cfg, 0, sizeof(cfg));
+	cfg[0].type = TRIG_EDGE;
+	cfg[0].level = 0;
+	cfg[0].hysteresis = 1000;
+	cfg[1] = cfg[0];
+	cfg[1].slope = TRIG_FALLING;
+	cfg[2].type = TRIG_LEVEL;
+	cfg[2].level = 19000;
+	cfg[3].type = TRIG_PULSE;
+	cfg[3].level = 25000;
+	cfg[3].hysteresis = 500;
+	cfg[3].width_cmp = TRIG_WIDTH_LESS;
+	cfg[3].width_min = 20;
+	cfg[4].type = TRIG_RUNT;
+	cfg[4].low = 8000;
+	cfg[4].high = 25000;
+	cfg[5] = cfg[4];
+	cfg[5].slope = TRIG_FALLING;
+	cfg[5].low = -25000;
+	cfg[5].high = -8000;
+
+	printf("%zu samples, cycles per second: %.0f\n", samples, cpu_hz);
+	bench_start("trigger-bench");
+	for (i = 0; i < 6; i++) {
+		err |= bench(&cfg[i], s16, 16);
+		/* same thresholds on the 8-bit copy */
+		cfg[i].level >>= 8;
+		cfg[i].hysteresis >>= 8;
+		cfg[i].low >>= 8;
+		cfg[i].high >>= 8;
+		err |= bench(&cfg[i], s8, 8);
+	}
+
+	free(s16);
+	free(s8);
+	if (bench_finish() && !err)
+		err = 2;
+	return err;
+}
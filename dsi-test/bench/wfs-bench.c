@@ -0,0 +1,384 @@
+/*
+ * wfs-bench - waveform server throughput and latency over loopback
+ *
+ * License: LGPLv2.1
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+#include "wfserver.h"
+#include "harness.h"
+
+static atomic_int released;
+
+static void release(void *arg, const void *data)
+{
+	(void)arg;
+	(void)data;
+	atomic_fetch_add(&released, 1);
+}
+
+static void pattern(int16_t *p, size_t n, int seed)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		p[i] = (i * 37 + seed) ^ (i >> 11);
+}
+
+static int16_t *frame, *frame2, *back;
+static uint64_t samples;
+static const char *file;
+
+static struct wfs_req req(uint32_t op, uint32_t id, uint32_t ch,
+			  uint64_t first, uint64_t count)
+{
+	struct wfs_req r = {op, id, ch, 0, first, count};
+
+	return r;
+}
+
+static int check_read(struct wfs_client *c, uint32_t op, uint64_t first,
+		      uint64_t count)
+{
+	struct wfs_req r = req(op, 7, 0, first, count);
+	const int16_t *src = op == WFS_OP_READ ? frame : frame2;
+	struct wfs_resp resp;
+	long k;
+
+	if (wfs_send(c, &r, 1))
+		return -1;
+	k = wfs_recv(c, &resp, back, samples * 2);
+	return k != (long)count * 2 || resp.status || resp.id != 7 ||
+	       resp.first != first || memcmp(back, src + first, count * 2);
+}
+
+static int verify(const char *path, int port, struct wfs_server *s)
+{
+	struct wfs_req batch[6];
+	struct wfs_info info[WFS_MAX_CHANNELS];
+	struct wfs_resp resp;
+	struct wfs_client *c, *t;
+	int i, err = 0, e;
+	long k;
+
+	c = wfs_connect(path);
+	if (!c) {
+		perror(path);
+		return -1;
+	}
+
+	batch[0] = req(WFS_OP_INFO, 1, 0, 0, 0);
+	wfs_send(c, batch, 1);
+	k = wfs_recv(c, &resp, info, sizeof(info));
+	e = k != sizeof(info[0]) || info[0].bits != 16 ||
+	    info[0].samples != samples || info[0].file_samples != samples;
+	printf("info: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	e = check_read(c, WFS_OP_READ, 1000, 100000) ||
+	    check_read(c, WFS_OP_READ, samples - 5, 5) ||
+	    check_read(c, WFS_OP_READ, 0, samples);
+	printf("read from memory: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	e = check_read(c, WFS_OP_READ_FILE, 12345, 200000) ||
+	    check_read(c, WFS_OP_READ_FILE, 0, samples);
+	printf("read from file: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	/* answered in order, errors included, a read clamped */
+	batch[0] = req(WFS_OP_PING, 10, 0, 0, 0);
+	batch[1] = req(WFS_OP_READ, 11, 0, 5, 3);
+	batch[2] = req(WFS_OP_READ, 12, 0, samples + 1, 3);
+	batch[3] = req(WFS_OP_READ_FILE, 13, 0, samples - 2, 100);
+	batch[4] = req(WFS_OP_READ, 14, 5, 0, 1);
+	batch[5] = req(99, 15, 0, 0, 0);
+	wfs_send(c, batch, 6);
+	e = 0;
+	for (i = 0; i < 6; i++) {
+		k = wfs_recv(c, &resp, back, samples * 2);
+		e |= resp.id != 10u + i;
+		switch (i) {
+		case 1:
+			e |= k != 6 || resp.status || memcmp(back, frame + 5, 6);
+			break;
+		case 2:
+			e |= k || resp.status != -ERANGE;
+			break;
+		case 3:
+			e |= k != 4 || resp.status ||
+			     memcmp(back, frame2 + samples - 2, 4);
+			break;
+		case 4:
+		case 5:
+			e |= k || resp.status != -EINVAL;
+			break;
+		default:
+			e |= k || resp.status;
+		}
+	}
+	printf("batched requests: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	/* a new frame is pushed, the old one let go */
+	batch[0] = req(WFS_OP_SUBSCRIBE, 20, 0, 0, 0);
+	wfs_send(c, batch, 1);
+	k = wfs_recv(c, &resp, back, 0);
+	e = k || resp.status;
+	wfs_publish(s, 0, frame2, samples, release, NULL);
+	k = wfs_recv(c, &resp, back, samples * 2);
+	e |= resp.op != WFS_OP_FRAME || resp.seq != 2 ||
+	     k != (long)samples * 2 || memcmp(back, frame2, samples * 2);
+	batch[0] = req(WFS_OP_UNSUBSCRIBE, 21, 0, 0, 0);
+	wfs_send(c, batch, 1);
+	k = wfs_recv(c, &resp, back, 0);
+	e |= k || resp.status || resp.id != 21;
+	e |= atomic_load(&released) != 1;
+	wfs_publish(s, 0, frame, samples, release, NULL);
+	printf("subscription: %s\n", e ? "FAILED" : "ok");
+	err |= e;
+
+	t = port ? wfs_connect_tcp("127.0.0.1", port) : NULL;
+	if (port) {
+		e = !t || check_read(t, WFS_OP_READ, 777, 300000);
+		printf("tcp: %s\n", e ? "FAILED" : "ok");
+		err |= e;
+	}
+	wfs_disconnect(t);
+	wfs_disconnect(c);
+	if (err)
+		fprintf(stderr, "wfs: verification FAILED\n");
+	return err ? -1 : 0;
+}
+
+static void throughput(struct wfs_client *c, const char *name, uint32_t op,
+		       uint64_t count)
+{
+	struct wfs_req r = req(op, 0, 0, 0, count);
+	struct wfs_resp resp;
+	uint64_t t0 = bench_now_ns(), t, bytes = 0, n = 0;
+	char full[64];
+
+	do {
+		r.first = n * 4099 % (samples - count);
+		wfs_send(c, &r, 1);
+		bytes += wfs_recv(c, &resp, back, count * 2);
+		n++;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000);
+	printf("%-24s %8llu kB/request: %7.0f MB/s, %7.1f us/request\n", name,
+	       (unsigned long long)count * 2 >> 10, bytes * 1e3 / t, t / 1e3 / n);
+	snprintf(full, sizeof(full), "%s %llu kB", name,
+		 (unsigned long long)count * 2 >> 10);
+	bench_report(full, t, n, count * 2);
+}
+
+static void batched(struct wfs_client *c, const char *name, int depth,
+		    uint64_t count)
+{
+	struct wfs_req r[64];
+	struct wfs_resp resp;
+	uint64_t t0 = bench_now_ns(), t, n = 0;
+	char full[64];
+	int i;
+
+	for (i = 0; i < depth; i++)
+		r[i] = req(WFS_OP_READ, i, 0, i * 65536, count);
+	do {
+		wfs_send(c, r, depth);
+		for (i = 0; i < depth; i++)
+			wfs_recv(c, &resp, back, count * 2);
+		n += depth;
+		t = bench_now_ns() - t0;
+	} while (t < 300000000);
+	printf("%-24s %2d x %2llu kB: %7.2f us/request, %7.0f MB/s\n", name,
+	       depth, (unsigned long long)count * 2 >> 10, t / 1e3 / n,
+	       n * count * 2 * 1e3 / t);
+	snprintf(full, sizeof(full), "%s %d x %llu kB", name, depth,
+		 (unsigned long long)count * 2 >> 10);
+	bench_report(full, t, n, count * 2);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void latency(struct wfs_client *c, const char *name)
+{
+	static uint64_t lat[1 << 20];
+	struct wfs_req r = req(WFS_OP_PING, 0, 0, 0, 0);
+	struct wfs_resp resp;
+	uint64_t t0 = bench_now_ns(), t, sum = 0;
+	int n = 0;
+
+	do {
+		t = bench_now_ns();
+		wfs_send(c, &r, 1);
+		wfs_recv(c, &resp, NULL, 0);
+		lat[n] = bench_now_ns() - t;
+		sum += lat[n++];
+	} while (bench_now_ns() - t0 < 300000000 && n < (int)(sizeof(lat) / 8));
+	qsort(lat, n, sizeof(lat[0]), cmp_u64);
+	printf("%-24s round trip avg %5.1f us, p50 %5.1f us, p99 %5.1f us\n",
+	       name, sum / 1e3 / n, lat[n / 2] / 1e3, lat[n * 99 / 100] / 1e3);
+	bench_report(name, sum, n, 0);
+}
+
+/* What dumping registers as text would cost: one line per sample */
+static int text_fd[2];
+static uint64_t text_count;
+
+static void *text_server(void *arg)
+{
+	char buf[65536];
+	size_t len = 0;
+	uint64_t i;
+
+	(void)arg;
+	for (i = 0; i < text_count; i++) {
+		len += snprintf(buf + len, sizeof(buf) - len, "%d\n",
+				frame[i % samples]);
+		if (len > sizeof(buf) - 16) {
+			if (write(text_fd[0], buf, len) != (ssize_t)len)
+				break;
+			len = 0;
+		}
+	}
+	if (len && write(text_fd[0], buf, len) != (ssize_t)len)
+		return NULL;
+	shutdown(text_fd[0], SHUT_WR);
+	return NULL;
+}
+
+static void text_baseline(void)
+{
+	char buf[65536 + 1], *p, *e;
+	uint64_t t = bench_now_ns(), got = 0;
+	size_t keep = 0;
+	pthread_t th;
+	ssize_t k;
+
+	text_count = 4 << 20;
+	socketpair(AF_UNIX, SOCK_STREAM, 0, text_fd);
+	pthread_create(&th, NULL, text_server, NULL);
+	while ((k = read(text_fd[1], buf + keep, sizeof(buf) - 1 - keep)) > 0) {
+		buf[keep + k] = 0;
+		p = buf;
+		for (;;) {
+			e = strchr(p, '\n');
+			if (!e)
+				break;
+			back[got++ % samples] = strtol(p, NULL, 10);
+			p = e + 1;
+		}
+		keep = buf + keep + k - p;
+		memmove(buf, p, keep);
+	}
+	pthread_join(th, NULL);
+	close(text_fd[0]);
+	close(text_fd[1]);
+	t = bench_now_ns() - t;
+	printf("%-24s %8s          %7.0f MB/s of samples (%llu lines)\n",
+	       "text dump", "", got * 2 * 1e3 / t, (unsigned long long)got);
+	bench_report("text dump", t, got, 2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "/tmp/wfs-bench.sock";
+	struct wfs_server *s;
+	struct wfs_client *c;
+	struct wfs_stats st;
+	int opt, port = 7391, fd;
+
+	file = "/tmp/wfs-bench.bin";
+	samples = 16 << 20;
+	while ((opt = getopt(argc, argv, "f:n:p:s:")) != -1) {
+		switch (opt) {
+		case 'f': file = optarg; break;
+		case 'n': samples = strtoull(optarg, NULL, 0); break;
+		case 'p': port = atoi(optarg); break;
+		case 's': path = optarg; break;
+		default:
+			fprintf(stderr, "Use: \"%s [-s socket] [-p tcp port, 0 for none] [-f file] [-n samples]\"\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	if (samples < 1 << 20) {
+		fprintf(stderr, "at least 1M samples\n");
+		exit(1);
+	}
+
+	frame = malloc(samples * 2);
+	frame2 = malloc(samples * 2);
+	back = malloc(samples * 2);
+	pattern(frame, samples, 0);
+	pattern(frame2, samples, 12345);
+	fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || write(fd, frame2, samples * 2) != (ssize_t)samples * 2) {
+		perror(file);
+		exit(1);
+	}
+	close(fd);
+
+	s = wfs_create(path, NULL, port);
+	if (!s) {
+		perror("wfs_create");
+		exit(1);
+	}
+	wfs_add_channel(s, 16, 1e-9);
+	wfs_publish(s, 0, frame, samples, release, NULL);
+	wfs_attach_file(s, 0, file, 0, samples);
+
+	if (verify(path, port, s)) {
+		wfs_destroy(s);
+		unlink(file);
+		return 1;
+	}
+
+	bench_start("wfs-bench");
+	c = wfs_connect(path);
+	throughput(c, "unix read", WFS_OP_READ, 2048);
+	throughput(c, "unix read", WFS_OP_READ, 65536);
+	throughput(c, "unix read", WFS_OP_READ, 1 << 20);
+	throughput(c, "unix read file", WFS_OP_READ_FILE, 65536);
+	throughput(c, "unix read file", WFS_OP_READ_FILE, 1 << 20);
+	batched(c, "unix batched read", 1, 2048);
+	batched(c, "unix batched read", 64, 2048);
+	latency(c, "unix ping");
+	wfs_disconnect(c);
+	if (port) {
+		c = wfs_connect_tcp("127.0.0.1", port);
+		throughput(c, "tcp read", WFS_OP_READ, 65536);
+		throughput(c, "tcp read", WFS_OP_READ, 1 << 20);
+		throughput(c, "tcp read file", WFS_OP_READ_FILE, 1 << 20);
+		batched(c, "tcp batched read", 64, 2048);
+		latency(c, "tcp ping");
+		wfs_disconnect(c);
+	}
+	text_baseline();
+
+	wfs_get_stats(s, &st);
+	printf("served %llu requests, %llu MB\n",
+	       (unsigned long long)st.requests,
+	       (unsigned long long)st.bytes_sent >> 20);
+	wfs_destroy(s);
+	unlink(file);
+	return bench_finish() ? 2 : 0;
+}
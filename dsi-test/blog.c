@@ -0,0 +1,457 @@
+/*
+ * Deferred-format binary log
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* blog.c - printf() for places that cannot afford printf().
+ *
+ * blog() stores the address of a static descriptor of its call site (the
+ * format string, the number of arguments), a timestamp and the arguments
+ * as 64-bit words, and returns: no formatting, no locking, no system
+ * call. Each thread has a ring of words of its own, allocated on its
+ * first message and pushed on a list with a compare-and-swap; the ring
+ * works like the sample ring, free-running indexes on separate cache
+ * lines published with release stores. A message that does not fit is
+ * dropped and counted, the caller never waits.
+ *
+ * Formatting happens later, in whoever calls blog_drain(): the thread
+ * blog_start() runs at SCHED_IDLE, or the program itself at a quiet
+ * moment. The drain merges the rings by timestamp, so the output reads in
+ * order across threads. blog_drain_binary() skips the formatting and
+ * writes the words themselves, plus each format string once;
+ * blog_decode() turns such a file into text, on the target or on a host.
+ *
+ * The format string is interpreted at drain time, one conversion at a
+ * time, with the argument converted back to the type its length modifier
+ * says (%hhx, %d, %lu, %f...). */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "blog.h"
+
+#define BLOG_CACHELINE 64
+#define BLOG_HEADER 2       /* site, timestamp */
+#define BLOG_TAG_SITE 1     /* site definition in a binary file */
+
+int blog_enabled = 1;
+
+struct blog_ring {
+    /* producer */
+    atomic_size_t head __attribute__((aligned(BLOG_CACHELINE)));
+    size_t tail_cache;
+    atomic_uint_least64_t logged, dropped;
+
+    /* consumer */
+    atomic_size_t tail __attribute__((aligned(BLOG_CACHELINE)));
+
+    /* constant */
+    struct blog_ring *next __attribute__((aligned(BLOG_CACHELINE)));
+    uint64_t *buf;
+    size_t mask;
+};
+
+static size_t ring_words = 1 << 16;
+static _Atomic(struct blog_ring *) rings;
+static __thread struct blog_ring *self;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t drained;
+static unsigned int bin_gen;
+static int bin_fd = -1;
+
+static struct {
+    pthread_t thread;
+    FILE *out;
+    unsigned int period_ms;
+    atomic_int stop;
+    int running;
+} drainer;
+
+int blog_set_ring_size(size_t words)
+{
+    if (words < 64 || (words & (words - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+    ring_words = words;
+    return 0;
+}
+
+static struct blog_ring *blog_ring(void)
+{
+    struct blog_ring *r;
+
+    if (self)
+        return self;
+    if (posix_memalign((void **)&r, BLOG_CACHELINE, sizeof(*r)))
+        return NULL;
+    memset(r, 0, sizeof(*r));
+    r->buf = malloc(ring_words * sizeof(*r->buf));
+    if (!r->buf) {
+        free(r);
+        return NULL;
+    }
+    r->mask = ring_words - 1;
+    /* rings outlive their threads: whatever they logged still drains */
+    r->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &r->next, r))
+        ;
+    self = r;
+    return r;
+}
+
+void blog_write(struct blog_site *site, const uint64_t *args)
+{
+    struct blog_ring *r = self ? self : blog_ring();
+    size_t head, n = BLOG_HEADER + site->nargs, i;
+    struct timespec t;
+
+    if (!r)
+        return;
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head + n - r->tail_cache > r->mask + 1) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head + n - r->tail_cache > r->mask + 1) {
+            atomic_store_explicit(&r->dropped,
+                atomic_load_explicit(&r->dropped, memory_order_relaxed) + 1,
+                memory_order_relaxed);
+            return;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    r->buf[head & r->mask] = (uintptr_t)site;
+    r->buf[(head + 1) & r->mask] = t.tv_sec * 1000000000ULL + t.tv_nsec;
+    for (i = 0; i < site->nargs; i++)
+        r->buf[(head + BLOG_HEADER + i) & r->mask] = args[i];
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+    atomic_store_explicit(&r->logged,
+        atomic_load_explicit(&r->logged, memory_order_relaxed) + 1,
+        memory_order_relaxed);
+}
+
+/* One conversion of fmt, from *p, with its argument; returns what was
+   printed. %s arguments are only followed when strings is set. */
+static int blog_conv(FILE *out, const char **p, const uint64_t *args,
+                     int *arg, int nargs, int strings)
+{
+    char spec[32];
+    const char *start = *p, *s = *p;
+    uint64_t v;
+    int len = 0, n;
+
+    /* flags, width, precision: copied as they are */
+    s++;
+    s += strspn(s, "-+ #0");
+    s += strspn(s, "0123456789");
+    if (*s == '.') {
+        s++;
+        s += strspn(s, "0123456789");
+    }
+    /* length modifier */
+    while (*s && strchr("hlLqjzt", *s)) {
+        len += *s == 'h' ? -1 : strchr("jqL", *s) ? 2 : 1;
+        s++;
+    }
+    n = s - *p + 1;
+    if (!*s || n >= sizeof(spec)) {
+        /* malformed: the rest goes out as it is */
+        *p += strlen(*p);
+        return fputs(start, out);
+    }
+    memcpy(spec, *p, n);
+    spec[n] = '\0';
+    *p = s + 1;
+    if (*s == '%')
+        return fputs("%", out);
+    v = *arg < nargs ? args[(*arg)++] : 0;
+
+    switch (*s) {
+    case 'd': case 'i':
+        if (len >= 2)
+            return fprintf(out, spec, (long long)v);
+        if (len == 1)
+            return fprintf(out, spec, (long)v);
+        if (len == -2)
+            return fprintf(out, spec, (int)(signed char)v);
+        if (len == -1)
+            return fprintf(out, spec, (int)(short)v);
+        return fprintf(out, spec, (int)v);
+    case 'u': case 'x': case 'X': case 'o': case 'c':
+        if (len >= 2)
+            return fprintf(out, spec, (unsigned long long)v);
+        if (len == 1)
+            return fprintf(out, spec, (unsigned long)v);
+        if (len == -2)
+            return fprintf(out, spec, (unsigned int)(unsigned char)v);
+        if (len == -1)
+            return fprintf(out, spec, (unsigned int)(unsigned short)v);
+        return fprintf(out, spec, (unsigned int)v);
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a':
+    case 'A': {
+        union { uint64_t u; double d; } d = { v };
+
+        return fprintf(out, spec, d.d);
+    }
+    case 'p':
+        return fprintf(out, spec, (void *)(uintptr_t)v);
+    case 's':
+        if (!strings)
+            return fprintf(out, "<string at %#llx>", (unsigned long long)v);
+        return fprintf(out, spec, v ? (const char *)(uintptr_t)v : "(null)");
+    default:
+        return fputs(spec, out);
+    }
+}
+
+static void blog_format(FILE *out, const char *fmt, uint64_t t,
+                        const uint64_t *args, int nargs, int strings)
+{
+    const char *p = fmt, *q;
+    int arg = 0;
+
+    fprintf(out, "[%5llu.%06llu] ", (unsigned long long)(t / 1000000000),
+            (unsigned long long)(t % 1000000000 / 1000));
+    while (*p) {
+        q = strchr(p, '%');
+        if (!q) {
+            fputs(p, out);
+            break;
+        }
+        fwrite(p, 1, q - p, out);
+        p = q;
+        blog_conv(out, &p, args, &arg, nargs, strings);
+    }
+}
+
+/* The ring whose oldest message is the oldest of all, or NULL */
+static struct blog_ring *blog_oldest(void)
+{
+    struct blog_ring *r, *best = NULL;
+    uint64_t t, best_t = 0;
+    size_t tail;
+
+    for (r = atomic_load(&rings); r; r = r->next) {
+        tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        if (atomic_load_explicit(&r->head, memory_order_acquire) == tail)
+            continue;
+        t = r->buf[(tail + 1) & r->mask];
+        if (!best || t < best_t) {
+            best = r;
+            best_t = t;
+        }
+    }
+    return best;
+}
+
+static size_t blog_drain_to(FILE *out, int fd)
+{
+    uint64_t words[BLOG_HEADER + 8], def[4];
+    struct blog_site *site;
+    struct blog_ring *r;
+    size_t tail, count = 0, len;
+    int i;
+
+    pthread_mutex_lock(&drain_lock);
+    if (fd >= 0 && fd != bin_fd) {
+        /* a new file has none of the definitions */
+        bin_fd = fd;
+        bin_gen++;
+    }
+    while ((r = blog_oldest())) {
+        tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        site = (struct blog_site *)(uintptr_t)r->buf[tail & r->mask];
+        for (i = 0; i < BLOG_HEADER + site->nargs; i++)
+            words[i] = r->buf[(tail + i) & r->mask];
+        atomic_store_explicit(&r->tail, tail + i, memory_order_release);
+
+        if (fd < 0) {
+            if (out)
+                blog_format(out, site->fmt, words[1], words + BLOG_HEADER,
+                            site->nargs, 1);
+        } else {
+            if (site->bin_gen != bin_gen) {
+                len = strlen(site->fmt);
+                def[0] = BLOG_TAG_SITE;
+                def[1] = words[0];
+                def[2] = site->nargs;
+                def[3] = len;
+                if (write(fd, def, sizeof(def)) != sizeof(def) ||
+                    write(fd, site->fmt, len) != len ||
+                    write(fd, "\0\0\0\0\0\0\0", 7 - (len + 7) % 8) !=
+                    7 - (len + 7) % 8)
+                    break;
+                site->bin_gen = bin_gen;
+            }
+            if (write(fd, words, i * sizeof(words[0])) !=
+                i * sizeof(words[0]))
+                break;
+        }
+        count++;
+    }
+    drained += count;
+    pthread_mutex_unlock(&drain_lock);
+    if (out)
+        fflush(out);
+    return count;
+}
+
+size_t blog_drain(FILE *out)
+{
+    return blog_drain_to(out, -1);
+}
+
+size_t blog_drain_binary(int fd)
+{
+    return blog_drain_to(NULL, fd);
+}
+
+static int blog_read(int fd, void *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+        n = read(fd, buf, len);
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int blog_decode(int fd, FILE *out)
+{
+    struct {
+        uint64_t id;
+        int nargs;
+        char *fmt;
+    } *sites = NULL, *s;
+    uint64_t words[BLOG_HEADER + 8], def[3];
+    int n_sites = 0, i, err = 0;
+    char *fmt;
+
+    while (!blog_read(fd, words, sizeof(words[0]))) {
+        if (words[0] == BLOG_TAG_SITE) {
+            if (blog_read(fd, def, sizeof(def)) || def[1] > 8 ||
+                !(fmt = calloc(1, def[2] + 8)) ||
+                blog_read(fd, fmt, (def[2] + 7) & ~7ULL)) {
+                err = -1;
+                break;
+            }
+            s = realloc(sites, (n_sites + 1) * sizeof(*sites));
+            if (!s) {
+                free(fmt);
+                err = -1;
+                break;
+            }
+            sites = s;
+            sites[n_sites].id = def[0];
+            sites[n_sites].nargs = def[1];
+            sites[n_sites].fmt = fmt;
+            n_sites++;
+            continue;
+        }
+        /* the latest definition wins: an address may be reused by a
+           later run appended to the same file */
+        for (i = n_sites - 1; i >= 0 && sites[i].id != words[0]; i--)
+            ;
+        if (i < 0 || blog_read(fd, words + 1, (1 + sites[i].nargs) *
+                                               sizeof(words[0]))) {
+            err = -1;
+            break;
+        }
+        /* %s pointed into the other process: not worth following */
+        blog_format(out, sites[i].fmt, words[1], words + BLOG_HEADER,
+                    sites[i].nargs, 0);
+    }
+    for (i = 0; i < n_sites; i++)
+        free(sites[i].fmt);
+    free(sites);
+    if (err)
+        errno = EINVAL;
+    return err;
+}
+
+static void *blog_thread(void *arg)
+{
+    struct sched_param sp = { 0 };
+    struct timespec t = { drainer.period_ms / 1000,
+                          drainer.period_ms % 1000 * 1000000 };
+
+    /* only runs when nothing else wants the CPU */
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+    while (!atomic_load(&drainer.stop)) {
+        blog_drain(drainer.out);
+        nanosleep(&t, NULL);
+    }
+    return NULL;
+}
+
+int blog_start(FILE *out, unsigned int period_ms)
+{
+    int err;
+
+    if (drainer.running) {
+        errno = EBUSY;
+        return -1;
+    }
+    drainer.out = out;
+    drainer.period_ms = period_ms ? period_ms : 1;
+    atomic_store(&drainer.stop, 0);
+    err = pthread_create(&drainer.thread, NULL, blog_thread, NULL);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    drainer.running = 1;
+    return 0;
+}
+
+void blog_stop(void)
+{
+    if (!drainer.running)
+        return;
+    atomic_store(&drainer.stop, 1);
+    pthread_join(drainer.thread, NULL);
+    drainer.running = 0;
+    blog_drain(drainer.out);
+}
+
+void blog_get_stats(struct blog_stats *st)
+{
+    struct blog_ring *r;
+
+    memset(st, 0, sizeof(*st));
+    for (r = atomic_load(&rings); r; r = r->next) {
+        st->logged += atomic_load_explicit(&r->logged, memory_order_relaxed);
+        st->dropped += atomic_load_explicit(&r->dropped,
+                                            memory_order_relaxed);
+        st->threads++;
+    }
+    pthread_mutex_lock(&drain_lock);
+    st->drained = drained;
+    pthread_mutex_unlock(&drain_lock);
+}
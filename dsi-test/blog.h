@@ -0,0 +1,110 @@
+/*
+ * Deferred-format binary log
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __BLOG_H
+#define __BLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Where a message comes from: one per blog() call site, never formatted
+   by the caller */
+struct blog_site {
+    const char *fmt;
+    const char *file;
+    int line;
+    int nargs;
+    unsigned int bin_gen;   /* drainer's: definition written to the file */
+};
+
+struct blog_stats {
+    uint64_t logged;        /* messages stored */
+    uint64_t dropped;       /* messages lost to a full ring */
+    uint64_t drained;       /* messages formatted or written out */
+    unsigned int threads;   /* rings */
+};
+
+/* 0 turns blog() into a test and a branch */
+extern int blog_enabled;
+
+/* Messages up to 8 arguments: integers of any width, double, and
+   pointers as void * or char *. A %s argument is kept as a pointer and
+   read when the message is formatted, so it must point to a string that
+   lives as long as the program (a literal, a table entry). */
+#define blog(fmt, ...) do {                                             \
+        static struct blog_site __blog_site = {                         \
+            fmt, __FILE__, __LINE__, BLOG_N(__VA_ARGS__), 0 };          \
+        if (__builtin_expect(blog_enabled, 1)) {                        \
+            const uint64_t __blog_a[BLOG_N(__VA_ARGS__) + 1] = {        \
+                BLOG_ARGS(__VA_ARGS__) };                               \
+            blog_write(&__blog_site, __blog_a);                         \
+        }                                                               \
+    } while (0)
+
+void blog_write(struct blog_site *site, const uint64_t *args);
+
+/* Words of the ring of each thread, a power of two (default 64k, 512 kB);
+   before the first message of the thread */
+int blog_set_ring_size(size_t words);
+
+/* Formats what the rings hold, oldest first across the threads; returns
+   the number of messages. A NULL out throws them away */
+size_t blog_drain(FILE *out);
+/* The same, unformatted, with the format strings the first time a site
+   shows up in fd; blog_decode() formats the file, later or elsewhere */
+size_t blog_drain_binary(int fd);
+int blog_decode(int fd, FILE *out);
+
+/* A thread at SCHED_IDLE draining to out every period_ms, and a last time
+   on blog_stop() */
+int blog_start(FILE *out, unsigned int period_ms);
+void blog_stop(void);
+
+void blog_get_stats(struct blog_stats *st);
+
+/* Argument capture */
+static inline uint64_t blog_int(uint64_t v) { return v; }
+static inline uint64_t blog_dbl(double d)
+{
+    union { double d; uint64_t u; } v = { d };
+    return v.u;
+}
+static inline uint64_t blog_ptr(const void *p) { return (uintptr_t)p; }
+
+#define BLOG_ARG(x) _Generic((x),                                       \
+        float: blog_dbl, double: blog_dbl,                              \
+        char *: blog_ptr, const char *: blog_ptr,                       \
+        void *: blog_ptr, const void *: blog_ptr,                       \
+        default: blog_int)(x)
+
+#define BLOG_N(...) BLOG_N_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define BLOG_N_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define BLOG_CAT(a, b) BLOG_CAT_(a, b)
+#define BLOG_CAT_(a, b) a ## b
+#define BLOG_ARGS(...) BLOG_CAT(BLOG_A, BLOG_N(__VA_ARGS__))(__VA_ARGS__)
+#define BLOG_A0()
+#define BLOG_A1(a) BLOG_ARG(a)
+#define BLOG_A2(a, ...) BLOG_ARG(a), BLOG_A1(__VA_ARGS__)
+#define BLOG_A3(a, ...) BLOG_ARG(a), BLOG_A2(__VA_ARGS__)
+#define BLOG_A4(a, ...) BLOG_ARG(a), BLOG_A3(__VA_ARGS__)
+#define BLOG_A5(a, ...) BLOG_ARG(a), BLOG_A4(__VA_ARGS__)
+#define BLOG_A6(a, ...) BLOG_ARG(a), BLOG_A5(__VA_ARGS__)
+#define BLOG_A7(a, ...) BLOG_ARG(a), BLOG_A6(__VA_ARGS__)
+#define BLOG_A8(a, ...) BLOG_ARG(a), BLOG_A7(__VA_ARGS__)
+
+#endif
@@ -0,0 +1,502 @@
+/*
+ * Capture files with a min/max pyramid
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* capfile.c - deep captures on the SD card that open instantly.
+ *
+ * File layout, all little endian, every section page aligned:
+ *
+ *   header      magic, format, channel table with the level offsets
+ *   data        chunk 0 of every channel, chunk 1 of every channel, ...
+ *               (the writer streams a chunk at a time; a reader finds any
+ *               sample with one multiply)
+ *   pyramid     per channel, level 0 has the (min, max) of every 64
+ *               samples, each level above one entry per 16 below it
+ *
+ * The reader maps the whole file and never reads it: drawing a column
+ * range picks the coarsest level that still has an entry per column and
+ * only faults in that level's pages. An overview of 100M samples reads
+ * a few kB of level 3 or 4 instead of 100 MB of samples, so the first
+ * frame does not wait for the card. Zoomed in past 64 samples per
+ * column, it reads samples, and then only those of the visible range.
+ *
+ * The writer keeps level 0 in memory (1/16 of an 8-bit capture's size)
+ * and builds the upper levels from it when the capture is finished. The
+ * header is rewritten as complete at that point; files from interrupted
+ * captures are refused by the reader. The whole file is mapped, which on
+ * the A9 limits it to about 2 GB. */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capfile.h"
+
+#define CAP_MAGIC "DSOCAP\r\n"
+#define CAP_VERSION 1
+#define PAGE 4096
+
+struct file_channel {
+    struct cap_channel info;
+    uint64_t level_offset[CAP_MAX_LEVELS];
+    uint64_t level_count[CAP_MAX_LEVELS];
+};
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t complete;          /* 0 until cap_finish() */
+    uint32_t channels, bits;
+    uint32_t chunk, levels;
+    uint64_t samples;
+    double sample_period;
+    uint64_t data_offset;
+    struct file_channel ch[CAP_MAX_CHANNELS];
+};
+
+struct cap_writer {
+    int fd;
+    struct file_header h;
+    size_t bytes;               /* per sample */
+    uint8_t *buf[CAP_MAX_CHANNELS];
+    size_t fill;                /* samples in buf */
+    uint64_t chunks;            /* written */
+    struct decim_span *lvl0[CAP_MAX_CHANNELS];
+    size_t n0, max0;
+};
+
+struct cap_file {
+    uint8_t *map;
+    size_t size;
+    const struct file_header *h;
+    size_t bytes;
+};
+
+static uint64_t page_align(uint64_t v)
+{
+    return (v + PAGE - 1) & ~(uint64_t)(PAGE - 1);
+}
+
+static int pwrite_all(int fd, const void *p, size_t len, uint64_t off)
+{
+    ssize_t r;
+
+    while (len) {
+        r = pwrite(fd, p, len, off);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p = (const uint8_t *)p + r;
+        len -= r;
+        off += r;
+    }
+    return 0;
+}
+
+static uint64_t chunk_offset(const struct file_header *h, size_t bytes,
+                             uint64_t k, int ch)
+{
+    return h->data_offset + (k * h->channels + ch) * h->chunk * bytes;
+}
+
+static void writer_free(struct cap_writer *w)
+{
+    int c;
+
+    for (c = 0; c < CAP_MAX_CHANNELS; c++) {
+        free(w->buf[c]);
+        free(w->lvl0[c]);
+    }
+    free(w);
+}
+
+struct cap_writer *cap_create(const char *path, const struct cap_info *info,
+                              const struct cap_channel *ch)
+{
+    struct cap_writer *w;
+    int c;
+
+    if (info->channels < 1 || info->channels > CAP_MAX_CHANNELS ||
+        (info->bits != 8 && info->bits != 16) || info->chunk % CAP_BASE) {
+        errno = EINVAL;
+        return NULL;
+    }
+    w = calloc(1, sizeof(*w));
+    if (!w)
+        return NULL;
+    memcpy(w->h.magic, CAP_MAGIC, 8);
+    w->h.version = CAP_VERSION;
+    w->h.channels = info->channels;
+    w->h.bits = info->bits;
+    w->h.chunk = info->chunk ? info->chunk : CAP_DEFAULT_CHUNK;
+    w->h.sample_period = info->sample_period;
+    w->h.data_offset = PAGE;
+    w->bytes = info->bits / 8;
+    for (c = 0; c < info->channels; c++) {
+        w->h.ch[c].info = ch[c];
+        w->buf[c] = malloc(w->h.chunk * w->bytes);
+        if (!w->buf[c]) {
+            writer_free(w);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
+    w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        writer_free(w);
+        return NULL;
+    }
+    /* marked incomplete until finished */
+    if (pwrite_all(w->fd, &w->h, sizeof(w->h), 0)) {
+        close(w->fd);
+        writer_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/* Writes the chunk being filled and adds its level 0 entries */
+static int flush(struct cap_writer *w)
+{
+    size_t need = w->n0 + (w->fill + CAP_BASE - 1) / CAP_BASE, i, len, e;
+    struct decim_span *p;
+    const uint8_t *s;
+    int c;
+
+    if (!w->fill)
+        return 0;
+    if (need > w->max0) {
+        w->max0 = need * 2;
+        for (c = 0; c < (int)w->h.channels; c++) {
+            p = realloc(w->lvl0[c], w->max0 * sizeof(*p));
+            if (!p)
+                return -1;
+            w->lvl0[c] = p;
+        }
+    }
+    for (c = 0; c < (int)w->h.channels; c++) {
+        if (pwrite_all(w->fd, w->buf[c], w->fill * w->bytes,
+                       chunk_offset(&w->h, w->bytes, w->chunks, c)))
+            return -1;
+        for (i = 0, e = w->n0; i < w->fill; i += CAP_BASE, e++) {
+            len = w->fill - i < CAP_BASE ? w->fill - i : CAP_BASE;
+            s = w->buf[c] + i * w->bytes;
+            if (w->bytes == 1) {
+                int8_t mn, mx;
+
+                decim_block_s8((const int8_t *)s, len, &mn, &mx);
+                w->lvl0[c][e].min = mn;
+                w->lvl0[c][e].max = mx;
+            } else {
+                decim_block_s16((const int16_t *)s, len, &w->lvl0[c][e].min,
+                                &w->lvl0[c][e].max);
+            }
+        }
+    }
+    w->n0 = need;
+    w->h.samples += w->fill;
+    w->chunks++;
+    w->fill = 0;
+    return 0;
+}
+
+int cap_write(struct cap_writer *w, const void *const src[], size_t n)
+{
+    size_t k, done = 0;
+    int c;
+
+    while (done < n) {
+        k = w->h.chunk - w->fill < n - done ? w->h.chunk - w->fill : n - done;
+        for (c = 0; c < (int)w->h.channels; c++)
+            memcpy(w->buf[c] + w->fill * w->bytes,
+                   (const uint8_t *)src[c] + done * w->bytes, k * w->bytes);
+        w->fill += k;
+        done += k;
+        if (w->fill == w->h.chunk && flush(w))
+            return -1;
+    }
+    return 0;
+}
+
+/* Builds and writes the levels of channel c from offset *off on */
+static int write_levels(struct cap_writer *w, int c, uint64_t *off)
+{
+    struct decim_span *cur = w->lvl0[c], *next;
+    size_t n = w->n0, i, m;
+    int l, ret = 0;
+
+    for (l = 0; l < CAP_MAX_LEVELS && n; l++) {
+        w->h.ch[c].level_offset[l] = *off;
+        w->h.ch[c].level_count[l] = n;
+        if (pwrite_all(w->fd, cur, n * sizeof(*cur), *off)) {
+            ret = -1;
+            break;
+        }
+        *off = page_align(*off + n * sizeof(*cur));
+        if ((int)w->h.levels < l + 1)
+            w->h.levels = l + 1;
+        /* up to a level that fits a few columns */
+        if (n <= CAP_FACTOR || l + 1 == CAP_MAX_LEVELS)
+            break;
+        m = (n + CAP_FACTOR - 1) / CAP_FACTOR;
+        next = malloc(m * sizeof(*next));
+        if (!next) {
+            ret = -1;
+            break;
+        }
+        for (i = 0; i < m; i++)
+            decim_reduce(cur + i * CAP_FACTOR, n - i * CAP_FACTOR < CAP_FACTOR ?
+                         n - i * CAP_FACTOR : CAP_FACTOR, &next[i]);
+        if (cur != w->lvl0[c])
+            free(cur);
+        cur = next;
+        n = m;
+    }
+    if (cur != w->lvl0[c])
+        free(cur);
+    return ret;
+}
+
+int cap_finish(struct cap_writer *w)
+{
+    uint64_t off;
+    int c, ret = flush(w);
+
+    off = page_align(chunk_offset(&w->h, w->bytes, w->chunks, 0));
+    for (c = 0; !ret && c < (int)w->h.channels; c++)
+        ret = write_levels(w, c, &off);
+    if (!ret) {
+        w->h.complete = 1;
+        ret = pwrite_all(w->fd, &w->h, sizeof(w->h), 0);
+    }
+    if (!ret)
+        ret = ftruncate(w->fd, off);
+    if (close(w->fd))
+        ret = -1;
+    writer_free(w);
+    return ret;
+}
+
+static int header_ok(const struct file_header *h, size_t size)
+{
+    uint64_t chunks, bytes = h->bits / 8;
+    unsigned int c, l;
+
+    if (memcmp(h->magic, CAP_MAGIC, 8) || h->version != CAP_VERSION ||
+        !h->complete || h->channels < 1 || h->channels > CAP_MAX_CHANNELS ||
+        (h->bits != 8 && h->bits != 16) || !h->chunk || h->chunk % CAP_BASE ||
+        h->levels > CAP_MAX_LEVELS)
+        return 0;
+    /* the last channel's slot of the last, possibly partial chunk */
+    chunks = (h->samples + h->chunk - 1) / h->chunk;
+    if (chunks && chunk_offset(h, bytes, chunks - 1, h->channels - 1) +
+        (h->samples - (chunks - 1) * h->chunk) * bytes > size)
+        return 0;
+    for (c = 0; c < h->channels; c++)
+        for (l = 0; l < h->levels; l++)
+            if (h->ch[c].level_offset[l] +
+                h->ch[c].level_count[l] * sizeof(struct decim_span) > size)
+                return 0;
+    return 1;
+}
+
+struct cap_file *cap_open(const char *path)
+{
+    struct cap_file *f;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+    f = calloc(1, sizeof(*f));
+    if (!f || fstat(fd, &st)) {
+        free(f);
+        close(fd);
+        return NULL;
+    }
+    f->size = st.st_size;
+    if (f->size < PAGE) {
+        errno = EINVAL;
+        goto fail;
+    }
+    f->map = mmap(NULL, f->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (f->map == MAP_FAILED)
+        goto fail;
+    close(fd);
+    f->h = (const struct file_header *)f->map;
+    if (!header_ok(f->h, f->size)) {
+        munmap(f->map, f->size);
+        free(f);
+        errno = EINVAL;
+        return NULL;
+    }
+    f->bytes = f->h->bits / 8;
+    return f;
+
+fail:
+    close(fd);
+    free(f);
+    return NULL;
+}
+
+void cap_close(struct cap_file *f)
+{
+    if (!f)
+        return;
+    munmap(f->map, f->size);
+    free(f);
+}
+
+void cap_get_info(struct cap_file *f, struct cap_info *info)
+{
+    info->channels = f->h->channels;
+    info->bits = f->h->bits;
+    info->sample_period = f->h->sample_period;
+    info->chunk = f->h->chunk;
+    info->samples = f->h->samples;
+    info->levels = f->h->levels;
+}
+
+const struct cap_channel *cap_get_channel(struct cap_file *f, int ch)
+{
+    if (ch < 0 || ch >= (int)f->h->channels) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return &f->h->ch[ch].info;
+}
+
+const struct decim_span *cap_level(struct cap_file *f, int ch, int level,
+                                   size_t *n)
+{
+    if (ch < 0 || ch >= (int)f->h->channels || level < 0 ||
+        level >= (int)f->h->levels) {
+        errno = EINVAL;
+        return NULL;
+    }
+    *n = f->h->ch[ch].level_count[level];
+    return (const struct decim_span *)(f->map +
+                                       f->h->ch[ch].level_offset[level]);
+}
+
+/* Samples of channel ch from s on that are contiguous in the file */
+static const uint8_t *piece(struct cap_file *f, int ch, uint64_t s,
+                            size_t *len)
+{
+    uint64_t k = s / f->h->chunk, o = s % f->h->chunk;
+
+    *len = f->h->chunk - o;
+    if (*len > f->h->samples - s)
+        *len = f->h->samples - s;
+    return f->map + chunk_offset(f->h, f->bytes, k, ch) + o * f->bytes;
+}
+
+size_t cap_read(struct cap_file *f, int ch, uint64_t first, void *dst,
+                size_t n)
+{
+    const uint8_t *p;
+    size_t len, done = 0;
+
+    if (ch < 0 || ch >= (int)f->h->channels || first >= f->h->samples)
+        return 0;
+    if (n > f->h->samples - first)
+        n = f->h->samples - first;
+    while (done < n) {
+        p = piece(f, ch, first + done, &len);
+        if (len > n - done)
+            len = n - done;
+        memcpy((uint8_t *)dst + done * f->bytes, p, len * f->bytes);
+        done += len;
+    }
+    return n;
+}
+
+/* Envelope of samples a .. b straight from the data */
+static void raw_span(struct cap_file *f, int ch, uint64_t a, uint64_t b,
+                     struct decim_span *out)
+{
+    const uint8_t *p;
+    int16_t mn, mx;
+    int8_t mn8, mx8;
+    size_t len;
+
+    out->min = INT16_MAX;
+    out->max = INT16_MIN;
+    while (a < b) {
+        p = piece(f, ch, a, &len);
+        if (len > b - a)
+            len = b - a;
+        if (f->bytes == 1) {
+            decim_block_s8((const int8_t *)p, len, &mn8, &mx8);
+            mn = mn8;
+            mx = mx8;
+        } else {
+            decim_block_s16((const int16_t *)p, len, &mn, &mx);
+        }
+        if (mn < out->min)
+            out->min = mn;
+        if (mx > out->max)
+            out->max = mx;
+        a += len;
+    }
+}
+
+long cap_render(struct cap_file *f, int ch, struct decim_span *out, int cols,
+                uint64_t first, uint64_t count)
+{
+    uint64_t per, g = CAP_BASE, a, b;
+    const struct decim_span *lvl;
+    size_t n;
+    int l = 0, c;
+
+    if (ch < 0 || ch >= (int)f->h->channels || cols <= 0 || !count ||
+        first > f->h->samples || count > f->h->samples - first) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    per = count / cols;
+    if (per >= CAP_BASE && f->h->levels) {
+        while (l + 1 < (int)f->h->levels && g * CAP_FACTOR <= per) {
+            g *= CAP_FACTOR;
+            l++;
+        }
+        lvl = cap_level(f, ch, l, &n);
+        decim_spans(out, cols, lvl, n, g, first, count);
+        return g;
+    }
+
+    for (c = 0; c < cols; c++) {
+        a = first + (uint64_t)c * count / cols;
+        b = first + (uint64_t)(c + 1) * count / cols;
+        if (b == a)
+            b = a + 1;
+        raw_span(f, ch, a, b, &out[c]);
+    }
+    return 1;
+}
@@ -0,0 +1,83 @@
+/*
+ * Capture files with a min/max pyramid
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __CAPFILE_H
+#define __CAPFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decimate.h"
+
+#define CAP_MAX_CHANNELS 8
+#define CAP_MAX_LEVELS 8
+#define CAP_BASE 64             /* samples per entry of level 0 */
+#define CAP_FACTOR 16           /* entries per entry of the level above */
+#define CAP_DEFAULT_CHUNK (1 << 20)
+
+struct cap_info {
+    int channels;               /* 1 .. CAP_MAX_CHANNELS */
+    int bits;                   /* 8 or 16 */
+    double sample_period;       /* seconds */
+    uint32_t chunk;             /* samples per chunk and channel, a multiple
+                                   of CAP_BASE; 0 for the default */
+    uint64_t samples;           /* per channel; set by the reader */
+    int levels;                 /* set by the reader */
+};
+
+struct cap_channel {
+    char name[16];
+    double volts_per_lsb, offset;
+};
+
+/* Writing. cap_write() appends n samples to every channel, src[c] holding
+   those of channel c; sample data goes to the file a chunk at a time.
+   cap_finish() writes the pyramid and the final header, closes the file
+   and frees w, also when it fails. Errors return -1 / NULL with errno. */
+struct cap_writer;
+
+struct cap_writer *cap_create(const char *path, const struct cap_info *info,
+                              const struct cap_channel *ch);
+int cap_write(struct cap_writer *w, const void *const src[], size_t n);
+int cap_finish(struct cap_writer *w);
+
+/* Reading, through a read-only mapping of the file */
+struct cap_file;
+
+struct cap_file *cap_open(const char *path);
+void cap_close(struct cap_file *f);
+void cap_get_info(struct cap_file *f, struct cap_info *info);
+const struct cap_channel *cap_get_channel(struct cap_file *f, int ch);
+
+/* Level l of channel ch: n entries of CAP_BASE * CAP_FACTOR^l samples */
+const struct decim_span *cap_level(struct cap_file *f, int ch, int level,
+                                   size_t *n);
+
+/* Copies up to n raw samples from sample first on; returns how many */
+size_t cap_read(struct cap_file *f, int ch, uint64_t first, void *dst,
+                size_t n);
+
+/* Column envelopes for samples first .. first + count, as
+   decim_minmax_*() would give them, from the coarsest level with at least
+   one entry per column, or from the samples when zoomed in further (see
+   decim_spans() for the precision). Only that level's pages are touched.
+   Returns the samples per entry used, 1 for raw samples, or -1. */
+long cap_render(struct cap_file *f, int ch, struct decim_span *out, int cols,
+                uint64_t first, uint64_t count);
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ * Dirty-rectangle compositor for the scope display
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* compositor.c - layer composition into the frmbuf scanout buffers.
+ *
+ * Layers report what they changed as rectangles in screen coordinates.
+ * At compose time those are collected into the damage of the new frame,
+ * which is kept in a short history. With several scanout buffers, the back
+ * buffer handed out by frmbuf still shows the frame it was last composed
+ * with, so it gets the union of the damage of all frames since then; a
+ * buffer that is too old (or new) is composed in full. Within a damaged
+ * rectangle the composition starts at the topmost opaque layer covering
+ * it, so the static background is not copied under the waveform area.
+ *
+ * Not thread safe: layers are drawn and composed from the UI thread. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "compositor.h"
+
+struct compositor_layer {
+    struct compositor *c;
+    int z;
+    struct pixconv_surface *surf;
+    int x, y, flags, visible;
+    uint8_t key[3];                     /* R, G, B */
+    struct compositor_damage damage;    /* screen coordinates */
+};
+
+struct compositor {
+    int width, height;
+    struct compositor_layer *layers[COMPOSITOR_MAX_LAYERS]; /* by z */
+    int n_layers;
+
+    struct compositor_damage damage;    /* of removed layers */
+
+    uint64_t frame;
+    struct compositor_damage hist[COMPOSITOR_HISTORY];
+    uint64_t buf_frame[FRMBUF_MAX_BUFFERS];     /* 0: never composed */
+
+    struct compositor_stats stats;
+};
+
+static long area(const struct pixconv_rect *r)
+{
+    return (long)r->w * r->h;
+}
+
+static int intersect(struct pixconv_rect *out, const struct pixconv_rect *a,
+                     const struct pixconv_rect *b)
+{
+    int x0 = a->x > b->x ? a->x : b->x;
+    int y0 = a->y > b->y ? a->y : b->y;
+    int x1 = a->x + a->w < b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h < b->y + b->h ? a->y + a->h : b->y + b->h;
+
+    out->x = x0;
+    out->y = y0;
+    out->w = x1 - x0;
+    out->h = y1 - y0;
+    return out->w > 0 && out->h > 0;
+}
+
+static void bound(struct pixconv_rect *out, const struct pixconv_rect *a,
+                  const struct pixconv_rect *b)
+{
+    int x0 = a->x < b->x ? a->x : b->x;
+    int y0 = a->y < b->y ? a->y : b->y;
+    int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+
+    out->x = x0;
+    out->y = y0;
+    out->w = x1 - x0;
+    out->h = y1 - y0;
+}
+
+static int contains(const struct pixconv_rect *a, const struct pixconv_rect *b)
+{
+    return b->x >= a->x && b->y >= a->y &&
+           b->x + b->w <= a->x + a->w && b->y + b->h <= a->y + a->h;
+}
+
+static void damage_remove(struct compositor_damage *d, int i)
+{
+    d->r[i] = d->r[--d->n];
+}
+
+/* Rectangles are merged when their bounding box costs no more pixels than
+   the two apart; when the list is full, the pair growing least is. */
+void compositor_damage_add(struct compositor_damage *d,
+                           const struct pixconv_rect *r)
+{
+    struct pixconv_rect u;
+    long grow, best_grow = -1;
+    int i, best = 0;
+
+    if (r->w <= 0 || r->h <= 0)
+        return;
+
+    for (i = 0; i < d->n; i++) {
+        if (contains(&d->r[i], r))
+            return;
+        bound(&u, &d->r[i], r);
+        if (area(&u) <= area(&d->r[i]) + area(r)) {
+            damage_remove(d, i);
+            compositor_damage_add(d, &u);
+            return;
+        }
+        grow = area(&u) - area(&d->r[i]);
+        if (best_grow < 0 || grow < best_grow) {
+            best_grow = grow;
+            best = i;
+        }
+    }
+
+    if (d->n < COMPOSITOR_MAX_RECTS) {
+        d->r[d->n++] = *r;
+        return;
+    }
+    bound(&u, &d->r[best], r);
+    damage_remove(d, best);
+    compositor_damage_add(d, &u);
+}
+
+static void layer_rect(const struct compositor_layer *l, struct pixconv_rect *r)
+{
+    r->x = l->x;
+    r->y = l->y;
+    r->w = l->surf->width;
+    r->h = l->surf->height;
+}
+
+/* Damages the on-screen area of l, clipped by r (screen coordinates) */
+static void layer_damage_screen(struct compositor_layer *l,
+                                const struct pixconv_rect *r)
+{
+    struct pixconv_rect screen = {0, 0, l->c->width, l->c->height};
+    struct pixconv_rect lr, a, b;
+
+    layer_rect(l, &lr);
+    if (!r)
+        r = &lr;
+    if (intersect(&a, r, &lr) && intersect(&b, &a, &screen))
+        compositor_damage_add(&l->damage, &b);
+}
+
+struct compositor *compositor_create(int width, int height)
+{
+    struct compositor *c;
+
+    if (width <= 0 || height <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    c = calloc(1, sizeof(*c));
+    if (!c)
+        return NULL;
+    c->width = width;
+    c->height = height;
+    return c;
+}
+
+void compositor_destroy(struct compositor *c)
+{
+    while (c->n_layers)
+        compositor_layer_destroy(c->layers[0]);
+    free(c);
+}
+
+struct compositor_layer *compositor_layer_create(struct compositor *c, int z,
+                                                 struct pixconv_surface *surf,
+                                                 int x, int y, int flags,
+                                                 uint32_t key)
+{
+    struct compositor_layer *l;
+    int i;
+
+    if (c->n_layers == COMPOSITOR_MAX_LAYERS ||
+        pixconv_bpp(surf->fmt) == 0 ||
+        ((flags & COMPOSITOR_LAYER_KEYED) && surf->fmt != PIXCONV_RGB888)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    l = calloc(1, sizeof(*l));
+    if (!l)
+        return NULL;
+    l->c = c;
+    l->z = z;
+    l->surf = surf;
+    l->x = x;
+    l->y = y;
+    l->flags = flags;
+    l->visible = 1;
+    l->key[0] = key >> 16;
+    l->key[1] = key >> 8;
+    l->key[2] = key;
+
+    /* stable insertion: equal z stacks in creation order */
+    for (i = c->n_layers; i > 0 && c->layers[i - 1]->z > z; i--)
+        c->layers[i] = c->layers[i - 1];
+    c->layers[i] = l;
+    c->n_layers++;
+
+    layer_damage_screen(l, NULL);
+    return l;
+}
+
+void compositor_layer_destroy(struct compositor_layer *l)
+{
+    struct compositor *c = l->c;
+    struct pixconv_rect screen = {0, 0, c->width, c->height};
+    struct pixconv_rect lr, r;
+    int i;
+
+    for (i = 0; i < c->n_layers && c->layers[i] != l; i++)
+        ;
+    for (; i < c->n_layers - 1; i++)
+        c->layers[i] = c->layers[i + 1];
+    c->n_layers--;
+
+    /* whatever it covered or had pending has to be redrawn without it */
+    layer_rect(l, &lr);
+    if (l->visible && intersect(&r, &lr, &screen))
+        compositor_damage_add(&c->damage, &r);
+    for (i = 0; i < l->damage.n; i++)
+        compositor_damage_add(&c->damage, &l->damage.r[i]);
+    free(l);
+}
+
+void compositor_layer_damage(struct compositor_layer *l,
+                             const struct pixconv_rect *r)
+{
+    struct pixconv_rect s;
+
+    if (!l->visible)
+        return;
+    if (!r) {
+        layer_damage_screen(l, NULL);
+        return;
+    }
+    s.x = r->x + l->x;
+    s.y = r->y + l->y;
+    s.w = r->w;
+    s.h = r->h;
+    layer_damage_screen(l, &s);
+}
+
+void compositor_layer_move(struct compositor_layer *l, int x, int y)
+{
+    struct pixconv_rect screen = {0, 0, l->c->width, l->c->height};
+    struct pixconv_rect old, r;
+
+    if (x == l->x && y == l->y)
+        return;
+    if (l->visible) {
+        layer_rect(l, &old);
+        if (intersect(&r, &old, &screen))
+            compositor_damage_add(&l->damage, &r);
+    }
+    l->x = x;
+    l->y = y;
+    if (l->visible)
+        layer_damage_screen(l, NULL);
+}
+
+void compositor_layer_show(struct compositor_layer *l, int visible)
+{
+    struct pixconv_rect screen = {0, 0, l->c->width, l->c->height};
+    struct pixconv_rect lr, r;
+
+    visible = !!visible;
+    if (visible == l->visible)
+        return;
+    /* damage is kept while hidden: the area has to be uncovered */
+    layer_rect(l, &lr);
+    if (intersect(&r, &lr, &screen))
+        compositor_damage_add(&l->damage, &r);
+    l->visible = visible;
+}
+
+static uint64_t fill_black(struct pixconv_surface *dst,
+                           const struct pixconv_rect *r)
+{
+    uint8_t *d = dst->ptr + r->y * dst->stride + r->x * 3;
+    int y;
+
+    for (y = 0; y < r->h; y++, d += dst->stride)
+        memset(d, 0, r->w * 3);
+    return (uint64_t)r->w * r->h * 3;
+}
+
+static uint64_t blit_keyed(uint8_t *d, int dstride, const uint8_t *s,
+                           int sstride, int w, int h, const uint8_t *key)
+{
+    uint64_t n = 0;
+    int x, y;
+
+    for (y = 0; y < h; y++, d += dstride, s += sstride) {
+        for (x = 0; x < w * 3; x += 3) {
+            if (s[x] == key[0] && s[x + 1] == key[1] && s[x + 2] == key[2])
+                continue;
+            d[x] = s[x];
+            d[x + 1] = s[x + 1];
+            d[x + 2] = s[x + 2];
+            n++;
+        }
+    }
+    return n * 3;
+}
+
+static uint64_t compose_rect(struct compositor *c, struct pixconv_surface *dst,
+                             const struct pixconv_rect *r)
+{
+    struct pixconv_surface sv, dv;
+    struct pixconv_rect lr, i;
+    struct compositor_layer *l;
+    uint64_t bytes = 0;
+    int n, first = -1;
+
+    /* nothing below an opaque layer covering the whole rectangle shows */
+    for (n = c->n_layers - 1; n >= 0 && first < 0; n--) {
+        l = c->layers[n];
+        layer_rect(l, &lr);
+        if (l->visible && !(l->flags & COMPOSITOR_LAYER_KEYED) &&
+            contains(&lr, r))
+            first = n;
+    }
+    if (first < 0) {
+        bytes += fill_black(dst, r);
+        first = 0;
+    }
+
+    for (n = first; n < c->n_layers; n++) {
+        l = c->layers[n];
+        layer_rect(l, &lr);
+        if (!l->visible || !intersect(&i, &lr, r))
+            continue;
+
+        sv = *l->surf;
+        sv.ptr += (i.y - l->y) * sv.stride +
+                  (i.x - l->x) * pixconv_bpp(sv.fmt);
+        if (l->flags & COMPOSITOR_LAYER_KEYED) {
+            bytes += blit_keyed(dst->ptr + i.y * dst->stride + i.x * 3,
+                                dst->stride, sv.ptr, sv.stride, i.w, i.h,
+                                l->key);
+            continue;
+        }
+        sv.width = i.w;
+        sv.height = i.h;
+        dv = *dst;
+        dv.ptr += i.y * dv.stride + i.x * 3;
+        dv.width = i.w;
+        dv.height = i.h;
+        bytes += (uint64_t)pixconv_blit(&dv, &sv, NULL, 0) * 3;
+    }
+    return bytes;
+}
+
+uint64_t compositor_compose(struct compositor *c, struct frmbuf_buffer *back)
+{
+    struct pixconv_surface dst = {back->ptr, back->width, back->height,
+                                  back->stride, PIXCONV_RGB888};
+    struct pixconv_rect screen = {0, 0, c->width, c->height}, r;
+    struct compositor_damage *cur, todo;
+    uint64_t last, f, bytes = 0;
+    int full, i, j;
+
+    if (dst.width > c->width)
+        dst.width = c->width;
+    if (dst.height > c->height)
+        dst.height = c->height;
+    screen.w = dst.width;
+    screen.h = dst.height;
+
+    if (back->index < 0 || back->index >= FRMBUF_MAX_BUFFERS)
+        return compose_rect(c, &dst, &screen);
+
+    cur = &c->hist[++c->frame % COMPOSITOR_HISTORY];
+    *cur = c->damage;
+    c->damage.n = 0;
+    for (i = 0; i < c->n_layers; i++) {
+        struct compositor_layer *l = c->layers[i];
+
+        for (j = 0; j < l->damage.n; j++)
+            compositor_damage_add(cur, &l->damage.r[j]);
+        l->damage.n = 0;
+    }
+
+    last = c->buf_frame[back->index];
+    full = !last || c->frame - last > COMPOSITOR_HISTORY;
+    todo.n = 0;
+    if (full) {
+        compositor_damage_add(&todo, &screen);
+    } else {
+        for (f = last + 1; f <= c->frame; f++) {
+            struct compositor_damage *d = &c->hist[f % COMPOSITOR_HISTORY];
+
+            for (j = 0; j < d->n; j++)
+                compositor_damage_add(&todo, &d->r[j]);
+        }
+    }
+
+    for (i = 0; i < todo.n; i++)
+        if (intersect(&r, &todo.r[i], &screen))
+            bytes += compose_rect(c, &dst, &r);
+    c->buf_frame[back->index] = c->frame;
+
+    c->stats.frames++;
+    c->stats.bytes_written += bytes;
+    c->stats.last_bytes = bytes;
+    c->stats.last_rects = todo.n;
+    c->stats.last_full = full;
+    return bytes;
+}
+
+void compositor_get_stats(struct compositor *c, struct compositor_stats *st)
+{
+    *st = c->stats;
+}
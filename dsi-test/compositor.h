@@ -0,0 +1,86 @@
+/*
+ * Dirty-rectangle compositor for the scope display
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __COMPOSITOR_H
+#define __COMPOSITOR_H
+
+#include <stdint.h>
+
+#include "frmbuf.h"
+#include "pixconv.h"
+
+#define COMPOSITOR_MAX_LAYERS 8
+/* rectangles kept per damage region before they get merged */
+#define COMPOSITOR_MAX_RECTS 16
+/* frames of damage history, enough for FRMBUF_MAX_BUFFERS buffers */
+#define COMPOSITOR_HISTORY 8
+
+/* z order of the usual scope layers */
+enum compositor_z {
+    COMPOSITOR_Z_BACKGROUND = 0,    /* graticule, static labels */
+    COMPOSITOR_Z_WAVEFORM = 1,
+    COMPOSITOR_Z_OVERLAY = 2,       /* cursors, readouts */
+    COMPOSITOR_Z_MENU = 3
+};
+
+/* pixels of an RGB888 layer equal to the key color are transparent */
+#define COMPOSITOR_LAYER_KEYED (1 << 0)
+
+struct compositor_damage {
+    int n;
+    struct pixconv_rect r[COMPOSITOR_MAX_RECTS];
+};
+
+struct compositor_stats {
+    uint64_t frames;
+    uint64_t bytes_written;     /* all frames */
+    uint64_t last_bytes;        /* last composed frame */
+    int last_rects;
+    int last_full;              /* last frame needed a full recompose */
+};
+
+struct compositor;
+struct compositor_layer;
+
+struct compositor *compositor_create(int width, int height);
+void compositor_destroy(struct compositor *c);
+
+/* The surface stays owned by the caller, who draws into it and then
+   reports the changed area with compositor_layer_damage() */
+struct compositor_layer *compositor_layer_create(struct compositor *c, int z,
+                                                 struct pixconv_surface *surf,
+                                                 int x, int y, int flags,
+                                                 uint32_t key);
+void compositor_layer_destroy(struct compositor_layer *l);
+/* r in layer coordinates, NULL for the whole layer */
+void compositor_layer_damage(struct compositor_layer *l,
+                             const struct pixconv_rect *r);
+void compositor_layer_move(struct compositor_layer *l, int x, int y);
+void compositor_layer_show(struct compositor_layer *l, int visible);
+
+/* Brings the back buffer up to date, recomposing only what changed since
+   that buffer was last composed. Returns the bytes written. A buffer with
+   a negative index (e.g. a screenshot) gets a full composition of the
+   current state and leaves the damage bookkeeping alone. */
+uint64_t compositor_compose(struct compositor *c, struct frmbuf_buffer *back);
+void compositor_get_stats(struct compositor *c, struct compositor_stats *st);
+
+void compositor_damage_add(struct compositor_damage *d,
+                           const struct pixconv_rect *r);
+
+#endif
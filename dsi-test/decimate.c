@@ -0,0 +1,344 @@
+/*
+ * Min/max column decimation and rasterization of waveforms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* decimate.c - from millions of samples to one span per pixel column.
+ *
+ * A record is reduced to the (min, max) envelope of each display column,
+ * which keeps every glitch visible no matter the zoom. The block kernels
+ * run two independent vmin/vmax accumulator chains over 32 bytes per
+ * iteration, so the Cortex-A9 NEON pipeline is fed while the loads stream
+ * in; the lanes are folded with pairwise vpmin/vpmax at the end of each
+ * column. The rasterizer then fills one vertical run per column. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DECIM_NEON
+#endif
+
+#include "decimate.h"
+
+void decim_block_s8(const int8_t *src, size_t n, int8_t *min, int8_t *max)
+{
+    int8_t mn = INT8_MAX, mx = INT8_MIN;
+
+#ifdef DECIM_NEON
+    if (n >= 32) {
+        int8x16_t mn0 = vdupq_n_s8(INT8_MAX), mn1 = mn0;
+        int8x16_t mx0 = vdupq_n_s8(INT8_MIN), mx1 = mx0;
+        int8x8_t l, h;
+
+        for (; n >= 32; n -= 32, src += 32) {
+            int8x16_t a = vld1q_s8(src), b = vld1q_s8(src + 16);
+
+            __builtin_prefetch(src + 256);
+            mn0 = vminq_s8(mn0, a);
+            mx0 = vmaxq_s8(mx0, a);
+            mn1 = vminq_s8(mn1, b);
+            mx1 = vmaxq_s8(mx1, b);
+        }
+        mn0 = vminq_s8(mn0, mn1);
+        mx0 = vmaxq_s8(mx0, mx1);
+        l = vmin_s8(vget_low_s8(mn0), vget_high_s8(mn0));
+        h = vmax_s8(vget_low_s8(mx0), vget_high_s8(mx0));
+        l = vpmin_s8(l, l);
+        h = vpmax_s8(h, h);
+        l = vpmin_s8(l, l);
+        h = vpmax_s8(h, h);
+        l = vpmin_s8(l, l);
+        h = vpmax_s8(h, h);
+        mn = vget_lane_s8(l, 0);
+        mx = vget_lane_s8(h, 0);
+    }
+#endif
+    for (; n > 0; n--, src++) {
+        if (*src < mn)
+            mn = *src;
+        if (*src > mx)
+            mx = *src;
+    }
+    *min = mn;
+    *max = mx;
+}
+
+void decim_block_s16(const int16_t *src, size_t n, int16_t *min, int16_t *max)
+{
+    int16_t mn = INT16_MAX, mx = INT16_MIN;
+
+#ifdef DECIM_NEON
+    if (n >= 16) {
+        int16x8_t mn0 = vdupq_n_s16(INT16_MAX), mn1 = mn0;
+        int16x8_t mx0 = vdupq_n_s16(INT16_MIN), mx1 = mx0;
+        int16x4_t l, h;
+
+        for (; n >= 16; n -= 16, src += 16) {
+            int16x8_t a = vld1q_s16(src), b = vld1q_s16(src + 8);
+
+            __builtin_prefetch(src + 128);
+            mn0 = vminq_s16(mn0, a);
+            mx0 = vmaxq_s16(mx0, a);
+            mn1 = vminq_s16(mn1, b);
+            mx1 = vmaxq_s16(mx1, b);
+        }
+        mn0 = vminq_s16(mn0, mn1);
+        mx0 = vmaxq_s16(mx0, mx1);
+        l = vmin_s16(vget_low_s16(mn0), vget_high_s16(mn0));
+        h = vmax_s16(vget_low_s16(mx0), vget_high_s16(mx0));
+        l = vpmin_s16(l, l);
+        h = vpmax_s16(h, h);
+        l = vpmin_s16(l, l);
+        h = vpmax_s16(h, h);
+        mn = vget_lane_s16(l, 0);
+        mx = vget_lane_s16(h, 0);
+    }
+#endif
+    for (; n > 0; n--, src++) {
+        if (*src < mn)
+            mn = *src;
+        if (*src > mx)
+            mx = *src;
+    }
+    *min = mn;
+    *max = mx;
+}
+
+void decim_minmax_s8(struct decim_span *out, int cols, const int8_t *src,
+                     size_t n)
+{
+    size_t a, b;
+    int8_t mn, mx;
+    int c;
+
+    for (c = 0; c < cols; c++) {
+        if (!n) {
+            out[c].min = INT16_MAX;
+            out[c].max = INT16_MIN;
+            continue;
+        }
+        a = (uint64_t)c * n / cols;
+        b = (uint64_t)(c + 1) * n / cols;
+        if (b == a)
+            b = a + 1;
+        decim_block_s8(src + a, b - a, &mn, &mx);
+        out[c].min = mn;
+        out[c].max = mx;
+    }
+}
+
+void decim_minmax_s16(struct decim_span *out, int cols, const int16_t *src,
+                      size_t n)
+{
+    size_t a, b;
+    int c;
+
+    for (c = 0; c < cols; c++) {
+        if (!n) {
+            out[c].min = INT16_MAX;
+            out[c].max = INT16_MIN;
+            continue;
+        }
+        a = (uint64_t)c * n / cols;
+        b = (uint64_t)(c + 1) * n / cols;
+        if (b == a)
+            b = a + 1;
+        decim_block_s16(src + a, b - a, &out[c].min, &out[c].max);
+    }
+}
+
+void decim_reduce(const struct decim_span *src, size_t n,
+                  struct decim_span *out)
+{
+    int16_t mn = INT16_MAX, mx = INT16_MIN;
+    size_t i = 0;
+
+#ifdef DECIM_NEON
+    if (n >= 8) {
+        int16x8_t vmn = vdupq_n_s16(INT16_MAX), vmx = vdupq_n_s16(INT16_MIN);
+        int16x8x2_t v;
+        int16x4_t l;
+
+        /* min and max lanes come apart with the de-interleaving load */
+        for (; i + 8 <= n; i += 8) {
+            v = vld2q_s16(&src[i].min);
+            vmn = vminq_s16(vmn, v.val[0]);
+            vmx = vmaxq_s16(vmx, v.val[1]);
+        }
+        l = vmin_s16(vget_low_s16(vmn), vget_high_s16(vmn));
+        l = vpmin_s16(l, l);
+        mn = vget_lane_s16(vpmin_s16(l, l), 0);
+        l = vmax_s16(vget_low_s16(vmx), vget_high_s16(vmx));
+        l = vpmax_s16(l, l);
+        mx = vget_lane_s16(vpmax_s16(l, l), 0);
+    }
+#endif
+    for (; i < n; i++) {
+        if (src[i].min < mn)
+            mn = src[i].min;
+        if (src[i].max > mx)
+            mx = src[i].max;
+    }
+    out->min = mn;
+    out->max = mx;
+}
+
+void decim_spans(struct decim_span *out, int cols,
+                 const struct decim_span *lvl, size_t n, uint64_t g,
+                 uint64_t first, uint64_t count)
+{
+    uint64_t a, b;
+    int c;
+
+    for (c = 0; c < cols; c++) {
+        a = first + (uint64_t)c * count / cols;
+        b = first + (uint64_t)(c + 1) * count / cols;
+        if (b == a)
+            b = a + 1;
+        a /= g;
+        b = (b + g - 1) / g;
+        if (b > n)
+            b = n;
+        if (b <= a) {
+            out[c].min = INT16_MAX;
+            out[c].max = INT16_MIN;
+            continue;
+        }
+        decim_reduce(lvl + a, b - a, &out[c]);
+    }
+}
+
+void decim_connect(struct decim_span *spans, int cols)
+{
+    int c;
+
+    /* right to left, so that every column sees its original neighbour */
+    for (c = cols - 1; c > 0; c--) {
+        struct decim_span p = spans[c - 1], *s = &spans[c];
+
+        if (p.min > p.max || s->min > s->max)
+            continue;
+        if (p.max < s->min)
+            s->min = p.max;
+        if (p.min > s->max)
+            s->max = p.min;
+    }
+}
+
+/* 16.16 fixed point rows per sample step */
+static int64_t row_scale(int lo, int hi, int height)
+{
+    return ((int64_t)(height - 1) << 16) / (hi - lo);
+}
+
+/* Rows covered by a span, 0 at hi; returns 0 if it is empty or out of
+   range, values beyond lo..hi are drawn on the edge */
+static int span_rows(const struct decim_span *s, int lo, int hi,
+                     int64_t scale, int *y0, int *y1)
+{
+    int mn = s->min, mx = s->max;
+
+    if (mn > mx || mn > hi || mx < lo)
+        return 0;
+    if (mn < lo)
+        mn = lo;
+    if (mx > hi)
+        mx = hi;
+    *y0 = (int)(((hi - mx) * scale) >> 16);
+    *y1 = (int)(((hi - mn) * scale) >> 16);
+    return 1;
+}
+
+int decim_rows(int16_t *y0, int16_t *y1, const struct decim_span *spans,
+               int cols, int lo, int hi, int height)
+{
+    int64_t scale;
+    int c, a, b;
+
+    if (hi <= lo || height <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    scale = row_scale(lo, hi, height);
+    for (c = 0; c < cols; c++) {
+        if (span_rows(&spans[c], lo, hi, scale, &a, &b)) {
+            y0[c] = a;
+            y1[c] = b;
+        } else {
+            y0[c] = 1;
+            y1[c] = 0;
+        }
+    }
+    return 0;
+}
+
+int decim_draw(struct pixconv_surface *dst, const struct pixconv_rect *area,
+               const struct decim_span *spans, int lo, int hi, uint32_t rgb)
+{
+    uint8_t r = rgb >> 16, g = rgb >> 8, b = rgb;
+    int bpp = pixconv_bpp(dst->fmt);
+    int c, x, y, y0, y1, cols, total = 0;
+    int64_t scale;
+    uint8_t *p;
+
+    if ((dst->fmt != PIXCONV_RGB888 && dst->fmt != PIXCONV_XRGB8888) ||
+        hi <= lo || area->h <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    scale = row_scale(lo, hi, area->h);
+    cols = area->w;
+    if (area->x + cols > dst->width)
+        cols = dst->width - area->x;
+
+    for (c = area->x < 0 ? -area->x : 0; c < cols; c++) {
+        if (!span_rows(&spans[c], lo, hi, scale, &y0, &y1))
+            continue;
+        y0 += area->y;
+        y1 += area->y;
+        if (y0 < 0)
+            y0 = 0;
+        if (y1 >= dst->height)
+            y1 = dst->height - 1;
+
+        x = area->x + c;
+        p = dst->ptr + y0 * dst->stride + x * bpp;
+        if (bpp == 3) {
+            for (y = y0; y <= y1; y++, p += dst->stride) {
+                p[0] = r;
+                p[1] = g;
+                p[2] = b;
+            }
+        } else {
+            for (y = y0; y <= y1; y++, p += dst->stride) {
+                p[0] = b;
+                p[1] = g;
+                p[2] = r;
+                p[3] = 0xff;
+            }
+        }
+        if (y1 >= y0)
+            total += y1 - y0 + 1;
+    }
+
+    return total;
+}
@@ -0,0 +1,76 @@
+/*
+ * Min/max column decimation and rasterization of waveforms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DECIMATE_H
+#define __DECIMATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pixconv.h"
+
+/* Envelope of the samples falling onto one pixel column */
+struct decim_span {
+    int16_t min, max;
+};
+
+/* Splits n samples into cols equal columns (column c covers samples
+   c * n / cols up to (c + 1) * n / cols) and stores the envelope of each.
+   With fewer samples than columns a column holds the sample it falls on;
+   with none, every span is empty (min > max) and skipped when drawn. */
+void decim_minmax_s8(struct decim_span *out, int cols, const int8_t *src,
+                     size_t n);
+void decim_minmax_s16(struct decim_span *out, int cols, const int16_t *src,
+                      size_t n);
+
+/* Envelope of a whole block, n > 0 */
+void decim_block_s8(const int8_t *src, size_t n, int8_t *min, int8_t *max);
+void decim_block_s16(const int16_t *src, size_t n, int16_t *min, int16_t *max);
+
+/* Envelope of n spans, n > 0: one entry of a coarser min/max level */
+void decim_reduce(const struct decim_span *src, size_t n,
+                  struct decim_span *out);
+
+/* Columns from a precomputed level whose entry e is the envelope of
+   samples e * g up to (e + 1) * g; n entries. The columns split samples
+   first .. first + count like decim_minmax_*() does, and each gets the
+   envelope of every entry overlapping it, so it is at most one entry
+   wider on each side than the exact one but never misses a sample. */
+void decim_spans(struct decim_span *out, int cols,
+                 const struct decim_span *lvl, size_t n, uint64_t g,
+                 uint64_t first, uint64_t count);
+
+/* Joins each span to its left neighbour so that steep edges between
+   columns draw as a connected trace */
+void decim_connect(struct decim_span *spans, int cols);
+
+/* Maps each span to the rows it covers in a column of the given height,
+   with the same scaling as decim_draw(); empty spans get y0 > y1.
+   Returns -1 with errno = EINVAL for an empty range. */
+int decim_rows(int16_t *y0, int16_t *y1, const struct decim_span *spans,
+               int cols, int lo, int hi, int height);
+
+/* Fills one vertical run per column into an RGB888 or XRGB8888 surface.
+   Column c of spans goes to x = area->x + c for c < area->w; sample value
+   hi maps to the top row of area and lo to the bottom one. rgb is
+   0xRRGGBB. Returns the number of pixels written, -1 with errno = EINVAL
+   for other formats or an empty range. */
+int decim_draw(struct pixconv_surface *dst, const struct pixconv_rect *area,
+               const struct decim_span *spans, int lo, int hi, uint32_t rgb);
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Serial protocol decoders for captured logic data
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* decode.c - protocol state machines stepped at edges only.
+ *
+ * The decoders never look at samples one by one. A line is a bit vector,
+ * and w ^ (w << 1 | last bit of the previous word) has a bit set exactly
+ * where the level changes, so the edges of 32 samples fall out of three
+ * operations and are then taken one at a time with count-trailing-zeros
+ * (rbit + clz on the A9). Quiet stretches go by four words per step on
+ * NEON. The protocol logic runs only at the edges it cares about: UART
+ * at start bits, after which the data bits are read at their centres
+ * directly; SPI at sampling clock edges; I2C at SCL rising edges and at
+ * SDA changes, whose SCL level tells starts and stops apart. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DEC_NEON
+#endif
+
+#include "decode.h"
+
+struct edges {
+    const uint32_t *w;
+    size_t n, nw;       /* samples, words */
+    size_t k;           /* word of the pending edges */
+    uint32_t m;         /* edges of word k not returned yet */
+};
+
+static inline int bit(const uint32_t *w, size_t i)
+{
+    return w[i >> 5] >> (i & 31) & 1;
+}
+
+/* Bit i set where sample 32 k + i differs from the one before it */
+static inline uint32_t word_edges(const uint32_t *w, size_t k)
+{
+    uint32_t prev = k ? w[k - 1] >> 31 : w[0] & 1;
+
+    return w[k] ^ (w[k] << 1 | prev);
+}
+
+/* Edges at samples from 'from' on */
+static void edges_init(struct edges *e, const uint32_t *w, size_t n,
+                       size_t from)
+{
+    e->w = w;
+    e->n = n;
+    e->nw = (n + 31) / 32;
+    e->k = from / 32;
+    e->m = e->k < e->nw ? word_edges(w, e->k) & (~0u << (from & 31)) : 0;
+}
+
+/* Sample index of the next edge, n when there are no more */
+static size_t edges_next(struct edges *e)
+{
+    size_t i;
+
+    while (!e->m) {
+#ifdef DEC_NEON
+        /* four words at a time while nothing changes */
+        while (e->k + 5 <= e->nw) {
+            uint32x4_t v = vld1q_u32(e->w + e->k + 1);
+            uint32x4_t p = vld1q_u32(e->w + e->k);
+            uint32x4_t x = veorq_u32(v, vorrq_u32(vshlq_n_u32(v, 1),
+                                                  vshrq_n_u32(p, 31)));
+            uint32x2_t r = vorr_u32(vget_low_u32(x), vget_high_u32(x));
+
+            if (vget_lane_u32(vpmax_u32(r, r), 0))
+                break;
+            e->k += 4;
+        }
+#endif
+        if (++e->k >= e->nw)
+            return e->n;
+        e->m = word_edges(e->w, e->k);
+    }
+    i = e->k * 32 + __builtin_ctz(e->m);
+    e->m &= e->m - 1;
+    return i < e->n ? i : e->n;
+}
+
+static void annot(struct dec_annot *a, size_t start, size_t end, int value,
+                  int type, int flags)
+{
+    a->start = start;
+    a->end = end;
+    a->value = value;
+    a->type = type;
+    a->flags = flags;
+}
+
+long dec_uart(const struct dec_uart_config *cfg, const uint32_t *rx, size_t n,
+              struct dec_annot *out, size_t max)
+{
+    double bl = cfg->bit_len;
+    int nd = cfg->data_bits, np = cfg->parity != DEC_PARITY_NONE;
+    int idle = !cfg->invert, b, v, ones, flags;
+    size_t cnt = 0, i, stop;
+    struct edges e;
+
+    if (bl < 2 || nd < 5 || nd > 9 || cfg->parity > DEC_PARITY_ODD ||
+        cfg->stop_bits < 1 || cfg->stop_bits > 2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    edges_init(&e, rx, n, 0);
+    while (cnt < max) {
+        i = edges_next(&e);
+        if (i >= n)
+            break;
+        /* start bits are edges away from idle that last to their centre */
+        if (bit(rx, i) == idle)
+            continue;
+        if (i + (1 + nd + np + cfg->stop_bits) * bl > n)
+            break;
+        if (bit(rx, i + (size_t)(0.5 * bl)) == idle)
+            continue;
+
+        v = 0;
+        ones = 0;
+        for (b = 0; b < nd; b++) {
+            if (bit(rx, i + (size_t)((1.5 + b) * bl)) == idle) {
+                v |= 1 << b;
+                ones++;
+            }
+        }
+        flags = 0;
+        if (np) {
+            ones += bit(rx, i + (size_t)((1.5 + nd) * bl)) == idle;
+            if ((ones & 1) != (cfg->parity == DEC_PARITY_ODD))
+                flags |= DEC_F_PARITY;
+        }
+        stop = i + (size_t)((1.5 + nd + np) * bl);
+        if (bit(rx, stop) != idle)
+            flags |= DEC_F_FRAME;
+        annot(&out[cnt++], i, i + (size_t)((1 + nd + np + cfg->stop_bits) *
+                                           bl), v, DEC_UART, flags);
+        /* the next start bit cannot begin before this stop bit's centre */
+        edges_init(&e, rx, n, stop + 1);
+    }
+    return cnt;
+}
+
+long dec_spi(const struct dec_spi_config *cfg, const uint32_t *sclk,
+             const uint32_t *mosi, const uint32_t *miso, const uint32_t *cs,
+             size_t n, struct dec_annot *out, size_t max)
+{
+    int level = cfg->cpol == cfg->cpha;     /* of the sampling edge */
+    int on = !!cfg->cs_active_high, nbits = 0, bo, bi;
+    unsigned int vo = 0, vi = 0;
+    size_t cnt = 0, need = !!mosi + !!miso, i, c, start = 0;
+    struct edges ec, es;
+
+    if (cfg->bits < 1 || cfg->bits > 16) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    edges_init(&ec, sclk, n, 0);
+    c = n;
+    if (cs) {
+        edges_init(&es, cs, n, 0);
+        c = edges_next(&es);
+    }
+    while (cnt + need <= max) {
+        i = edges_next(&ec);
+        if (i >= n)
+            break;
+        if (bit(sclk, i) != level)
+            continue;
+        if (cs) {
+            /* chip select changes since the last clock restart the word */
+            while (c <= i) {
+                nbits = 0;
+                c = edges_next(&es);
+            }
+            if (bit(cs, i) != on)
+                continue;
+        }
+
+        if (!nbits) {
+            start = i;
+            vo = vi = 0;
+        }
+        bo = mosi ? bit(mosi, i) : 0;
+        bi = miso ? bit(miso, i) : 0;
+        if (cfg->lsb_first) {
+            vo |= bo << nbits;
+            vi |= bi << nbits;
+        } else {
+            vo = vo << 1 | bo;
+            vi = vi << 1 | bi;
+        }
+        if (++nbits == cfg->bits) {
+            if (mosi)
+                annot(&out[cnt++], start, i, vo, DEC_SPI_MOSI, 0);
+            if (miso)
+                annot(&out[cnt++], start, i, vi, DEC_SPI_MISO, 0);
+            nbits = 0;
+        }
+    }
+    return cnt;
+}
+
+long dec_i2c(const uint32_t *scl, const uint32_t *sda, size_t n,
+             struct dec_annot *out, size_t max)
+{
+    struct edges ec, ed;
+    size_t cnt = 0, i, j, start = 0;
+    int active = 0, addr = 0, nbits = 0, v = 0, flags;
+
+    edges_init(&ec, scl, n, 0);
+    edges_init(&ed, sda, n, 0);
+    i = edges_next(&ec);
+    j = edges_next(&ed);
+    while (cnt < max && (i < n || j < n)) {
+        if (i <= j) {
+            /* SCL rising: a data bit, or the acknowledge after eight */
+            if (active && bit(scl, i)) {
+                if (!nbits) {
+                    start = i;
+                    v = 0;
+                }
+                if (nbits < 8) {
+                    v = v << 1 | bit(sda, i);
+                } else {
+                    flags = bit(sda, i) ? DEC_F_NACK : 0;
+                    if (addr)
+                        annot(&out[cnt++], start, i, v >> 1, DEC_I2C_ADDR,
+                              flags | (v & 1 ? DEC_F_READ : 0));
+                    else
+                        annot(&out[cnt++], start, i, v, DEC_I2C_DATA, flags);
+                    addr = 0;
+                    nbits = -1;
+                }
+                nbits++;
+            }
+            i = edges_next(&ec);
+        } else {
+            /* SDA moving while SCL is high: start or stop */
+            if (bit(scl, j)) {
+                if (!bit(sda, j)) {
+                    annot(&out[cnt++], j, j, 0, DEC_I2C_START, 0);
+                    active = addr = 1;
+                    nbits = 0;
+                } else if (active) {
+                    annot(&out[cnt++], j, j, 0, DEC_I2C_STOP, 0);
+                    active = 0;
+                }
+            }
+            j = edges_next(&ed);
+        }
+    }
+    return cnt;
+}
+
+/* 8 x 8 bit transpose: byte r bit c <-> byte c bit r */
+static inline uint64_t transpose8(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+void dec_split(const uint8_t *src, size_t n, uint32_t *lines[8])
+{
+    uint64_t x[4];
+    uint8_t tail[32];
+    size_t i;
+    int c, r;
+
+    for (i = 0; i < n; i += 32) {
+        if (i + 32 <= n) {
+            memcpy(x, src + i, 32);
+        } else {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, src + i, n - i);
+            memcpy(x, tail, 32);
+        }
+        /* little endian: sample i + 8 r + b is byte b of x[r] */
+        for (r = 0; r < 4; r++)
+            x[r] = transpose8(x[r]);
+        for (c = 0; c < 8; c++)
+            lines[c][i / 32] = (x[0] >> (8 * c) & 0xff) |
+                               (x[1] >> (8 * c) & 0xff) << 8 |
+                               (x[2] >> (8 * c) & 0xff) << 16 |
+                               (x[3] >> (8 * c) & 0xff) << 24;
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * Serial protocol decoders for captured logic data
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DECODE_H
+#define __DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A line is a packed bit vector: sample i is bit i % 32 of word i / 32.
+ * Captures of up to 2^32 samples.
+ */
+
+enum dec_type {
+    DEC_UART = 0,
+    DEC_SPI_MOSI,
+    DEC_SPI_MISO,
+    DEC_I2C_START,      /* also repeated starts */
+    DEC_I2C_STOP,
+    DEC_I2C_ADDR,       /* 7-bit address in value */
+    DEC_I2C_DATA
+};
+
+#define DEC_F_FRAME     (1 << 0)    /* UART: stop bit not idle */
+#define DEC_F_PARITY    (1 << 1)    /* UART: parity mismatch */
+#define DEC_F_NACK      (1 << 2)    /* I2C: not acknowledged */
+#define DEC_F_READ      (1 << 3)    /* I2C address: read transfer */
+
+/* One decoded item for the display, from sample start to sample end */
+struct dec_annot {
+    uint32_t start, end;
+    uint16_t value;
+    uint8_t type;       /* DEC_* */
+    uint8_t flags;      /* DEC_F_* */
+};
+
+enum dec_parity {
+    DEC_PARITY_NONE = 0,
+    DEC_PARITY_EVEN,
+    DEC_PARITY_ODD
+};
+
+struct dec_uart_config {
+    double bit_len;             /* samples per bit, at least 2 */
+    int data_bits;              /* 5 .. 9, LSB first */
+    enum dec_parity parity;
+    int stop_bits;              /* 1 or 2 */
+    int invert;                 /* idle low */
+};
+
+struct dec_spi_config {
+    int cpol, cpha;             /* SPI mode */
+    int bits;                   /* 1 .. 16 per word */
+    int lsb_first;
+    int cs_active_high;
+};
+
+/* Each returns the number of annotations stored, at most max, or -1 with
+   errno = EINVAL for a bad configuration. A frame still incomplete at the
+   end of the capture is not reported. */
+long dec_uart(const struct dec_uart_config *cfg, const uint32_t *rx, size_t n,
+              struct dec_annot *out, size_t max);
+
+/* mosi, miso and cs may be NULL; every change of cs restarts the word */
+long dec_spi(const struct dec_spi_config *cfg, const uint32_t *sclk,
+             const uint32_t *mosi, const uint32_t *miso, const uint32_t *cs,
+             size_t n, struct dec_annot *out, size_t max);
+
+long dec_i2c(const uint32_t *scl, const uint32_t *sda, size_t n,
+             struct dec_annot *out, size_t max);
+
+/* Splits a capture of one byte per sample, a channel per bit, into eight
+   lines of (n + 31) / 32 words each */
+void dec_split(const uint8_t *src, size_t n, uint32_t *lines[8]);
+
+#endif
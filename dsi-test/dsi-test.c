@@ -1,6 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 #include "ual.h"
 #include "dsi_core.h"
+#include "dsi_model.h"
+#include "blog.h"
 
 #define BASE_DSI 0x60000000
 
@@ -8,7 +14,7 @@ static struct ual_bar_tkn *ubar;
 
 void dsi_write(uint32_t reg, uint32_t val)
 {
-    //printf("DSI write %x %x\n", reg, val);
+    blog("DSI write %x %x\n", reg, val);
     ual_writel(ubar, reg , val);
 }
 
@@ -17,6 +23,14 @@ uint32_t dsi_read(uint32_t reg)
     return ual_readl(ubar, reg );
 }
 
+int dsi_wait(uint32_t reg, uint32_t mask, uint32_t value)
+{
+    struct timespec timeout = {0, DSI_WAIT_TIMEOUT_MS * 1000000};
+
+    /* one request, not one per read, when the core is remote */
+    return ual_readl_poll(ubar, reg, mask, value, &timeout, NULL) ? -1 : 0;
+}
+
 /*1              -> l2
 clk            -> clk
 2              -> l1
@@ -47,30 +61,85 @@ struct dsi_panel_config panel_iphone4 = {
   NULL,		/* user init */
 };
 
-main()
+int main(int argc, char **argv)
 {
 	struct ual_desc_rawmem rawmem;
+    struct ual_desc_remote remote;
+    struct dsi_model *model = NULL;
+    const char *probes = getenv("DSI_PROBE");
+    const char *rtspec = getenv("DSI_RT");
+    struct ual_rt_config rt;
+    int err = 0;
+
+    /* DSI_PROBE=clock|cycles|perf times the driver and libual */
+    if (probes) {
+        static const char *const sources[] = {"off", "clock", "cycles",
+                                              "perf"};
+        int i;
 
-    rawmem.offset = BASE_DSI;
-    rawmem.size = 0x10000;
+        for (i = 0; i < 4 && strcmp(probes, sources[i]); i++)
+            ;
+        if (i == 4 || ual_probe_enable(i))
+            fprintf(stderr, "DSI_PROBE=%s: %s\n", probes,
+                    i == 4 ? "unknown source" : strerror(errno));
+    }
 
-    ubar = ual_open(UAL_BUS_RAWMEM, &rawmem);
+    /* the driver's messages, formatted when the CPU is idle */
+    blog_start(stdout, 100);
+
+    /* DSI_RT=<cpu>[:<priority>] makes the driver a real-time thread;
+       after blog_start(), the drainer keeps to the other cores */
+    if (rtspec && (ual_rt_parse(&rt, rtspec) || ual_rt_setup(&rt)))
+        fprintf(stderr, "DSI_RT=%s: %s\n", rtspec, strerror(errno));
+
+    if (argc > 1 && !strcmp(argv[1], "-m")) {
+        /* run against the behavioral model instead of the hardware */
+        model = dsi_model_create(NULL);
+        ubar = dsi_model_open(model);
+    } else if (argc > 2 && !strcmp(argv[1], "-r")) {
+        /* the core of a board running ualsrv */
+        remote.address = argv[2];
+        ubar = ual_open(UAL_BUS_REMOTE, &remote);
+        if (!ubar) {
+            fprintf(stderr, "%s: %s\n", argv[2], ual_strerror(errno));
+            return 1;
+        }
+    } else {
+        rawmem.offset = BASE_DSI;
+        rawmem.size = 0x10000;
+
+        ubar = ual_open(UAL_BUS_RAWMEM, &rawmem);
+    }
 
 //    printf("ubar %p\n", ubar);
     //ual_writel( ubar, REG_H_FRONT_PORCH, 123 );
     //printf("Rdbk %x\n", ual_readl(ubar, REG_DSI_GPIO) );
 
-    dsi_init(&panel_iphone4);
- 
-    //return 0;
-    usleep(1);
-   // dsi_force_lp(1);
-    dsi_write( REG_TEST_CTL, 0);
-    dsi_write( REG_TEST_XSIZE, 640-1);
-    dsi_write( REG_TEST_YSIZE, 960-1);
-    //getchar();
-    dsi_write( REG_TEST_CTL, 1);
-    //dsi_force_lp(0);
+    if (dsi_init(&panel_iphone4)) {
+        /* a core that never ends an LP byte, or a link that died */
+        fprintf(stderr, "dsi_init: %s\n", ual_strerror(errno));
+        err = 1;
+    } else {
+        //return 0;
+        usleep(1);
+       // dsi_force_lp(1);
+        dsi_write( REG_TEST_CTL, 0);
+        dsi_write( REG_TEST_XSIZE, 640-1);
+        dsi_write( REG_TEST_YSIZE, 960-1);
+        //getchar();
+        dsi_write( REG_TEST_CTL, 1);
+        //dsi_force_lp(0);
+    }
+
+    blog_stop();
+    if (ual_probe_source)
+        ual_probe_dump(2);
+
+    if (model) {
+        dsi_model_dump(model);
+        ual_close(ubar);
+        dsi_model_destroy(model);
+    }
     
-    return 0;
+    return err;
 }
\ No newline at end of file
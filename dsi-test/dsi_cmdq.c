@@ -0,0 +1,325 @@
+/*
+ * DSI Core - asynchronous DCS command queue
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* dsi_cmdq.c - moves LP command transmission off the caller's thread.
+ *
+ * Producers push into a bounded lock-free ring (one sequence number per
+ * slot, so any number of threads may submit concurrently); a single service
+ * thread drains it in batches, drops commands superseded by a later one with
+ * the same key, waits for the frame gap and only then spins on the LP TX
+ * handshake in dsi_core.c. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#include "dsi_core.h"
+#include "dsi_cmdq.h"
+
+struct dsi_cmdq_slot {
+    atomic_uint seq;
+    struct dsi_cmd cmd;
+    dsi_cmdq_done_fn done;
+    void *arg;
+    int status;      /* in the batch, what the callback is told */
+};
+
+struct dsi_cmdq {
+    struct dsi_cmdq_config cfg;
+
+    struct dsi_cmdq_slot *slots;
+    unsigned int mask;
+
+    /* producers only touch tail, the service thread only head */
+    atomic_uint tail __attribute__((aligned(64)));
+    unsigned int head __attribute__((aligned(64)));
+
+    sem_t wake;
+    atomic_int stop;
+    pthread_t thread;
+
+    /* batch scratch, owned by the service thread */
+    struct dsi_cmdq_slot *batch;
+    int last[256];
+
+    atomic_uint submitted;
+    unsigned int retired;
+    pthread_mutex_t lock;
+    pthread_cond_t retired_cond;
+};
+
+/* Coalescing keys of the DCS commands whose effect is a state, not an
+   action: only the final value of a batch needs to reach the panel */
+static uint8_t dcs_key(uint8_t dcs)
+{
+    switch (dcs) {
+    case DCS_SET_DISPLAY_ON:
+    case DCS_SET_DISPLAY_OFF:
+        return DCS_SET_DISPLAY_ON;
+    case DCS_ENTER_IDLE_MODE:
+    case DCS_EXIT_IDLE_MODE:
+        return DCS_EXIT_IDLE_MODE;
+    case DCS_SET_GAMMA_CURVE:
+    case DCS_WRITE_DISPLAY_BRIGHTNESS:
+    case DCS_WRITE_CTRL_DISPLAY:
+    case DCS_WRITE_POWER_SAVE:
+        return dcs;
+    default:
+        return DSI_CMDQ_KEY_NONE;
+    }
+}
+
+static int cmd_send(const struct dsi_cmd *cmd)
+{
+    if (cmd->length)
+        return dsi_long_write(cmd->ptype == DSI_DCS_LONG, cmd->data,
+                              cmd->length);
+    return dsi_send_lp_short(cmd->ptype, cmd->data[0], cmd->data[1]);
+}
+
+/* Single consumer side of the ring: takes every published slot */
+static int cmdq_drain(struct dsi_cmdq *q)
+{
+    struct dsi_cmdq_slot *slot;
+    int n = 0;
+
+    for (;;) {
+        slot = &q->slots[q->head & q->mask];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) !=
+            q->head + 1)
+            break;
+
+        q->batch[n++] = *slot;
+        atomic_store_explicit(&slot->seq, q->head + q->mask + 1,
+                              memory_order_release);
+        q->head++;
+    }
+    return n;
+}
+
+static void cmdq_retire(struct dsi_cmdq *q, int n)
+{
+    pthread_mutex_lock(&q->lock);
+    q->retired += n;
+    pthread_cond_broadcast(&q->retired_cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Sends one drained batch and retires it */
+static void cmdq_batch(struct dsi_cmdq *q, int n)
+{
+    struct dsi_cmdq_slot *s;
+    int i, gap = 1;
+
+    for (i = 0; i < n; i++)
+        if (q->batch[i].cmd.key)
+            q->last[q->batch[i].cmd.key] = i;
+
+    /* without a frame gap the packets would cut into the video stream */
+    if (q->cfg.wait_frame && q->cfg.wait_frame(q->cfg.wait_arg))
+        gap = 0;
+    if (gap && q->cfg.force_lp)
+        dsi_force_lp(1);
+
+    for (i = 0; i < n; i++) {
+        s = &q->batch[i];
+        if (s->cmd.key && q->last[s->cmd.key] != i)
+            s->status = DSI_CMDQ_COALESCED;
+        else if (!gap)
+            s->status = DSI_CMDQ_FAILED;
+        else
+            s->status = cmd_send(&s->cmd) ? DSI_CMDQ_FAILED : DSI_CMDQ_SENT;
+    }
+
+    if (gap && q->cfg.force_lp)
+        dsi_force_lp(0);
+
+    for (i = 0; i < n; i++) {
+        s = &q->batch[i];
+        if (s->done)
+            s->done(s->arg, s->status);
+    }
+    cmdq_retire(q, n);
+}
+
+static void *cmdq_service(void *arg)
+{
+    struct dsi_cmdq *q = arg;
+    int i, n;
+
+    while (!atomic_load(&q->stop)) {
+        sem_wait(&q->wake);
+
+        /* every submission posts after publishing its slot, so the ring
+           is empty up to it once this loop ends; the tokens of entries a
+           batch already took only cost an empty pass later */
+        while ((n = cmdq_drain(q)))
+            cmdq_batch(q, n);
+    }
+
+    n = cmdq_drain(q);
+    for (i = 0; i < n; i++)
+        if (q->batch[i].done)
+            q->batch[i].done(q->batch[i].arg, DSI_CMDQ_CANCELLED);
+    cmdq_retire(q, n);
+
+    return NULL;
+}
+
+struct dsi_cmdq *dsi_cmdq_create(const struct dsi_cmdq_config *cfg)
+{
+    struct dsi_cmdq *q;
+    unsigned int depth = 2, i;
+
+    while (depth < cfg->depth)
+        depth <<= 1;
+
+    if (posix_memalign((void **)&q, 64, sizeof(*q)))
+        return NULL;
+    memset(q, 0, sizeof(*q));
+    q->cfg = *cfg;
+    q->mask = depth - 1;
+
+    q->slots = calloc(depth, sizeof(struct dsi_cmdq_slot));
+    q->batch = calloc(depth, sizeof(struct dsi_cmdq_slot));
+    if (!q->slots || !q->batch)
+        goto err_alloc;
+    for (i = 0; i < depth; i++)
+        atomic_init(&q->slots[i].seq, i);
+
+    sem_init(&q->wake, 0, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->retired_cond, NULL);
+
+    if (pthread_create(&q->thread, NULL, cmdq_service, q))
+        goto err_thread;
+
+    return q;
+
+ err_thread:
+    sem_destroy(&q->wake);
+ err_alloc:
+    free(q->slots);
+    free(q->batch);
+    free(q);
+    return NULL;
+}
+
+void dsi_cmdq_destroy(struct dsi_cmdq *q)
+{
+    atomic_store(&q->stop, 1);
+    sem_post(&q->wake);
+    pthread_join(q->thread, NULL);
+
+    sem_destroy(&q->wake);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->retired_cond);
+    free(q->slots);
+    free(q->batch);
+    free(q);
+}
+
+int dsi_cmdq_submit(struct dsi_cmdq *q, const struct dsi_cmd *cmd,
+                    dsi_cmdq_done_fn done, void *arg)
+{
+    struct dsi_cmdq_slot *slot;
+    unsigned int pos, seq;
+    int diff;
+
+    if (cmd->length > DSI_CMDQ_MAX_PAYLOAD) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        slot = &q->slots[pos & q->mask];
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        diff = (int)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            errno = EAGAIN;
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    slot->cmd = *cmd;
+    slot->done = done;
+    slot->arg = arg;
+    atomic_fetch_add_explicit(&q->submitted, 1, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    sem_post(&q->wake);
+    return 0;
+}
+
+/* Queues a DCS write, choosing the short or long packet form from the
+   parameter count, and coalesces state-setting commands */
+int dsi_cmdq_dcs(struct dsi_cmdq *q, uint8_t dcs, const uint8_t *params, int n,
+                 dsi_cmdq_done_fn done, void *arg)
+{
+    struct dsi_cmd cmd;
+
+    if (n < 0 || n + 1 > DSI_CMDQ_MAX_PAYLOAD) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    cmd.key = dcs_key(dcs);
+    if (n <= 1) {
+        cmd.ptype = n ? DSI_DCS_SHORT_WRITE_1 : DSI_DCS_SHORT_WRITE;
+        cmd.length = 0;
+        cmd.data[0] = dcs;
+        cmd.data[1] = n ? params[0] : 0;
+    } else {
+        cmd.ptype = DSI_DCS_LONG;
+        cmd.length = n + 1;
+        cmd.data[0] = dcs;
+        memcpy(&cmd.data[1], params, n);
+    }
+
+    return dsi_cmdq_submit(q, &cmd, done, arg);
+}
+
+int dsi_cmdq_brightness(struct dsi_cmdq *q, uint8_t level)
+{
+    return dsi_cmdq_dcs(q, DCS_WRITE_DISPLAY_BRIGHTNESS, &level, 1, NULL, NULL);
+}
+
+void dsi_cmdq_flush(struct dsi_cmdq *q)
+{
+    unsigned int target = atomic_load(&q->submitted);
+
+    pthread_mutex_lock(&q->lock);
+    while ((int)(q->retired - target) < 0)
+        pthread_cond_wait(&q->retired_cond, &q->lock);
+    pthread_mutex_unlock(&q->lock);
+}
@@ -0,0 +1,91 @@
+/*
+ * DSI Core - asynchronous DCS command queue
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DSI_CMDQ_H
+#define __DSI_CMDQ_H
+
+#include <stdint.h>
+
+/* Largest long packet payload accepted by the queue */
+#define DSI_CMDQ_MAX_PAYLOAD 64
+
+/* DSI data types used by the queue */
+#define DSI_DCS_SHORT_WRITE   0x05
+#define DSI_DCS_SHORT_WRITE_1 0x15
+#define DSI_GENERIC_LONG      0x29
+#define DSI_DCS_LONG          0x39
+
+/* DCS commands that are typically issued while the display is running */
+#define DCS_SET_DISPLAY_OFF          0x28
+#define DCS_SET_DISPLAY_ON           0x29
+#define DCS_SET_GAMMA_CURVE          0x26
+#define DCS_EXIT_IDLE_MODE           0x38
+#define DCS_ENTER_IDLE_MODE          0x39
+#define DCS_WRITE_DISPLAY_BRIGHTNESS 0x51
+#define DCS_WRITE_CTRL_DISPLAY       0x53
+#define DCS_WRITE_POWER_SAVE         0x55
+
+/* Coalescing key: commands sharing a non-zero key within one batch
+   are reduced to the last one submitted */
+#define DSI_CMDQ_KEY_NONE 0
+
+/* Completion status passed to the callback */
+enum dsi_cmdq_status {
+    DSI_CMDQ_SENT = 0,      /* the packet went out on the LP lane */
+    DSI_CMDQ_COALESCED,     /* superseded by a later command with the same key */
+    DSI_CMDQ_CANCELLED,     /* queue destroyed before the command was sent */
+    DSI_CMDQ_FAILED         /* the core did not complete the LP handshake,
+                               or wait_frame failed and the batch was dropped */
+};
+
+/* Called from the service thread once a command is retired */
+typedef void (*dsi_cmdq_done_fn)(void *arg, int status);
+
+struct dsi_cmd {
+    uint8_t ptype;   /* DSI data type */
+    uint8_t length;  /* payload length for long packets, 0 for short ones */
+    uint8_t key;     /* coalescing key, DSI_CMDQ_KEY_NONE to always send */
+    uint8_t data[DSI_CMDQ_MAX_PAYLOAD]; /* short packets: data[0] = w0, data[1] = w1 */
+};
+
+struct dsi_cmdq_config {
+    int depth;                      /* queue slots, rounded up to a power of 2 */
+    int force_lp;                   /* force LP mode around each batch (video running) */
+    int (*wait_frame)(void *arg);   /* blocks until the next frame gap and returns
+                                       0, non-zero fails the batch; NULL sends
+                                       at once */
+    void *wait_arg;
+};
+
+struct dsi_cmdq;
+
+struct dsi_cmdq *dsi_cmdq_create(const struct dsi_cmdq_config *cfg);
+void dsi_cmdq_destroy(struct dsi_cmdq *q);
+
+/* Non-blocking submission, safe from any number of threads.
+   Returns 0, or -1 with errno = EAGAIN when the queue is full. */
+int dsi_cmdq_submit(struct dsi_cmdq *q, const struct dsi_cmd *cmd,
+                    dsi_cmdq_done_fn done, void *arg);
+int dsi_cmdq_dcs(struct dsi_cmdq *q, uint8_t dcs, const uint8_t *params, int n,
+                 dsi_cmdq_done_fn done, void *arg);
+int dsi_cmdq_brightness(struct dsi_cmdq *q, uint8_t level);
+
+/* Blocks until every command submitted before the call has been retired */
+void dsi_cmdq_flush(struct dsi_cmdq *q);
+
+#endif
@@ -22,8 +22,10 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <errno.h>
 
 #include "dsi_core.h"
+#include "blog.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -55,7 +57,7 @@ static uint8_t reverse_bits(uint8_t x)
 }
 
 /* calculates DSI packet header ECC checksum */
-static uint8_t dsi_ecc(uint32_t data)
+uint8_t dsi_ecc(uint32_t data)
 {
     uint8_t ecc = 0;
     int     i;
@@ -71,33 +73,54 @@ static uint8_t dsi_ecc(uint32_t data)
 
 int dsi_ctl = 0;
 
-/* Sends a single byte to the display in low power mode */
-void dsi_lp_write_byte(uint32_t value)
+UAL_PROBE_DEFINE(probe_lp_byte, "dsi_lp_write_byte");
+UAL_PROBE_DEFINE(probe_init_setup, "dsi_init setup");
+UAL_PROBE_DEFINE(probe_init_power, "dsi_init power-up");
+UAL_PROBE_DEFINE(probe_init_clock, "dsi_init clock");
+UAL_PROBE_DEFINE(probe_init_cmds, "dsi_init commands");
+UAL_PROBE_DEFINE(probe_init_timing, "dsi_init timing");
+
+/* Sends a single byte to the display in low power mode; -1 when the
+   LP TX handshake does not complete */
+int dsi_lp_write_byte(uint32_t value)
 {
     int rv = 0;
+    UAL_PROBE_SCOPE(&probe_lp_byte);
 
     dsi_write(REG_DSI_CTL, dsi_ctl | 2);
 
-    while (!(dsi_read(REG_DSI_CTL) & 2)) ;
+    if (dsi_wait(REG_DSI_CTL, 2, 2))
+        return -1;
     dsi_write(REG_LP_TX, value | 0x100);
 
-    while (!(dsi_read(REG_DSI_CTL) & 2)) ;
+    return dsi_wait(REG_DSI_CTL, 2, 2);
+}
+
+/* Leaves LP TX mode after a packet, also one given up half way */
+static int dsi_lp_end(int err)
+{
+    int e = errno;
+
+    dsi_write(REG_DSI_CTL, dsi_ctl);
+    errno = e;
+    return err ? -1 : 0;
 }
 
 /* Composes a short packet and sends it in low power mode to the display */
-void dsi_send_lp_short(uint8_t ptype, uint8_t w0, uint8_t w1)
+int dsi_send_lp_short(uint8_t ptype, uint8_t w0, uint8_t w1)
 {
     uint8_t  pdata[4];
     uint32_t d;
+    int err;
 
-    dsi_lp_write_byte(0xe1);
-    dsi_lp_write_byte(reverse_bits(ptype));
-    dsi_lp_write_byte(reverse_bits(w0));
-    dsi_lp_write_byte(reverse_bits(w1));
-    dsi_lp_write_byte(reverse_bits(dsi_ecc(ptype |
+    err = dsi_lp_write_byte(0xe1) ||
+        dsi_lp_write_byte(reverse_bits(ptype)) ||
+        dsi_lp_write_byte(reverse_bits(w0)) ||
+        dsi_lp_write_byte(reverse_bits(w1)) ||
+        dsi_lp_write_byte(reverse_bits(dsi_ecc(ptype |
                                            (((uint32_t)w0) <<
     8) | (((uint32_t)w1) << 16))));
-    dsi_write(REG_DSI_CTL, dsi_ctl);
+    return dsi_lp_end(err);
 }
 
 uint16_t dsi_crc(const uint8_t *d, int n)
@@ -124,34 +147,36 @@ uint16_t dsi_crc(const uint8_t *d, int n)
     return result;
 }
 
-void dsi_long_write(int is_dcs, const unsigned char *data, int length)
+int dsi_long_write(int is_dcs, const unsigned char *data, int length)
 {
     uint8_t w1 = 0;
     uint8_t w0 = length;
+    int err;
 
     uint8_t ptype = is_dcs ? 0x39 : 0x29;
     //printf("pp_long write: %d bytes ptype %x\n", length, ptype);
 
-    dsi_lp_write_byte(0xe1);
-    dsi_lp_write_byte(reverse_bits(ptype));
-    dsi_lp_write_byte(reverse_bits(w0));
-    dsi_lp_write_byte(reverse_bits(w1));
-    dsi_lp_write_byte(reverse_bits(dsi_ecc(ptype |
+    err = dsi_lp_write_byte(0xe1) ||
+        dsi_lp_write_byte(reverse_bits(ptype)) ||
+        dsi_lp_write_byte(reverse_bits(w0)) ||
+        dsi_lp_write_byte(reverse_bits(w1)) ||
+        dsi_lp_write_byte(reverse_bits(dsi_ecc(ptype |
                                            (((uint32_t)w0) <<
     8) | (((uint32_t)w1) << 16))));
 
     int i;
 
-    for (i = 0; i < length; i++)
-        dsi_lp_write_byte(reverse_bits(data[i]));
+    for (i = 0; i < length && !err; i++)
+        err = dsi_lp_write_byte(reverse_bits(data[i]));
 
     uint16_t crc = dsi_crc(data, length);
 
     crc = 0x0000;
 
-    dsi_lp_write_byte(reverse_bits(crc & 0xff));
-    dsi_lp_write_byte(reverse_bits(crc >> 8));
-    dsi_write(REG_DSI_CTL, dsi_ctl);
+    if (!err)
+        err = dsi_lp_write_byte(reverse_bits(crc & 0xff)) ||
+            dsi_lp_write_byte(reverse_bits(crc >> 8));
+    return dsi_lp_end(err);
 }
 
 void dsi_delay()
@@ -159,14 +184,13 @@ void dsi_delay()
     usleep(100000);
 }
 
-void SSD_Single(uint8_t r, uint8_t data )
+int SSD_Single(uint8_t r, uint8_t data )
 {
     uint8_t ddd[2] = {r,data};
     
-    printf("ssd_single write: %x %x\n", r, data);
-    dsi_send_lp_short( 0x13, r ,data );
+    blog("ssd_single write: %x %x\n", r, data);
+    return dsi_send_lp_short( 0x13, r ,data );
     //dsi_long_write(1, ddd, 2);//int is_dcs, const unsigned char *data, int length)
-    return;
     uint8_t w1 = data;
     uint8_t w0 = r;
 
@@ -184,13 +208,17 @@ void SSD_Single(uint8_t r, uint8_t data )
     dsi_lp_write_byte(reverse_bits(crc & 0xff));
     dsi_lp_write_byte(reverse_bits(crc >> 8));
     dsi_write(REG_DSI_CTL, dsi_ctl);
+    return 0;
 }
 
-void dsi_init(struct dsi_panel_config *panel)
+int dsi_init(struct dsi_panel_config *panel)
 {
     int i;
+    struct ual_probe_mark mark;
 
-    printf("LansCfg 0x%04x\n", panel->lane_config);
+    blog("LansCfg 0x%04x\n", panel->lane_config);
+
+    UAL_PROBE_BEGIN(&probe_init_setup, &mark);
 
     dsi_write(REG_TIMING_CTL, 0); // disable core, force LP mode
     dsi_write(REG_DSI_LANE_CTL, panel->lane_config);
@@ -200,9 +228,11 @@ void dsi_init(struct dsi_panel_config *panel)
     dsi_ctl = (panel->num_lanes << 8);
     dsi_write(REG_DSI_CTL, dsi_ctl); /* disable DSI clock, set lane count */
 
-    printf("dsi_ctl %x\n", dsi_ctl );
+    UAL_PROBE_END(&probe_init_setup, &mark);
+    blog("dsi_ctl %x\n", dsi_ctl );
 
 
+    UAL_PROBE_BEGIN(&probe_init_power, &mark);
     dsi_write(REG_DSI_GPIO, 0x2);    /* Avdd on */
     dsi_delay();
 //    for (i = 0; i < 10; i++) dsi_delay();
@@ -218,7 +248,9 @@ void dsi_init(struct dsi_panel_config *panel)
 //    for (i = 0; i < 10; i++) dsi_delay();
 
   //  dsi_delay();
+    UAL_PROBE_END(&probe_init_power, &mark);
 
+    UAL_PROBE_BEGIN(&probe_init_clock, &mark);
     dsi_ctl |= 1;
     usleep(100000);
 
@@ -226,9 +258,12 @@ void dsi_init(struct dsi_panel_config *panel)
     dsi_delay();
 
     usleep(100000);
+    UAL_PROBE_END(&probe_init_clock, &mark);
 
-    printf("nop\n");
-    dsi_send_lp_short(0x05, 0x00, 0x00); /* send DCS NOP */
+    blog("nop\n");
+    UAL_PROBE_BEGIN(&probe_init_cmds, &mark);
+    if (dsi_send_lp_short(0x05, 0x00, 0x00)) /* send DCS NOP */
+        goto err_cmds;
 
     usleep(100000);
     
@@ -524,20 +559,25 @@ dsi_delay();
 //for(;;)
 {
 
-        printf(".");
-        dsi_send_lp_short(0x15, 0x11, 0x00); /* send DCS SLEEP_OUT */
+        blog("sleep out, display on\n");
+        if (dsi_send_lp_short(0x15, 0x11, 0x00)) /* send DCS SLEEP_OUT */
+            goto err_cmds;
         delay(panel->cmd_delay);
 
-        dsi_send_lp_short(0x15, 0x29, 0x00); /* send DCS DISPLAY_ON */
+        if (dsi_send_lp_short(0x15, 0x29, 0x00)) /* send DCS DISPLAY_ON */
+            goto err_cmds;
         delay(panel->cmd_delay);
 
-        dsi_send_lp_short(0x15, 0x38, 0x00); /* send DCS EXIT_IDLE_MODE */
+        if (dsi_send_lp_short(0x15, 0x38, 0x00)) /* send DCS EXIT_IDLE_MODE */
+            goto err_cmds;
         delay(panel->cmd_delay);
 
         //dsi_send_lp_short(0x15, 0x21, 0x00); /* send DCS ENTER_INVERT_MODE */
         //delay(panel->cmd_delay);
 }
+    UAL_PROBE_END(&probe_init_cmds, &mark);
 
+    UAL_PROBE_BEGIN(&probe_init_timing, &mark);
     dsi_write(REG_H_FRONT_PORCH, panel->h_front_porch);
     dsi_write(REG_H_BACK_PORCH, panel->h_back_porch);
     dsi_write(REG_H_ACTIVE, panel->width * 3);
@@ -550,6 +590,13 @@ dsi_delay();
               panel->v_back_porch + panel->height + panel->v_front_porch);
 
     dsi_write(REG_TIMING_CTL, 1); /* start display refresh */
+    UAL_PROBE_END(&probe_init_timing, &mark);
+    return 0;
+
+err_cmds:
+    UAL_PROBE_END(&probe_init_cmds, &mark);
+    blog("LP command not acknowledged, giving up\n");
+    return -1;
 }
 
 void dsi_force_lp(int force)
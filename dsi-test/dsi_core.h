@@ -80,12 +80,21 @@ struct dsi_panel_config {
 /* I/O registers access */
 void dsi_write(uint32_t reg, uint32_t val);
 uint32_t dsi_read(uint32_t reg);
-
-void dsi_send_lp_short(uint8_t ptype, uint8_t w0, uint8_t w1);
-void dsi_init( struct dsi_panel_config *);
+/* Busy-waits until (dsi_read(reg) & mask) == value, for at most
+   DSI_WAIT_TIMEOUT_MS; 0, or -1 with errno set */
+#define DSI_WAIT_TIMEOUT_MS 100
+int dsi_wait(uint32_t reg, uint32_t mask, uint32_t value);
+
+/* Packet header ECC (24 bits of header) and payload checksum */
+uint8_t dsi_ecc(uint32_t data);
+uint16_t dsi_crc(const uint8_t *d, int n);
+
+/* These return 0, or -1 with errno set when the core stopped answering */
+int dsi_send_lp_short(uint8_t ptype, uint8_t w0, uint8_t w1);
+int dsi_init( struct dsi_panel_config *);
 int dsi_calc_vrefresh(struct dsi_panel_config *panel);
 int dsi_calc_bitrate(struct dsi_panel_config *panel);
 void dsi_force_lp(int force);
-void dsi_long_write(int is_dcs, const unsigned char *data, int length);
+int dsi_long_write(int is_dcs, const unsigned char *data, int length);
 
 #endif
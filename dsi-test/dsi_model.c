@@ -0,0 +1,447 @@
+/*
+ * DSI Core - behavioral model of the tom,dsi register block
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* dsi_model.c - host-side stand-in for the DSI core.
+ *
+ * The model sits behind a UAL_BUS_SIM token, so dsi_core.c runs on it
+ * unchanged. It implements the LP TX handshake of REG_DSI_CTL/REG_LP_TX
+ * with escape mode timing derived from REG_DSI_TICKDIV, turns every escape
+ * sequence back into DSI packets and checks their ECC and CRC with its own
+ * reference implementations, so that encoder changes in dsi_core.c are
+ * verified against something independent. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "dsi_core.h"
+#include "dsi_model.h"
+
+#define MODEL_NUM_REGS ((REG_DSI_LANE_CTL >> 2) + 1)
+
+/* sync and blanking packet overhead per line, as in dsi_calc_vrefresh() */
+#define LINE_OVERHEAD (6 + 6 + 6 + 4)
+
+struct dsi_model {
+    struct dsi_model_config cfg;
+    pthread_mutex_t lock;
+
+    uint32_t regs[MODEL_NUM_REGS];
+
+    uint64_t vtime;
+    struct timespec t0;
+
+    /* LP escape mode transmitter */
+    int lp_active;
+    uint64_t busy_until;
+    uint64_t seq_start;
+    int seq_len;
+    uint8_t seq[DSI_MODEL_MAX_PAYLOAD + 16];
+
+    struct dsi_model_packet *packets;
+    int num_packets;
+
+    struct dsi_model_stats stats;
+};
+
+static uint8_t bit_reverse(uint8_t x)
+{
+    x = (x >> 4) | (x << 4);
+    x = ((x & 0xcc) >> 2) | ((x & 0x33) << 2);
+    x = ((x & 0xaa) >> 1) | ((x & 0x55) << 1);
+    return x;
+}
+
+/* Reference ECC: the parity equations of the MIPI DSI spec, bit by bit,
+   rather than dsi_ecc()'s masks */
+#define D(n) ((h >> (n)) & 1)
+static uint8_t ref_ecc(uint32_t h)
+{
+    uint8_t p0, p1, p2, p3, p4, p5;
+
+    p0 = D(0) ^ D(1) ^ D(2) ^ D(4) ^ D(5) ^ D(7) ^ D(10) ^ D(11) ^ D(13) ^
+         D(16) ^ D(20) ^ D(21) ^ D(22) ^ D(23);
+    p1 = D(0) ^ D(1) ^ D(3) ^ D(4) ^ D(6) ^ D(8) ^ D(10) ^ D(12) ^ D(14) ^
+         D(17) ^ D(20) ^ D(21) ^ D(22) ^ D(23);
+    p2 = D(0) ^ D(2) ^ D(3) ^ D(5) ^ D(6) ^ D(9) ^ D(11) ^ D(12) ^ D(15) ^
+         D(18) ^ D(20) ^ D(21) ^ D(22);
+    p3 = D(1) ^ D(2) ^ D(3) ^ D(7) ^ D(8) ^ D(9) ^ D(13) ^ D(14) ^ D(15) ^
+         D(19) ^ D(20) ^ D(21) ^ D(23);
+    p4 = D(4) ^ D(5) ^ D(6) ^ D(7) ^ D(8) ^ D(9) ^ D(16) ^ D(17) ^ D(18) ^
+         D(19) ^ D(20) ^ D(22) ^ D(23);
+    p5 = D(10) ^ D(11) ^ D(12) ^ D(13) ^ D(14) ^ D(15) ^ D(16) ^ D(17) ^
+         D(18) ^ D(19) ^ D(21) ^ D(22) ^ D(23);
+    /* P6 and P7 are 0 */
+    return p0 | p1 << 1 | p2 << 2 | p3 << 3 | p4 << 4 | p5 << 5;
+}
+#undef D
+
+/* Reference CRC-16/CCITT (x^16 + x^12 + x^5 + 1, LSB first, seed 0xffff) */
+static uint16_t ref_crc(const uint8_t *d, int n)
+{
+    static uint16_t table[256];
+    uint16_t crc = 0xffff;
+    int i, j;
+
+    if (!table[1]) {
+        for (i = 0; i < 256; i++) {
+            uint16_t c = i;
+
+            for (j = 0; j < 8; j++)
+                c = (c & 1) ? (c >> 1) ^ 0x8408 : c >> 1;
+            table[i] = c;
+        }
+    }
+
+    for (i = 0; i < n; i++)
+        crc = (crc >> 8) ^ table[(crc ^ d[i]) & 0xff];
+    return crc;
+}
+
+static int dt_is_long(uint8_t dt)
+{
+    switch (dt & 0x0f) {
+    case 0x9: case 0xc: case 0xd: case 0xe:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static uint64_t model_now(struct dsi_model *m)
+{
+    struct timespec t;
+
+    if (!m->cfg.realtime)
+        return m->vtime;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)(t.tv_sec - m->t0.tv_sec) * 1000000000ULL +
+           t.tv_nsec - m->t0.tv_nsec;
+}
+
+/* Duration of one LP bit: spaced-one-hot coding takes two LP states per
+   bit, each lasting one tick of BASE_CLOCK / (TICKDIV + 1) */
+static uint64_t lp_bit_ns(struct dsi_model *m)
+{
+    uint64_t div = m->regs[REG_DSI_TICKDIV >> 2] + 1;
+
+    return 2 * div * 1000000000ULL / BASE_CLOCK;
+}
+
+static void log_packet(struct dsi_model *m, struct dsi_model_packet *pk)
+{
+    if (!pk->ecc_ok)
+        m->stats.ecc_errors++;
+    if (!pk->crc_ok)
+        m->stats.crc_errors++;
+    if (pk->truncated)
+        m->stats.truncated++;
+
+    if (m->num_packets < m->cfg.max_packets)
+        m->packets[m->num_packets++] = *pk;
+}
+
+/* Splits a finished escape sequence into packets */
+static void decode_sequence(struct dsi_model *m, uint64_t t_end)
+{
+    struct dsi_model_packet pk;
+    const uint8_t *p = m->seq + 1;
+    int left = m->seq_len - 1;
+    int need;
+
+    while (left >= 4) {
+        memset(&pk, 0, sizeof(pk));
+        pk.escape = m->seq[0];
+        pk.vc = p[0] >> 6;
+        pk.dt = p[0] & 0x3f;
+        pk.wc = p[1] | (p[2] << 8);
+        pk.ecc_ok = ref_ecc(p[0] | (p[1] << 8) | (p[2] << 16)) ==
+                    (p[3] & 0x3f);
+        pk.is_long = dt_is_long(pk.dt);
+        pk.crc_ok = 1;
+        pk.t_start = m->seq_start;
+        pk.t_end = t_end;
+        p += 4;
+        left -= 4;
+
+        if (pk.is_long) {
+            need = pk.wc + 2;
+            if (left < need || pk.wc > DSI_MODEL_MAX_PAYLOAD) {
+                pk.truncated = 1;
+                pk.length = left < DSI_MODEL_MAX_PAYLOAD ?
+                            left : DSI_MODEL_MAX_PAYLOAD;
+                memcpy(pk.payload, p, pk.length);
+                log_packet(m, &pk);
+                return;
+            }
+
+            uint16_t crc = p[pk.wc] | (p[pk.wc + 1] << 8);
+
+            pk.length = pk.wc;
+            memcpy(pk.payload, p, pk.wc);
+            if (crc == 0x0000)
+                pk.crc_skipped = 1;
+            else
+                pk.crc_ok = crc == ref_crc(p, pk.wc);
+            p += need;
+            left -= need;
+        }
+        log_packet(m, &pk);
+    }
+}
+
+static void lp_tx_byte(struct dsi_model *m, uint32_t value)
+{
+    uint64_t now = model_now(m);
+
+    if (!(value & 0x100))
+        return;
+
+    if (now < m->busy_until)
+        m->stats.lp_overruns++;
+    if ((m->regs[REG_TIMING_CTL >> 2] & 3) == 1)
+        m->stats.lp_in_hs++;
+
+    if (m->seq_len == 0)
+        m->seq_start = now;
+    /* the first byte is the escape entry command, sent as is; packet bytes
+       are bit-reversed by the driver because the core shifts MSB first */
+    if (m->seq_len < (int)sizeof(m->seq)) {
+        m->seq[m->seq_len] = m->seq_len ? bit_reverse(value) : value;
+        m->seq_len++;
+    }
+
+    m->busy_until = (now > m->busy_until ? now : m->busy_until) +
+                    8 * lp_bit_ns(m);
+    m->stats.lp_bytes++;
+}
+
+static void write_ctl(struct dsi_model *m, uint32_t value)
+{
+    int lp_req = !!(value & 2);
+    uint64_t now = model_now(m);
+
+    if (lp_req && !m->lp_active) {
+        /* LP-11, LP-10, LP-00, LP-01, LP-00 before the entry command */
+        m->busy_until = now + 2 * lp_bit_ns(m);
+        m->seq_len = 0;
+    } else if (!lp_req && m->lp_active) {
+        if (m->seq_len)
+            decode_sequence(m, m->busy_until > now ? m->busy_until : now);
+        m->seq_len = 0;
+        /* mark-1 and back to stop state */
+        m->busy_until = (m->busy_until > now ? m->busy_until : now) +
+                        lp_bit_ns(m);
+    }
+
+    m->lp_active = lp_req;
+    m->regs[REG_DSI_CTL >> 2] = value & ~2;
+}
+
+static uint32_t model_read(void *priv, uint32_t addr, enum ual_data_width dw)
+{
+    struct dsi_model *m = priv;
+    uint32_t value = 0;
+    int r = addr >> 2;
+
+    pthread_mutex_lock(&m->lock);
+    m->vtime += m->cfg.access_ns;
+    m->stats.reads++;
+
+    if (addr == REG_DSI_CTL) {
+        value = m->regs[r];
+        if (m->lp_active) {
+            if (model_now(m) >= m->busy_until)
+                value |= 2;
+            else
+                m->stats.ready_polls++;
+        }
+    } else if (r < MODEL_NUM_REGS) {
+        value = m->regs[r];
+    }
+
+    pthread_mutex_unlock(&m->lock);
+    return value;
+}
+
+static void model_write(void *priv, uint32_t addr, uint32_t value,
+                        enum ual_data_width dw)
+{
+    struct dsi_model *m = priv;
+    int r = addr >> 2;
+
+    pthread_mutex_lock(&m->lock);
+    m->vtime += m->cfg.access_ns;
+    m->stats.writes++;
+
+    if (addr == REG_DSI_CTL)
+        write_ctl(m, value);
+    else if (addr == REG_LP_TX)
+        lp_tx_byte(m, value);
+    else if (r < MODEL_NUM_REGS)
+        m->regs[r] = value;
+
+    pthread_mutex_unlock(&m->lock);
+}
+
+struct dsi_model *dsi_model_create(const struct dsi_model_config *cfg)
+{
+    struct dsi_model *m;
+
+    m = calloc(1, sizeof(struct dsi_model));
+    if (!m)
+        return NULL;
+
+    if (cfg)
+        m->cfg = *cfg;
+    if (!m->cfg.phy_freq)
+        m->cfg.phy_freq = 500000000;
+    if (!m->cfg.access_ns)
+        m->cfg.access_ns = 150;
+    if (!m->cfg.max_packets)
+        m->cfg.max_packets = 4096;
+
+    m->packets = calloc(m->cfg.max_packets, sizeof(struct dsi_model_packet));
+    if (!m->packets) {
+        free(m);
+        return NULL;
+    }
+
+    pthread_mutex_init(&m->lock, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &m->t0);
+    return m;
+}
+
+void dsi_model_destroy(struct dsi_model *m)
+{
+    pthread_mutex_destroy(&m->lock);
+    free(m->packets);
+    free(m);
+}
+
+struct ual_bar_tkn *dsi_model_open(struct dsi_model *m)
+{
+    struct ual_desc_sim sim;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.size = 0x10000;
+    sim.priv = m;
+    sim.read = model_read;
+    sim.write = model_write;
+
+    return ual_open(UAL_BUS_SIM, &sim);
+}
+
+const struct dsi_model_packet *dsi_model_packets(struct dsi_model *m, int *n)
+{
+    *n = m->num_packets;
+    return m->packets;
+}
+
+void dsi_model_clear(struct dsi_model *m)
+{
+    pthread_mutex_lock(&m->lock);
+    m->num_packets = 0;
+    memset(&m->stats, 0, sizeof(m->stats));
+    pthread_mutex_unlock(&m->lock);
+}
+
+void dsi_model_get_stats(struct dsi_model *m, struct dsi_model_stats *st)
+{
+    pthread_mutex_lock(&m->lock);
+    *st = m->stats;
+    st->time_ns = model_now(m);
+    pthread_mutex_unlock(&m->lock);
+}
+
+int dsi_model_timing(struct dsi_model *m, struct dsi_model_timing *t)
+{
+    uint32_t *regs = m->regs;
+    double frame_bytes;
+
+    memset(t, 0, sizeof(*t));
+    t->lanes = (regs[REG_DSI_CTL >> 2] >> 8) & 7;
+    t->h_front_porch = regs[REG_H_FRONT_PORCH >> 2];
+    t->h_back_porch = regs[REG_H_BACK_PORCH >> 2];
+    t->h_active_bytes = regs[REG_H_ACTIVE >> 2];
+    t->frame_gap_bytes = regs[REG_H_TOTAL >> 2];
+    /* dsi_init() programs the vertical registers as cumulative line
+       counts: back porch, end of active area, end of front porch */
+    t->v_back_porch = regs[REG_V_BACK_PORCH >> 2];
+    t->v_active = regs[REG_V_FRONT_PORCH >> 2] - t->v_back_porch;
+    t->v_total = regs[REG_V_TOTAL >> 2];
+
+    if (!t->lanes || !t->h_active_bytes || t->v_total <= 0)
+        return -1;
+
+    t->line_bytes = t->h_front_porch + t->h_active_bytes + t->h_back_porch +
+                    LINE_OVERHEAD;
+    t->byte_clock = m->cfg.phy_freq / 8 * t->lanes;
+    frame_bytes = (double)t->line_bytes * t->v_total + t->frame_gap_bytes;
+    t->line_us = 1e6 * t->line_bytes / t->byte_clock;
+    t->frame_us = 1e6 * frame_bytes / t->byte_clock;
+    t->vrefresh_hz = 1e6 / t->frame_us;
+
+    return 0;
+}
+
+void dsi_model_dump(struct dsi_model *m)
+{
+    struct dsi_model_packet *pk;
+    struct dsi_model_timing t;
+    struct dsi_model_stats st;
+    int i, j;
+
+    for (i = 0; i < m->num_packets; i++) {
+        pk = &m->packets[i];
+        printf("%10.3f us esc %02x vc %d dt %02x %s", pk->t_start / 1000.0,
+               pk->escape, pk->vc, pk->dt, pk->is_long ? "long " : "short");
+        if (pk->is_long) {
+            printf(" wc %d:", pk->wc);
+            for (j = 0; j < pk->length; j++)
+                printf(" %02x", pk->payload[j]);
+        } else {
+            printf(" %02x %02x", pk->wc & 0xff, pk->wc >> 8);
+        }
+        printf("%s%s%s%s\n", pk->ecc_ok ? "" : " ECC-ERR",
+               pk->crc_ok ? "" : " CRC-ERR",
+               pk->crc_skipped ? " (no crc)" : "",
+               pk->truncated ? " TRUNCATED" : "");
+    }
+
+    dsi_model_get_stats(m, &st);
+    printf("model: %llu reads %llu writes, %llu LP bytes, %llu busy polls, "
+           "%llu overruns, %llu LP-in-HS\n",
+           (unsigned long long)st.reads, (unsigned long long)st.writes,
+           (unsigned long long)st.lp_bytes, (unsigned long long)st.ready_polls,
+           (unsigned long long)st.lp_overruns, (unsigned long long)st.lp_in_hs);
+    printf("model: %llu ECC errors %llu CRC errors %llu truncated, "
+           "model time %.3f ms\n",
+           (unsigned long long)st.ecc_errors, (unsigned long long)st.crc_errors,
+           (unsigned long long)st.truncated, st.time_ns / 1e6);
+
+    if (dsi_model_timing(m, &t) == 0)
+        printf("timing: %d lanes, line %d bytes (%.2f us), %d/%d lines, "
+               "frame %.1f us, %.2f Hz\n", t.lanes, t.line_bytes, t.line_us,
+               t.v_active, t.v_total, t.frame_us, t.vrefresh_hz);
+}
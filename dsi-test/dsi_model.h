@@ -0,0 +1,87 @@
+/*
+ * DSI Core - behavioral model of the tom,dsi register block
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __DSI_MODEL_H
+#define __DSI_MODEL_H
+
+#include <stdint.h>
+
+#include "ual.h"
+
+#define DSI_MODEL_MAX_PAYLOAD 256
+
+struct dsi_model_config {
+    int phy_freq;       /* HS bit rate per lane, Hz (0: 500 MHz as in dsi_core.c) */
+    int access_ns;      /* modeled cost of one register access (0: 150 ns) */
+    int realtime;       /* LP handshake follows the wall clock instead of
+                           the modeled access time */
+    int max_packets;    /* packets kept in the log (0: 4096) */
+};
+
+/* One packet decoded from the LP byte stream */
+struct dsi_model_packet {
+    uint8_t escape;     /* escape mode entry command (0xe1 = LPDT) */
+    uint8_t vc, dt;     /* virtual channel and data type */
+    uint16_t wc;        /* word count (long) or the two data bytes (short) */
+    int is_long;
+    int length;         /* payload bytes actually received */
+    uint8_t payload[DSI_MODEL_MAX_PAYLOAD];
+    int ecc_ok;
+    int crc_ok;         /* 1 also when the sender left the CRC at 0x0000 */
+    int crc_skipped;    /* the sender did not compute the CRC */
+    int truncated;      /* sequence ended before the announced length */
+    uint64_t t_start, t_end; /* model time, ns */
+};
+
+struct dsi_model_stats {
+    uint64_t reads, writes;
+    uint64_t lp_bytes;
+    uint64_t ready_polls;   /* REG_DSI_CTL reads that found the TX busy */
+    uint64_t lp_overruns;   /* LP_TX written while busy */
+    uint64_t lp_in_hs;      /* LP TX while video refresh was running */
+    uint64_t ecc_errors, crc_errors, truncated;
+    uint64_t time_ns;       /* model time */
+};
+
+/* Frame timing produced by the programmed registers, as dsi_init()
+   lays them out */
+struct dsi_model_timing {
+    int lanes;
+    int h_active_bytes, h_front_porch, h_back_porch;
+    int line_bytes;         /* including sync/blanking packet overhead */
+    int v_back_porch, v_active, v_total;
+    int frame_gap_bytes;
+    int byte_clock;         /* aggregated over all lanes, bytes/s */
+    double line_us, frame_us, vrefresh_hz;
+};
+
+struct dsi_model;
+
+struct dsi_model *dsi_model_create(const struct dsi_model_config *cfg);
+void dsi_model_destroy(struct dsi_model *m);
+
+/* libual token for the model; ual_close() it before dsi_model_destroy() */
+struct ual_bar_tkn *dsi_model_open(struct dsi_model *m);
+
+const struct dsi_model_packet *dsi_model_packets(struct dsi_model *m, int *n);
+void dsi_model_clear(struct dsi_model *m);
+void dsi_model_get_stats(struct dsi_model *m, struct dsi_model_stats *st);
+int dsi_model_timing(struct dsi_model *m, struct dsi_model_timing *t);
+void dsi_model_dump(struct dsi_model *m);
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * Frame buffer manager for the Xilinx Video Frame Buffer Read core
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* frmbuf.c - zero-copy scanout through v_frmbuf_rd_0.
+ *
+ * The buffers are carved out of a physically contiguous region mapped
+ * through libual. The core runs in auto-restart mode and raises AP_READY
+ * each time it has latched its registers for a new frame: a buffer address
+ * written after that interrupt is picked up at the following frame start.
+ * The interrupt thread therefore moves buffers along
+ * QUEUED -> PENDING (address programmed) -> SCANOUT -> FREE,
+ * one step per frame, and a renderer never waits for anything but a free
+ * buffer. A newer queued buffer replaces an older one that was not
+ * programmed yet (mailbox mode), so the screen always gets the latest frame. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "frmbuf.h"
+
+enum frmbuf_state {
+    BUF_FREE = 0,
+    BUF_DRAWING,
+    BUF_QUEUED,
+    BUF_PENDING,
+    BUF_SCANOUT
+};
+
+struct frmbuf {
+    struct frmbuf_config cfg;
+    struct frmbuf_buffer bufs[FRMBUF_MAX_BUFFERS];
+    enum frmbuf_state state[FRMBUF_MAX_BUFFERS];
+
+    int queued, pending, scanout;
+    int virt_width;                   /* pixels per buffer row */
+    int pan_req, pan_prog, pan_live;  /* window offsets, pixels */
+
+    int uio_fd;
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    struct frmbuf_stats stats;
+};
+
+/* Waits for AP_READY and acknowledges it. Returns -1 on timeout so that
+   the caller can check for termination. */
+static int frmbuf_irq_wait(struct frmbuf *fb)
+{
+    struct timespec period = {0, 500000}, timeout = {0, 100000000};
+    struct pollfd pfd;
+    uint32_t count, isr;
+
+    if (fb->uio_fd >= 0) {
+        pfd.fd = fb->uio_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 100) <= 0)
+            return -1;
+        if (read(fb->uio_fd, &count, 4) != 4)
+            return -1;
+    } else if (!ual_event_wait(fb->cfg.regs, REG_FRMBUF_ISR,
+                               FRMBUF_IRQ_AP_READY, &period, &timeout)) {
+        return -1;
+    }
+
+    /* ISR bits are toggle-on-write */
+    isr = ual_readl(fb->cfg.regs, REG_FRMBUF_ISR);
+    ual_writel(fb->cfg.regs, REG_FRMBUF_ISR, isr);
+
+    if (fb->uio_fd >= 0) {
+        count = 1; /* re-enable the interrupt line in the UIO driver */
+        if (write(fb->uio_fd, &count, 4) != 4)
+            return -1;
+    }
+    return 0;
+}
+
+static void *frmbuf_irq_thread(void *arg)
+{
+    struct frmbuf *fb = arg;
+
+    pthread_mutex_lock(&fb->lock);
+    while (!fb->stop) {
+        pthread_mutex_unlock(&fb->lock);
+        if (frmbuf_irq_wait(fb)) {
+            pthread_mutex_lock(&fb->lock);
+            continue;
+        }
+        pthread_mutex_lock(&fb->lock);
+
+        fb->stats.frames++;
+
+        /* the address programmed at the previous frame start is live now */
+        fb->pan_live = fb->pan_prog;
+        if (fb->pending >= 0) {
+            if (fb->scanout >= 0)
+                fb->state[fb->scanout] = BUF_FREE;
+            fb->scanout = fb->pending;
+            fb->state[fb->scanout] = BUF_SCANOUT;
+            fb->pending = -1;
+            fb->stats.flips++;
+        } else {
+            fb->stats.repeats++;
+        }
+
+        if (fb->queued >= 0) {
+            /* the new buffer takes over the requested window position */
+            ual_writel(fb->cfg.regs, REG_FRMBUF_ADDR,
+                       fb->bufs[fb->queued].phys + fb->pan_req * FRMBUF_BPP);
+            fb->pending = fb->queued;
+            fb->state[fb->pending] = BUF_PENDING;
+            fb->queued = -1;
+            fb->pan_prog = fb->pan_req;
+        } else if (fb->pan_req != fb->pan_prog) {
+            ual_writel(fb->cfg.regs, REG_FRMBUF_ADDR,
+                       fb->bufs[fb->scanout].phys + fb->pan_req * FRMBUF_BPP);
+            fb->pan_prog = fb->pan_req;
+        }
+
+        pthread_cond_broadcast(&fb->cond);
+    }
+    pthread_mutex_unlock(&fb->lock);
+
+    return NULL;
+}
+
+static void frmbuf_hw_start(struct frmbuf *fb)
+{
+    struct ual_bar_tkn *regs = fb->cfg.regs;
+    struct frmbuf_buffer *b = &fb->bufs[0];
+
+    ual_writel(regs, REG_FRMBUF_CTRL, 0);
+    ual_writel(regs, REG_FRMBUF_WIDTH, b->width);
+    ual_writel(regs, REG_FRMBUF_HEIGHT, b->height);
+    ual_writel(regs, REG_FRMBUF_STRIDE, b->stride);
+    ual_writel(regs, REG_FRMBUF_FMT, FRMBUF_FMT_RGB8);
+    ual_writel(regs, REG_FRMBUF_ADDR, b->phys);
+
+    ual_writel(regs, REG_FRMBUF_ISR, ual_readl(regs, REG_FRMBUF_ISR));
+    ual_writel(regs, REG_FRMBUF_IER, FRMBUF_IRQ_AP_READY);
+    ual_writel(regs, REG_FRMBUF_GIE, 1);
+    ual_writel(regs, REG_FRMBUF_CTRL,
+               FRMBUF_CTRL_AP_START | FRMBUF_CTRL_AUTO_RESTART);
+}
+
+struct frmbuf *frmbuf_open(const struct frmbuf_config *cfg,
+                           const struct dsi_panel_config *panel)
+{
+    struct frmbuf *fb;
+    uint8_t *mem;
+    uint32_t stride, size;
+    long page = sysconf(_SC_PAGESIZE);
+    int i, width, err;
+
+    width = cfg->virt_width ? cfg->virt_width : panel->width;
+    if (cfg->num_buffers < 1 || cfg->num_buffers > FRMBUF_MAX_BUFFERS ||
+        width < panel->width) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    stride = (width * FRMBUF_BPP + FRMBUF_STRIDE_ALIGN - 1) &
+             ~(FRMBUF_STRIDE_ALIGN - 1);
+    size = (stride * panel->height + page - 1) & ~(page - 1);
+    if ((uint64_t)size * cfg->num_buffers > cfg->mem_size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mem = ual_bar_ptr(cfg->mem);
+    if (!mem) {
+        errno = UAL_ERR_NOT_MAPPED;
+        return NULL;
+    }
+
+    fb = calloc(1, sizeof(struct frmbuf));
+    if (!fb)
+        return NULL;
+    fb->cfg = *cfg;
+    fb->virt_width = width;
+    fb->queued = fb->pending = -1;
+    fb->uio_fd = -1;
+
+    for (i = 0; i < cfg->num_buffers; i++) {
+        fb->bufs[i].index = i;
+        fb->bufs[i].ptr = mem + i * size;
+        fb->bufs[i].phys = cfg->mem_phys + i * size;
+        fb->bufs[i].width = panel->width;
+        fb->bufs[i].height = panel->height;
+        fb->bufs[i].stride = stride;
+        memset(fb->bufs[i].ptr, 0, size);
+    }
+
+    if (cfg->uio_dev) {
+        fb->uio_fd = open(cfg->uio_dev, O_RDWR);
+        if (fb->uio_fd < 0)
+            goto err_uio;
+    }
+
+    pthread_mutex_init(&fb->lock, NULL);
+    pthread_cond_init(&fb->cond, NULL);
+
+    /* buffer 0 is latched by the first frame */
+    fb->scanout = 0;
+    fb->state[0] = BUF_SCANOUT;
+    frmbuf_hw_start(fb);
+
+    err = pthread_create(&fb->thread, NULL, frmbuf_irq_thread, fb);
+    if (err) {
+        errno = err;
+        goto err_thread;
+    }
+
+    return fb;
+
+ err_thread:
+    ual_writel(cfg->regs, REG_FRMBUF_CTRL, 0);
+    if (fb->uio_fd >= 0)
+        close(fb->uio_fd);
+    pthread_cond_destroy(&fb->cond);
+    pthread_mutex_destroy(&fb->lock);
+    errno = err;
+ err_uio:
+    free(fb);
+    return NULL;
+}
+
+void frmbuf_close(struct frmbuf *fb)
+{
+    pthread_mutex_lock(&fb->lock);
+    fb->stop = 1;
+    pthread_cond_broadcast(&fb->cond);
+    pthread_mutex_unlock(&fb->lock);
+    pthread_join(fb->thread, NULL);
+
+    /* dropping auto-restart stops the core at the end of the frame */
+    ual_writel(fb->cfg.regs, REG_FRMBUF_GIE, 0);
+    ual_writel(fb->cfg.regs, REG_FRMBUF_CTRL, 0);
+
+    if (fb->uio_fd >= 0)
+        close(fb->uio_fd);
+    pthread_mutex_destroy(&fb->lock);
+    pthread_cond_destroy(&fb->cond);
+    free(fb);
+}
+
+struct frmbuf_buffer *frmbuf_get_back(struct frmbuf *fb)
+{
+    int i;
+
+    pthread_mutex_lock(&fb->lock);
+    for (;;) {
+        for (i = 0; i < fb->cfg.num_buffers; i++)
+            if (fb->state[i] == BUF_FREE)
+                break;
+        if (i < fb->cfg.num_buffers || fb->stop)
+            break;
+        pthread_cond_wait(&fb->cond, &fb->lock);
+    }
+
+    if (i == fb->cfg.num_buffers) {
+        pthread_mutex_unlock(&fb->lock);
+        return NULL;
+    }
+
+    fb->state[i] = BUF_DRAWING;
+    pthread_mutex_unlock(&fb->lock);
+
+    return &fb->bufs[i];
+}
+
+void frmbuf_queue(struct frmbuf *fb, struct frmbuf_buffer *buf)
+{
+    pthread_mutex_lock(&fb->lock);
+    if (fb->queued >= 0) {
+        fb->state[fb->queued] = BUF_FREE;
+        fb->stats.dropped++;
+        pthread_cond_broadcast(&fb->cond);
+    }
+    fb->queued = buf->index;
+    fb->state[buf->index] = BUF_QUEUED;
+    pthread_mutex_unlock(&fb->lock);
+}
+
+uint64_t frmbuf_wait_vsync(struct frmbuf *fb)
+{
+    uint64_t frame;
+
+    pthread_mutex_lock(&fb->lock);
+    frame = fb->stats.frames;
+    while (fb->stats.frames == frame && !fb->stop)
+        pthread_cond_wait(&fb->cond, &fb->lock);
+    frame = fb->stats.frames;
+    pthread_mutex_unlock(&fb->lock);
+
+    return frame;
+}
+
+const struct frmbuf_buffer *frmbuf_front(struct frmbuf *fb)
+{
+    const struct frmbuf_buffer *buf;
+
+    /* the IRQ thread moves scanout at every flip; the caller owns the
+       result only until then, see frmbuf.h */
+    pthread_mutex_lock(&fb->lock);
+    buf = &fb->bufs[fb->scanout];
+    pthread_mutex_unlock(&fb->lock);
+    return buf;
+}
+
+void frmbuf_get_stats(struct frmbuf *fb, struct frmbuf_stats *st)
+{
+    pthread_mutex_lock(&fb->lock);
+    *st = fb->stats;
+    pthread_mutex_unlock(&fb->lock);
+}
+
+int frmbuf_pan(struct frmbuf *fb, int x)
+{
+    int max = fb->virt_width - fb->bufs[0].width;
+
+    if (x < 0 || x > max || x % FRMBUF_PAN_STEP) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&fb->lock);
+    fb->pan_req = x;
+    pthread_mutex_unlock(&fb->lock);
+    return 0;
+}
+
+int frmbuf_pan_live(struct frmbuf *fb)
+{
+    int x;
+
+    pthread_mutex_lock(&fb->lock);
+    x = fb->pan_live;
+    pthread_mutex_unlock(&fb->lock);
+    return x;
+}
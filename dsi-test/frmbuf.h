@@ -0,0 +1,115 @@
+/*
+ * Frame buffer manager for the Xilinx Video Frame Buffer Read core
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __FRMBUF_H
+#define __FRMBUF_H
+
+#include <stdint.h>
+
+#include "ual.h"
+#include "dsi_core.h"
+
+/* v_frmbuf_rd_0 in the PL, see DT/DTC/pl.dtsi */
+#define BASE_FRMBUF 0x43c00000
+
+/* Register definitions */
+#define REG_FRMBUF_CTRL   0x00
+#define REG_FRMBUF_GIE    0x04
+#define REG_FRMBUF_IER    0x08
+#define REG_FRMBUF_ISR    0x0c
+#define REG_FRMBUF_WIDTH  0x10
+#define REG_FRMBUF_HEIGHT 0x18
+#define REG_FRMBUF_STRIDE 0x20
+#define REG_FRMBUF_FMT    0x28
+#define REG_FRMBUF_ADDR   0x30
+#define REG_FRMBUF_ADDR2  0x3c
+
+#define FRMBUF_CTRL_AP_START     (1<<0)
+#define FRMBUF_CTRL_AP_DONE      (1<<1)
+#define FRMBUF_CTRL_AP_IDLE      (1<<2)
+#define FRMBUF_CTRL_AP_READY     (1<<3)
+#define FRMBUF_CTRL_AUTO_RESTART (1<<7)
+
+#define FRMBUF_IRQ_AP_DONE  (1<<0)
+#define FRMBUF_IRQ_AP_READY (1<<1)
+
+/* memory video format: packed 24 bit R, G, B ("rgb888" in the DT) */
+#define FRMBUF_FMT_RGB8 20
+
+#define FRMBUF_BPP 3
+#define FRMBUF_STRIDE_ALIGN 64
+#define FRMBUF_MAX_BUFFERS 4
+
+/* start addresses must be multiples of xlnx,dma-align, so panning moves
+   in steps of lcm(FRMBUF_DMA_ALIGN, FRMBUF_BPP) / FRMBUF_BPP pixels */
+#define FRMBUF_DMA_ALIGN 8
+#define FRMBUF_PAN_STEP 8
+
+struct frmbuf_config {
+    struct ual_bar_tkn *regs;   /* control registers of v_frmbuf_rd_0 */
+    struct ual_bar_tkn *mem;    /* mapping of a physically contiguous
+                                   carve-out (reserved-memory via /dev/mem) */
+    uint32_t mem_phys;          /* bus address of the carve-out */
+    uint32_t mem_size;
+    int num_buffers;            /* 1..FRMBUF_MAX_BUFFERS, 3 = triple buffering */
+    int virt_width;             /* buffer width in pixels, 0 = panel width;
+                                   wider buffers can be panned horizontally */
+    const char *uio_dev;        /* UIO node bound to irq 29, NULL polls ISR */
+};
+
+struct frmbuf_buffer {
+    int index;
+    uint8_t *ptr;
+    uint32_t phys;
+    int width, height, stride;
+};
+
+struct frmbuf_stats {
+    uint64_t frames;    /* frame starts seen (AP_READY interrupts) */
+    uint64_t flips;     /* buffers that reached the screen */
+    uint64_t dropped;   /* queued buffers replaced before being shown */
+    uint64_t repeats;   /* frames that re-scanned the previous buffer */
+};
+
+struct frmbuf;
+
+struct frmbuf *frmbuf_open(const struct frmbuf_config *cfg,
+                           const struct dsi_panel_config *panel);
+void frmbuf_close(struct frmbuf *fb);
+
+/* Takes a free back buffer for drawing, blocking while all are busy */
+struct frmbuf_buffer *frmbuf_get_back(struct frmbuf *fb);
+/* Hands a drawn buffer over for display at the next frame start */
+void frmbuf_queue(struct frmbuf *fb, struct frmbuf_buffer *buf);
+/* Blocks until the next frame start; returns the frame number */
+uint64_t frmbuf_wait_vsync(struct frmbuf *fb);
+/* Buffer currently scanned out, to be used as a read-only reference. Its
+   pixels stay valid only until the next flip: once a queued buffer reaches
+   the screen this one is free again and frmbuf_get_back() may hand it out
+   for drawing. Single-buffer setups never flip. */
+const struct frmbuf_buffer *frmbuf_front(struct frmbuf *fb);
+void frmbuf_get_stats(struct frmbuf *fb, struct frmbuf_stats *st);
+
+/* Moves the visible window of the front buffer to pixel column x (a
+   multiple of FRMBUF_PAN_STEP, at most virt_width - panel width) from the
+   next frame start on; a buffer queued afterwards keeps the position */
+int frmbuf_pan(struct frmbuf *fb, int x);
+/* Window position that the core is scanning out right now */
+int frmbuf_pan_live(struct frmbuf *fb);
+
+#endif
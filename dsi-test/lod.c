@@ -0,0 +1,243 @@
+/*
+ * In-memory min/max level-of-detail pyramid for deep records
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* lod.c - zoom and pan through a deep record at a constant cost.
+ *
+ * Redrawing a view of a record from its samples costs in proportion to
+ * the samples in view: an overview of 100M samples means reading 100 MB
+ * per frame. Here the record carries a min/max pyramid, level 0 with one
+ * entry per 64 samples and each level above one per factor entries of
+ * the one below, all sized for the capacity up front. A view then takes
+ * its columns from the coarsest level that still has an entry per
+ * column, which is between 1 and factor entries per column at any zoom,
+ * so a frame costs the same for 1M or 100M samples.
+ *
+ * The pyramid is built as the data arrives rather than after the
+ * capture: every append recomputes the level 0 entries it touched, and
+ * each level above the entries over those, which is a few entries per
+ * level on top of one pass over the new samples while they are still in
+ * the cache. The published sample count is stored with release order
+ * after that, so a renderer on another thread loading it with acquire
+ * order sees a complete pyramid for everything up to it. The entry at
+ * the end may be widened under it by the next append, but only with
+ * samples that are about to be published anyway. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#include "lod.h"
+
+struct lod {
+    atomic_size_t n;            /* published samples */
+    uint8_t *buf;
+    size_t capacity;
+    int bytes, factor, levels;
+    struct decim_span *lvl[LOD_MAX_LEVELS];
+    uint64_t g[LOD_MAX_LEVELS]; /* samples per entry */
+};
+
+struct lod *lod_create(int bits, size_t capacity, int factor)
+{
+    struct lod *l;
+    size_t e;
+    int k;
+
+    if ((bits != 8 && bits != 16) || (factor != 4 && factor != 16) ||
+        !capacity) {
+        errno = EINVAL;
+        return NULL;
+    }
+    l = calloc(1, sizeof(*l));
+    if (!l)
+        return NULL;
+    l->bytes = bits / 8;
+    l->factor = factor;
+    l->capacity = capacity;
+    l->buf = malloc(capacity * l->bytes);
+    if (!l->buf)
+        goto fail;
+
+    /* up to the first level that fits into a single group */
+    e = (capacity + LOD_BASE - 1) / LOD_BASE;
+    l->g[0] = LOD_BASE;
+    for (k = 0; k < LOD_MAX_LEVELS; k++) {
+        l->lvl[k] = malloc(e * sizeof(struct decim_span));
+        if (!l->lvl[k])
+            goto fail;
+        l->levels = k + 1;
+        if (e <= (size_t)factor)
+            break;
+        e = (e + factor - 1) / factor;
+        if (k + 1 < LOD_MAX_LEVELS)
+            l->g[k + 1] = l->g[k] * factor;
+    }
+    atomic_init(&l->n, 0);
+    return l;
+
+fail:
+    lod_destroy(l);
+    errno = ENOMEM;
+    return NULL;
+}
+
+void lod_destroy(struct lod *l)
+{
+    int k;
+
+    if (!l)
+        return;
+    for (k = 0; k < l->levels; k++)
+        free(l->lvl[k]);
+    free(l->buf);
+    free(l);
+}
+
+void lod_reset(struct lod *l)
+{
+    atomic_store_explicit(&l->n, 0, memory_order_release);
+}
+
+/* Recomputes the entries over samples from .. to - 1, from > to */
+static void update(struct lod *l, size_t from, size_t to)
+{
+    size_t a = from / LOD_BASE, b = (to - 1) / LOD_BASE, e, s, len, cnt;
+    int k;
+
+    for (e = a; e <= b; e++) {
+        s = e * LOD_BASE;
+        len = to - s < LOD_BASE ? to - s : LOD_BASE;
+        if (l->bytes == 1) {
+            int8_t mn, mx;
+
+            decim_block_s8((const int8_t *)l->buf + s, len, &mn, &mx);
+            l->lvl[0][e].min = mn;
+            l->lvl[0][e].max = mx;
+        } else {
+            decim_block_s16((const int16_t *)l->buf + s, len,
+                            &l->lvl[0][e].min, &l->lvl[0][e].max);
+        }
+    }
+    for (k = 1; k < l->levels; k++) {
+        cnt = b + 1;            /* entries of level k - 1 */
+        a /= l->factor;
+        b /= l->factor;
+        for (e = a; e <= b; e++) {
+            s = e * l->factor;
+            len = cnt - s < (size_t)l->factor ? cnt - s : (size_t)l->factor;
+            decim_reduce(l->lvl[k - 1] + s, len, &l->lvl[k][e]);
+        }
+    }
+}
+
+/* Samples [n, n + k) have been stored */
+static void publish(struct lod *l, size_t n, size_t k)
+{
+    if (!k)
+        return;
+    update(l, n, n + k);
+    atomic_store_explicit(&l->n, n + k, memory_order_release);
+}
+
+size_t lod_append(struct lod *l, const void *src, size_t n)
+{
+    size_t have = atomic_load_explicit(&l->n, memory_order_relaxed);
+
+    if (n > l->capacity - have)
+        n = l->capacity - have;
+    memcpy(l->buf + have * l->bytes, src, n * l->bytes);
+    publish(l, have, n);
+    return n;
+}
+
+/* Whole words of free space at the end of the record, NULL if it does
+   not end on a word */
+static uint32_t *word_space(struct lod *l, size_t have, size_t *words)
+{
+    if (have * l->bytes % 4) {
+        *words = 0;
+        return NULL;
+    }
+    *words = (l->capacity - have) * l->bytes / 4;
+    return (uint32_t *)(l->buf + have * l->bytes);
+}
+
+size_t lod_fill_ual(struct lod *l, struct ual_bar_tkn *dev, uint32_t addr,
+                    size_t n)
+{
+    size_t have = atomic_load_explicit(&l->n, memory_order_relaxed), room;
+    uint32_t *dst = word_space(l, have, &room);
+
+    if (n > room)
+        n = room;
+    if (!n)
+        return 0;
+    ual_readl_n(dev, addr, dst, n);
+    publish(l, have, n * 4 / l->bytes);
+    return n;
+}
+
+size_t lod_drain_ual_fifo(struct lod *l, struct ual_bar_tkn *dev,
+                          uint32_t addr, uint32_t level_addr)
+{
+    size_t have = atomic_load_explicit(&l->n, memory_order_relaxed), room, n;
+    uint32_t *dst = word_space(l, have, &room);
+
+    if (!room)
+        return 0;
+    n = ual_readl_fifo(dev, addr, dst, room, level_addr);
+    publish(l, have, n * 4 / l->bytes);
+    return n;
+}
+
+const void *lod_samples(struct lod *l, size_t *n)
+{
+    *n = atomic_load_explicit(&l->n, memory_order_acquire);
+    return l->buf;
+}
+
+long lod_render(struct lod *l, struct decim_span *out, int cols,
+                uint64_t first, uint64_t count)
+{
+    size_t n = atomic_load_explicit(&l->n, memory_order_acquire);
+    uint64_t per;
+    int k = 0;
+
+    if (cols <= 0 || !count || first > n || count > n - first) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    per = count / cols;
+    if (per < LOD_BASE) {
+        if (l->bytes == 1)
+            decim_minmax_s8(out, cols, (const int8_t *)l->buf + first, count);
+        else
+            decim_minmax_s16(out, cols, (const int16_t *)l->buf + first,
+                             count);
+        return 1;
+    }
+    while (k + 1 < l->levels && l->g[k + 1] <= per)
+        k++;
+    decim_spans(out, cols, l->lvl[k], (n + l->g[k] - 1) / l->g[k], l->g[k],
+                first, count);
+    return l->g[k];
+}
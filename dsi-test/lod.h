@@ -0,0 +1,65 @@
+/*
+ * In-memory min/max level-of-detail pyramid for deep records
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __LOD_H
+#define __LOD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ual.h"
+#include "decimate.h"
+
+#define LOD_BASE 64             /* samples per entry of level 0 */
+#define LOD_MAX_LEVELS 12
+
+struct lod;
+
+/* A record of up to capacity samples of 8 or 16 bits, with levels of
+   factor (4 or 16) entries per entry of the level below. Returns NULL
+   with errno = EINVAL for other values. */
+struct lod *lod_create(int bits, size_t capacity, int factor);
+void lod_destroy(struct lod *l);
+/* Empties the record for the next capture */
+void lod_reset(struct lod *l);
+
+/* Producer side, one thread. Each appends samples at the end of the
+   record and brings the pyramid up to date before publishing them; what
+   does not fit into the capacity is not stored. Return the samples, or
+   for the UAL variants the 32-bit words, stored. The UAL variants read
+   whole words into the record and need it to hold whole words. */
+size_t lod_append(struct lod *l, const void *src, size_t n);
+size_t lod_fill_ual(struct lod *l, struct ual_bar_tkn *dev, uint32_t addr,
+                    size_t n);
+/* As sring_drain_ual_fifo(): as many words as the level register reports */
+size_t lod_drain_ual_fifo(struct lod *l, struct ual_bar_tkn *dev,
+                          uint32_t addr, uint32_t level_addr);
+
+/* Consumer side, any thread. The samples published so far, *n of them */
+const void *lod_samples(struct lod *l, size_t *n);
+
+/* Column envelopes for samples first .. first + count of the published
+   record, from the coarsest level with at least one entry per column
+   (see decim_spans() for the precision) or, zoomed in further, exactly
+   as decim_minmax_*() gives them. The cost depends on cols and the
+   factor, not on count. Returns the samples per entry used, 1 for raw
+   samples, or -1 with errno = EINVAL for a range past the record. */
+long lod_render(struct lod *l, struct decim_span *out, int cols,
+                uint64_t first, uint64_t count);
+
+#endif
@@ -0,0 +1,656 @@
+/*
+ * Automatic waveform measurements
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* measure.c - all measurements from one pass over the samples.
+ *
+ * The only pass over the record computes, for every block of 64 samples,
+ * its minimum, maximum, sum and sum of squares (NEON: 8 or 16 lanes of
+ * min/max and widening pairwise adds). Levels, mean and RMS follow from
+ * the block totals directly.
+ *
+ * The timing measurements need the 10/50/90 % levels, which are only
+ * known once the extremes are, so they cannot be found during the pass
+ * itself. They are found afterwards from the block summaries instead: a
+ * search for the next sample beyond a threshold skips every block whose
+ * min/max says it holds none, so only the blocks around edges are looked
+ * at again. An edge is a passage from the 10 % level to the 90 % one (or
+ * back), which also gives hysteresis against noise; the 50 % crossing
+ * inside it gives period and duty cycle, the 10 % and 90 % ones the
+ * rise and fall times, all interpolated between samples.
+ *
+ * Deep records split the block pass with a worker thread on the second
+ * core. In roll mode the block summaries live in a ring next to the
+ * samples, the totals are kept up to date as blocks enter and leave the
+ * window, and a result only costs the walk over the summaries. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MEAS_NEON
+#endif
+
+#include "measure.h"
+
+#define BLK 64
+#define NONE ((size_t)-1)
+#define MIN_AMP 4               /* LSBs; less than that is a flat line */
+#define TIMING (MEAS_FREQ | MEAS_PERIOD | MEAS_RISE | MEAS_FALL | MEAS_DUTY)
+
+struct blk {
+    int64_t sumsq;
+    int32_t sum;
+    int16_t min, max;
+};
+
+struct tot {
+    int64_t sum, sumsq;
+    int min, max;
+    size_t n;
+};
+
+/* Samples seen through their blocks; block b is in slot first + b of a
+   ring of nring slots (a plain array when first is 0 and nring large) */
+struct view {
+    const void *base;
+    const struct blk *blk;
+    int bits;
+    size_t first, nring;
+    size_t n;
+};
+
+struct edges {
+    unsigned int nr, nf, nhigh;
+    double r_first, r_last;     /* 50 % crossings, in samples */
+    double f_first, f_last;
+    double rise, fall, high;    /* sums, in samples */
+};
+
+struct job {
+    const void *src;
+    size_t n, b0, b1;
+    struct tot tot;
+};
+
+struct meas {
+    struct meas_config cfg;
+    struct blk *blk;
+    size_t nblk;
+    int worker;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct job job;
+    int pending, quit;
+};
+
+struct meas_roll {
+    struct meas_config cfg;
+    void *ring;
+    struct blk *blk;
+    size_t nring;               /* slots, one more than the window */
+    size_t head, count, fill;   /* block being filled, complete blocks
+                                   before it, samples in it */
+    int64_t sum, sumsq;
+};
+
+static void block_s16(const int16_t *p, size_t len, struct blk *o)
+{
+    int64_t sq = 0;
+    int32_t sum = 0;
+    int mn = INT16_MAX, mx = INT16_MIN;
+    size_t i = 0;
+
+#ifdef MEAS_NEON
+    if (len == BLK) {
+        int16x8_t v, vmn = vdupq_n_s16(INT16_MAX), vmx = vdupq_n_s16(INT16_MIN);
+        int32x4_t vs = vdupq_n_s32(0);
+        int64x2_t vq = vdupq_n_s64(0), s2;
+        int16x4_t h;
+
+        for (; i < BLK; i += 8) {
+            v = vld1q_s16(p + i);
+            vmn = vminq_s16(vmn, v);
+            vmx = vmaxq_s16(vmx, v);
+            vs = vpadalq_s16(vs, v);
+            vq = vpadalq_s32(vq, vmull_s16(vget_low_s16(v), vget_low_s16(v)));
+            vq = vpadalq_s32(vq, vmull_s16(vget_high_s16(v),
+                                           vget_high_s16(v)));
+        }
+        h = vmin_s16(vget_low_s16(vmn), vget_high_s16(vmn));
+        h = vpmin_s16(h, h);
+        mn = vget_lane_s16(vpmin_s16(h, h), 0);
+        h = vmax_s16(vget_low_s16(vmx), vget_high_s16(vmx));
+        h = vpmax_s16(h, h);
+        mx = vget_lane_s16(vpmax_s16(h, h), 0);
+        s2 = vpaddlq_s32(vs);
+        sum = vgetq_lane_s64(s2, 0) + vgetq_lane_s64(s2, 1);
+        sq = vgetq_lane_s64(vq, 0) + vgetq_lane_s64(vq, 1);
+    }
+#endif
+    for (; i < len; i++) {
+        if (p[i] < mn)
+            mn = p[i];
+        if (p[i] > mx)
+            mx = p[i];
+        sum += p[i];
+        sq += p[i] * p[i];
+    }
+    o->min = mn;
+    o->max = mx;
+    o->sum = sum;
+    o->sumsq = sq;
+}
+
+static void block_s8(const int8_t *p, size_t len, struct blk *o)
+{
+    int64_t sq = 0;
+    int32_t sum = 0;
+    int mn = INT8_MAX, mx = INT8_MIN;
+    size_t i = 0;
+
+#ifdef MEAS_NEON
+    if (len == BLK) {
+        int8x16_t v, vmn = vdupq_n_s8(INT8_MAX), vmx = vdupq_n_s8(INT8_MIN);
+        int16x8_t vs = vdupq_n_s16(0);
+        int32x4_t vq = vdupq_n_s32(0);
+        int64x2_t s2;
+        int8x8_t h;
+
+        /* 16384 per square and 4 loads: no lane can overflow */
+        for (; i < BLK; i += 16) {
+            v = vld1q_s8(p + i);
+            vmn = vminq_s8(vmn, v);
+            vmx = vmaxq_s8(vmx, v);
+            vs = vpadalq_s8(vs, v);
+            vq = vpadalq_s16(vq, vmull_s8(vget_low_s8(v), vget_low_s8(v)));
+            vq = vpadalq_s16(vq, vmull_s8(vget_high_s8(v), vget_high_s8(v)));
+        }
+        h = vmin_s8(vget_low_s8(vmn), vget_high_s8(vmn));
+        h = vpmin_s8(h, h);
+        h = vpmin_s8(h, h);
+        mn = vget_lane_s8(vpmin_s8(h, h), 0);
+        h = vmax_s8(vget_low_s8(vmx), vget_high_s8(vmx));
+        h = vpmax_s8(h, h);
+        h = vpmax_s8(h, h);
+        mx = vget_lane_s8(vpmax_s8(h, h), 0);
+        s2 = vpaddlq_s32(vpaddlq_s16(vs));
+        sum = vgetq_lane_s64(s2, 0) + vgetq_lane_s64(s2, 1);
+        s2 = vpaddlq_s32(vq);
+        sq = vgetq_lane_s64(s2, 0) + vgetq_lane_s64(s2, 1);
+    }
+#endif
+    for (; i < len; i++) {
+        if (p[i] < mn)
+            mn = p[i];
+        if (p[i] > mx)
+            mx = p[i];
+        sum += p[i];
+        sq += p[i] * p[i];
+    }
+    o->min = mn;
+    o->max = mx;
+    o->sum = sum;
+    o->sumsq = sq;
+}
+
+static void block(int bits, const void *p, size_t len, struct blk *o)
+{
+    if (bits == 8)
+        block_s8(p, len, o);
+    else
+        block_s16(p, len, o);
+}
+
+static void tot_init(struct tot *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->min = INT_MAX;
+    t->max = INT_MIN;
+}
+
+static void tot_add(struct tot *t, const struct blk *b)
+{
+    t->sum += b->sum;
+    t->sumsq += b->sumsq;
+    if (b->min < t->min)
+        t->min = b->min;
+    if (b->max > t->max)
+        t->max = b->max;
+}
+
+static void tot_merge(struct tot *t, const struct tot *o)
+{
+    t->sum += o->sum;
+    t->sumsq += o->sumsq;
+    t->n += o->n;
+    if (o->min < t->min)
+        t->min = o->min;
+    if (o->max > t->max)
+        t->max = o->max;
+}
+
+/* Blocks b0 .. b1 - 1 of a record of n samples */
+static void summarize(int bits, const void *src, size_t n, size_t b0,
+                      size_t b1, struct blk *blk, struct tot *t)
+{
+    size_t b, len;
+
+    tot_init(t);
+    for (b = b0; b < b1; b++) {
+        len = n - b * BLK < BLK ? n - b * BLK : BLK;
+        block(bits, (const uint8_t *)src + b * BLK * (bits / 8), len,
+              &blk[b]);
+        tot_add(t, &blk[b]);
+        t->n += len;
+    }
+}
+
+static inline size_t slot(const struct view *v, size_t b)
+{
+    b += v->first;
+    return b >= v->nring ? b - v->nring : b;
+}
+
+static inline int at(const struct view *v, size_t i)
+{
+    size_t o = slot(v, i / BLK) * BLK + i % BLK;
+
+    return v->bits == 8 ? ((const int8_t *)v->base)[o] :
+                          ((const int16_t *)v->base)[o];
+}
+
+/* Samples of block b and where the block after it starts */
+static const void *bptr(const struct view *v, size_t b, size_t *end)
+{
+    *end = (b + 1) * BLK < v->n ? (b + 1) * BLK : v->n;
+    return (const uint8_t *)v->base + slot(v, b) * BLK * (v->bits / 8);
+}
+
+#define X(p, bits, k) ((bits) == 8 ? ((const int8_t *)(p))[k] : \
+                                     ((const int16_t *)(p))[k])
+
+/* First sample from i on at or above thr (up), or at or below it */
+static size_t fwd(const struct view *v, size_t i, double thr, int up)
+{
+    const void *p;
+    size_t b, end;
+    int x;
+
+    while (i < v->n) {
+        b = i / BLK;
+        p = bptr(v, b, &end);
+        if (up ? v->blk[slot(v, b)].max >= thr :
+                 v->blk[slot(v, b)].min <= thr) {
+            for (; i < end; i++) {
+                x = X(p, v->bits, i - b * BLK);
+                if (up ? x >= thr : x <= thr)
+                    return i;
+            }
+        }
+        i = end;
+    }
+    return v->n;
+}
+
+/* Last sample before i at or below thr (below), or at or above it */
+static size_t back(const struct view *v, size_t i, double thr, int below)
+{
+    const void *p;
+    size_t b, end;
+    int x;
+
+    while (i > 0) {
+        b = (i - 1) / BLK;
+        p = bptr(v, b, &end);
+        if (below ? v->blk[slot(v, b)].min <= thr :
+                    v->blk[slot(v, b)].max >= thr) {
+            while (i > b * BLK) {
+                x = X(p, v->bits, --i - b * BLK);
+                if (below ? x <= thr : x >= thr)
+                    return i;
+            }
+        }
+        i = b * BLK;
+    }
+    return NONE;
+}
+
+/* Where the signal goes through thr between samples j and j + 1 */
+static double interp(const struct view *v, size_t j, double thr)
+{
+    int a = at(v, j), b = at(v, j + 1);
+
+    return j + (thr - a) / (b - a);
+}
+
+static void walk(const struct view *v, int min, int max, struct edges *e)
+{
+    double amp = max - min, lo = min + 0.1 * amp, hi = min + 0.9 * amp;
+    double mid = min + 0.5 * amp, t10, t50, t90;
+    size_t i, j;
+    int high;
+
+    memset(e, 0, sizeof(*e));
+    if (amp < MIN_AMP)
+        return;
+
+    /* the state is unknown until the signal is beyond 10 % or 90 % */
+    i = fwd(v, 0, lo, 0);
+    j = fwd(v, 0, hi, 1);
+    high = j < i;
+    i = high ? j : i;
+
+    /* every crossing searched backwards exists: the state was entered
+       beyond the far threshold */
+    for (;;) {
+        if (!high) {
+            i = fwd(v, i, hi, 1);
+            if (i == v->n)
+                break;
+            t90 = interp(v, i - 1, hi);
+            j = back(v, i, mid, 1);
+            t50 = interp(v, j, mid);
+            t10 = interp(v, back(v, j + 1, lo, 1), lo);
+            e->rise += t90 - t10;
+            if (!e->nr++)
+                e->r_first = t50;
+            e->r_last = t50;
+        } else {
+            i = fwd(v, i, lo, 0);
+            if (i == v->n)
+                break;
+            t10 = interp(v, i - 1, lo);
+            j = back(v, i, mid, 0);
+            t50 = interp(v, j, mid);
+            t90 = interp(v, back(v, j + 1, hi, 0), hi);
+            e->fall += t10 - t90;
+            if (!e->nf++)
+                e->f_first = t50;
+            e->f_last = t50;
+            if (e->nr) {
+                e->high += t50 - e->r_last;
+                e->nhigh++;
+            }
+        }
+        high = !high;
+    }
+}
+
+static void finish(const struct meas_config *c, const struct tot *t,
+                   const struct view *v, struct meas_result *r)
+{
+    double k = c->volts_per_lsb, o = c->offset, mean, ms, a, b;
+    unsigned int want = c->enable;
+    struct edges e;
+
+    memset(r, 0, sizeof(*r));
+    if (!t->n)
+        return;
+
+    a = t->min * k + o;
+    b = t->max * k + o;
+    r->min = a < b ? a : b;
+    r->max = a < b ? b : a;
+    r->vpp = r->max - r->min;
+    mean = (double)t->sum / t->n;
+    ms = (double)t->sumsq / t->n;
+    r->mean = mean * k + o;
+    r->rms = sqrt(k * k * ms + 2 * k * o * mean + o * o);
+    r->valid = want & (MEAS_MIN | MEAS_MAX | MEAS_VPP | MEAS_MEAN | MEAS_RMS);
+
+    if (!(want & TIMING))
+        return;
+    walk(v, t->min, t->max, &e);
+    r->rising = e.nr;
+    r->falling = e.nf;
+    if (e.nr >= 2)
+        r->period = (e.r_last - e.r_first) / (e.nr - 1);
+    else if (e.nf >= 2)
+        r->period = (e.f_last - e.f_first) / (e.nf - 1);
+    if (r->period > 0) {
+        r->valid |= want & (MEAS_PERIOD | MEAS_FREQ);
+        if (e.nhigh) {
+            r->duty = 100 * e.high / e.nhigh / r->period;
+            r->valid |= want & MEAS_DUTY;
+        }
+        r->period *= c->sample_period;
+        r->freq = 1 / r->period;
+    }
+    if (e.nr) {
+        r->rise = e.rise / e.nr * c->sample_period;
+        r->valid |= want & MEAS_RISE;
+    }
+    if (e.nf) {
+        r->fall = e.fall / e.nf * c->sample_period;
+        r->valid |= want & MEAS_FALL;
+    }
+}
+
+static int config_ok(const struct meas_config *cfg)
+{
+    return (cfg->bits == 8 || cfg->bits == 16) &&
+           cfg->threads >= 1 && cfg->threads <= 2 &&
+           (!(cfg->enable & TIMING) || cfg->sample_period > 0);
+}
+
+static void *worker(void *arg)
+{
+    struct meas *m = arg;
+    struct job *j = &m->job;
+
+    pthread_mutex_lock(&m->lock);
+    for (;;) {
+        while (!m->pending && !m->quit)
+            pthread_cond_wait(&m->cond, &m->lock);
+        if (m->quit)
+            break;
+        pthread_mutex_unlock(&m->lock);
+        summarize(m->cfg.bits, j->src, j->n, j->b0, j->b1, m->blk, &j->tot);
+        pthread_mutex_lock(&m->lock);
+        m->pending = 0;
+        pthread_cond_broadcast(&m->cond);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return NULL;
+}
+
+struct meas *meas_create(const struct meas_config *cfg)
+{
+    struct meas *m;
+
+    if (!config_ok(cfg)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    m = calloc(1, sizeof(*m));
+    if (!m)
+        return NULL;
+    m->cfg = *cfg;
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->cond, NULL);
+    if (cfg->threads > 1) {
+        if (pthread_create(&m->thread, NULL, worker, m)) {
+            meas_destroy(m);
+            return NULL;
+        }
+        m->worker = 1;
+    }
+    return m;
+}
+
+void meas_destroy(struct meas *m)
+{
+    if (!m)
+        return;
+    if (m->worker) {
+        pthread_mutex_lock(&m->lock);
+        m->quit = 1;
+        pthread_cond_broadcast(&m->cond);
+        pthread_mutex_unlock(&m->lock);
+        pthread_join(m->thread, NULL);
+    }
+    pthread_mutex_destroy(&m->lock);
+    pthread_cond_destroy(&m->cond);
+    free(m->blk);
+    free(m);
+}
+
+int meas_run(struct meas *m, const void *src, size_t n,
+             struct meas_result *res)
+{
+    size_t nblk = (n + BLK - 1) / BLK, half = nblk;
+    struct view v = {src, NULL, m->cfg.bits, 0, nblk, n};
+    struct blk *blk;
+    struct tot t;
+
+    if (nblk > m->nblk) {
+        blk = realloc(m->blk, nblk * sizeof(*blk));
+        if (!blk)
+            return -1;
+        m->blk = blk;
+        m->nblk = nblk;
+    }
+    v.blk = m->blk;
+
+    /* the second half of a deep record goes to the other core */
+    if (m->worker && n >= MEAS_PAR_MIN) {
+        half = nblk / 2;
+        pthread_mutex_lock(&m->lock);
+        m->job.src = src;
+        m->job.n = n;
+        m->job.b0 = half;
+        m->job.b1 = nblk;
+        m->pending = 1;
+        pthread_cond_broadcast(&m->cond);
+        pthread_mutex_unlock(&m->lock);
+    }
+    summarize(m->cfg.bits, src, n, 0, half, m->blk, &t);
+    if (half < nblk) {
+        pthread_mutex_lock(&m->lock);
+        while (m->pending)
+            pthread_cond_wait(&m->cond, &m->lock);
+        pthread_mutex_unlock(&m->lock);
+        tot_merge(&t, &m->job.tot);
+    }
+
+    finish(&m->cfg, &t, &v, res);
+    return 0;
+}
+
+struct meas_roll *meas_roll_create(const struct meas_config *cfg,
+                                   size_t window)
+{
+    struct meas_roll *r;
+
+    if (!config_ok(cfg) || !window) {
+        errno = EINVAL;
+        return NULL;
+    }
+    r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+    r->cfg = *cfg;
+    r->nring = (window + BLK - 1) / BLK + 1;
+    r->ring = malloc(r->nring * BLK * (cfg->bits / 8));
+    r->blk = malloc(r->nring * sizeof(*r->blk));
+    if (!r->ring || !r->blk) {
+        meas_roll_destroy(r);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return r;
+}
+
+void meas_roll_destroy(struct meas_roll *r)
+{
+    if (!r)
+        return;
+    free(r->ring);
+    free(r->blk);
+    free(r);
+}
+
+void meas_roll_reset(struct meas_roll *r)
+{
+    r->head = r->count = r->fill = 0;
+    r->sum = r->sumsq = 0;
+}
+
+/* The block at head is complete: it enters the window, and the oldest
+   one leaves it once the window is full */
+static void roll_block(struct meas_roll *r)
+{
+    size_t sz = r->cfg.bits / 8, old;
+    struct blk *b = &r->blk[r->head];
+
+    if (r->count == r->nring - 1) {
+        old = (r->head + 1) % r->nring;
+        r->sum -= r->blk[old].sum;
+        r->sumsq -= r->blk[old].sumsq;
+        r->count--;
+    }
+    block(r->cfg.bits, (uint8_t *)r->ring + r->head * BLK * sz, BLK, b);
+    r->sum += b->sum;
+    r->sumsq += b->sumsq;
+    r->count++;
+    r->head = (r->head + 1) % r->nring;
+    r->fill = 0;
+}
+
+void meas_roll_push(struct meas_roll *r, const void *src, size_t n)
+{
+    size_t sz = r->cfg.bits / 8, k;
+    const uint8_t *s = src;
+
+    while (n) {
+        k = BLK - r->fill < n ? BLK - r->fill : n;
+        memcpy((uint8_t *)r->ring + (r->head * BLK + r->fill) * sz, s,
+               k * sz);
+        r->fill += k;
+        s += k * sz;
+        n -= k;
+        if (r->fill == BLK)
+            roll_block(r);
+    }
+}
+
+int meas_roll_result(struct meas_roll *r, struct meas_result *res)
+{
+    struct view v = {r->ring, r->blk, r->cfg.bits,
+                     (r->head + r->nring - r->count) % r->nring, r->nring,
+                     r->count * BLK};
+    struct tot t;
+    size_t b;
+
+    tot_init(&t);
+    for (b = 0; b < r->count; b++)
+        tot_add(&t, &r->blk[slot(&v, b)]);
+    t.sum = r->sum;
+    t.sumsq = r->sumsq;
+    t.n = v.n;
+    finish(&r->cfg, &t, &v, res);
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Automatic waveform measurements
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __MEASURE_H
+#define __MEASURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEAS_MIN        (1 << 0)
+#define MEAS_MAX        (1 << 1)
+#define MEAS_VPP        (1 << 2)
+#define MEAS_MEAN       (1 << 3)
+#define MEAS_RMS        (1 << 4)
+#define MEAS_FREQ       (1 << 5)
+#define MEAS_PERIOD     (1 << 6)
+#define MEAS_RISE       (1 << 7)    /* 10 % to 90 % */
+#define MEAS_FALL       (1 << 8)
+#define MEAS_DUTY       (1 << 9)
+#define MEAS_ALL        ((1 << 10) - 1)
+
+/* Records with at least this many samples use the second core */
+#define MEAS_PAR_MIN    (256 * 1024)
+
+struct meas_config {
+    unsigned int enable;        /* MEAS_* */
+    int bits;                   /* 8 or 16 bit samples */
+    double volts_per_lsb;       /* volts = sample * volts_per_lsb + offset */
+    double offset;
+    double sample_period;       /* seconds */
+    int threads;                /* 1, or 2 to split deep records */
+};
+
+/* Levels in volts, times in seconds, duty in percent. Only the
+   measurements flagged in 'valid' hold a value: the rest were either not
+   enabled or not measurable (a flat line has no frequency). */
+struct meas_result {
+    unsigned int valid;
+    double min, max, vpp, mean, rms;
+    double freq, period, rise, fall, duty;
+    unsigned int rising, falling;   /* edges the timings are based on */
+};
+
+struct meas;
+
+struct meas *meas_create(const struct meas_config *cfg);
+void meas_destroy(struct meas *m);
+
+/* All enabled measurements of one acquisition of n samples */
+int meas_run(struct meas *m, const void *src, size_t n,
+             struct meas_result *res);
+
+/* Roll mode: measurements over the last 'window' samples of a stream
+   (rounded up to a multiple of 64). Samples only count once their block
+   of 64 is complete, so the newest 63 may not be included yet. */
+struct meas_roll;
+
+struct meas_roll *meas_roll_create(const struct meas_config *cfg,
+                                   size_t window);
+void meas_roll_destroy(struct meas_roll *r);
+void meas_roll_push(struct meas_roll *r, const void *src, size_t n);
+void meas_roll_reset(struct meas_roll *r);
+int meas_roll_result(struct meas_roll *r, struct meas_result *res);
+
+#endif
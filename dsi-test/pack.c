@@ -0,0 +1,642 @@
+/*
+ * Lossless delta/bit-pack compression of captured samples
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* pack.c - captures to the SD card at a fraction of their size.
+ *
+ * Sampled waveforms change little from one sample to the next, so the
+ * differences are small numbers even where the samples are not. Each
+ * block stores its first sample, then groups of 128 differences, zigzag
+ * mapped (0, -1, 1, -2, ... to 0, 1, 2, 3, ...) so that small negative
+ * ones are small too, and packed at the bit width of the largest in the
+ * group: one width byte, then 16 bytes per bit. Noise sets the width
+ * group by group; a flat line takes one byte per 128 samples, full
+ * scale noise barely grows. Differences are taken modulo 2^bits, so
+ * they never need more bits than the samples and every input round trips
+ * exactly.
+ *
+ * The packing is vertical, to suit 8 lane vectors: lane l of a group
+ * holds samples l, l + 8, ..., l + 120, each lane a bit stream of its
+ * own in 16-bit words that are stored interleaved with the other lanes.
+ * Packing and unpacking then use the same shift for all lanes at every
+ * step, and one NEON instruction moves eight values. The plain C loops
+ * produce the same bytes and are the reference.
+ *
+ * Blocks do not depend on each other; the files written here keep an
+ * index of where each starts, so any sample is one block decode away.
+ * The encoding runs on a worker thread that also writes, fed through a
+ * few block buffers, so the producer only copies samples. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PACK_NEON
+#endif
+
+#include "pack.h"
+
+#define PACK_MAGIC "DSOPACK\n"
+#define PACK_VERSION 1
+#define PACK_BUFFERS 4
+#define LANES 8
+
+/* Differences of a group, zigzag mapped; returns their bitwise or */
+static unsigned int deltas(const void *src, int bits, size_t n,
+                           int16_t *prev, uint16_t *z)
+{
+    unsigned int all = 0;
+    size_t i = 0;
+    int16_t x, p = *prev;
+    uint16_t d;
+
+#ifdef PACK_NEON
+    if (n == PACK_GROUP) {
+        int16x8_t pv = vdupq_n_s16(p), cur, dv;
+        uint16x8_t acc = vdupq_n_u16(0), zv;
+        uint16x4_t r;
+
+        for (; i < n; i += LANES) {
+            if (bits == 8)
+                cur = vmovl_s8(vld1_s8((const int8_t *)src + i));
+            else
+                cur = vld1q_s16((const int16_t *)src + i);
+            dv = vsubq_s16(cur, vextq_s16(pv, cur, 7));
+            if (bits == 8)
+                dv = vshrq_n_s16(vshlq_n_s16(dv, 8), 8);
+            zv = vreinterpretq_u16_s16(veorq_s16(vshlq_n_s16(dv, 1),
+                                                 vshrq_n_s16(dv, 15)));
+            vst1q_u16(z + i, zv);
+            acc = vorrq_u16(acc, zv);
+            pv = cur;
+        }
+        r = vorr_u16(vget_low_u16(acc), vget_high_u16(acc));
+        r = vorr_u16(r, vext_u16(r, r, 2));
+        r = vorr_u16(r, vext_u16(r, r, 1));
+        *prev = vgetq_lane_s16(pv, 7);
+        return vget_lane_u16(r, 0);
+    }
+#endif
+    for (; i < n; i++) {
+        x = bits == 8 ? ((const int8_t *)src)[i] : ((const int16_t *)src)[i];
+        d = bits == 8 ? (uint16_t)(int8_t)(x - p) : (uint16_t)(x - p);
+        z[i] = (uint16_t)(d << 1) ^ (uint16_t)-(d >> 15);
+        all |= z[i];
+        p = x;
+    }
+    for (; i < PACK_GROUP; i++)
+        z[i] = 0;
+    *prev = p;
+    return all;
+}
+
+/* Lane l of z to 16-bit words l, l + 8, ... of dst: w words per lane */
+static void pack_group(const uint16_t *z, int w, uint8_t *dst)
+{
+#ifdef PACK_NEON
+    uint16x8_t acc = vdupq_n_u16(0), v;
+    int j, nb = 0;
+
+    for (j = 0; j < PACK_GROUP / LANES; j++) {
+        v = vld1q_u16(z + j * LANES);
+        acc = vorrq_u16(acc, vshlq_u16(v, vdupq_n_s16(nb)));
+        nb += w;
+        if (nb >= 16) {
+            vst1q_u8(dst, vreinterpretq_u8_u16(acc));
+            dst += 2 * LANES;
+            /* what did not fit of v, shifted in at nb - w */
+            acc = vshlq_u16(v, vdupq_n_s16(nb - w - 16));
+            nb -= 16;
+        }
+    }
+#else
+    uint32_t acc;
+    int l, j, k, nb;
+    uint16_t word;
+
+    for (l = 0; l < LANES; l++) {
+        acc = 0;
+        nb = 0;
+        k = 0;
+        for (j = 0; j < PACK_GROUP / LANES; j++) {
+            acc |= (uint32_t)z[j * LANES + l] << nb;
+            nb += w;
+            if (nb >= 16) {
+                word = acc;
+                memcpy(dst + (k++ * LANES + l) * 2, &word, 2);
+                acc >>= 16;
+                nb -= 16;
+            }
+        }
+    }
+#endif
+}
+
+/* Inverse of pack_group() */
+static void unpack_group(const uint8_t *src, int w, uint16_t *z)
+{
+    uint16_t mask = w == 16 ? 0xffff : (1u << w) - 1;
+    int j, k, o;
+#ifdef PACK_NEON
+    uint16x8_t m = vdupq_n_u16(mask), v;
+
+    for (j = 0; j < PACK_GROUP / LANES; j++) {
+        k = j * w / 16;
+        o = j * w % 16;
+        /* byte loads, the groups are not aligned */
+        v = vshlq_u16(vreinterpretq_u16_u8(vld1q_u8(src + k * 16)),
+                      vdupq_n_s16(-o));
+        if (o + w > 16)
+            v = vorrq_u16(v, vshlq_u16(vreinterpretq_u16_u8(
+                                           vld1q_u8(src + k * 16 + 16)),
+                                       vdupq_n_s16(16 - o)));
+        vst1q_u16(z + j * LANES, vandq_u16(v, m));
+    }
+#else
+    uint16_t a, b;
+    int l;
+
+    for (j = 0; j < PACK_GROUP / LANES; j++) {
+        k = j * w / 16;
+        o = j * w % 16;
+        for (l = 0; l < LANES; l++) {
+            memcpy(&a, src + (k * LANES + l) * 2, 2);
+            a >>= o;
+            if (o + w > 16) {
+                memcpy(&b, src + ((k + 1) * LANES + l) * 2, 2);
+                a |= b << (16 - o);
+            }
+            z[j * LANES + l] = a & mask;
+        }
+    }
+#endif
+}
+
+/* Running sum of the differences in z, n of them, from *prev on */
+static void undeltas(const uint16_t *z, int bits, size_t n, int16_t *prev,
+                     void *dst)
+{
+    int16_t p = *prev, d;
+    size_t i = 0;
+
+#ifdef PACK_NEON
+    if (n == PACK_GROUP) {
+        int16x8_t pv = vdupq_n_s16(p), zero = vdupq_n_s16(0), s;
+        uint16x8_t v;
+
+        for (; i < n; i += LANES) {
+            v = vld1q_u16(z + i);
+            s = veorq_s16(vreinterpretq_s16_u16(vshrq_n_u16(v, 1)),
+                          vnegq_s16(vreinterpretq_s16_u16(
+                              vandq_u16(v, vdupq_n_u16(1)))));
+            /* prefix sum in three steps, then the carry from before */
+            s = vaddq_s16(s, vextq_s16(zero, s, 7));
+            s = vaddq_s16(s, vextq_s16(zero, s, 6));
+            s = vaddq_s16(s, vextq_s16(zero, s, 4));
+            s = vaddq_s16(s, vdupq_n_s16(vgetq_lane_s16(pv, 7)));
+            if (bits == 8)
+                vst1_s8((int8_t *)dst + i, vmovn_s16(s));
+            else
+                vst1q_s16((int16_t *)dst + i, s);
+            pv = s;
+        }
+        *prev = vgetq_lane_s16(pv, 7);
+        return;
+    }
+#endif
+    for (; i < n; i++) {
+        d = (int16_t)((z[i] >> 1) ^ (uint16_t)-(z[i] & 1));
+        p = (int16_t)(p + d);
+        if (bits == 8)
+            ((int8_t *)dst)[i] = p;
+        else
+            ((int16_t *)dst)[i] = p;
+    }
+    *prev = p;
+}
+
+size_t pack_encode(const void *src, int bits, size_t n, uint8_t *dst)
+{
+    uint16_t z[PACK_GROUP];
+    size_t i, len, bytes = bits / 8, o = 2;
+    unsigned int all;
+    int16_t prev;
+    int w;
+
+    prev = bits == 8 ? *(const int8_t *)src : *(const int16_t *)src;
+    memcpy(dst, &prev, 2);
+    for (i = 0; i < n; i += PACK_GROUP) {
+        len = n - i < PACK_GROUP ? n - i : PACK_GROUP;
+        all = deltas((const uint8_t *)src + i * bytes, bits, len, &prev, z);
+        w = all ? 32 - __builtin_clz(all) : 0;
+        dst[o++] = w;
+        if (w)
+            pack_group(z, w, dst + o);
+        o += 16 * w;
+    }
+    return o;
+}
+
+long pack_decode(const uint8_t *src, size_t len, int bits, size_t n,
+                 void *dst)
+{
+    uint16_t z[PACK_GROUP];
+    size_t i, k, bytes = bits / 8, o = 2;
+    int16_t prev;
+    int w;
+
+    if (len < 2 || (bits != 8 && bits != 16)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&prev, src, 2);
+    for (i = 0; i < n; i += PACK_GROUP) {
+        k = n - i < PACK_GROUP ? n - i : PACK_GROUP;
+        if (o >= len || src[o] > 16 || len - o - 1 < 16u * src[o]) {
+            errno = EINVAL;
+            return -1;
+        }
+        w = src[o++];
+        if (w)
+            unpack_group(src + o, w, z);
+        else
+            memset(z, 0, sizeof(z));
+        o += 16 * w;
+        undeltas(z, bits, k, &prev, (uint8_t *)dst + i * bytes);
+    }
+    return o;
+}
+
+/* Files: header, blocks, index of block offsets plus the end */
+struct file_header {
+    char magic[8];
+    uint32_t version, bits;
+    uint32_t block, reserved;
+    uint64_t samples;
+    uint64_t blocks;
+    uint64_t index_offset;      /* 0 until finished */
+};
+
+struct pack_writer {
+    int fd;
+    size_t bytes;
+    struct file_header h;
+
+    /* buffers [tail, head) are queued, head is being filled */
+    uint8_t *raw[PACK_BUFFERS];
+    size_t count[PACK_BUFFERS];
+    unsigned int head, tail;
+    size_t fill;
+    int quit, error;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+
+    /* worker */
+    uint8_t *out;
+    uint64_t *index;
+    size_t max_index;
+    uint64_t off;
+
+    struct pack_stats st;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static int pwrite_all(int fd, const void *p, size_t len, uint64_t off)
+{
+    ssize_t r;
+
+    while (len) {
+        r = pwrite(fd, p, len, off);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p = (const uint8_t *)p + r;
+        len -= r;
+        off += r;
+    }
+    return 0;
+}
+
+/* Encodes and writes one block, adding it to the index */
+static int put_block(struct pack_writer *w, const uint8_t *src, size_t n)
+{
+    uint64_t t0 = now_ns(), t1, *p;
+    size_t len;
+
+    if (w->h.blocks + 2 > w->max_index) {
+        w->max_index = w->max_index ? w->max_index * 2 : 1024;
+        p = realloc(w->index, w->max_index * sizeof(*p));
+        if (!p)
+            return -1;
+        w->index = p;
+    }
+    len = pack_encode(src, w->h.bits, n, w->out);
+    t1 = now_ns();
+    if (pwrite_all(w->fd, w->out, len, w->off))
+        return -1;
+    w->index[w->h.blocks++] = w->off;
+    w->off += len;
+    w->st.encode_ns += t1 - t0;
+    w->st.write_ns += now_ns() - t1;
+    w->st.samples += n;
+    w->st.packed_bytes += len;
+    return 0;
+}
+
+static void *worker(void *arg)
+{
+    struct pack_writer *w = arg;
+    unsigned int b;
+    int err;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->tail == w->head && !w->quit)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->tail == w->head)
+            break;
+        b = w->tail % PACK_BUFFERS;
+        pthread_mutex_unlock(&w->lock);
+
+        err = w->error ? 0 : put_block(w, w->raw[b], w->count[b]) ? errno : 0;
+
+        pthread_mutex_lock(&w->lock);
+        if (err && !w->error)
+            w->error = err;
+        w->tail++;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static void writer_free(struct pack_writer *w)
+{
+    int b;
+
+    for (b = 0; b < PACK_BUFFERS; b++)
+        free(w->raw[b]);
+    free(w->out);
+    free(w->index);
+    free(w);
+}
+
+struct pack_writer *pack_create(const char *path, int bits, size_t block)
+{
+    struct pack_writer *w;
+    int b;
+
+    if (!block)
+        block = PACK_DEFAULT_BLOCK;
+    if ((bits != 8 && bits != 16) || block % PACK_GROUP ||
+        block > UINT32_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    w = calloc(1, sizeof(*w));
+    if (!w)
+        return NULL;
+    memcpy(w->h.magic, PACK_MAGIC, 8);
+    w->h.version = PACK_VERSION;
+    w->h.bits = bits;
+    w->h.block = block;
+    w->bytes = bits / 8;
+    w->off = sizeof(w->h);
+    for (b = 0; b < PACK_BUFFERS; b++)
+        if (!(w->raw[b] = malloc(block * w->bytes)))
+            goto nomem;
+    if (!(w->out = malloc(PACK_BOUND(block))))
+        goto nomem;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        writer_free(w);
+        return NULL;
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->thread, NULL, worker, w)) {
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        close(w->fd);
+        writer_free(w);
+        errno = EAGAIN;
+        return NULL;
+    }
+    return w;
+
+nomem:
+    writer_free(w);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* Hands the buffer being filled to the worker; waits for a free one */
+static int queue(struct pack_writer *w, int *stalled)
+{
+    pthread_mutex_lock(&w->lock);
+    w->count[w->head % PACK_BUFFERS] = w->fill;
+    w->head++;
+    w->fill = 0;
+    pthread_cond_broadcast(&w->cond);
+    while (w->head - w->tail == PACK_BUFFERS) {
+        if (!*stalled) {
+            w->st.stalls++;
+            *stalled = 1;
+        }
+        pthread_cond_wait(&w->cond, &w->lock);
+    }
+    if (w->error) {
+        errno = w->error;
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+int pack_write(struct pack_writer *w, const void *src, size_t n)
+{
+    size_t k, done = 0;
+    int stalled = 0;
+
+    while (done < n) {
+        k = w->h.block - w->fill < n - done ? w->h.block - w->fill : n - done;
+        memcpy(w->raw[w->head % PACK_BUFFERS] + w->fill * w->bytes,
+               (const uint8_t *)src + done * w->bytes, k * w->bytes);
+        w->fill += k;
+        done += k;
+        w->st.raw_bytes += k * w->bytes;
+        if (w->fill == w->h.block && queue(w, &stalled))
+            return -1;
+    }
+    return 0;
+}
+
+int pack_finish(struct pack_writer *w, struct pack_stats *st)
+{
+    int stalled = 0, ret = 0;
+
+    if (w->fill)
+        queue(w, &stalled);
+    pthread_mutex_lock(&w->lock);
+    w->quit = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+
+    if (w->error) {
+        errno = w->error;
+        ret = -1;
+    } else if (!w->index && !(w->index = malloc(sizeof(*w->index)))) {
+        ret = -1;
+    } else {
+        w->index[w->h.blocks] = w->off;
+        w->h.samples = w->st.samples;
+        w->h.index_offset = w->off;
+        ret = pwrite_all(w->fd, w->index,
+                         (w->h.blocks + 1) * sizeof(*w->index), w->off);
+        if (!ret)
+            ret = pwrite_all(w->fd, &w->h, sizeof(w->h), 0);
+    }
+    if (close(w->fd))
+        ret = -1;
+    if (st)
+        *st = w->st;
+    writer_free(w);
+    return ret;
+}
+
+struct pack_file {
+    int fd;
+    struct file_header h;
+    uint64_t *index;
+    uint8_t *in, *cache;
+    uint64_t cached;            /* block in cache, or ~0 */
+};
+
+void pack_close(struct pack_file *f)
+{
+    if (!f)
+        return;
+    close(f->fd);
+    free(f->index);
+    free(f->in);
+    free(f->cache);
+    free(f);
+}
+
+struct pack_file *pack_open(const char *path)
+{
+    struct pack_file *f = calloc(1, sizeof(*f));
+    size_t len;
+    uint64_t b;
+
+    if (!f)
+        return NULL;
+    f->fd = open(path, O_RDONLY);
+    if (f->fd < 0) {
+        free(f);
+        return NULL;
+    }
+    if (pread(f->fd, &f->h, sizeof(f->h), 0) != sizeof(f->h) ||
+        memcmp(f->h.magic, PACK_MAGIC, 8) || f->h.version != PACK_VERSION ||
+        (f->h.bits != 8 && f->h.bits != 16) || !f->h.block ||
+        f->h.block % PACK_GROUP || !f->h.index_offset ||
+        f->h.blocks != (f->h.samples + f->h.block - 1) / f->h.block)
+        goto invalid;
+
+    len = (f->h.blocks + 1) * sizeof(*f->index);
+    f->index = malloc(len);
+    f->in = malloc(PACK_BOUND(f->h.block));
+    f->cache = malloc((size_t)f->h.block * f->h.bits / 8);
+    if (!f->index || !f->in || !f->cache) {
+        pack_close(f);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (pread(f->fd, f->index, len, f->h.index_offset) != (ssize_t)len)
+        goto invalid;
+    for (b = 0; b < f->h.blocks; b++)
+        if (f->index[b + 1] < f->index[b] ||
+            f->index[b + 1] - f->index[b] > PACK_BOUND(f->h.block))
+            goto invalid;
+    f->cached = ~0ULL;
+    return f;
+
+invalid:
+    pack_close(f);
+    errno = EINVAL;
+    return NULL;
+}
+
+void pack_get_info(struct pack_file *f, int *bits, uint64_t *samples)
+{
+    *bits = f->h.bits;
+    *samples = f->h.samples;
+}
+
+long pack_read(struct pack_file *f, uint64_t first, void *dst, size_t n)
+{
+    size_t bytes = f->h.bits / 8, o, k, len, cnt, done = 0;
+    uint64_t b;
+
+    if (first >= f->h.samples)
+        return 0;
+    if (n > f->h.samples - first)
+        n = f->h.samples - first;
+    while (done < n) {
+        b = (first + done) / f->h.block;
+        o = (first + done) % f->h.block;
+        cnt = b + 1 < f->h.blocks ? f->h.block :
+              f->h.samples - b * f->h.block;
+        if (b != f->cached) {
+            len = f->index[b + 1] - f->index[b];
+            f->cached = ~0ULL;
+            if (pread(f->fd, f->in, len, f->index[b]) != (ssize_t)len)
+                return -1;
+            if (pack_decode(f->in, len, f->h.bits, cnt, f->cache) < 0)
+                return -1;
+            f->cached = b;
+        }
+        k = cnt - o < n - done ? cnt - o : n - done;
+        memcpy((uint8_t *)dst + done * bytes, f->cache + o * bytes,
+               k * bytes);
+        done += k;
+    }
+    return n;
+}
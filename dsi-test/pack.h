@@ -0,0 +1,69 @@
+/*
+ * Lossless delta/bit-pack compression of captured samples
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __PACK_H
+#define __PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACK_GROUP 128          /* samples sharing one bit width */
+#define PACK_DEFAULT_BLOCK 65536
+
+/* Largest encoding of a block of n samples */
+#define PACK_BOUND(n) (2 + ((n) + PACK_GROUP - 1) / PACK_GROUP * \
+                       (1 + 2 * PACK_GROUP))
+
+/* One independently decodable block of n > 0 samples of 8 or 16 bits.
+   Returns the bytes written to dst, at most PACK_BOUND(n). */
+size_t pack_encode(const void *src, int bits, size_t n, uint8_t *dst);
+/* Returns the bytes of src used, or -1 with errno = EINVAL if the n
+   samples do not decode from len bytes. */
+long pack_decode(const uint8_t *src, size_t len, int bits, size_t n,
+                 void *dst);
+
+struct pack_stats {
+    uint64_t samples;
+    uint64_t raw_bytes, packed_bytes;
+    uint64_t encode_ns;         /* spent by the worker thread encoding */
+    uint64_t write_ns;          /* ... and writing */
+    uint64_t stalls;            /* pack_write() calls that had to wait */
+};
+
+/* Packed sample files: blocks of block samples (a multiple of
+   PACK_GROUP, 0 for the default), encoded and written by a worker
+   thread, with an index for random access. pack_write() copies the
+   samples and only waits when all buffers are queued. pack_finish()
+   writes the rest and the index, closes the file, fills *st if not
+   NULL and frees w, also on failure. Errors are -1 / NULL with errno,
+   write errors of the worker come back from the next call. */
+struct pack_writer;
+
+struct pack_writer *pack_create(const char *path, int bits, size_t block);
+int pack_write(struct pack_writer *w, const void *src, size_t n);
+int pack_finish(struct pack_writer *w, struct pack_stats *st);
+
+struct pack_file;
+
+struct pack_file *pack_open(const char *path);
+void pack_close(struct pack_file *f);
+void pack_get_info(struct pack_file *f, int *bits, uint64_t *samples);
+/* Decodes up to n samples from sample first on; returns how many, or -1 */
+long pack_read(struct pack_file *f, uint64_t first, void *dst, size_t n);
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * Intensity-graded persistence buffer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* persist.c - analog-style persistence from decimated waveforms.
+ *
+ * Every pixel of the waveform area holds a 16-bit hit count. Spans are
+ * accumulated row by row rather than column by column: each row compares
+ * its index against the per-column span limits eight columns at a time and
+ * adds the weight under that mask with a saturating vqadd, so the buffer is
+ * walked in memory order. Decay is a vmull/vshrn multiply-shift, which
+ * takes every count down to zero eventually. Rows remember whether they
+ * hold anything and whether they changed, so decay skips empty rows and
+ * only changed rows go through the color LUT into the scanout buffer. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PERSIST_NEON
+#endif
+
+#include "persist.h"
+
+struct persist {
+    int width, height;
+    int stride;                 /* counts per row, multiple of 8 */
+    uint16_t *hits;
+    int16_t *y0, *y1;           /* span rows per column */
+    uint8_t *live;              /* row has non-zero counts */
+    uint8_t *dirty;             /* row changed since last render */
+    uint8_t lut[PERSIST_LUT_SIZE][3];
+    int shift;
+};
+
+/* dark blue - cyan - green - yellow - red - white */
+static const struct {
+    int index;
+    uint32_t rgb;
+} grade[] = {
+    {0, 0x000000}, {1, 0x001040}, {48, 0x0060ff}, {96, 0x00ff80},
+    {160, 0xffff00}, {224, 0xff4000}, {255, 0xffffff}
+};
+
+static void lut_grade(uint32_t *lut)
+{
+    int i, k, c, a, b, t;
+
+    for (k = 0; k + 1 < (int)(sizeof(grade) / sizeof(grade[0])); k++) {
+        a = grade[k].index;
+        b = grade[k + 1].index;
+        for (i = a; i <= b; i++) {
+            lut[i] = 0;
+            for (c = 0; c < 24; c += 8) {
+                t = (grade[k].rgb >> c & 0xff) * (b - i) +
+                    (grade[k + 1].rgb >> c & 0xff) * (i - a);
+                lut[i] |= (uint32_t)(b > a ? t / (b - a) : t) << c;
+            }
+        }
+    }
+}
+
+void persist_lut_mono(uint32_t *lut, uint32_t rgb)
+{
+    int i, c;
+
+    for (i = 0; i < PERSIST_LUT_SIZE; i++) {
+        lut[i] = 0;
+        for (c = 0; c < 24; c += 8)
+            lut[i] |= ((rgb >> c & 0xff) * i / 255) << c;
+    }
+}
+
+void persist_set_lut(struct persist *p, const uint32_t *lut, int shift)
+{
+    int i;
+
+    for (i = 0; i < PERSIST_LUT_SIZE; i++) {
+        p->lut[i][0] = lut[i] >> 16;
+        p->lut[i][1] = lut[i] >> 8;
+        p->lut[i][2] = lut[i];
+    }
+    p->shift = shift;
+    /* everything on screen has to be recolored */
+    memcpy(p->dirty, p->live, p->height);
+}
+
+struct persist *persist_create(int width, int height)
+{
+    uint32_t lut[PERSIST_LUT_SIZE];
+    struct persist *p;
+    void *mem;
+
+    if (width <= 0 || height <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->width = width;
+    p->height = height;
+    p->stride = (width + 7) & ~7;
+
+    if (posix_memalign(&mem, 16, p->stride * height * sizeof(uint16_t)))
+        goto fail;
+    p->hits = mem;
+    if (posix_memalign(&mem, 16, 2 * p->stride * sizeof(int16_t)))
+        goto fail;
+    p->y0 = mem;
+    p->y1 = p->y0 + p->stride;
+    p->live = calloc(height, 1);
+    p->dirty = calloc(height, 1);
+    if (!p->live || !p->dirty)
+        goto fail;
+
+    memset(p->hits, 0, p->stride * height * sizeof(uint16_t));
+    lut_grade(lut);
+    persist_set_lut(p, lut, 4);
+    return p;
+
+fail:
+    persist_destroy(p);
+    errno = ENOMEM;
+    return NULL;
+}
+
+void persist_destroy(struct persist *p)
+{
+    free(p->hits);
+    free(p->y0);
+    free(p->live);
+    free(p->dirty);
+    free(p);
+}
+
+void persist_clear(struct persist *p)
+{
+    int y;
+
+    for (y = 0; y < p->height; y++) {
+        if (!p->live[y])
+            continue;
+        memset(p->hits + y * p->stride, 0, p->stride * sizeof(uint16_t));
+        p->live[y] = 0;
+        p->dirty[y] = 1;
+    }
+}
+
+static void add_row(uint16_t *row, const int16_t *y0, const int16_t *y1,
+                    int n, int y, uint16_t weight)
+{
+    int c = 0;
+
+#ifdef PERSIST_NEON
+    int16x8_t vy = vdupq_n_s16(y);
+    uint16x8_t w = vdupq_n_u16(weight);
+
+    for (; c < n; c += 8) {
+        uint16x8_t m = vandq_u16(vcleq_s16(vld1q_s16(y0 + c), vy),
+                                 vcgeq_s16(vld1q_s16(y1 + c), vy));
+
+        vst1q_u16(row + c, vqaddq_u16(vld1q_u16(row + c), vandq_u16(m, w)));
+    }
+#endif
+    for (; c < n; c++) {
+        if (y0[c] <= y && y <= y1[c]) {
+            unsigned s = row[c] + weight;
+
+            row[c] = s > 0xffff ? 0xffff : s;
+        }
+    }
+}
+
+int persist_add(struct persist *p, const struct decim_span *spans, int cols,
+                int lo, int hi, uint16_t weight)
+{
+    int c, y, ymin = p->height, ymax = -1;
+
+    if (cols > p->width)
+        cols = p->width;
+    if (decim_rows(p->y0, p->y1, spans, cols, lo, hi, p->height))
+        return -1;
+    /* the row padding never gets hits */
+    for (c = cols; c < p->stride; c++) {
+        p->y0[c] = 1;
+        p->y1[c] = 0;
+    }
+
+    for (c = 0; c < cols; c++) {
+        if (p->y0[c] > p->y1[c])
+            continue;
+        if (p->y0[c] < ymin)
+            ymin = p->y0[c];
+        if (p->y1[c] > ymax)
+            ymax = p->y1[c];
+    }
+
+    for (y = ymin; y <= ymax; y++) {
+        add_row(p->hits + y * p->stride, p->y0, p->y1, p->stride, y, weight);
+        p->live[y] = 1;
+        p->dirty[y] = 1;
+    }
+    return 0;
+}
+
+/* Returns non-zero if anything is left in the row */
+static int decay_row(uint16_t *row, int n, uint16_t factor)
+{
+    unsigned any = 0;
+    int c = 0;
+
+#ifdef PERSIST_NEON
+    uint16x4_t f = vdup_n_u16(factor);
+    uint16x8_t acc = vdupq_n_u16(0);
+    uint16x4_t a;
+
+    for (; c < n; c += 8) {
+        uint16x8_t h = vld1q_u16(row + c);
+        uint16x8_t r = vcombine_u16(
+            vshrn_n_u32(vmull_u16(vget_low_u16(h), f), 16),
+            vshrn_n_u32(vmull_u16(vget_high_u16(h), f), 16));
+
+        vst1q_u16(row + c, r);
+        acc = vorrq_u16(acc, r);
+    }
+    a = vorr_u16(vget_low_u16(acc), vget_high_u16(acc));
+    any = vget_lane_u32(vreinterpret_u32_u16(a), 0) |
+          vget_lane_u32(vreinterpret_u32_u16(a), 1);
+#endif
+    for (; c < n; c++) {
+        row[c] = (uint32_t)row[c] * factor >> 16;
+        any |= row[c];
+    }
+    return any != 0;
+}
+
+void persist_decay(struct persist *p, uint16_t factor)
+{
+    int y;
+
+    for (y = 0; y < p->height; y++) {
+        if (!p->live[y])
+            continue;
+        p->live[y] = decay_row(p->hits + y * p->stride, p->stride, factor);
+        p->dirty[y] = 1;
+    }
+}
+
+int persist_render(struct persist *p, struct pixconv_surface *dst, int x, int y,
+                   struct pixconv_rect *damage)
+{
+    int bpp = pixconv_bpp(dst->fmt);
+    int r, c, idx, rows = 0, ymin = -1, ymax = -1;
+    const uint16_t *h;
+    const uint8_t *l;
+    uint8_t *d;
+
+    if ((dst->fmt != PIXCONV_RGB888 && dst->fmt != PIXCONV_XRGB8888) ||
+        x < 0 || y < 0 || x + p->width > dst->width ||
+        y + p->height > dst->height) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (r = 0; r < p->height; r++) {
+        if (!p->dirty[r])
+            continue;
+        p->dirty[r] = 0;
+
+        h = p->hits + r * p->stride;
+        d = dst->ptr + (y + r) * dst->stride + x * bpp;
+        for (c = 0; c < p->width; c++, d += bpp) {
+            idx = h[c] >> p->shift;
+            l = p->lut[idx < PERSIST_LUT_SIZE ? idx : PERSIST_LUT_SIZE - 1];
+            if (bpp == 3) {
+                d[0] = l[0];
+                d[1] = l[1];
+                d[2] = l[2];
+            } else {
+                d[0] = l[2];
+                d[1] = l[1];
+                d[2] = l[0];
+                d[3] = 0xff;
+            }
+        }
+
+        if (ymin < 0)
+            ymin = r;
+        ymax = r;
+        rows++;
+    }
+
+    if (damage) {
+        damage->x = x;
+        damage->y = y + (ymin < 0 ? 0 : ymin);
+        damage->w = rows ? p->width : 0;
+        damage->h = rows ? ymax - ymin + 1 : 0;
+    }
+    return rows;
+}
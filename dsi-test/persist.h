@@ -0,0 +1,55 @@
+/*
+ * Intensity-graded persistence buffer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __PERSIST_H
+#define __PERSIST_H
+
+#include <stdint.h>
+
+#include "decimate.h"
+#include "pixconv.h"
+
+#define PERSIST_LUT_SIZE 256
+
+struct persist;
+
+struct persist *persist_create(int width, int height);
+void persist_destroy(struct persist *p);
+void persist_clear(struct persist *p);
+
+/* Hit counts are mapped through lut[min(hits >> shift, 255)], entries
+   0xRRGGBB. The default is a blue-green-yellow-white ramp, shift 4. */
+void persist_set_lut(struct persist *p, const uint32_t *lut, int shift);
+/* Ramp from black to rgb, for single channel displays */
+void persist_lut_mono(uint32_t *lut, uint32_t rgb);
+
+/* Adds weight (saturating) to every pixel covered by the spans, column
+   c of the buffer for spans[c], scaled like decim_draw() */
+int persist_add(struct persist *p, const struct decim_span *spans, int cols,
+                int lo, int hi, uint16_t weight);
+/* Multiplies all counts by factor / 65536 */
+void persist_decay(struct persist *p, uint16_t factor);
+
+/* Converts the rows changed since the last call into dst at (x, y), an
+   RGB888 or XRGB8888 surface, and returns the number of rows written;
+   damage, if not NULL, receives their bounding box in dst. -1 with
+   errno = EINVAL if the buffer does not fit into dst. */
+int persist_render(struct persist *p, struct pixconv_surface *dst, int x, int y,
+                   struct pixconv_rect *damage);
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * Pixel format conversion for the rgb888 scanout path
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* pixconv.c - row conversion kernels and the rectangle blitter.
+ *
+ * On the Cortex-A9 the kernels move 16 pixels per iteration with the
+ * structure loads/stores (vld4/vst3 and friends), which do the channel
+ * (de)interleaving for free; 565 expansion replicates the high bits with
+ * shift-and-insert so that white stays 0xff. Row tails and non-NEON
+ * builds use the scalar loops, which define the exact results. */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXCONV_NEON
+#endif
+
+#include "pixconv.h"
+
+void pixconv_xrgb8888_to_rgb888(uint8_t *dst, const uint32_t *src, int n)
+{
+#ifdef PIXCONV_NEON
+    for (; n >= 16; n -= 16, src += 16, dst += 48) {
+        uint8x16x4_t p = vld4q_u8((const uint8_t *)src); /* B, G, R, X */
+        uint8x16x3_t o;
+
+        __builtin_prefetch(src + 64);
+        o.val[0] = p.val[2];
+        o.val[1] = p.val[1];
+        o.val[2] = p.val[0];
+        vst3q_u8(dst, o);
+    }
+#endif
+    /* byte accesses: rows of odd-strided surfaces are not word aligned */
+    const uint8_t *s = (const uint8_t *)src;
+
+    for (; n > 0; n--, s += 4, dst += 3) {
+        dst[0] = s[2];
+        dst[1] = s[1];
+        dst[2] = s[0];
+    }
+}
+
+void pixconv_rgb565_to_rgb888(uint8_t *dst, const uint16_t *src, int n)
+{
+#ifdef PIXCONV_NEON
+    for (; n >= 8; n -= 8, src += 8, dst += 24) {
+        uint16x8_t p = vld1q_u16(src);
+        uint8x8x3_t o;
+
+        o.val[0] = vshrn_n_u16(p, 8);
+        o.val[0] = vsri_n_u8(o.val[0], o.val[0], 5);
+        o.val[1] = vshrn_n_u16(vshlq_n_u16(p, 5), 8);
+        o.val[1] = vsri_n_u8(o.val[1], o.val[1], 6);
+        o.val[2] = vmovn_u16(vshlq_n_u16(p, 3));
+        o.val[2] = vsri_n_u8(o.val[2], o.val[2], 5);
+        vst3_u8(dst, o);
+    }
+#endif
+    const uint8_t *s = (const uint8_t *)src;
+
+    for (; n > 0; n--, s += 2, dst += 3) {
+        uint16_t p = s[0] | (s[1] << 8);
+        uint8_t r = (p >> 8) & 0xf8, g = (p >> 3) & 0xfc, b = p << 3;
+
+        dst[0] = r | (r >> 5);
+        dst[1] = g | (g >> 6);
+        dst[2] = b | (b >> 5);
+    }
+}
+
+void pixconv_rgb888_to_xrgb8888(uint32_t *dst, const uint8_t *src, int n)
+{
+#ifdef PIXCONV_NEON
+    for (; n >= 16; n -= 16, src += 48, dst += 16) {
+        uint8x16x3_t p = vld3q_u8(src);
+        uint8x16x4_t o;
+
+        o.val[0] = p.val[2];
+        o.val[1] = p.val[1];
+        o.val[2] = p.val[0];
+        o.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8((uint8_t *)dst, o);
+    }
+#endif
+    uint8_t *d = (uint8_t *)dst;
+
+    for (; n > 0; n--, src += 3, d += 4) {
+        d[0] = src[2];
+        d[1] = src[1];
+        d[2] = src[0];
+        d[3] = 0xff;
+    }
+}
+
+void pixconv_rgb888_to_rgb565(uint16_t *dst, const uint8_t *src, int n)
+{
+#ifdef PIXCONV_NEON
+    for (; n >= 8; n -= 8, src += 24, dst += 8) {
+        uint8x8x3_t p = vld3_u8(src);
+        uint16x8_t o;
+
+        o = vshll_n_u8(p.val[0], 8);
+        o = vsriq_n_u16(o, vshll_n_u8(p.val[1], 8), 5);
+        o = vsriq_n_u16(o, vshll_n_u8(p.val[2], 8), 11);
+        vst1q_u16(dst, o);
+    }
+#endif
+    uint8_t *d = (uint8_t *)dst;
+    uint16_t p;
+
+    for (; n > 0; n--, src += 3, d += 2) {
+        p = ((src[0] & 0xf8) << 8) | ((src[1] & 0xfc) << 3) | (src[2] >> 3);
+        d[0] = p;
+        d[1] = p >> 8;
+    }
+}
+
+int pixconv_bpp(enum pixconv_format fmt)
+{
+    switch (fmt) {
+    case PIXCONV_RGB888:
+        return 3;
+    case PIXCONV_XRGB8888:
+        return 4;
+    case PIXCONV_RGB565:
+        return 2;
+    }
+    return 0;
+}
+
+static int clip(struct pixconv_rect *r, const struct pixconv_surface *a,
+                const struct pixconv_surface *b)
+{
+    int w = a->width < b->width ? a->width : b->width;
+    int h = a->height < b->height ? a->height : b->height;
+
+    if (r->x < 0) {
+        r->w += r->x;
+        r->x = 0;
+    }
+    if (r->y < 0) {
+        r->h += r->y;
+        r->y = 0;
+    }
+    if (r->x + r->w > w)
+        r->w = w - r->x;
+    if (r->y + r->h > h)
+        r->h = h - r->y;
+
+    return r->w > 0 && r->h > 0;
+}
+
+int pixconv_blit(struct pixconv_surface *dst, const struct pixconv_surface *src,
+                 const struct pixconv_rect *rects, int n_rects)
+{
+    struct pixconv_rect whole = {0, 0, src->width, src->height}, r;
+    int sbpp = pixconv_bpp(src->fmt), dbpp = pixconv_bpp(dst->fmt);
+    const uint8_t *s;
+    uint8_t *d;
+    int i, y, total = 0;
+
+    if (!rects) {
+        rects = &whole;
+        n_rects = 1;
+    }
+
+    for (i = 0; i < n_rects; i++) {
+        r = rects[i];
+        if (!clip(&r, dst, src))
+            continue;
+
+        s = src->ptr + r.y * src->stride + r.x * sbpp;
+        d = dst->ptr + r.y * dst->stride + r.x * dbpp;
+
+        for (y = 0; y < r.h; y++, s += src->stride, d += dst->stride) {
+            switch (src->fmt << 4 | dst->fmt) {
+            case PIXCONV_XRGB8888 << 4 | PIXCONV_RGB888:
+                pixconv_xrgb8888_to_rgb888(d, (const uint32_t *)s, r.w);
+                break;
+            case PIXCONV_RGB565 << 4 | PIXCONV_RGB888:
+                pixconv_rgb565_to_rgb888(d, (const uint16_t *)s, r.w);
+                break;
+            case PIXCONV_RGB888 << 4 | PIXCONV_XRGB8888:
+                pixconv_rgb888_to_xrgb8888((uint32_t *)d, s, r.w);
+                break;
+            case PIXCONV_RGB888 << 4 | PIXCONV_RGB565:
+                pixconv_rgb888_to_rgb565((uint16_t *)d, s, r.w);
+                break;
+            default:
+                if (src->fmt != dst->fmt) {
+                    errno = EINVAL;
+                    return -1;
+                }
+                memcpy(d, s, r.w * sbpp);
+                break;
+            }
+        }
+        total += r.w * r.h;
+    }
+
+    return total;
+}
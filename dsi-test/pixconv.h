@@ -0,0 +1,60 @@
+/*
+ * Pixel format conversion for the rgb888 scanout path
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __PIXCONV_H
+#define __PIXCONV_H
+
+#include <stdint.h>
+
+/* Memory layouts, named as in DRM/Qt:
+   RGB888   - bytes R, G, B: what v_frmbuf_rd fetches in FRMBUF_FMT_RGB8
+   XRGB8888 - little endian 0xXXRRGGBB words (QImage::Format_RGB32)
+   RGB565   - little endian RRRRRGGG GGGBBBBB halfwords */
+enum pixconv_format {
+    PIXCONV_RGB888 = 0,
+    PIXCONV_XRGB8888,
+    PIXCONV_RGB565
+};
+
+struct pixconv_surface {
+    uint8_t *ptr;
+    int width, height;
+    int stride;         /* bytes, any value >= width * bytes per pixel */
+    enum pixconv_format fmt;
+};
+
+struct pixconv_rect {
+    int x, y, w, h;
+};
+
+/* Row kernels, n pixels, no alignment requirement */
+void pixconv_xrgb8888_to_rgb888(uint8_t *dst, const uint32_t *src, int n);
+void pixconv_rgb565_to_rgb888(uint8_t *dst, const uint16_t *src, int n);
+void pixconv_rgb888_to_xrgb8888(uint32_t *dst, const uint8_t *src, int n);
+void pixconv_rgb888_to_rgb565(uint16_t *dst, const uint8_t *src, int n);
+
+/* Converts the rectangles (whole surface if rects is NULL) from src into
+   the same position of dst, clipped to both surfaces. Returns the number
+   of pixels converted, or -1 with errno = EINVAL for an unsupported pair
+   of formats. */
+int pixconv_blit(struct pixconv_surface *dst, const struct pixconv_surface *src,
+                 const struct pixconv_rect *rects, int n_rects);
+
+int pixconv_bpp(enum pixconv_format fmt);
+
+#endif
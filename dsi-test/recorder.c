@@ -0,0 +1,387 @@
+/*
+ * Asynchronous multi-buffered recorder for long captures
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* recorder.c - streaming a capture to the SD card without losing it.
+ *
+ * write() from the readout loop copies into the page cache and returns,
+ * until the kernel decides there is too much dirty data and makes the
+ * writer wait for the card, for hundreds of milliseconds at a time. The
+ * FIFO in the PL overflows long before that.
+ *
+ * Here the readout loop only ever fills buffers from a fixed pool. A
+ * full buffer is handed to the writer thread by advancing a counter and
+ * posting a semaphore, neither of which can block; when the card falls
+ * so far behind that no buffer is free, data is refused and counted,
+ * and the loop carries on. The writer uses O_DIRECT where the file
+ * system allows it, which takes the page cache out of the picture.
+ * Otherwise it starts writeback of every buffer as soon as it is
+ * written, waits for the previous one and drops it from the cache, so
+ * dirty data never exceeds two buffers and the kernel never has a
+ * reason to stall anybody. Space is reserved with fallocate() up front,
+ * so the file system does not allocate blocks while recording. */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "recorder.h"
+
+struct recorder {
+    int fd, regular, direct;
+    size_t size;
+    int n;
+    uint8_t **buf;
+    size_t *len;
+
+    /* buffers [tail, head) wait for the writer, head is being filled */
+    atomic_uint head, tail;
+    size_t fill;                /* producer */
+    atomic_int quit;
+    sem_t wake;
+    pthread_t thread;
+
+    /* writer */
+    uint64_t off;
+    size_t prev_len;
+
+    atomic_uint_least64_t written, dropped, drops, writes;
+    atomic_uint_least64_t write_ns, max_write_ns;
+    atomic_int max_queued, error;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static int write_all(int fd, const uint8_t *p, size_t len)
+{
+    ssize_t w;
+
+    while (len) {
+        w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += w;
+        len -= w;
+    }
+    return 0;
+}
+
+/* Keeps the page cache out of the way when O_DIRECT is not available */
+static void writeback(struct recorder *r, size_t len)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(r->fd, r->off, len, SYNC_FILE_RANGE_WRITE);
+    if (r->prev_len) {
+        sync_file_range(r->fd, r->off - r->prev_len, r->prev_len,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(r->fd, r->off - r->prev_len, r->prev_len,
+                      POSIX_FADV_DONTNEED);
+    }
+#endif
+    r->prev_len = len;
+}
+
+static void put_buffer(struct recorder *r, const uint8_t *p, size_t len)
+{
+    size_t wlen = len;
+    uint64_t t0 = now_ns(), t, max;
+
+    if (atomic_load_explicit(&r->error, memory_order_relaxed))
+        return;
+    /* the last buffer may be short; pad it, the file is trimmed later */
+    if (r->direct)
+        wlen = (len + REC_ALIGN - 1) & ~(size_t)(REC_ALIGN - 1);
+    if (write_all(r->fd, p, wlen)) {
+        atomic_store(&r->error, errno);
+        return;
+    }
+    if (r->regular && !r->direct)
+        writeback(r, len);
+    r->off += len;
+
+    t = now_ns() - t0;
+    atomic_fetch_add_explicit(&r->written, len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->writes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->write_ns, t, memory_order_relaxed);
+    max = atomic_load_explicit(&r->max_write_ns, memory_order_relaxed);
+    if (t > max)
+        atomic_store_explicit(&r->max_write_ns, t, memory_order_relaxed);
+}
+
+static void *writer(void *arg)
+{
+    struct recorder *r = arg;
+    unsigned int tail = 0, b;
+    int quit;
+
+    for (;;) {
+        sem_wait(&r->wake);
+        quit = atomic_load_explicit(&r->quit, memory_order_acquire);
+        while (tail != atomic_load_explicit(&r->head, memory_order_acquire)) {
+            b = tail % r->n;
+            put_buffer(r, r->buf[b], r->len[b]);
+            atomic_store_explicit(&r->tail, ++tail, memory_order_release);
+        }
+        if (quit)
+            break;
+    }
+    return NULL;
+}
+
+static void rec_free(struct recorder *r)
+{
+    int b;
+
+    if (r->buf)
+        for (b = 0; b < r->n; b++)
+            free(r->buf[b]);
+    free(r->buf);
+    free(r->len);
+    free(r);
+}
+
+struct recorder *rec_open(const char *path, const struct rec_config *cfg)
+{
+    struct recorder *r;
+    struct stat st;
+    void *mem;
+    int b, flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    if (!cfg->buffer_size || cfg->buffer_size % REC_ALIGN ||
+        cfg->buffers < 2) {
+        errno = EINVAL;
+        return NULL;
+    }
+    r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+    r->size = cfg->buffer_size;
+    r->n = cfg->buffers;
+    r->buf = calloc(r->n, sizeof(*r->buf));
+    r->len = calloc(r->n, sizeof(*r->len));
+    if (!r->buf || !r->len)
+        goto nomem;
+    for (b = 0; b < r->n; b++) {
+        if (posix_memalign(&mem, REC_ALIGN, r->size))
+            goto nomem;
+        r->buf[b] = mem;
+        /* fault the pool in now rather than in the readout loop */
+        memset(mem, 0, r->size);
+    }
+
+    r->fd = -1;
+    if (cfg->direct) {
+        r->fd = open(path, flags | O_DIRECT, 0644);
+        r->direct = r->fd >= 0;
+    }
+    if (r->fd < 0)
+        r->fd = open(path, flags, 0644);
+    if (r->fd < 0) {
+        rec_free(r);
+        return NULL;
+    }
+    r->regular = !fstat(r->fd, &st) && S_ISREG(st.st_mode);
+    if (r->regular && cfg->prealloc)
+        /* not all file systems can; recording works without */
+        fallocate(r->fd, FALLOC_FL_KEEP_SIZE, 0, cfg->prealloc);
+
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->quit, 0);
+    sem_init(&r->wake, 0, 0);
+    if (pthread_create(&r->thread, NULL, writer, r)) {
+        sem_destroy(&r->wake);
+        close(r->fd);
+        rec_free(r);
+        errno = EAGAIN;
+        return NULL;
+    }
+    return r;
+
+nomem:
+    rec_free(r);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* Hands the buffer being filled to the writer */
+static void hand_over(struct recorder *r)
+{
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    int queued;
+
+    r->len[head % r->n] = r->fill;
+    r->fill = 0;
+    atomic_store_explicit(&r->head, ++head, memory_order_release);
+    sem_post(&r->wake);
+    queued = head - atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (queued > atomic_load_explicit(&r->max_queued, memory_order_relaxed))
+        atomic_store_explicit(&r->max_queued, queued, memory_order_relaxed);
+}
+
+int rec_close(struct recorder *r, struct rec_stats *st)
+{
+    int ret = 0;
+
+    /* the partial buffer always has room: it is the one being filled */
+    if (r->fill)
+        hand_over(r);
+    atomic_store_explicit(&r->quit, 1, memory_order_release);
+    sem_post(&r->wake);
+    pthread_join(r->thread, NULL);
+    sem_destroy(&r->wake);
+
+    /* drop the padding and the unused reservation */
+    if (r->regular && ftruncate(r->fd, r->off))
+        ret = -1;
+    if (close(r->fd))
+        ret = -1;
+    if (st)
+        rec_get_stats(r, st);
+    if (atomic_load(&r->error)) {
+        errno = atomic_load(&r->error);
+        ret = -1;
+    }
+    rec_free(r);
+    return ret;
+}
+
+void *rec_reserve(struct recorder *r, size_t *len)
+{
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) >=
+        (unsigned int)r->n) {
+        *len = 0;
+        return NULL;
+    }
+    if (*len > r->size - r->fill)
+        *len = r->size - r->fill;
+    return r->buf[head % r->n] + r->fill;
+}
+
+void rec_commit(struct recorder *r, size_t len)
+{
+    r->fill += len;
+    if (r->fill == r->size)
+        hand_over(r);
+}
+
+void rec_drop(struct recorder *r, size_t len)
+{
+    if (!len)
+        return;
+    atomic_fetch_add_explicit(&r->dropped, len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->drops, 1, memory_order_relaxed);
+}
+
+size_t rec_write(struct recorder *r, const void *src, size_t len)
+{
+    size_t done = 0, k;
+    void *dst;
+
+    while (done < len) {
+        k = len - done;
+        dst = rec_reserve(r, &k);
+        if (!k)
+            break;
+        memcpy(dst, (const uint8_t *)src + done, k);
+        rec_commit(r, k);
+        done += k;
+    }
+    rec_drop(r, len - done);
+    return done;
+}
+
+size_t rec_fill_ual(struct recorder *r, struct ual_bar_tkn *dev,
+                    uint32_t addr, size_t n)
+{
+    size_t done = 0, len;
+    void *dst;
+
+    while (done < n) {
+        len = (n - done) * 4;
+        dst = rec_reserve(r, &len);
+        len /= 4;
+        if (!len)
+            break;
+        ual_readl_n(dev, addr + done * 4, dst, len);
+        rec_commit(r, len * 4);
+        done += len;
+    }
+    rec_drop(r, (n - done) * 4);
+    return done;
+}
+
+size_t rec_drain_ual_fifo(struct recorder *r, struct ual_bar_tkn *dev,
+                          uint32_t addr, uint32_t level_addr)
+{
+    size_t done = 0, len, got;
+    void *dst;
+    int k;
+
+    /* at most every free buffer once */
+    for (k = 0; k <= r->n; k++) {
+        len = r->size;
+        dst = rec_reserve(r, &len);
+        len /= 4;
+        if (!len)
+            break;
+        got = ual_readl_fifo(dev, addr, dst, len, level_addr);
+        rec_commit(r, got * 4);
+        done += got;
+        if (got < len)
+            break;
+    }
+    return done;
+}
+
+void rec_get_stats(struct recorder *r, struct rec_stats *st)
+{
+    st->written = atomic_load_explicit(&r->written, memory_order_relaxed);
+    st->dropped = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+    st->drops = atomic_load_explicit(&r->drops, memory_order_relaxed);
+    st->writes = atomic_load_explicit(&r->writes, memory_order_relaxed);
+    st->write_ns = atomic_load_explicit(&r->write_ns, memory_order_relaxed);
+    st->max_write_ns = atomic_load_explicit(&r->max_write_ns,
+                                            memory_order_relaxed);
+    st->max_queued = atomic_load_explicit(&r->max_queued,
+                                          memory_order_relaxed);
+    st->direct = r->direct;
+    st->error = atomic_load_explicit(&r->error, memory_order_relaxed);
+}
@@ -0,0 +1,77 @@
+/*
+ * Asynchronous multi-buffered recorder for long captures
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RECORDER_H
+#define __RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ual.h"
+
+#define REC_ALIGN 4096
+
+struct rec_config {
+    size_t buffer_size;         /* bytes, a multiple of REC_ALIGN */
+    int buffers;                /* at least 2 */
+    uint64_t prealloc;          /* bytes to reserve up front, 0 for none */
+    int direct;                 /* try O_DIRECT */
+};
+
+struct rec_stats {
+    uint64_t written;           /* bytes on disk */
+    uint64_t dropped;           /* bytes refused for lack of a buffer */
+    uint64_t drops;             /* times that happened */
+    uint64_t writes;
+    uint64_t write_ns, max_write_ns;
+    int max_queued;             /* most buffers waiting for the disk */
+    int direct;                 /* O_DIRECT in use */
+    int error;                  /* errno of the first failed write */
+};
+
+struct recorder;
+
+/* Creates path; a writer thread stores full buffers from then on.
+   Returns NULL with errno on failure. */
+struct recorder *rec_open(const char *path, const struct rec_config *cfg);
+/* Writes what is buffered, waits for the thread, trims preallocated
+   space and closes. Returns -1 with errno if any write failed. */
+int rec_close(struct recorder *r, struct rec_stats *st);
+
+/* Producer side, one thread, never waits for the disk: space that is not
+   available is refused and counted as dropped.
+   rec_reserve() returns free space in the current buffer, up to *len
+   bytes, or NULL with *len = 0 when every buffer waits for the disk;
+   rec_commit() takes the first len bytes of it. */
+void *rec_reserve(struct recorder *r, size_t *len);
+void rec_commit(struct recorder *r, size_t len);
+/* Counts len bytes the producer had to throw away */
+void rec_drop(struct recorder *r, size_t len);
+
+/* Copies what fits, the rest is dropped; returns the bytes stored */
+size_t rec_write(struct recorder *r, const void *src, size_t len);
+/* As sring_fill_ual() and sring_drain_ual_fifo(), into the buffers */
+size_t rec_fill_ual(struct recorder *r, struct ual_bar_tkn *dev,
+                    uint32_t addr, size_t n);
+size_t rec_drain_ual_fifo(struct recorder *r, struct ual_bar_tkn *dev,
+                          uint32_t addr, uint32_t level_addr);
+
+/* Any thread */
+void rec_get_stats(struct recorder *r, struct rec_stats *st);
+
+#endif
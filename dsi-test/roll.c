@@ -0,0 +1,160 @@
+/*
+ * Hardware-scrolled roll mode display
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* roll.c - scrolling by moving the scanout start address.
+ *
+ * Each row of the front buffer holds the W visible columns twice: column c
+ * of the waveform lives in ring slot s = c % W and is stored at both s
+ * (low copy) and s + W (high copy). Whatever the position of the window
+ * [x, x + W) with 0 <= x <= W, it then shows W consecutive columns, and
+ * scrolling is a single write of the frame reader address.
+ *
+ * New columns always go to the high copy first: it is just right of the
+ * window being displayed. The low copy is filled in later, once both the
+ * live and the requested window have moved past it. When the window
+ * reaches x = W it is moved back to the identical x = 0 before the next
+ * lap starts writing high slots again. Per step the CPU touches only the
+ * 'step' new columns, twice. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "roll.h"
+
+struct roll {
+    struct frmbuf *fb;
+    const struct frmbuf_buffer *buf;
+    int width, step;
+    roll_draw_fn draw;
+    void *arg;
+
+    uint64_t col;       /* columns rendered so far */
+    int x;              /* requested window position */
+    int low_a, low_b;   /* slots whose low copy is still missing */
+
+    struct roll_stats stats;
+};
+
+struct roll *roll_create(struct frmbuf *fb, int step, roll_draw_fn draw,
+                         void *arg)
+{
+    const struct frmbuf_buffer *buf = frmbuf_front(fb);
+    struct roll *r;
+
+    if (step <= 0 || step % FRMBUF_PAN_STEP || buf->width % step ||
+        buf->stride < 2 * buf->width * FRMBUF_BPP) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    r = calloc(1, sizeof(struct roll));
+    if (!r)
+        return NULL;
+
+    r->fb = fb;
+    r->buf = buf;
+    r->width = buf->width;
+    r->step = step;
+    r->draw = draw;
+    r->arg = arg;
+
+    if (frmbuf_pan(fb, 0) < 0) {
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void roll_destroy(struct roll *r)
+{
+    free(r);
+}
+
+/* Copies the pending low slots that neither window can show any more */
+static void roll_fill_low(struct roll *r, int live)
+{
+    const struct frmbuf_buffer *b = r->buf;
+    int limit = live < r->x ? live : r->x;
+    int end = r->low_b < limit ? r->low_b : limit;
+    int y, len;
+    uint8_t *row;
+
+    if (end <= r->low_a)
+        return;
+
+    len = (end - r->low_a) * FRMBUF_BPP;
+    for (y = 0, row = b->ptr + r->low_a * FRMBUF_BPP; y < b->height;
+         y++, row += b->stride)
+        memcpy(row, row + r->width * FRMBUF_BPP, len);
+
+    r->stats.bytes_read += (uint64_t)len * b->height;
+    r->stats.bytes_written += (uint64_t)len * b->height;
+    r->low_a = end;
+    if (r->low_a == r->low_b)
+        r->low_a = r->low_b = 0;
+}
+
+int roll_advance(struct roll *r)
+{
+    const struct frmbuf_buffer *b = r->buf;
+    int live = frmbuf_pan_live(r->fb);
+    int s = r->col % r->width;
+
+    roll_fill_low(r, live);
+
+    if (s == 0 && r->col) {
+        /* end of a lap: the x = W window must be swapped for x = 0 */
+        if (r->x == r->width) {
+            if (r->low_b) {
+                r->stats.waits++;
+                return 0;
+            }
+            r->x = 0;
+            frmbuf_pan(r->fb, 0);
+            r->stats.wraps++;
+        }
+        if (live != 0) {
+            r->stats.waits++;
+            return 0;
+        }
+    }
+
+    r->draw(r->arg, b->ptr + (r->width + s) * FRMBUF_BPP, b->stride,
+            b->height, r->col, r->step);
+    r->stats.bytes_written += (uint64_t)r->step * FRMBUF_BPP * b->height;
+
+    if (!r->low_b)
+        r->low_a = s;
+    r->low_b = s + r->step;
+
+    r->col += r->step;
+    r->x = s + r->step;
+    frmbuf_pan(r->fb, r->x);
+    r->stats.steps++;
+
+    return 1;
+}
+
+void roll_get_stats(struct roll *r, struct roll_stats *st)
+{
+    *st = r->stats;
+}
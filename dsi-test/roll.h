@@ -0,0 +1,55 @@
+/*
+ * Hardware-scrolled roll mode display
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __ROLL_H
+#define __ROLL_H
+
+#include <stdint.h>
+
+#include "frmbuf.h"
+
+/* Renders n columns starting at column 'first' (counted from the start of
+   the roll) into dst, which points at the top pixel of the first column */
+typedef void (*roll_draw_fn)(void *arg, uint8_t *dst, int stride, int height,
+                             uint64_t first, int n);
+
+struct roll_stats {
+    uint64_t steps;         /* advances by 'step' columns */
+    uint64_t waits;         /* roll_advance() calls that had to wait for
+                               the scanout to catch up */
+    uint64_t wraps;
+    uint64_t bytes_written; /* by the renderer and the ring maintenance */
+    uint64_t bytes_read;
+};
+
+struct roll;
+
+/* The front buffer of fb is used as the ring: it needs a virtual width of
+   at least twice the panel width. step is a multiple of FRMBUF_PAN_STEP
+   dividing the panel width. */
+struct roll *roll_create(struct frmbuf *fb, int step, roll_draw_fn draw,
+                         void *arg);
+void roll_destroy(struct roll *r);
+
+/* Scrolls by one step, rendering only the newly exposed columns. Returns
+   1 when the display advanced, 0 when it has to be called again after the
+   next frame. */
+int roll_advance(struct roll *r);
+void roll_get_stats(struct roll *r, struct roll_stats *st);
+
+#endif
@@ -0,0 +1,691 @@
+/*
+ * Real-input FFT and averaged power spectrum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* spectrum.c - power spectrum of real frames for the spectrum view.
+ *
+ * An n point real FFT is done as an n / 2 point complex one: even samples
+ * go to the real part, odd ones to the imaginary part, and a split step
+ * afterwards separates the two transforms again. The window is applied
+ * while the frame is unpacked into that form, so it costs one multiply
+ * per sample and no pass of its own.
+ *
+ * The complex FFT is a Stockham radix-4 (plus one radix-2 stage when
+ * log2(n / 2) is odd) on split real/imaginary arrays. Stockham ping-pongs
+ * between two buffers and delivers natural order, so there is no bit
+ * reversal pass, and split arrays let NEON do four butterflies at a time
+ * with plain loads: the first stage runs across butterflies and scatters
+ * its results with vst4, the later ones run across the contiguous stride.
+ *
+ * Twiddles, split-step factors and windows only depend on the size and
+ * are kept in one shared plan per size. The split step also computes the
+ * bin power and folds it into the exponential average in the same pass.
+ * dB conversion uses a polynomial log2 on the float's mantissa, about
+ * 0.0006 dB off, which is far below what a screen pixel resolves. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SPEC_NEON
+#endif
+
+#include "spectrum.h"
+
+#define MIN_LOG2 10
+#define MAX_LOG2 16
+#define NPLANS (MAX_LOG2 - MIN_LOG2 + 1)
+
+struct spec_plan {
+    int n, m;               /* real points, complex points */
+    int users;
+    float *tw;              /* per radix-4 stage of length L: w1, w2, w3
+                               as re[L / 4] then im[L / 4] */
+    float *sr, *si;         /* split step: exp(-2 pi i k / n), k < m */
+    float *win[SPEC_WIN_COUNT];     /* even samples, then odd ones */
+    float sum[SPEC_WIN_COUNT];      /* window sums, the coherent gain */
+};
+
+struct spectrum {
+    struct spec_plan *plan;
+    enum spec_window win;
+    int avg, frames;
+    float *zr, *zi, *yr, *yi;       /* FFT buffers, m each */
+    float *power;                   /* averaged, m + 1 */
+};
+
+static struct spec_plan *plans[NPLANS];
+static pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static float *alloc_floats(size_t n)
+{
+    void *p;
+
+    if (posix_memalign(&p, 16, n * sizeof(float)))
+        return NULL;
+    return p;
+}
+
+static int log2_points(int n)
+{
+    int l;
+
+    for (l = MIN_LOG2; l <= MAX_LOG2; l++)
+        if (n == 1 << l)
+            return l;
+    return -1;
+}
+
+/* Periodic windows, as spectral analysis wants them */
+static int make_window(struct spec_plan *p, enum spec_window w)
+{
+    static const double coef[SPEC_WIN_COUNT][5] = {
+        {1, 0, 0, 0, 0},
+        {0.5, 0.5, 0, 0, 0},
+        {0.35875, 0.48829, 0.14128, 0.01168, 0},
+        {0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368},
+    };
+    const double *a = coef[w];
+    double x, v, sum = 0;
+    int i, k;
+
+    if (p->win[w])
+        return 0;
+    p->win[w] = alloc_floats(p->n);
+    if (!p->win[w])
+        return -1;
+    for (i = 0; i < p->n; i++) {
+        x = 2 * M_PI * i / p->n;
+        v = a[0];
+        for (k = 1; k < 5; k++)
+            v += (k & 1 ? -a[k] : a[k]) * cos(k * x);
+        p->win[w][(i & 1) * p->m + i / 2] = v;
+        sum += v;
+    }
+    p->sum[w] = sum;
+    return 0;
+}
+
+static void free_plan(struct spec_plan *p)
+{
+    int w;
+
+    for (w = 0; w < SPEC_WIN_COUNT; w++)
+        free(p->win[w]);
+    free(p->tw);
+    free(p->sr);
+    free(p->si);
+    free(p);
+}
+
+static struct spec_plan *new_plan(int n)
+{
+    struct spec_plan *p = calloc(1, sizeof(*p));
+    int m = n / 2, L, n1, k, j;
+    float *t;
+
+    if (!p)
+        return NULL;
+    p->n = n;
+    p->m = m;
+    /* sum of 6 * L / 4 over the radix-4 stages stays below 2 * m */
+    p->tw = alloc_floats(2 * m);
+    p->sr = alloc_floats(m);
+    p->si = alloc_floats(m);
+    if (!p->tw || !p->sr || !p->si) {
+        free_plan(p);
+        return NULL;
+    }
+
+    t = p->tw;
+    for (L = m; L >= 4; L /= 4) {
+        n1 = L / 4;
+        for (j = 1; j <= 3; j++) {
+            for (k = 0; k < n1; k++) {
+                t[k] = cos(2 * M_PI * j * k / L);
+                t[n1 + k] = -sin(2 * M_PI * j * k / L);
+            }
+            t += 2 * n1;
+        }
+    }
+    for (k = 0; k < m; k++) {
+        p->sr[k] = cos(2 * M_PI * k / n);
+        p->si[k] = -sin(2 * M_PI * k / n);
+    }
+    return p;
+}
+
+/* Takes a reference on the plan for n with window w computed */
+static struct spec_plan *get_plan(int n, enum spec_window w)
+{
+    struct spec_plan *p;
+    int l = log2_points(n);
+
+    if (l < 0 || w >= SPEC_WIN_COUNT) {
+        errno = EINVAL;
+        return NULL;
+    }
+    pthread_mutex_lock(&plan_lock);
+    p = plans[l - MIN_LOG2];
+    if (!p)
+        p = plans[l - MIN_LOG2] = new_plan(n);
+    if (p && make_window(p, w))
+        p = NULL;
+    if (p)
+        p->users++;
+    pthread_mutex_unlock(&plan_lock);
+    if (!p)
+        errno = ENOMEM;
+    return p;
+}
+
+static int plan_window(struct spec_plan *p, enum spec_window w)
+{
+    int ret;
+
+    if (w >= SPEC_WIN_COUNT) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&plan_lock);
+    ret = make_window(p, w);
+    pthread_mutex_unlock(&plan_lock);
+    if (ret)
+        errno = ENOMEM;
+    return ret;
+}
+
+static void put_plan(struct spec_plan *p)
+{
+    pthread_mutex_lock(&plan_lock);
+    p->users--;
+    pthread_mutex_unlock(&plan_lock);
+}
+
+void spec_release_plans(void)
+{
+    int i;
+
+    pthread_mutex_lock(&plan_lock);
+    for (i = 0; i < NPLANS; i++) {
+        if (plans[i] && !plans[i]->users) {
+            free_plan(plans[i]);
+            plans[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&plan_lock);
+}
+
+/*
+ * FFT stages. Stage of length L and stride s, n1 = L / 4:
+ *   a..d = x[q + s * (p + {0,1,2,3} * n1)]
+ *   y[q + s * (4 * p + k)] = w^(k p) * butterfly_k(a, b, c, d)
+ */
+
+#ifdef SPEC_NEON
+struct cx4 {
+    float32x4_t r, i;
+};
+
+static inline struct cx4 cmul4(float32x4_t r, float32x4_t i,
+                               float32x4_t wr, float32x4_t wi)
+{
+    struct cx4 o;
+
+    o.r = vmlsq_f32(vmulq_f32(r, wr), i, wi);
+    o.i = vmlaq_f32(vmulq_f32(r, wi), i, wr);
+    return o;
+}
+
+/* y0..y3 of four butterflies, twiddles w1..w3 as re, im pairs */
+static inline void bfly4(const struct cx4 *a, const struct cx4 *b,
+                         const struct cx4 *c, const struct cx4 *d,
+                         const float32x4_t *w, struct cx4 *y)
+{
+    float32x4_t apcr = vaddq_f32(a->r, c->r), apci = vaddq_f32(a->i, c->i);
+    float32x4_t amcr = vsubq_f32(a->r, c->r), amci = vsubq_f32(a->i, c->i);
+    float32x4_t bpdr = vaddq_f32(b->r, d->r), bpdi = vaddq_f32(b->i, d->i);
+    /* j (b - d) */
+    float32x4_t jr = vsubq_f32(d->i, b->i), ji = vsubq_f32(b->r, d->r);
+
+    y[0].r = vaddq_f32(apcr, bpdr);
+    y[0].i = vaddq_f32(apci, bpdi);
+    y[1] = cmul4(vsubq_f32(amcr, jr), vsubq_f32(amci, ji), w[0], w[1]);
+    y[2] = cmul4(vsubq_f32(apcr, bpdr), vsubq_f32(apci, bpdi), w[2], w[3]);
+    y[3] = cmul4(vaddq_f32(amcr, jr), vaddq_f32(amci, ji), w[4], w[5]);
+}
+
+static inline struct cx4 load4(const float *r, const float *i, int o)
+{
+    struct cx4 v = {vld1q_f32(r + o), vld1q_f32(i + o)};
+
+    return v;
+}
+#endif
+
+static void radix4(int L, int s, const float *xr, const float *xi,
+                   float *yr, float *yi, const float *tw)
+{
+    int n1 = L / 4, p = 0, q, k, i0, o;
+    float ar, ai, br, bi, cr, ci, dr, di, tr, ti, wr, wi;
+    float apcr, apci, amcr, amci, bpdr, bpdi, jr, ji;
+
+#ifdef SPEC_NEON
+    struct cx4 a, b, c, d, y[4];
+    float32x4_t w[6];
+    float32x4x4_t vr, vi;
+
+    if (s == 1) {
+        /* across butterflies, results interleaved by k */
+        for (; p + 4 <= n1; p += 4) {
+            a = load4(xr, xi, p);
+            b = load4(xr, xi, p + n1);
+            c = load4(xr, xi, p + 2 * n1);
+            d = load4(xr, xi, p + 3 * n1);
+            for (k = 0; k < 6; k++)
+                w[k] = vld1q_f32(tw + k * n1 + p);
+            bfly4(&a, &b, &c, &d, w, y);
+            for (k = 0; k < 4; k++) {
+                vr.val[k] = y[k].r;
+                vi.val[k] = y[k].i;
+            }
+            vst4q_f32(yr + 4 * p, vr);
+            vst4q_f32(yi + 4 * p, vi);
+        }
+    } else {
+        /* s is a power of 4 here: across the stride */
+        for (; p < n1; p++) {
+            for (k = 0; k < 6; k++)
+                w[k] = vdupq_n_f32(tw[k * n1 + p]);
+            i0 = s * p;
+            o = 4 * s * p;
+            for (q = 0; q < s; q += 4) {
+                a = load4(xr, xi, i0 + q);
+                b = load4(xr, xi, i0 + q + s * n1);
+                c = load4(xr, xi, i0 + q + 2 * s * n1);
+                d = load4(xr, xi, i0 + q + 3 * s * n1);
+                bfly4(&a, &b, &c, &d, w, y);
+                for (k = 0; k < 4; k++) {
+                    vst1q_f32(yr + o + k * s + q, y[k].r);
+                    vst1q_f32(yi + o + k * s + q, y[k].i);
+                }
+            }
+        }
+    }
+#endif
+    for (; p < n1; p++) {
+        i0 = s * p;
+        o = 4 * s * p;
+        for (q = 0; q < s; q++) {
+            ar = xr[i0 + q];
+            ai = xi[i0 + q];
+            br = xr[i0 + q + s * n1];
+            bi = xi[i0 + q + s * n1];
+            cr = xr[i0 + q + 2 * s * n1];
+            ci = xi[i0 + q + 2 * s * n1];
+            dr = xr[i0 + q + 3 * s * n1];
+            di = xi[i0 + q + 3 * s * n1];
+            apcr = ar + cr;
+            apci = ai + ci;
+            amcr = ar - cr;
+            amci = ai - ci;
+            bpdr = br + dr;
+            bpdi = bi + di;
+            jr = di - bi;
+            ji = br - dr;
+
+            yr[o + q] = apcr + bpdr;
+            yi[o + q] = apci + bpdi;
+            for (k = 1; k < 4; k++) {
+                switch (k) {
+                case 1:
+                    tr = amcr - jr;
+                    ti = amci - ji;
+                    break;
+                case 2:
+                    tr = apcr - bpdr;
+                    ti = apci - bpdi;
+                    break;
+                default:
+                    tr = amcr + jr;
+                    ti = amci + ji;
+                    break;
+                }
+                wr = tw[(k - 1) * 2 * n1 + p];
+                wi = tw[(k - 1) * 2 * n1 + n1 + p];
+                yr[o + k * s + q] = tr * wr - ti * wi;
+                yi[o + k * s + q] = tr * wi + ti * wr;
+            }
+        }
+    }
+}
+
+/* Last stage when the length is 2 times a power of 4 */
+static void radix2(int s, const float *xr, const float *xi,
+                   float *yr, float *yi)
+{
+    int q = 0;
+    float ar, ai, br, bi;
+
+#ifdef SPEC_NEON
+    struct cx4 a, b;
+
+    for (; q + 4 <= s; q += 4) {
+        a = load4(xr, xi, q);
+        b = load4(xr, xi, q + s);
+        vst1q_f32(yr + q, vaddq_f32(a.r, b.r));
+        vst1q_f32(yi + q, vaddq_f32(a.i, b.i));
+        vst1q_f32(yr + q + s, vsubq_f32(a.r, b.r));
+        vst1q_f32(yi + q + s, vsubq_f32(a.i, b.i));
+    }
+#endif
+    for (; q < s; q++) {
+        ar = xr[q];
+        ai = xi[q];
+        br = xr[q + s];
+        bi = xi[q + s];
+        yr[q] = ar + br;
+        yi[q] = ai + bi;
+        yr[q + s] = ar - br;
+        yi[q + s] = ai - bi;
+    }
+}
+
+/* Complex FFT of zr/zi; returns which buffer pair holds the result */
+static int fft(struct spectrum *s)
+{
+    struct spec_plan *p = s->plan;
+    float *b[2][2] = {{s->zr, s->zi}, {s->yr, s->yi}};
+    const float *tw = p->tw;
+    int L, st = 1, cur = 0;
+
+    for (L = p->m; L >= 4; L /= 4) {
+        radix4(L, st, b[cur][0], b[cur][1], b[!cur][0], b[!cur][1], tw);
+        tw += 6 * (L / 4);
+        st *= 4;
+        cur = !cur;
+    }
+    if (L == 2) {
+        radix2(st, b[cur][0], b[cur][1], b[!cur][0], b[!cur][1]);
+        cur = !cur;
+    }
+    return cur;
+}
+
+/*
+ * Split step. With Z the complex FFT of z[k] = x[2k] + i x[2k + 1]:
+ *   2 X[k] = (Z[k] + conj Z[m - k]) - i w^k (Z[k] - conj Z[m - k])
+ * |2 X[k]|^2 is what the one-sided spectrum wants for k inside (0, m), so
+ * the interior bins use the same scale as DC and Nyquist. Each bin's
+ * power is folded into the average with weight alpha.
+ */
+static void split(struct spectrum *s, const float *zr, const float *zi,
+                  float alpha)
+{
+    struct spec_plan *p = s->plan;
+    int m = p->m, k = 1, j;
+    float scale = 1.0f / (p->sum[s->win] * p->sum[s->win]);
+    float er, ei, ur, ui, xr, xi, pw;
+    float *avg = s->power;
+
+    /* DC and Nyquist are real */
+    pw = (zr[0] + zi[0]) * (zr[0] + zi[0]) * scale;
+    avg[0] += alpha * (pw - avg[0]);
+    pw = (zr[0] - zi[0]) * (zr[0] - zi[0]) * scale;
+    avg[m] += alpha * (pw - avg[m]);
+
+#ifdef SPEC_NEON
+    {
+        float32x4_t vc = vdupq_n_f32(scale), va = vdupq_n_f32(alpha);
+        float32x4_t ar, ai, br, bi, ur, ui, vr, vi, wr, wi, v;
+
+#define REV4(x) (v = vrev64q_f32(x), \
+                 vcombine_f32(vget_high_f32(v), vget_low_f32(v)))
+        for (; k + 4 <= m; k += 4) {
+            j = m - k - 3;
+            ar = vld1q_f32(zr + k);
+            ai = vld1q_f32(zi + k);
+            br = vld1q_f32(zr + j);
+            br = REV4(br);
+            bi = vld1q_f32(zi + j);
+            bi = REV4(bi);
+            wr = vld1q_f32(p->sr + k);
+            wi = vld1q_f32(p->si + k);
+            /* E = Z + conj Z', O = -i (Z - conj Z') */
+            vr = vaddq_f32(ar, br);
+            vi = vsubq_f32(ai, bi);
+            ur = vaddq_f32(ai, bi);
+            ui = vsubq_f32(br, ar);
+            vr = vaddq_f32(vr, vmlsq_f32(vmulq_f32(ur, wr), ui, wi));
+            vi = vaddq_f32(vi, vmlaq_f32(vmulq_f32(ur, wi), ui, wr));
+            v = vmulq_f32(vmlaq_f32(vmulq_f32(vr, vr), vi, vi), vc);
+            ar = vld1q_f32(avg + k);
+            vst1q_f32(avg + k, vmlaq_f32(ar, va, vsubq_f32(v, ar)));
+        }
+#undef REV4
+    }
+#endif
+    for (; k < m; k++) {
+        j = m - k;
+        er = zr[k] + zr[j];
+        ei = zi[k] - zi[j];
+        ur = zi[k] + zi[j];
+        ui = zr[j] - zr[k];
+        xr = er + ur * p->sr[k] - ui * p->si[k];
+        xi = ei + ur * p->si[k] + ui * p->sr[k];
+        pw = (xr * xr + xi * xi) * scale;
+        avg[k] += alpha * (pw - avg[k]);
+    }
+}
+
+static void add_frame(struct spectrum *s)
+{
+    float *res[2][2] = {{s->zr, s->zi}, {s->yr, s->yi}};
+    int cur = fft(s);
+
+    if (s->frames < s->avg)
+        s->frames++;
+    split(s, res[cur][0], res[cur][1], 1.0f / s->frames);
+}
+
+void spec_add_s16(struct spectrum *s, const int16_t *src)
+{
+    const float *we = s->plan->win[s->win], *wo = we + s->plan->m;
+    int m = s->plan->m, k = 0;
+
+#ifdef SPEC_NEON
+    int16x8x2_t v;
+
+    for (; k + 8 <= m; k += 8) {
+        v = vld2q_s16(src + 2 * k);
+        vst1q_f32(s->zr + k, vmulq_f32(vld1q_f32(we + k),
+                  vcvtq_f32_s32(vmovl_s16(vget_low_s16(v.val[0])))));
+        vst1q_f32(s->zr + k + 4, vmulq_f32(vld1q_f32(we + k + 4),
+                  vcvtq_f32_s32(vmovl_s16(vget_high_s16(v.val[0])))));
+        vst1q_f32(s->zi + k, vmulq_f32(vld1q_f32(wo + k),
+                  vcvtq_f32_s32(vmovl_s16(vget_low_s16(v.val[1])))));
+        vst1q_f32(s->zi + k + 4, vmulq_f32(vld1q_f32(wo + k + 4),
+                  vcvtq_f32_s32(vmovl_s16(vget_high_s16(v.val[1])))));
+    }
+#endif
+    for (; k < m; k++) {
+        s->zr[k] = src[2 * k] * we[k];
+        s->zi[k] = src[2 * k + 1] * wo[k];
+    }
+    add_frame(s);
+}
+
+void spec_add_f32(struct spectrum *s, const float *src)
+{
+    const float *we = s->plan->win[s->win], *wo = we + s->plan->m;
+    int m = s->plan->m, k = 0;
+
+#ifdef SPEC_NEON
+    float32x4x2_t v;
+
+    for (; k + 4 <= m; k += 4) {
+        v = vld2q_f32(src + 2 * k);
+        vst1q_f32(s->zr + k, vmulq_f32(vld1q_f32(we + k), v.val[0]));
+        vst1q_f32(s->zi + k, vmulq_f32(vld1q_f32(wo + k), v.val[1]));
+    }
+#endif
+    for (; k < m; k++) {
+        s->zr[k] = src[2 * k] * we[k];
+        s->zi[k] = src[2 * k + 1] * wo[k];
+    }
+    add_frame(s);
+}
+
+/* log2 on [1, 2): degree 4 least squares fit in t = x - 1 */
+#define L1 1.4385468f
+#define L2 -0.6780815f
+#define L3 0.3236304f
+#define L4 -0.0842851f
+#define DB_PER_LOG2 3.0103000f      /* 10 log10(2) */
+
+static inline float fast_log2(float x)
+{
+    union {
+        float f;
+        uint32_t u;
+    } v = {x};
+    float e = (int)(v.u >> 23) - 127, t;
+
+    v.u = (v.u & 0x7fffff) | 0x3f800000;
+    t = v.f - 1;
+    return e + t * (L1 + t * (L2 + t * (L3 + t * L4)));
+}
+
+void spec_db(struct spectrum *s, float *out, float ref)
+{
+    int n = s->plan->m + 1, k = 0;
+    float ref2 = ref * ref, floor = ref2 * 1e-20f;
+    float off = 2 * log2f(ref);
+    const float *pw = s->power;
+
+#ifdef SPEC_NEON
+    float32x4_t vf = vdupq_n_f32(floor), vo = vdupq_n_f32(off);
+    float32x4_t vd = vdupq_n_f32(DB_PER_LOG2), one = vdupq_n_f32(1);
+    float32x4_t e, t, l;
+    uint32x4_t u;
+
+    for (; k + 4 <= n; k += 4) {
+        u = vreinterpretq_u32_f32(vmaxq_f32(vld1q_f32(pw + k), vf));
+        e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(u, 23)),
+                                    vdupq_n_s32(127)));
+        u = vorrq_u32(vandq_u32(u, vdupq_n_u32(0x7fffff)),
+                      vdupq_n_u32(0x3f800000));
+        t = vsubq_f32(vreinterpretq_f32_u32(u), one);
+        l = vmlaq_f32(vdupq_n_f32(L3), t, vdupq_n_f32(L4));
+        l = vmlaq_f32(vdupq_n_f32(L2), t, l);
+        l = vmlaq_f32(vdupq_n_f32(L1), t, l);
+        l = vmlaq_f32(e, t, l);
+        vst1q_f32(out + k, vmulq_f32(vsubq_f32(l, vo), vd));
+    }
+#endif
+    for (; k < n; k++)
+        out[k] = (fast_log2(pw[k] > floor ? pw[k] : floor) - off) *
+                 DB_PER_LOG2;
+}
+
+const float *spec_power(struct spectrum *s)
+{
+    return s->power;
+}
+
+int spec_frames(struct spectrum *s)
+{
+    return s->frames;
+}
+
+void spec_reset(struct spectrum *s)
+{
+    memset(s->power, 0, (s->plan->m + 1) * sizeof(float));
+    s->frames = 0;
+}
+
+int spec_set_window(struct spectrum *s, enum spec_window win)
+{
+    if (plan_window(s->plan, win))
+        return -1;
+    s->win = win;
+    spec_reset(s);
+    return 0;
+}
+
+int spec_set_average(struct spectrum *s, int avg)
+{
+    if (avg < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    s->avg = avg;
+    spec_reset(s);
+    return 0;
+}
+
+struct spectrum *spec_create(int n, enum spec_window win, int avg)
+{
+    struct spectrum *s;
+    int m = n / 2;
+
+    if (avg < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+    s->plan = get_plan(n, win);
+    if (!s->plan) {
+        free(s);
+        return NULL;
+    }
+    s->win = win;
+    s->avg = avg;
+    s->zr = alloc_floats(m);
+    s->zi = alloc_floats(m);
+    s->yr = alloc_floats(m);
+    s->yi = alloc_floats(m);
+    s->power = alloc_floats(m + 1);
+    if (!s->zr || !s->zi || !s->yr || !s->yi || !s->power) {
+        spec_destroy(s);
+        errno = ENOMEM;
+        return NULL;
+    }
+    spec_reset(s);
+    return s;
+}
+
+void spec_destroy(struct spectrum *s)
+{
+    if (!s)
+        return;
+    put_plan(s->plan);
+    free(s->zr);
+    free(s->zi);
+    free(s->yr);
+    free(s->yi);
+    free(s->power);
+    free(s);
+}
@@ -0,0 +1,68 @@
+/*
+ * Real-input FFT and averaged power spectrum
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __SPECTRUM_H
+#define __SPECTRUM_H
+
+#include <stdint.h>
+
+#define SPEC_MIN_POINTS 1024
+#define SPEC_MAX_POINTS 65536
+
+enum spec_window {
+    SPEC_WIN_RECT = 0,
+    SPEC_WIN_HANN,
+    SPEC_WIN_BLACKMAN_HARRIS,   /* 4 term, -92 dB sidelobes */
+    SPEC_WIN_FLATTOP,           /* amplitude accurate to ~0.01 dB off-bin */
+    SPEC_WIN_COUNT
+};
+
+struct spectrum;
+
+/* n: FFT points, a power of two from SPEC_MIN_POINTS to SPEC_MAX_POINTS.
+   avg: frames in the exponential power average, 1 for none. Twiddle and
+   window tables are shared by all spectra of the same size. Returns NULL
+   with errno = EINVAL for a bad size or window. */
+struct spectrum *spec_create(int n, enum spec_window win, int avg);
+void spec_destroy(struct spectrum *s);
+
+/* Window and averaging can change between frames; both restart the
+   average */
+int spec_set_window(struct spectrum *s, enum spec_window win);
+int spec_set_average(struct spectrum *s, int avg);
+void spec_reset(struct spectrum *s);
+
+/* Adds one frame of n samples to the average */
+void spec_add_s16(struct spectrum *s, const int16_t *src);
+void spec_add_f32(struct spectrum *s, const float *src);
+
+/* Averaged power of bins 0 .. n / 2, scaled so that a sine of amplitude A
+   centred on a bin reads A^2 there */
+const float *spec_power(struct spectrum *s);
+
+/* The same in dB relative to amplitude ref (32768 for dBFS of s16 input),
+   n / 2 + 1 values, floored at -200 dB */
+void spec_db(struct spectrum *s, float *out, float ref);
+
+/* Frames averaged since the last restart */
+int spec_frames(struct spectrum *s);
+
+/* Frees the shared tables of sizes no spectrum uses any more */
+void spec_release_plans(void);
+
+#endif
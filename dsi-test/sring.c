@@ -0,0 +1,224 @@
+/*
+ * Single-producer/single-consumer sample ring
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* sring.c - hand-off from the PL readout thread to processing.
+ *
+ * head and tail are free-running byte counts, masked on use, so a full
+ * ring and an empty one are told apart without a spare slot. Each side
+ * owns one cache line holding its own index, a cached copy of the other
+ * side's index and its counters: the other side's line is only read when
+ * the cached copy says the ring looks full (or empty), which keeps the two
+ * cores from bouncing a line on every call. Data is published with a
+ * release store of the index and picked up with an acquire load. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#include "sring.h"
+
+struct sring {
+    /* producer */
+    atomic_size_t head __attribute__((aligned(SRING_CACHELINE)));
+    size_t tail_cache;
+    atomic_uint_least64_t produced, overruns, dropped;
+    atomic_size_t high_water;
+
+    /* consumer */
+    atomic_size_t tail __attribute__((aligned(SRING_CACHELINE)));
+    size_t head_cache;
+    atomic_uint_least64_t consumed;
+
+    /* constant */
+    uint8_t *buf __attribute__((aligned(SRING_CACHELINE)));
+    size_t size, mask;
+};
+
+struct sring *sring_create(size_t size)
+{
+    struct sring *r;
+    void *mem;
+
+    if (size < SRING_CACHELINE || (size & (size - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (posix_memalign(&mem, SRING_CACHELINE, sizeof(*r)))
+        return NULL;
+    r = mem;
+    memset(r, 0, sizeof(*r));
+    if (posix_memalign(&mem, SRING_CACHELINE, size)) {
+        free(r);
+        return NULL;
+    }
+    r->buf = mem;
+    r->size = size;
+    r->mask = size - 1;
+    return r;
+}
+
+void sring_destroy(struct sring *r)
+{
+    free(r->buf);
+    free(r);
+}
+
+void *sring_reserve(struct sring *r, size_t *len)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t room = r->size - (head - r->tail_cache);
+    size_t off = head & r->mask;
+
+    if (room < *len) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        room = r->size - (head - r->tail_cache);
+    }
+    if (room > r->size - off)
+        room = r->size - off;
+    if (*len > room)
+        *len = room;
+    return r->buf + off;
+}
+
+void sring_commit(struct sring *r, size_t len)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed) + len;
+    size_t level = head - r->tail_cache;
+
+    atomic_store_explicit(&r->head, head, memory_order_release);
+    atomic_fetch_add_explicit(&r->produced, len, memory_order_relaxed);
+    if (level > atomic_load_explicit(&r->high_water, memory_order_relaxed))
+        atomic_store_explicit(&r->high_water, level, memory_order_relaxed);
+}
+
+void sring_overrun(struct sring *r, size_t len)
+{
+    if (!len)
+        return;
+    atomic_fetch_add_explicit(&r->overruns, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->dropped, len, memory_order_relaxed);
+}
+
+size_t sring_write(struct sring *r, const void *src, size_t len)
+{
+    const uint8_t *s = src;
+    size_t done = 0, n;
+    void *dst;
+
+    /* at most two pieces, the second one after the wrap */
+    while (done < len) {
+        n = len - done;
+        dst = sring_reserve(r, &n);
+        if (!n)
+            break;
+        memcpy(dst, s + done, n);
+        sring_commit(r, n);
+        done += n;
+    }
+    sring_overrun(r, len - done);
+    return done;
+}
+
+size_t sring_fill_ual(struct sring *r, struct ual_bar_tkn *dev, uint32_t addr,
+                      size_t n)
+{
+    size_t done = 0, len;
+    void *dst;
+
+    while (done < n) {
+        len = (n - done) * 4;
+        dst = sring_reserve(r, &len);
+        len /= 4;
+        if (!len)
+            break;
+        ual_readl_n(dev, addr + done * 4, dst, len);
+        sring_commit(r, len * 4);
+        done += len;
+    }
+    sring_overrun(r, (n - done) * 4);
+    return done;
+}
+
+size_t sring_drain_ual_fifo(struct sring *r, struct ual_bar_tkn *dev,
+                            uint32_t addr, uint32_t level_addr)
+{
+    size_t done = 0, len, got;
+    void *dst;
+    int k;
+
+    /* the free space comes in at most two pieces, around the wrap */
+    for (k = 0; k < 2; k++) {
+        len = r->size;
+        dst = sring_reserve(r, &len);
+        len /= 4;
+        if (!len)
+            break;
+        got = ual_readl_fifo(dev, addr, dst, len, level_addr);
+        sring_commit(r, got * 4);
+        done += got;
+        if (got < len)
+            break;
+    }
+    return done;
+}
+
+const void *sring_peek(struct sring *r, size_t *len)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t avail = r->head_cache - tail;
+    size_t off = tail & r->mask;
+
+    if (!avail) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        avail = r->head_cache - tail;
+    }
+    if (avail > r->size - off)
+        avail = r->size - off;
+    *len = avail;
+    return r->buf + off;
+}
+
+void sring_release(struct sring *r, size_t len)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&r->tail, tail + len, memory_order_release);
+    atomic_fetch_add_explicit(&r->consumed, len, memory_order_relaxed);
+}
+
+size_t sring_level(struct sring *r)
+{
+    /* tail first: the head read after it can only be further on */
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    return atomic_load_explicit(&r->head, memory_order_acquire) - tail;
+}
+
+void sring_get_stats(struct sring *r, struct sring_stats *st)
+{
+    st->produced = atomic_load_explicit(&r->produced, memory_order_relaxed);
+    st->consumed = atomic_load_explicit(&r->consumed, memory_order_relaxed);
+    st->overruns = atomic_load_explicit(&r->overruns, memory_order_relaxed);
+    st->dropped = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+    st->high_water = atomic_load_explicit(&r->high_water,
+                                          memory_order_relaxed);
+}
@@ -0,0 +1,81 @@
+/*
+ * Single-producer/single-consumer sample ring
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __SRING_H
+#define __SRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ual.h"
+
+/* Covers the 32 byte L1 lines of the Cortex-A9 and the 64 byte ones of
+   the usual development hosts */
+#define SRING_CACHELINE 64
+
+struct sring_stats {
+    uint64_t produced;      /* bytes committed */
+    uint64_t consumed;      /* bytes released */
+    uint64_t overruns;      /* times the producer found no room */
+    uint64_t dropped;       /* bytes lost to those */
+    size_t high_water;      /* largest fill level seen by the producer */
+};
+
+struct sring;
+
+/* size: bytes, a power of two */
+struct sring *sring_create(size_t size);
+void sring_destroy(struct sring *r);
+
+/* Producer side. sring_reserve() returns the free contiguous space at the
+   write position and its length in *len, at most the requested *len and
+   possibly less at the end of the buffer; sring_commit() publishes the
+   first len bytes of it. */
+void *sring_reserve(struct sring *r, size_t *len);
+void sring_commit(struct sring *r, size_t len);
+/* Records data the producer had to throw away for lack of room */
+void sring_overrun(struct sring *r, size_t len);
+
+/* Copies as much as fits and counts the rest as overrun; returns the
+   bytes stored */
+size_t sring_write(struct sring *r, const void *src, size_t len);
+
+/* Reads n 32-bit words from addr of the UAL mapping straight into ring
+   space (the ring must only ever hold whole words). Words that do not fit
+   are not read and count as overrun. Returns the words stored. */
+size_t sring_fill_ual(struct sring *r, struct ual_bar_tkn *dev, uint32_t addr,
+                      size_t n);
+
+/* Drains a PL streaming FIFO at addr into ring space with
+   ual_readl_fifo(), as many words as its level register at level_addr
+   reports and the ring has room for; the rest stays in the FIFO.
+   Returns the words stored. */
+size_t sring_drain_ual_fifo(struct sring *r, struct ual_bar_tkn *dev,
+                            uint32_t addr, uint32_t level_addr);
+
+/* Consumer side. sring_peek() returns the contiguous readable data at the
+   read position, length in *len (0 when empty); sring_release() frees the
+   first len bytes of it. */
+const void *sring_peek(struct sring *r, size_t *len);
+void sring_release(struct sring *r, size_t len);
+
+/* Bytes readable right now, from either side */
+size_t sring_level(struct sring *r);
+void sring_get_stats(struct sring *r, struct sring_stats *st);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * Software trigger search over captured sample buffers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* trigger.c - trigger conditions as a sequence of threshold searches.
+ *
+ * Every trigger type is a small state machine whose states only change
+ * when the signal goes past a threshold: an edge is "below level minus
+ * hysteresis" followed by "at or above level", a runt is "above low"
+ * followed by "back below low before reaching high", and so on. Each step
+ * is therefore a search for the first sample at or above one threshold
+ * or at or below another, which is what the kernels do: on NEON they
+ * compare 64 samples (32 for 16-bit ones) per iteration and OR the lane
+ * masks together, and only the block that has a hit is walked sample by
+ * sample. Long stretches without a state change, the common case in deep
+ * memory, cost a few instructions per 16 samples. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <errno.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TRIG_NEON
+#endif
+
+#include "trigger.h"
+
+#define OFF INT_MIN     /* threshold not in use */
+
+struct scan {
+    const void *p;
+    size_t n;
+    int bits;
+};
+
+static size_t first_s8(const int8_t *p, size_t i, size_t n, int ge, int le,
+                       int use_ge, int use_le)
+{
+#ifdef TRIG_NEON
+    int8x16_t vg = vdupq_n_s8(ge), vl = vdupq_n_s8(le);
+    uint8x16_t eg = vdupq_n_u8(use_ge ? 0xff : 0);
+    uint8x16_t el = vdupq_n_u8(use_le ? 0xff : 0);
+    uint8x16_t m;
+    uint8x8_t r;
+
+#define HIT8(a) vorrq_u8(vandq_u8(vcgeq_s8(a, vg), eg), \
+                         vandq_u8(vcleq_s8(a, vl), el))
+    for (; i + 64 <= n; i += 64) {
+        __builtin_prefetch(p + i + 512);
+        m = vorrq_u8(vorrq_u8(HIT8(vld1q_s8(p + i)),
+                              HIT8(vld1q_s8(p + i + 16))),
+                     vorrq_u8(HIT8(vld1q_s8(p + i + 32)),
+                              HIT8(vld1q_s8(p + i + 48))));
+        r = vorr_u8(vget_low_u8(m), vget_high_u8(m));
+        if (vget_lane_u64(vreinterpret_u64_u8(r), 0))
+            break;
+    }
+#undef HIT8
+#endif
+    /* the hit, if any, is within the next 64 samples */
+    for (; i < n; i++)
+        if ((use_ge && p[i] >= ge) || (use_le && p[i] <= le))
+            return i;
+    return n;
+}
+
+static size_t first_s16(const int16_t *p, size_t i, size_t n, int ge, int le,
+                        int use_ge, int use_le)
+{
+#ifdef TRIG_NEON
+    int16x8_t vg = vdupq_n_s16(ge), vl = vdupq_n_s16(le);
+    uint16x8_t eg = vdupq_n_u16(use_ge ? 0xffff : 0);
+    uint16x8_t el = vdupq_n_u16(use_le ? 0xffff : 0);
+    uint16x8_t m;
+    uint16x4_t r;
+
+#define HIT16(a) vorrq_u16(vandq_u16(vcgeq_s16(a, vg), eg), \
+                           vandq_u16(vcleq_s16(a, vl), el))
+    for (; i + 32 <= n; i += 32) {
+        __builtin_prefetch(p + i + 256);
+        m = vorrq_u16(vorrq_u16(HIT16(vld1q_s16(p + i)),
+                                HIT16(vld1q_s16(p + i + 8))),
+                      vorrq_u16(HIT16(vld1q_s16(p + i + 16)),
+                                HIT16(vld1q_s16(p + i + 24))));
+        r = vorr_u16(vget_low_u16(m), vget_high_u16(m));
+        if (vget_lane_u64(vreinterpret_u64_u16(r), 0))
+            break;
+    }
+#undef HIT16
+#endif
+    for (; i < n; i++)
+        if ((use_ge && p[i] >= ge) || (use_le && p[i] <= le))
+            return i;
+    return n;
+}
+
+static int sample(const struct scan *s, size_t i)
+{
+    return s->bits == 8 ? ((const int8_t *)s->p)[i] :
+                          ((const int16_t *)s->p)[i];
+}
+
+/* First sample from i on with x >= ge or x <= le, s->n if none */
+static size_t first(const struct scan *s, size_t i, int ge, int le)
+{
+    int max = s->bits == 8 ? INT8_MAX : INT16_MAX, min = -max - 1;
+    int use_ge = ge != OFF && ge <= max, use_le = le != OFF && le >= min;
+
+    if (i >= s->n || (!use_ge && !use_le))
+        return s->n;
+    if (use_ge && ge < min)
+        return i;
+    if (use_le && le > max)
+        return i;
+
+    if (s->bits == 8)
+        return first_s8(s->p, i, s->n, use_ge ? ge : 0, use_le ? le : 0,
+                        use_ge, use_le);
+    return first_s16(s->p, i, s->n, use_ge ? ge : 0, use_le ? le : 0,
+                     use_ge, use_le);
+}
+
+/* At or beyond thr in the direction of the slope */
+static size_t toward(const struct scan *s, int rising, size_t i, int thr)
+{
+    return rising ? first(s, i, thr, OFF) : first(s, i, OFF, thr);
+}
+
+/* Strictly back on the other side of thr */
+static size_t back(const struct scan *s, int rising, size_t i, int thr)
+{
+    return rising ? first(s, i, OFF, thr - 1) : first(s, i, thr + 1, OFF);
+}
+
+/* Where the signal went through thr between samples i - 1 and i */
+static double interp(const struct scan *s, size_t i, int thr)
+{
+    int a, b;
+    double f;
+
+    if (i == 0)
+        return 0;
+    a = sample(s, i - 1);
+    b = sample(s, i);
+    if (a == b)
+        return i;
+    f = (double)(thr - a) / (b - a);
+    return f >= 0 && f <= 1 ? i - 1 + f : i;
+}
+
+static int width_match(const struct trig_config *cfg, uint32_t w)
+{
+    switch (cfg->width_cmp) {
+    case TRIG_WIDTH_LESS:
+        return w < cfg->width_min;
+    case TRIG_WIDTH_GREATER:
+        return w > cfg->width_max;
+    case TRIG_WIDTH_INSIDE:
+        return w >= cfg->width_min && w <= cfg->width_max;
+    case TRIG_WIDTH_OUTSIDE:
+        return w < cfg->width_min || w > cfg->width_max;
+    }
+    return 0;
+}
+
+static int valid(const struct trig_config *cfg)
+{
+    if (cfg->hysteresis < 0 || cfg->slope > TRIG_FALLING)
+        return 0;
+    switch (cfg->type) {
+    case TRIG_EDGE:
+    case TRIG_LEVEL:
+        return 1;
+    case TRIG_PULSE:
+        return cfg->width_cmp <= TRIG_WIDTH_OUTSIDE;
+    case TRIG_RUNT:
+        return cfg->low < cfg->high;
+    }
+    return 0;
+}
+
+/* One trigger from 'from' on; *next is where a search for the following
+   one has to resume */
+static int search(const struct trig_config *cfg, const struct scan *s,
+                  size_t from, struct trig_event *ev, size_t *next)
+{
+    int rising = cfg->slope == TRIG_RISING, L = cfg->level;
+    int arm = rising ? L - cfg->hysteresis : L + cfg->hysteresis;
+    int lo = rising ? cfg->low : cfg->high;     /* runt start threshold */
+    int hi = rising ? cfg->high : cfg->low;     /* ... and the full one */
+    size_t n = s->n, i, t0, t1;
+
+    ev->width = 0;
+    switch (cfg->type) {
+    case TRIG_EDGE:
+        i = back(s, rising, from, arm);
+        i = toward(s, rising, i, L);
+        if (i == n)
+            return 0;
+        ev->index = i;
+        ev->time = interp(s, i, L);
+        *next = i + 1;
+        return 1;
+
+    case TRIG_LEVEL:
+        i = toward(s, rising, from, L);
+        if (i == n)
+            return 0;
+        ev->index = i;
+        ev->time = i > from ? interp(s, i, L) : i;
+        *next = back(s, rising, i, L);
+        return 1;
+
+    case TRIG_PULSE:
+        i = back(s, rising, from, arm);
+        for (;;) {
+            t0 = toward(s, rising, i, L);
+            t1 = back(s, rising, t0, arm);
+            if (t1 == n)
+                return 0;
+            if (width_match(cfg, t1 - t0))
+                break;
+            i = t1;
+        }
+        ev->index = t1;
+        ev->time = interp(s, t1, arm);
+        ev->width = t1 - t0;
+        *next = t1;
+        return 1;
+
+    case TRIG_RUNT:
+        i = back(s, rising, from, lo);
+        for (;;) {
+            t0 = toward(s, rising, i, lo);
+            /* full swing or back out, whichever comes first */
+            t1 = rising ? first(s, t0, hi, lo - 1) : first(s, t0, lo + 1, hi);
+            if (t1 == n)
+                return 0;
+            if (rising ? sample(s, t1) < lo : sample(s, t1) > lo)
+                break;
+            i = back(s, rising, t1, lo);
+        }
+        ev->index = t1;
+        ev->time = interp(s, t1, lo);
+        ev->width = t1 - t0;
+        *next = t1;
+        return 1;
+    }
+    return 0;
+}
+
+static int find(const struct trig_config *cfg, const struct scan *s,
+                size_t from, struct trig_event *ev)
+{
+    size_t next;
+
+    if (!valid(cfg)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return search(cfg, s, from, ev, &next);
+}
+
+static long find_all(const struct trig_config *cfg, const struct scan *s,
+                     struct trig_event *ev, size_t max)
+{
+    size_t from = 0, count = 0;
+
+    if (!valid(cfg)) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (count < max && search(cfg, s, from, &ev[count], &from))
+        count++;
+    return count;
+}
+
+int trig_find_s8(const struct trig_config *cfg, const int8_t *src, size_t n,
+                 size_t from, struct trig_event *ev)
+{
+    struct scan s = {src, n, 8};
+
+    return find(cfg, &s, from, ev);
+}
+
+int trig_find_s16(const struct trig_config *cfg, const int16_t *src, size_t n,
+                  size_t from, struct trig_event *ev)
+{
+    struct scan s = {src, n, 16};
+
+    return find(cfg, &s, from, ev);
+}
+
+long trig_find_all_s8(const struct trig_config *cfg, const int8_t *src,
+                      size_t n, struct trig_event *ev, size_t max)
+{
+    struct scan s = {src, n, 8};
+
+    return find_all(cfg, &s, ev, max);
+}
+
+long trig_find_all_s16(const struct trig_config *cfg, const int16_t *src,
+                       size_t n, struct trig_event *ev, size_t max)
+{
+    struct scan s = {src, n, 16};
+
+    return find_all(cfg, &s, ev, max);
+}
@@ -0,0 +1,77 @@
+/*
+ * Software trigger search over captured sample buffers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TRIGGER_H
+#define __TRIGGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum trig_type {
+    TRIG_EDGE = 0,  /* crossing of level, re-armed hysteresis beyond it */
+    TRIG_LEVEL,     /* every sample where the signal gets to level */
+    TRIG_PULSE,     /* pulse between edges whose width matches */
+    TRIG_RUNT       /* pulse crossing low but not high (or the reverse) */
+};
+
+/* Rising: edges going up, high levels, positive pulses and runts */
+enum trig_slope {
+    TRIG_RISING = 0,
+    TRIG_FALLING
+};
+
+enum trig_width {
+    TRIG_WIDTH_LESS = 0,        /* width < width_min */
+    TRIG_WIDTH_GREATER,         /* width > width_max */
+    TRIG_WIDTH_INSIDE,          /* width_min <= width <= width_max */
+    TRIG_WIDTH_OUTSIDE
+};
+
+struct trig_config {
+    enum trig_type type;
+    enum trig_slope slope;
+    int level;                  /* edge, level, pulse */
+    int hysteresis;             /* edge, pulse; >= 0 */
+    int low, high;              /* runt */
+    enum trig_width width_cmp;  /* pulse */
+    uint32_t width_min, width_max;
+};
+
+struct trig_event {
+    size_t index;       /* sample at which the condition is met */
+    double time;        /* threshold crossing interpolated between the
+                           previous sample and index, in samples */
+    uint32_t width;     /* pulse and runt: samples since the start edge */
+};
+
+/* Search from sample 'from' on; return 1 and fill ev if a trigger is
+   found, 0 otherwise. The arming condition has to be seen after 'from'
+   too, so a capture cannot trigger on its first sample (except TRIG_LEVEL).
+   Return -1 with errno = EINVAL for an invalid configuration. */
+int trig_find_s8(const struct trig_config *cfg, const int8_t *src, size_t n,
+                 size_t from, struct trig_event *ev);
+int trig_find_s16(const struct trig_config *cfg, const int16_t *src, size_t n,
+                  size_t from, struct trig_event *ev);
+
+/* All triggers, up to max of them; returns their number or -1 */
+long trig_find_all_s8(const struct trig_config *cfg, const int8_t *src,
+                      size_t n, struct trig_event *ev, size_t max);
+long trig_find_all_s16(const struct trig_config *cfg, const int16_t *src,
+                       size_t n, struct trig_event *ev, size_t max);
+
+#endif
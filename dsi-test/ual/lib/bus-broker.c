@@ -0,0 +1,954 @@
+/**
+ * @license: LGPLv3
+ */
+
+/*
+ * Register broker: one process owns the mapping and every other process
+ * goes through it, so that nobody's read-modify-write can interleave with
+ * somebody else's.
+ *
+ * The broker publishes a shared memory segment holding one slot per
+ * client. A slot is a ring of commands the client fills and the broker
+ * executes in order: head and tail are free-running counts, each on a
+ * cache line of its own, published with release stores and picked up
+ * with acquire loads, as in the sample ring. Writes are posted into it
+ * and the client carries on; ual_rmwl() waits for its own command, and
+ * the broker executes it between two other commands, never in the middle
+ * of one. Reads do not need the broker at all: clients map the registers
+ * read-only and load them directly, after waiting for their own posted
+ * writes so that they read back what they wrote. FIFO bursts, which
+ * change the device when read, go through the ring and come back in the
+ * slot.
+ *
+ * Nobody makes a system call while the other side is busy. The broker
+ * spins for a while when the rings run dry, then announces it is going
+ * to sleep and waits on a futex, which the next client to post wakes; a
+ * client waiting for an answer does the same on its slot. On a single
+ * CPU spinning only delays the side that would make progress, so both
+ * sides go to sleep at once there. The broker takes back the slots of
+ * clients that died without ual_close() when it is idle; a client
+ * asleep wakes up every UAL_BROKER_IDLE_MS to make sure that the broker
+ * is still there, and fails with EPIPE when it is not.
+ *
+ * A slot has one writer: threads sharing a token take turns on it under
+ * the token's mutex, the way processes take turns on the registers.
+ *
+ * Whoever can write the segment gets register writes executed by the
+ * broker, root's when it maps /dev/mem: the segment is the broker
+ * user's alone, or its and a group's after ual_broker_set_group().
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ual-int.h"
+
+#define UAL_BROKER_MAGIC 0x52424c55 /* "ULBR" */
+#define UAL_BROKER_VERSION 2
+#define UAL_BROKER_SLOTS 32
+#define UAL_BROKER_RING 256 /* commands, a power of 2 */
+#define UAL_BROKER_DATA 1024 /* 32bit values a FIFO read brings back */
+#define UAL_BROKER_LINE 64
+#define UAL_BROKER_SPIN_NS 50000 /* before going to sleep */
+#define UAL_BROKER_IDLE_MS 100 /* between looks for dead clients, or broker */
+
+enum ual_broker_op {
+	UAL_BROKER_WRITE = 0,
+	UAL_BROKER_RMW,
+	UAL_BROKER_READ_FIFO,
+};
+
+struct ual_broker_cmd {
+	uint8_t op;
+	uint8_t dw;
+	uint16_t count; /* FIFO read */
+	uint32_t addr;
+	uint32_t value;
+	uint32_t mask; /* RMW */
+};
+
+struct ual_broker_slot {
+	/* client */
+	atomic_uint head __attribute__((aligned(UAL_BROKER_LINE)));
+	atomic_int waiting; /* futex waiter on tail */
+
+	/* broker */
+	atomic_uint tail __attribute__((aligned(UAL_BROKER_LINE)));
+	uint32_t result; /* old value of the last RMW */
+
+	atomic_int pid __attribute__((aligned(UAL_BROKER_LINE)));
+	struct ual_broker_cmd cmd[UAL_BROKER_RING];
+	uint32_t data[UAL_BROKER_DATA];
+};
+
+struct ual_broker_shm {
+	atomic_uint magic;
+	uint32_t version;
+	uint64_t size; /* bytes of the BAR */
+	uint64_t offset; /* of the BAR in path */
+	char path[128]; /* what clients map read-only */
+	atomic_int pid; /* of the broker */
+	atomic_int closed; /* by ual_broker_destroy() */
+
+	/* clients bump wake when the broker sleeps */
+	atomic_uint wake __attribute__((aligned(UAL_BROKER_LINE)));
+	atomic_int sleeping;
+	atomic_int stop;
+
+	struct ual_broker_slot slot[UAL_BROKER_SLOTS];
+};
+
+static long ual_futex(atomic_uint *addr, int op, unsigned int val,
+		      const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static void ual_broker_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__arm__) || defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+static uint64_t ual_broker_now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* Spinning only pays when the other side runs at the same time */
+static int ual_broker_spin(void)
+{
+	static int cpus;
+
+	if (!cpus)
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 1;
+}
+
+static void ual_broker_name(char *buf, size_t len, const char *name)
+{
+	snprintf(buf, len, "/ual-broker-%s", name);
+}
+
+/* Whether the broker of a segment still serves it */
+static int ual_broker_alive(struct ual_broker_shm *shm)
+{
+	int pid = atomic_load(&shm->pid);
+
+	if (!pid || atomic_load(&shm->closed))
+		return 0;
+	/* EPERM: alive, and somebody else's */
+	return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+
+/*
+ * Client side
+ */
+
+/**
+ * Internal broker client descriptor
+ */
+struct ual_bar_broker {
+	struct ual_broker_shm *shm;
+	struct ual_broker_slot *slot;
+	uint32_t head; /**< commands posted */
+	const volatile uint8_t *regs; /**< read-only mapping */
+	uint64_t size;
+	int mapped;
+	int dead; /**< the broker went away */
+	pthread_mutex_t lock; /**< threads sharing the token share head */
+};
+
+/* Wakes the broker if it went to sleep before seeing the new command */
+static void ual_broker_kick(struct ual_broker_shm *shm)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&shm->sleeping, memory_order_relaxed)) {
+		atomic_fetch_add(&shm->wake, 1);
+		ual_futex(&shm->wake, FUTEX_WAKE, 1, NULL);
+	}
+}
+
+/* Fails once the broker is known to be gone */
+static int ual_broker_gone(struct ual_bar_broker *b)
+{
+	if (!b->dead && !atomic_load_explicit(&b->shm->closed,
+					      memory_order_relaxed))
+		return 0;
+	b->dead = 1;
+	errno = EPIPE;
+	return -1;
+}
+
+/* Waits until the broker has executed every command up to head; -1 and
+   EPIPE when the broker went away first */
+static int ual_broker_wait(struct ual_bar_broker *b, uint32_t head)
+{
+	struct timespec idle = {0, UAL_BROKER_IDLE_MS * 1000000};
+	struct ual_broker_slot *s = b->slot;
+	uint64_t t0 = 0;
+	unsigned int t;
+	int ret = 0;
+
+	if (ual_broker_gone(b))
+		return -1;
+	if (ual_broker_spin()) {
+		while (1) {
+			t = atomic_load_explicit(&s->tail, memory_order_acquire);
+			if ((int)(t - head) >= 0)
+				return 0;
+			if (!t0)
+				t0 = ual_broker_now();
+			else if (ual_broker_now() - t0 > UAL_BROKER_SPIN_NS)
+				break;
+			ual_broker_relax();
+		}
+	}
+	atomic_store(&s->waiting, 1);
+	while (1) {
+		t = atomic_load(&s->tail);
+		if ((int)(t - head) >= 0)
+			break;
+		/* nothing moves tail once the broker is gone */
+		if (!ual_broker_alive(b->shm)) {
+			b->dead = 1;
+			errno = EPIPE;
+			ret = -1;
+			break;
+		}
+		ual_futex(&s->tail, FUTEX_WAIT, t, &idle);
+	}
+	atomic_store_explicit(&s->waiting, 0, memory_order_relaxed);
+	return ret;
+}
+
+/* Room for one more command; the broker frees it as it goes. NULL and
+   EPIPE without a broker */
+static struct ual_broker_cmd *ual_broker_next(struct ual_bar_broker *b)
+{
+	uint32_t t = atomic_load_explicit(&b->slot->tail,
+					  memory_order_acquire);
+
+	if (ual_broker_gone(b))
+		return NULL;
+	if (b->head - t >= UAL_BROKER_RING &&
+	    ual_broker_wait(b, b->head - UAL_BROKER_RING + 1))
+		return NULL;
+	return &b->slot->cmd[b->head % UAL_BROKER_RING];
+}
+
+static void ual_broker_post(struct ual_bar_broker *b)
+{
+	atomic_store_explicit(&b->slot->head, ++b->head, memory_order_release);
+	ual_broker_kick(b->shm);
+}
+
+/* What the client wrote is what it reads back */
+static int ual_broker_sync(struct ual_bar_broker *b)
+{
+	if (ual_broker_gone(b))
+		return -1;
+	if (atomic_load_explicit(&b->slot->tail, memory_order_acquire) !=
+	    b->head)
+		return ual_broker_wait(b, b->head);
+	return 0;
+}
+
+static int ual_broker_range(struct ual_bar_broker *b, uint32_t addr,
+			    uint64_t bytes)
+{
+	if (addr + bytes > b->size) {
+		errno = EFAULT;
+		return -1;
+	}
+	return 0;
+}
+
+static int ual_broker_open(struct ual_bar *bar)
+{
+	struct ual_bar_broker *b;
+	struct ual_broker_shm *shm;
+	char name[160];
+	void *regs;
+	int fd, i, err, pid = getpid(), free_pid;
+
+	if (!bar->desc.broker.name) {
+		errno = EINVAL;
+		return -1;
+	}
+	ual_broker_name(name, sizeof(name), bar->desc.broker.name);
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+		return -1;
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED,
+		   fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return -1;
+	if (atomic_load_explicit(&shm->magic, memory_order_acquire) !=
+	    UAL_BROKER_MAGIC || shm->version != UAL_BROKER_VERSION) {
+		errno = EPROTONOSUPPORT;
+		goto err_shm;
+	}
+	if (!ual_broker_alive(shm)) {
+		errno = ECONNREFUSED;
+		goto err_shm;
+	}
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		goto err_shm;
+	b->shm = shm;
+	b->size = shm->size;
+	for (i = 0; i < UAL_BROKER_SLOTS; i++) {
+		free_pid = 0;
+		if (atomic_compare_exchange_strong(&shm->slot[i].pid,
+						   &free_pid, pid))
+			break;
+	}
+	if (i == UAL_BROKER_SLOTS) {
+		errno = EBUSY;
+		goto err_alloc;
+	}
+	b->slot = &shm->slot[i];
+	pthread_mutex_init(&b->lock, NULL);
+	b->head = atomic_load(&b->slot->tail);
+	atomic_store(&b->slot->head, b->head);
+
+	/* reads need nothing but the registers */
+	fd = open(shm->path, O_RDONLY | O_SYNC);
+	if (fd < 0)
+		goto err_slot;
+	regs = mmap(NULL, b->size, PROT_READ, MAP_SHARED, fd, shm->offset);
+	close(fd);
+	if (regs == MAP_FAILED)
+		goto err_slot;
+	b->regs = regs;
+	bar->bus_data = b;
+
+	return 0;
+
+err_slot:
+	err = errno;
+	pthread_mutex_destroy(&b->lock);
+	atomic_store(&b->slot->pid, 0);
+	errno = err;
+err_alloc:
+	free(b);
+err_shm:
+	err = errno;
+	munmap(shm, sizeof(*shm));
+	errno = err;
+	return -1;
+}
+
+static int ual_broker_close(struct ual_bar *bar)
+{
+	struct ual_bar_broker *b = bar->bus_data;
+
+	if (!b) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	/* the slot is free again once the broker is done with it, or
+	   with the broker */
+	ual_broker_sync(b);
+	atomic_store(&b->slot->pid, 0);
+	pthread_mutex_destroy(&b->lock);
+	munmap((void *)b->regs, b->size);
+	munmap(b->shm, sizeof(*b->shm));
+	free(b);
+	bar->bus_data = NULL;
+
+	return 0;
+}
+
+static int ual_broker_map(struct ual_bar *bar)
+{
+	struct ual_bar_broker *b = bar->bus_data;
+
+	if (!b) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	if (b->mapped) {
+		errno = UAL_ERR_ALREADY_MAPPED;
+		return -1;
+	}
+
+	/* writes must go through the hooks: no pointer */
+	bar->ptr = NULL;
+	b->mapped = 1;
+
+	return 0;
+}
+
+static int ual_broker_unmap(struct ual_bar *bar)
+{
+	struct ual_bar_broker *b = bar->bus_data;
+
+	if (!b) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	if (!b->mapped) {
+		errno = UAL_ERR_NOT_MAPPED;
+		return -1;
+	}
+	b->mapped = 0;
+
+	return 0;
+}
+
+static uint32_t ual_broker_load(struct ual_bar_broker *b, uint32_t addr,
+				enum ual_data_width dw)
+{
+	if (dw == UAL_DATA_WIDTH_32)
+		return *(const volatile uint32_t *)(b->regs + addr);
+	if (dw == UAL_DATA_WIDTH_16)
+		return *(const volatile uint16_t *)(b->regs + addr);
+	return b->regs[addr];
+}
+
+static uint32_t ual_broker_read(struct ual_bar *bar, uint32_t addr,
+				enum ual_data_width dw)
+{
+	struct ual_bar_broker *b = bar->bus_data;
+	uint32_t v;
+
+	if (ual_broker_range(b, addr, dw))
+		return 0xffffffff;
+	pthread_mutex_lock(&b->lock);
+	v = ual_broker_sync(b) ? 0xffffffff : ual_broker_load(b, addr, dw);
+	pthread_mutex_unlock(&b->lock);
+	return v;
+}
+
+static void ual_broker_write(struct ual_bar *bar, uint32_t addr,
+			     uint32_t value, enum ual_data_width dw)
+{
+	struct ual_bar_broker *b = bar->bus_data;
+	struct ual_broker_cmd *cmd;
+
+	if (ual_broker_range(b, addr, dw))
+		return;
+	pthread_mutex_lock(&b->lock);
+	cmd = ual_broker_next(b);
+	if (cmd) {
+		cmd->op = UAL_BROKER_WRITE;
+		cmd->dw = dw;
+		cmd->addr = addr;
+		cmd->value = value;
+		ual_broker_post(b);
+	}
+	pthread_mutex_unlock(&b->lock);
+}
+
+static void ual_broker_read_n(struct ual_bar *bar, uint32_t addr, void *data,
+			      unsigned int n, enum ual_data_width dw, int fifo)
+{
+	struct ual_bar_broker *b = bar->bus_data;
+	unsigned int per = UAL_BROKER_DATA * 4 / dw, i = 0, k;
+	struct ual_broker_cmd *cmd;
+	uint8_t *p = data;
+
+	if (ual_broker_range(b, addr, fifo ? dw : (uint64_t)n * dw)) {
+		memset(data, 0xff, n * dw);
+		return;
+	}
+	pthread_mutex_lock(&b->lock);
+	if (!fifo) {
+		if (ual_broker_sync(b))
+			goto err;
+		for (i = 0; i < n; i++, addr += dw, p += dw) {
+			if (dw == UAL_DATA_WIDTH_32)
+				*(uint32_t *)p = ual_broker_load(b, addr, dw);
+			else if (dw == UAL_DATA_WIDTH_16)
+				*(uint16_t *)p = ual_broker_load(b, addr, dw);
+			else
+				*p = ual_broker_load(b, addr, dw);
+		}
+		goto out;
+	}
+
+	/* popping a FIFO is a change like any write: the broker does it */
+	for (i = 0; i < n; i += k) {
+		k = n - i < per ? n - i : per;
+		cmd = ual_broker_next(b);
+		if (!cmd)
+			goto err;
+		cmd->op = UAL_BROKER_READ_FIFO;
+		cmd->dw = dw;
+		cmd->count = k;
+		cmd->addr = addr;
+		ual_broker_post(b);
+		if (ual_broker_wait(b, b->head))
+			goto err;
+		memcpy(p + i * dw, b->slot->data, k * dw);
+	}
+	goto out;
+
+err:
+	/* all ones from where it failed, like a bus error on PCI */
+	memset(p + i * dw, 0xff, (n - i) * dw);
+out:
+	pthread_mutex_unlock(&b->lock);
+}
+
+static void ual_broker_write_n(struct ual_bar *bar, uint32_t addr,
+			       const void *data, unsigned int n,
+			       enum ual_data_width dw, int fifo)
+{
+	struct ual_bar_broker *b = bar->bus_data;
+	const uint8_t *p = data;
+	struct ual_broker_cmd *cmd;
+	unsigned int i;
+
+	if (ual_broker_range(b, addr, fifo ? dw : (uint64_t)n * dw))
+		return;
+	pthread_mutex_lock(&b->lock);
+	for (i = 0; i < n; i++, p += dw) {
+		cmd = ual_broker_next(b);
+		if (!cmd)
+			break;
+		cmd->op = UAL_BROKER_WRITE;
+		cmd->dw = dw;
+		cmd->addr = fifo ? addr : addr + i * dw;
+		if (dw == UAL_DATA_WIDTH_32)
+			cmd->value = *(const uint32_t *)p;
+		else if (dw == UAL_DATA_WIDTH_16)
+			cmd->value = *(const uint16_t *)p;
+		else
+			cmd->value = *p;
+		/* the broker starts on the first while the rest follow */
+		atomic_store_explicit(&b->slot->head, ++b->head,
+				      memory_order_release);
+	}
+	ual_broker_kick(b->shm);
+	pthread_mutex_unlock(&b->lock);
+}
+
+static uint32_t ual_broker_rmw(struct ual_bar *bar, uint32_t addr,
+			       uint32_t mask, uint32_t value)
+{
+	struct ual_bar_broker *b = bar->bus_data;
+	struct ual_broker_cmd *cmd;
+	uint32_t v = 0xffffffff;
+
+	/* the broker skips it, result would still hold the last answer */
+	if (addr & 3) {
+		errno = EINVAL;
+		return 0xffffffff;
+	}
+	if (ual_broker_range(b, addr, 4))
+		return 0xffffffff;
+	pthread_mutex_lock(&b->lock);
+	cmd = ual_broker_next(b);
+	if (cmd) {
+		cmd->op = UAL_BROKER_RMW;
+		cmd->dw = UAL_DATA_WIDTH_32;
+		cmd->addr = addr;
+		cmd->value = value;
+		cmd->mask = mask;
+		ual_broker_post(b);
+		if (!ual_broker_wait(b, b->head))
+			v = b->slot->result;
+	}
+	pthread_mutex_unlock(&b->lock);
+	return v;
+}
+
+
+static struct ual_bus_operations ual_broker_op = {
+	.open = ual_broker_open,
+	.close = ual_broker_close,
+	.map = ual_broker_map,
+	.unmap = ual_broker_unmap,
+	.read = ual_broker_read,
+	.write = ual_broker_write,
+	.read_n = ual_broker_read_n,
+	.write_n = ual_broker_write_n,
+	.rmw = ual_broker_rmw,
+};
+
+struct ual_bus ual_broker = {
+	.name = "Broker",
+	.type = UAL_BUS_BROKER,
+	.op = &ual_broker_op,
+};
+
+
+/*
+ * Broker side
+ */
+
+/* 0 when nobody serves the segment called name any more, -1 and
+   EADDRINUSE while a broker does */
+static int ual_broker_claim(const char *name)
+{
+	struct ual_broker_shm *shm;
+	struct stat st;
+	int fd, alive;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return errno == ENOENT ? 0 : -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	/* a layout older than the pid field: its broker is long gone */
+	if (st.st_size < sizeof(*shm)) {
+		close(fd);
+		return 0;
+	}
+	shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return -1;
+	alive = ual_broker_alive(shm);
+	munmap(shm, sizeof(*shm));
+	if (alive) {
+		errno = EADDRINUSE;
+		return -1;
+	}
+	return 0;
+}
+
+struct ual_broker {
+	struct ual_broker_shm *shm;
+	char name[160];
+	volatile uint8_t *regs;
+	uint64_t size;
+	struct ual_broker_stats st;
+};
+
+/**
+ * It maps size bytes of path at offset (/dev/mem and a physical address
+ * for hardware, any file for a simulation) and publishes them as broker
+ * name, for UAL_BUS_BROKER clients. Requests are served by
+ * ual_broker_run(). Only the user of the broker may attach, see
+ * ual_broker_set_group() to let others in. The name of a broker that
+ * died is taken over; the one of a live broker is not.
+ *
+ * @param[in] name broker name, what clients pass in ual_desc_broker
+ * @param[in] path file holding the registers
+ * @param[in] offset of the registers in path (PAGE_SIZE aligned)
+ * @param[in] size bytes of registers
+ * @return the broker, NULL on error and errno is appropriately set
+ *         (EADDRINUSE when another broker serves name)
+ */
+struct ual_broker *ual_broker_create(const char *name, const char *path,
+				     uint64_t offset, uint64_t size)
+{
+	struct ual_broker *b;
+	void *p;
+	int fd, err;
+
+	if (strlen(path) >= sizeof(b->shm->path) || !size) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (offset & (getpagesize() - 1)) {
+		errno = UAL_ERR_INVALID_OFFSET;
+		return NULL;
+	}
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return NULL;
+	b->size = size;
+
+	fd = open(path, O_RDWR | O_SYNC);
+	if (fd < 0)
+		goto err;
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+	close(fd);
+	if (p == MAP_FAILED)
+		goto err;
+	b->regs = p;
+
+	/* a segment left over by a broker that crashed goes */
+	ual_broker_name(b->name, sizeof(b->name), name);
+	if (ual_broker_claim(b->name))
+		goto err_regs;
+	shm_unlink(b->name);
+	fd = shm_open(b->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		goto err_regs;
+	if (ftruncate(fd, sizeof(*b->shm))) {
+		close(fd);
+		goto err_shm;
+	}
+	p = mmap(NULL, sizeof(*b->shm), PROT_READ | PROT_WRITE, MAP_SHARED,
+		 fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		goto err_shm;
+	b->shm = p;
+	atomic_store(&b->shm->pid, getpid());
+	b->shm->version = UAL_BROKER_VERSION;
+	b->shm->size = size;
+	b->shm->offset = offset;
+	strcpy(b->shm->path, path);
+	atomic_store_explicit(&b->shm->magic, UAL_BROKER_MAGIC,
+			      memory_order_release);
+
+	return b;
+
+err_shm:
+	err = errno;
+	shm_unlink(b->name);
+	errno = err;
+err_regs:
+	err = errno;
+	munmap((void *)b->regs, size);
+	errno = err;
+err:
+	free(b);
+	return NULL;
+}
+
+/**
+ * It lets the members of a group attach to the broker, and so write the
+ * registers: the segment becomes 0660 and owned by gid. Clients also need
+ * to read the file holding the registers, /dev/mem for hardware.
+ *
+ * @param[in] b broker returned by ual_broker_create()
+ * @param[in] gid the group
+ * @return 0 on success, -1 on error and errno is appropriately set
+ */
+int ual_broker_set_group(struct ual_broker *b, gid_t gid)
+{
+	int fd, err = 0;
+
+	fd = shm_open(b->name, O_RDWR, 0);
+	if (fd < 0)
+		return -1;
+	if (fchown(fd, -1, gid) || fchmod(fd, 0660))
+		err = errno;
+	close(fd);
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * It releases the broker. Clients still attached fail from then on: an
+ * access waiting for the broker (ual_rmwl(), a FIFO read, a read after
+ * writes not executed yet, a write into a full ring) returns at once,
+ * and every later one fails without waiting. Reads and ual_rmwl() return
+ * all ones, writes are dropped, and errno is EPIPE.
+ *
+ * A broker that dies without it is noticed by the clients waiting for
+ * it within UAL_BROKER_IDLE_MS (100 ms); they fail the same way. Writes
+ * posted in the meantime are lost without an error, until the next
+ * access that waits.
+ *
+ * @param[in] b broker returned by ual_broker_create()
+ */
+void ual_broker_destroy(struct ual_broker *b)
+{
+	int i;
+
+	if (!b)
+		return;
+	atomic_store(&b->shm->closed, 1);
+	for (i = 0; i < UAL_BROKER_SLOTS; i++)
+		ual_futex(&b->shm->slot[i].tail, FUTEX_WAKE, INT_MAX, NULL);
+	shm_unlink(b->name);
+	munmap(b->shm, sizeof(*b->shm));
+	munmap((void *)b->regs, b->size);
+	free(b);
+}
+
+static void ual_broker_execute(struct ual_broker *b, struct ual_broker_slot *s,
+			       const struct ual_broker_cmd *cmd)
+{
+	volatile uint8_t *r = b->regs + cmd->addr;
+	uint32_t v;
+	int i;
+
+	/* clients check their ranges; this one must not trust them */
+	if (cmd->addr + (uint64_t)cmd->dw > b->size)
+		return;
+	switch (cmd->op) {
+	case UAL_BROKER_WRITE:
+		if (cmd->dw == UAL_DATA_WIDTH_32)
+			*(volatile uint32_t *)r = cmd->value;
+		else if (cmd->dw == UAL_DATA_WIDTH_16)
+			*(volatile uint16_t *)r = cmd->value;
+		else
+			*r = cmd->value;
+		b->st.writes++;
+		break;
+	case UAL_BROKER_RMW:
+		/* a client that bypassed ual_rmwl() gets no stale answer */
+		s->result = 0xffffffff;
+		if (cmd->addr & 3)
+			break;
+		v = *(volatile uint32_t *)r;
+		s->result = v;
+		*(volatile uint32_t *)r = (v & ~cmd->mask) |
+			(cmd->value & cmd->mask);
+		b->st.rmws++;
+		break;
+	case UAL_BROKER_READ_FIFO:
+		for (i = 0; i < cmd->count && i * cmd->dw < sizeof(s->data);
+		     i++) {
+			if (cmd->dw == UAL_DATA_WIDTH_32)
+				s->data[i] = *(volatile uint32_t *)r;
+			else if (cmd->dw == UAL_DATA_WIDTH_16)
+				((uint16_t *)s->data)[i] =
+					*(volatile uint16_t *)r;
+			else
+				((uint8_t *)s->data)[i] = *r;
+		}
+		b->st.fifo_reads++;
+		break;
+	}
+}
+
+/* Executes what the slots hold; returns the number of commands */
+static unsigned int ual_broker_pass(struct ual_broker *b)
+{
+	struct ual_broker_slot *s;
+	unsigned int done = 0, h, t;
+	int i;
+
+	for (i = 0; i < UAL_BROKER_SLOTS; i++) {
+		s = &b->shm->slot[i];
+		h = atomic_load_explicit(&s->head, memory_order_acquire);
+		t = atomic_load_explicit(&s->tail, memory_order_relaxed);
+		if (h == t)
+			continue;
+		/* a slot whose client just came and went has nothing in it */
+		if ((unsigned int)(h - t) > UAL_BROKER_RING) {
+			atomic_store(&s->tail, h);
+			continue;
+		}
+		for (; t != h; t++, done++)
+			ual_broker_execute(b, s, &s->cmd[t % UAL_BROKER_RING]);
+		atomic_store_explicit(&s->tail, t, memory_order_release);
+		atomic_thread_fence(memory_order_seq_cst);
+		if (atomic_load_explicit(&s->waiting, memory_order_relaxed)) {
+			ual_futex(&s->tail, FUTEX_WAKE, 1, NULL);
+			b->st.wakeups++;
+		}
+	}
+	b->st.commands += done;
+	return done;
+}
+
+/* Frees the slots of clients that exited without closing */
+static void ual_broker_reap(struct ual_broker *b)
+{
+	struct ual_broker_slot *s;
+	int i, pid;
+
+	for (i = 0; i < UAL_BROKER_SLOTS; i++) {
+		s = &b->shm->slot[i];
+		pid = atomic_load(&s->pid);
+		if (!pid || kill(pid, 0) == 0 || errno != ESRCH)
+			continue;
+		if (atomic_compare_exchange_strong(&s->pid, &pid, 0))
+			b->st.reaped++;
+	}
+}
+
+/**
+ * It serves the clients until ual_broker_stop() is called.
+ *
+ * @param[in] b broker returned by ual_broker_create()
+ * @return 0
+ */
+int ual_broker_run(struct ual_broker *b)
+{
+	struct ual_broker_shm *shm = b->shm;
+	struct timespec idle = {0, UAL_BROKER_IDLE_MS * 1000000};
+	uint64_t t0 = 0;
+	unsigned int seq;
+
+	while (!atomic_load_explicit(&shm->stop, memory_order_relaxed)) {
+		if (ual_broker_pass(b)) {
+			t0 = 0;
+			continue;
+		}
+		if (ual_broker_spin()) {
+			if (!t0)
+				t0 = ual_broker_now();
+			if (ual_broker_now() - t0 < UAL_BROKER_SPIN_NS) {
+				ual_broker_relax();
+				continue;
+			}
+		}
+
+		/* announce the sleep, then look once more */
+		seq = atomic_load(&shm->wake);
+		atomic_store(&shm->sleeping, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		if (!ual_broker_pass(b)) {
+			ual_broker_reap(b);
+			ual_futex(&shm->wake, FUTEX_WAIT, seq, &idle);
+			b->st.sleeps++;
+		}
+		atomic_store(&shm->sleeping, 0);
+		t0 = 0;
+	}
+	return 0;
+}
+
+/**
+ * It makes ual_broker_run() return; safe in a signal handler.
+ *
+ * @param[in] b broker returned by ual_broker_create()
+ */
+void ual_broker_stop(struct ual_broker *b)
+{
+	atomic_store(&b->shm->stop, 1);
+	atomic_fetch_add(&b->shm->wake, 1);
+	ual_futex(&b->shm->wake, FUTEX_WAKE, 1, NULL);
+}
+
+/**
+ * It returns the broker counters; call from the ual_broker_run() thread,
+ * or once it has returned.
+ *
+ * @param[in] b broker returned by ual_broker_create()
+ * @param[out] st counters
+ */
+void ual_broker_get_stats(struct ual_broker *b, struct ual_broker_stats *st)
+{
+	int i;
+
+	*st = b->st;
+	st->clients = 0;
+	for (i = 0; i < UAL_BROKER_SLOTS; i++)
+		st->clients += !!atomic_load(&b->shm->slot[i].pid);
+}
@@ -0,0 +1,742 @@
+/**
+ * @license: LGPLv3
+ */
+
+/*
+ * Remote BAR: every access travels over a socket to ual_remote_serve(),
+ * which performs it on a mapping of its own.
+ *
+ * A round trip costs tens of microseconds on loopback and much more over
+ * a network, so only what needs an answer waits for one. Writes are
+ * posted: they are sent and the caller carries on, the stream keeping
+ * them in order with whatever follows. Blocks and FIFO bursts are one
+ * request per 64 kB, all sent before the first answer is awaited.
+ * ual_readl_poll(), the handshake loop that would otherwise cost a round
+ * trip per read, runs on the server and only its result comes back. A
+ * posted write that failed is reported, through errno, by the next
+ * answer. A poll with a timeout also bounds the wait for its answer, so
+ * that a dead link or server fails it instead of hanging the caller.
+ *
+ * Answers are matched to requests by their order on the stream: threads
+ * sharing a token take turns under its mutex, a request and its answers
+ * at a time.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "ual-int.h"
+
+#define UAL_REMOTE_VERSION 2
+#define UAL_REMOTE_MAX_DATA 65536 /* bytes in one request or answer */
+#define UAL_REMOTE_LINK_MS 1000 /* a poll answer may take beyond its timeout */
+
+enum ual_remote_op {
+	UAL_REMOTE_HELLO = 0,
+	UAL_REMOTE_READ,
+	UAL_REMOTE_WRITE, /* posted, count * dw bytes follow */
+	UAL_REMOTE_POLL,
+};
+
+#define UAL_REMOTE_FIFO (1 << 0) /* every value at addr */
+
+struct ual_remote_cmd {
+	uint8_t op;
+	uint8_t dw;
+	uint16_t flags;
+	uint32_t addr;
+	uint32_t count; /* values, or the poll match */
+	uint32_t mask; /* poll */
+	uint64_t timeout_ns; /* poll, 0 for ever */
+};
+
+struct ual_remote_reply {
+	int32_t status; /* 0 or errno */
+	int32_t posted; /* errno of an earlier posted write, or 0 */
+	uint32_t value; /* hello: version, poll: last value read */
+	uint32_t reserved;
+	uint64_t arg; /* hello: BAR size, poll: ns left */
+	uint64_t size; /* bytes following */
+};
+
+/**
+ * Internal remote descriptor
+ */
+struct ual_bar_remote {
+	int fd; /**< -1 once the connection broke */
+	uint64_t size; /**< of the server's BAR */
+	int mapped;
+	uint8_t *buf; /**< request being sent */
+	pthread_mutex_t lock; /**< one exchange on the stream at a time */
+};
+
+
+static int ual_remote_send_all(int fd, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	ssize_t k;
+
+	while (len) {
+		k = send(fd, p, len, MSG_NOSIGNAL);
+		if (k < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += k;
+		len -= k;
+	}
+	return 0;
+}
+
+static int ual_remote_recv_all(int fd, void *data, size_t len)
+{
+	uint8_t *p = data;
+	ssize_t k;
+
+	while (len) {
+		k = recv(fd, p, len, MSG_WAITALL);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0) {
+			if (!k)
+				errno = ECONNRESET;
+			return -1;
+		}
+		p += k;
+		len -= k;
+	}
+	return 0;
+}
+
+/* After a failed transfer the stream is out of step: give up on it */
+static int ual_remote_broken(struct ual_bar_remote *r)
+{
+	int err = errno;
+
+	if (r->fd >= 0)
+		close(r->fd);
+	r->fd = -1;
+	errno = err ? err : EPIPE;
+	return -1;
+}
+
+static int ual_remote_send(struct ual_bar_remote *r,
+			   const struct ual_remote_cmd *cmd,
+			   const void *data, size_t len)
+{
+	if (r->fd < 0) {
+		errno = ENOTCONN;
+		return -1;
+	}
+	memcpy(r->buf, cmd, sizeof(*cmd));
+	if (len)
+		memcpy(r->buf + sizeof(*cmd), data, len);
+	if (ual_remote_send_all(r->fd, r->buf, sizeof(*cmd) + len))
+		return ual_remote_broken(r);
+	return 0;
+}
+
+/* Takes an answer, and its len bytes of data on success */
+static int ual_remote_answer(struct ual_bar_remote *r,
+			     struct ual_remote_reply *rep,
+			     void *data, size_t len)
+{
+	if (r->fd < 0) {
+		errno = ENOTCONN;
+		return -1;
+	}
+	if (ual_remote_recv_all(r->fd, rep, sizeof(*rep)))
+		return ual_remote_broken(r);
+	if (rep->size != (rep->status ? 0 : len)) {
+		errno = EPROTO;
+		return ual_remote_broken(r);
+	}
+	if (rep->size && ual_remote_recv_all(r->fd, data, len))
+		return ual_remote_broken(r);
+	if (rep->status) {
+		errno = rep->status;
+		return -1;
+	}
+	if (rep->posted) {
+		/* the data is good, an earlier write was not */
+		errno = rep->posted;
+		return 1;
+	}
+	return 0;
+}
+
+static int ual_remote_connect(const char *address)
+{
+	struct sockaddr_un su;
+	struct sockaddr_in si;
+	const char *colon = strrchr(address, ':');
+	char host[64];
+	int fd, one = 1;
+
+	if (!colon || strchr(address, '/')) {
+		if (strlen(address) >= sizeof(su.sun_path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		memset(&su, 0, sizeof(su));
+		su.sun_family = AF_UNIX;
+		strcpy(su.sun_path, address);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+			return -1;
+		if (connect(fd, (struct sockaddr *)&su, sizeof(su))) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if (colon - address >= sizeof(host)) {
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(host, address, colon - address);
+	host[colon - address] = 0;
+	memset(&si, 0, sizeof(si));
+	si.sin_family = AF_INET;
+	si.sin_port = htons(atoi(colon + 1));
+	if (inet_pton(AF_INET, host, &si.sin_addr) != 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&si, sizeof(si))) {
+		close(fd);
+		return -1;
+	}
+	/* posted writes must not wait for the next one to fill a segment */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+
+static int ual_remote_open(struct ual_bar *bar)
+{
+	struct ual_remote_cmd cmd = {UAL_REMOTE_HELLO, 0, 0, 0,
+				     UAL_REMOTE_VERSION, 0, 0};
+	struct ual_remote_reply rep;
+	struct ual_bar_remote *r;
+	int err;
+
+	if (!bar->desc.remote.address) {
+		errno = EINVAL;
+		return -1;
+	}
+	r = calloc(1, sizeof(struct ual_bar_remote));
+	if (!r)
+		return -1;
+	r->fd = -1;
+	pthread_mutex_init(&r->lock, NULL);
+	r->buf = malloc(sizeof(struct ual_remote_cmd) + UAL_REMOTE_MAX_DATA);
+	if (!r->buf)
+		goto err;
+	r->fd = ual_remote_connect(bar->desc.remote.address);
+	if (r->fd < 0)
+		goto err;
+	if (ual_remote_send(r, &cmd, NULL, 0) ||
+	    ual_remote_answer(r, &rep, NULL, 0) < 0)
+		goto err;
+	if (rep.value != UAL_REMOTE_VERSION) {
+		errno = EPROTONOSUPPORT;
+		goto err;
+	}
+	r->size = rep.arg;
+	bar->bus_data = r;
+
+	return 0;
+
+err:
+	err = errno;
+	if (r->fd >= 0)
+		close(r->fd);
+	pthread_mutex_destroy(&r->lock);
+	free(r->buf);
+	free(r);
+	errno = err;
+	return -1;
+}
+
+static int ual_remote_close(struct ual_bar *bar)
+{
+	struct ual_bar_remote *r = bar->bus_data;
+
+	if (!r) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	/* the server finishes the posted writes before it sees the end */
+	if (r->fd >= 0)
+		close(r->fd);
+	pthread_mutex_destroy(&r->lock);
+	free(r->buf);
+	free(r);
+	bar->bus_data = NULL;
+
+	return 0;
+}
+
+static int ual_remote_map(struct ual_bar *bar)
+{
+	struct ual_bar_remote *r = bar->bus_data;
+
+	if (!r) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	if (r->mapped) {
+		errno = UAL_ERR_ALREADY_MAPPED;
+		return -1;
+	}
+
+	/* a NULL pointer routes all accesses through the socket */
+	bar->ptr = NULL;
+	r->mapped = 1;
+
+	return 0;
+}
+
+static int ual_remote_unmap(struct ual_bar *bar)
+{
+	struct ual_bar_remote *r = bar->bus_data;
+
+	if (!r) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	if (!r->mapped) {
+		errno = UAL_ERR_NOT_MAPPED;
+		return -1;
+	}
+	r->mapped = 0;
+
+	return 0;
+}
+
+static void ual_remote_read_n(struct ual_bar *bar, uint32_t addr, void *data,
+			      unsigned int n, enum ual_data_width dw, int fifo)
+{
+	struct ual_bar_remote *r = bar->bus_data;
+	struct ual_remote_cmd cmd = {UAL_REMOTE_READ, dw,
+				     fifo ? UAL_REMOTE_FIFO : 0, };
+	struct ual_remote_reply rep;
+	unsigned int per = UAL_REMOTE_MAX_DATA / dw, i, k, sent;
+	uint8_t *p = data;
+	int failed = 0;
+
+	pthread_mutex_lock(&r->lock);
+	/* all the requests first, then the answers as they come */
+	for (sent = 0; sent < n; sent += per) {
+		cmd.addr = fifo ? addr : addr + sent * dw;
+		cmd.count = n - sent < per ? n - sent : per;
+		if (ual_remote_send(r, &cmd, NULL, 0))
+			break;
+	}
+	for (i = 0; i < n; i += per) {
+		k = n - i < per ? n - i : per;
+		if (i >= sent || ual_remote_answer(r, &rep, p + i * dw,
+						   k * dw) < 0) {
+			/* all ones, like a bus error on PCI */
+			memset(p + i * dw, 0xff, k * dw);
+			failed = errno;
+		}
+	}
+	pthread_mutex_unlock(&r->lock);
+	if (failed)
+		errno = failed;
+}
+
+static void ual_remote_write_n(struct ual_bar *bar, uint32_t addr,
+			       const void *data, unsigned int n,
+			       enum ual_data_width dw, int fifo)
+{
+	struct ual_bar_remote *r = bar->bus_data;
+	struct ual_remote_cmd cmd = {UAL_REMOTE_WRITE, dw,
+				     fifo ? UAL_REMOTE_FIFO : 0, };
+	unsigned int per = UAL_REMOTE_MAX_DATA / dw, i;
+	const uint8_t *p = data;
+
+	pthread_mutex_lock(&r->lock);
+	for (i = 0; i < n; i += per) {
+		cmd.addr = fifo ? addr : addr + i * dw;
+		cmd.count = n - i < per ? n - i : per;
+		if (ual_remote_send(r, &cmd, p + i * dw, cmd.count * dw))
+			break;
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+union ual_remote_value {
+	uint32_t l;
+	uint16_t w;
+	uint8_t b;
+};
+
+static uint32_t ual_remote_read(struct ual_bar *bar, uint32_t addr,
+				enum ual_data_width dw)
+{
+	union ual_remote_value v;
+
+	ual_remote_read_n(bar, addr, &v, 1, dw, 0);
+	return dw == UAL_DATA_WIDTH_32 ? v.l : dw == UAL_DATA_WIDTH_16 ?
+		v.w : v.b;
+}
+
+static void ual_remote_write(struct ual_bar *bar, uint32_t addr,
+			     uint32_t value, enum ual_data_width dw)
+{
+	union ual_remote_value v;
+
+	if (dw == UAL_DATA_WIDTH_32)
+		v.l = value;
+	else if (dw == UAL_DATA_WIDTH_16)
+		v.w = value;
+	else
+		v.b = value;
+	ual_remote_write_n(bar, addr, &v, 1, dw, 0);
+}
+
+static int ual_remote_poll_locked(struct ual_bar_remote *r, uint32_t addr,
+				  uint32_t mask, uint32_t match,
+				  struct timespec *timeout, uint32_t *value)
+{
+	struct ual_remote_cmd cmd = {UAL_REMOTE_POLL, UAL_DATA_WIDTH_32, 0,
+				     addr, match, mask, 0};
+	struct ual_remote_reply rep;
+	struct pollfd pfd;
+	uint64_t slice;
+	int ret;
+
+	if (timeout) {
+		cmd.timeout_ns = timeout->tv_sec * 1000000000ULL +
+			timeout->tv_nsec;
+		/* 0 means for ever on the wire */
+		if (!cmd.timeout_ns)
+			cmd.timeout_ns = 1;
+	}
+	do {
+		if (ual_remote_send(r, &cmd, NULL, 0))
+			return -1;
+		/* the server answers within a link time, EAGAIN if the
+		   wait goes on */
+		slice = cmd.timeout_ns && cmd.timeout_ns <
+			UAL_REMOTE_LINK_MS * 1000000ULL ?
+			cmd.timeout_ns / 1000000 : UAL_REMOTE_LINK_MS;
+		pfd.fd = r->fd;
+		pfd.events = POLLIN;
+		do {
+			ret = poll(&pfd, 1, slice + UAL_REMOTE_LINK_MS);
+		} while (ret < 0 && errno == EINTR);
+		if (ret <= 0) {
+			/* an answer coming later would be taken for the
+			   next one's */
+			if (!ret)
+				errno = ETIMEDOUT;
+			return ual_remote_broken(r);
+		}
+		ret = ual_remote_answer(r, &rep, NULL, 0);
+		cmd.timeout_ns = rep.arg;
+	} while (ret < 0 && errno == EAGAIN);
+	if (ret >= 0 || errno == ETIME) {
+		if (value)
+			*value = rep.value;
+		if (timeout) {
+			timeout->tv_sec = rep.arg / 1000000000ULL;
+			timeout->tv_nsec = rep.arg % 1000000000ULL;
+		}
+	}
+	return ret < 0 ? -1 : 0;
+}
+
+static int ual_remote_poll(struct ual_bar *bar, uint32_t addr, uint32_t mask,
+			   uint32_t match, struct timespec *timeout,
+			   uint32_t *value)
+{
+	struct ual_bar_remote *r = bar->bus_data;
+	int ret;
+
+	pthread_mutex_lock(&r->lock);
+	ret = ual_remote_poll_locked(r, addr, mask, match, timeout, value);
+	pthread_mutex_unlock(&r->lock);
+	return ret;
+}
+
+
+static struct ual_bus_operations ual_remote_op = {
+	.open = ual_remote_open,
+	.close = ual_remote_close,
+	.map = ual_remote_map,
+	.unmap = ual_remote_unmap,
+	.read = ual_remote_read,
+	.write = ual_remote_write,
+	.read_n = ual_remote_read_n,
+	.write_n = ual_remote_write_n,
+	.poll = ual_remote_poll,
+};
+
+struct ual_bus ual_remote = {
+	.name = "Remote",
+	.type = UAL_BUS_REMOTE,
+	.op = &ual_remote_op,
+};
+
+
+/*
+ * Server side
+ */
+
+struct ual_remote_server {
+	struct ual_bar_tkn *dev;
+	uint64_t size;
+	int fd;
+	int posted; /* errno of a failed posted write, not reported yet */
+	uint8_t *in, *out;
+	size_t in_len, out_len;
+	uint32_t *tmp; /* aligned copy of the data */
+};
+
+#define UAL_REMOTE_IN (4 * (sizeof(struct ual_remote_cmd) + \
+			    UAL_REMOTE_MAX_DATA))
+#define UAL_REMOTE_OUT (4 * (sizeof(struct ual_remote_reply) + \
+			     UAL_REMOTE_MAX_DATA))
+
+static int ual_remote_range(struct ual_remote_server *s,
+			    const struct ual_remote_cmd *cmd)
+{
+	uint64_t bytes = (uint64_t)cmd->count * cmd->dw;
+
+	if (cmd->dw != 1 && cmd->dw != 2 && cmd->dw != 4)
+		return EINVAL;
+	if (bytes > UAL_REMOTE_MAX_DATA)
+		return EINVAL;
+	if (cmd->flags & UAL_REMOTE_FIFO) {
+		if (cmd->dw == UAL_DATA_WIDTH_8)
+			return EINVAL; /* there are no 8bit FIFO accessors */
+		bytes = cmd->dw;
+	}
+	if (cmd->addr + bytes > s->size)
+		return EFAULT;
+	return 0;
+}
+
+static void ual_remote_do_read(struct ual_remote_server *s,
+			       const struct ual_remote_cmd *cmd)
+{
+	int fifo = cmd->flags & UAL_REMOTE_FIFO;
+
+	if (fifo && cmd->dw == 4)
+		ual_readl_fifo(s->dev, cmd->addr, s->tmp, cmd->count,
+			       UAL_FIFO_NO_LEVEL);
+	else if (fifo)
+		ual_readw_fifo(s->dev, cmd->addr, (uint16_t *)s->tmp,
+			       cmd->count, UAL_FIFO_NO_LEVEL);
+	else if (cmd->dw == 4)
+		ual_readl_n(s->dev, cmd->addr, s->tmp, cmd->count);
+	else if (cmd->dw == 2)
+		ual_readw_n(s->dev, cmd->addr, (uint16_t *)s->tmp, cmd->count);
+	else
+		ual_readb_n(s->dev, cmd->addr, (uint8_t *)s->tmp, cmd->count);
+}
+
+static void ual_remote_do_write(struct ual_remote_server *s,
+				const struct ual_remote_cmd *cmd)
+{
+	int fifo = cmd->flags & UAL_REMOTE_FIFO;
+
+	if (fifo && cmd->dw == 4)
+		ual_writel_fifo(s->dev, cmd->addr, s->tmp, cmd->count,
+				UAL_FIFO_NO_LEVEL);
+	else if (fifo)
+		ual_writew_fifo(s->dev, cmd->addr, (uint16_t *)s->tmp,
+				cmd->count, UAL_FIFO_NO_LEVEL);
+	else if (cmd->dw == 4)
+		ual_writel_n(s->dev, cmd->addr, s->tmp, cmd->count);
+	else if (cmd->dw == 2)
+		ual_writew_n(s->dev, cmd->addr, (uint16_t *)s->tmp,
+			     cmd->count);
+	else
+		ual_writeb_n(s->dev, cmd->addr, (uint8_t *)s->tmp, cmd->count);
+}
+
+static int ual_remote_flush(struct ual_remote_server *s)
+{
+	if (s->out_len && ual_remote_send_all(s->fd, s->out, s->out_len))
+		return -1;
+	s->out_len = 0;
+	return 0;
+}
+
+static int ual_remote_reply(struct ual_remote_server *s,
+			    struct ual_remote_reply *rep, const void *data)
+{
+	if (s->out_len + sizeof(*rep) + rep->size > UAL_REMOTE_OUT &&
+	    ual_remote_flush(s))
+		return -1;
+	rep->posted = s->posted;
+	s->posted = 0;
+	memcpy(s->out + s->out_len, rep, sizeof(*rep));
+	if (rep->size)
+		memcpy(s->out + s->out_len + sizeof(*rep), data, rep->size);
+	s->out_len += sizeof(*rep) + rep->size;
+	return 0;
+}
+
+/* Executes one request, whose data is complete; -1 to hang up */
+static int ual_remote_execute(struct ual_remote_server *s,
+			      const struct ual_remote_cmd *cmd,
+			      const uint8_t *data)
+{
+	struct ual_remote_reply rep;
+	struct timespec t;
+	uint64_t left, slice;
+	uint32_t v = 0;
+	int err;
+
+	memset(&rep, 0, sizeof(rep));
+	switch (cmd->op) {
+	case UAL_REMOTE_HELLO:
+		rep.value = UAL_REMOTE_VERSION;
+		rep.arg = s->size;
+		if (cmd->count != UAL_REMOTE_VERSION)
+			rep.status = EPROTONOSUPPORT;
+		return ual_remote_reply(s, &rep, NULL);
+	case UAL_REMOTE_READ:
+		rep.status = ual_remote_range(s, cmd);
+		if (!rep.status) {
+			ual_remote_do_read(s, cmd);
+			rep.size = cmd->count * cmd->dw;
+		}
+		return ual_remote_reply(s, &rep, s->tmp);
+	case UAL_REMOTE_WRITE:
+		err = ual_remote_range(s, cmd);
+		if (err) {
+			if (!s->posted)
+				s->posted = err;
+			return 0;
+		}
+		memcpy(s->tmp, data, cmd->count * cmd->dw);
+		ual_remote_do_write(s, cmd);
+		return 0;
+	case UAL_REMOTE_POLL:
+		if (cmd->addr + 4ULL > s->size) {
+			rep.status = EFAULT;
+			return ual_remote_reply(s, &rep, NULL);
+		}
+		/* a link time at most, so that a client gone meanwhile
+		   is noticed; the client asks again for the rest */
+		left = cmd->timeout_ns;
+		if (!left || left > UAL_REMOTE_LINK_MS * 1000000ULL)
+			slice = UAL_REMOTE_LINK_MS * 1000000ULL;
+		else
+			slice = left;
+		t.tv_sec = slice / 1000000000ULL;
+		t.tv_nsec = slice % 1000000000ULL;
+		if (ual_readl_poll(s->dev, cmd->addr, cmd->mask, cmd->count,
+				   &t, &v))
+			rep.status = errno;
+		rep.value = v;
+		left = left ? left - slice + t.tv_sec * 1000000000ULL +
+			t.tv_nsec : 0;
+		if (rep.status == ETIME && slice != cmd->timeout_ns)
+			rep.status = EAGAIN;
+		rep.arg = left;
+		return ual_remote_reply(s, &rep, NULL);
+	}
+	errno = EPROTO;
+	return -1;
+}
+
+
+/**
+ * It serves the given BAR to a UAL_BUS_REMOTE client connected on fd,
+ * until the client goes away. Requests are handled in order, each batch
+ * received answered with one send.
+ *
+ * @param[in] dev UAL device token returned by ual_open()
+ * @param[in] size bytes of the BAR that clients may access
+ * @param[in] fd connected stream socket
+ * @return 0 when the client closed the connection, -1 on error and errno
+ *         is appropriately set
+ */
+int ual_remote_serve(struct ual_bar_tkn *dev, uint64_t size, int fd)
+{
+	struct ual_remote_server s;
+	struct ual_remote_cmd cmd;
+	size_t used, need;
+	ssize_t k;
+	int ret = -1;
+
+	memset(&s, 0, sizeof(s));
+	s.dev = dev;
+	s.size = size;
+	s.fd = fd;
+	s.in = malloc(UAL_REMOTE_IN);
+	s.out = malloc(UAL_REMOTE_OUT);
+	s.tmp = malloc(UAL_REMOTE_MAX_DATA);
+	if (!s.in || !s.out || !s.tmp) {
+		errno = ENOMEM;
+		goto out;
+	}
+
+	while (1) {
+		k = read(fd, s.in + s.in_len, UAL_REMOTE_IN - s.in_len);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0)
+			goto out;
+		if (!k) {
+			ret = s.in_len ? -1 : 0;
+			if (ret)
+				errno = EPROTO;
+			goto out;
+		}
+		s.in_len += k;
+
+		for (used = 0; s.in_len - used >= sizeof(cmd); used += need) {
+			memcpy(&cmd, s.in + used, sizeof(cmd));
+			need = sizeof(cmd);
+			if (cmd.op == UAL_REMOTE_WRITE) {
+				if ((uint64_t)cmd.count * cmd.dw >
+				    UAL_REMOTE_MAX_DATA) {
+					errno = EPROTO;
+					goto out;
+				}
+				need += cmd.count * cmd.dw;
+			}
+			if (s.in_len - used < need)
+				break;
+			if (ual_remote_execute(&s, &cmd,
+					       s.in + used + sizeof(cmd)))
+				goto out;
+		}
+		memmove(s.in, s.in + used, s.in_len - used);
+		s.in_len -= used;
+		if (ual_remote_flush(&s))
+			goto out;
+	}
+
+out:
+	free(s.in);
+	free(s.out);
+	free(s.tmp);
+	return ret;
+}
@@ -0,0 +1,139 @@
+/**
+ * @license: LGPLv3
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "ual-int.h"
+
+
+/**
+ * Internal simulated memory descriptor
+ */
+struct ual_bar_sim {
+	void *mem; /**< register file, when no hooks are given */
+	int mapped;
+};
+
+static int ual_sim_map(struct ual_bar *bar)
+{
+	struct ual_desc_sim *sim = &bar->desc.sim;
+	struct ual_bar_sim *bsim;
+
+	bsim = bar->bus_data;
+	if (!bsim) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	if (bsim->mapped) {
+		errno = UAL_ERR_ALREADY_MAPPED;
+		return -1;
+	}
+
+	if (!sim->size) {
+		errno = UAL_ERR_INVALID_SIZE;
+		return -1;
+	}
+
+	if (!sim->read != !sim->write) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!sim->read) {
+		bsim->mem = calloc(1, sim->size);
+		if (!bsim->mem)
+			return -1;
+	}
+	/* a NULL pointer routes all accesses through the read/write hooks */
+	bar->ptr = bsim->mem;
+	bsim->mapped = 1;
+
+	return 0;
+}
+
+static int ual_sim_unmap(struct ual_bar *bar)
+{
+	struct ual_bar_sim *bsim = bar->bus_data;
+
+	if (!bsim) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	if (!bsim->mapped) {
+		errno = UAL_ERR_NOT_MAPPED;
+		return -1;
+	}
+
+	free(bsim->mem);
+	bsim->mem = NULL;
+	bar->ptr = NULL;
+	bsim->mapped = 0;
+
+	return 0;
+}
+
+
+static int ual_sim_open(struct ual_bar *bar)
+{
+	struct ual_bar_sim *bsim;
+
+	bsim = malloc(sizeof(struct ual_bar_sim));
+	if (!bsim)
+		return -1;
+	memset(bsim, 0, sizeof(struct ual_bar_sim));
+	bar->bus_data = bsim;
+
+	return 0;
+}
+
+static int ual_sim_close(struct ual_bar *bar)
+{
+	struct ual_bar_sim *bsim = bar->bus_data;
+
+	if (!bsim) {
+		errno = UAL_ERR_NOT_OPEN;
+		return -1;
+	}
+
+	free(bsim);
+	bar->bus_data = NULL;
+
+	return 0;
+}
+
+static uint32_t ual_sim_read(struct ual_bar *bar, uint32_t addr,
+			     enum ual_data_width dw)
+{
+	struct ual_desc_sim *sim = &bar->desc.sim;
+
+	return sim->read(sim->priv, addr, dw);
+}
+
+static void ual_sim_write(struct ual_bar *bar, uint32_t addr, uint32_t value,
+			  enum ual_data_width dw)
+{
+	struct ual_desc_sim *sim = &bar->desc.sim;
+
+	sim->write(sim->priv, addr, value, dw);
+}
+
+
+
+static struct ual_bus_operations ual_sim_op = {
+	.open = ual_sim_open,
+	.close = ual_sim_close,
+	.map = ual_sim_map,
+	.unmap = ual_sim_unmap,
+	.read = ual_sim_read,
+	.write = ual_sim_write,
+};
+
+struct ual_bus ual_sim = {
+	.name = "Sim",
+	.type = UAL_BUS_SIM,
+	.op = &ual_sim_op,
+};
@@ -8,6 +8,15 @@
 #include <errno.h>
 #include "ual-int.h"
 
+/* Buses without a mapping may move a whole block in one request */
+static int ual_bus_block(struct ual_bar *bar, int write)
+{
+	if (bar->ptr || (bar->flags & UAL_BAR_FLAGS_DEVICE_BE) !=
+	    (bar->flags & UAL_BAR_FLAGS_HOST_BE))
+		return 0;
+	return write ? !!bar->bus->op->write_n : !!bar->bus->op->read_n;
+}
+
 /**
  * It writes 32bit values at consecutive addresses starting from the given one
  *
@@ -23,6 +32,10 @@ void ual_writel_n(struct ual_bar_tkn *dev, uint32_t addr, uint32_t *data,
 	uint32_t value;
 	int i;
 
+	if (ual_bus_block(bar, 1)) {
+		bar->bus->op->write_n(bar, addr, data, n, UAL_DATA_WIDTH_32, 0);
+		return;
+	}
 	for (i = 0; i < n; ++i, ++data) {
 		value = *data;
 		if ((bar->flags & UAL_BAR_FLAGS_DEVICE_BE) !=
@@ -34,7 +47,11 @@ void ual_writel_n(struct ual_bar_tkn *dev, uint32_t addr, uint32_t *data,
 				((value >> 8) & 0xff00) |
 				((value << 24) & 0xff000000);
 		}
-		*(volatile uint32_t *) (bar->ptr + addr + (i * 4)) = value;
+		if (bar->ptr)
+			*(volatile uint32_t *) (bar->ptr + addr + (i * 4)) = value;
+		else
+			bar->bus->op->write(bar, addr + (i * 4), value,
+					    UAL_DATA_WIDTH_32);
 	}
 }
 
@@ -52,6 +69,39 @@ void ual_writel(struct ual_bar_tkn *dev, uint32_t addr, uint32_t data)
 }
 
 
+/**
+ * It replaces the bits of mask in the 32bit value at the given address.
+ * On UAL_BUS_BROKER nobody else's access falls between the read and the
+ * write; on the other busses it is a plain read followed by a write.
+ *
+ * @param[in] dev UAL device token returned by ual_open()
+ * @param[in] addr offset within the selected BAR
+ * @param[in] mask bits to change
+ * @param[in] value new value of those bits
+ * @return the value before the change; 0xffffffff with errno set to
+ *         EINVAL, and nothing written, when addr is not 32bit aligned
+ */
+uint32_t ual_rmwl(struct ual_bar_tkn *dev, uint32_t addr, uint32_t mask,
+		  uint32_t value)
+{
+	struct ual_bar *bar = (struct ual_bar *)dev;
+	uint32_t old;
+
+	if (addr & 3) {
+		errno = EINVAL;
+		return 0xffffffff;
+	}
+
+	if (bar->bus->op->rmw && !bar->ptr &&
+	    (bar->flags & UAL_BAR_FLAGS_DEVICE_BE) ==
+	    (bar->flags & UAL_BAR_FLAGS_HOST_BE))
+		return bar->bus->op->rmw(bar, addr, mask, value);
+	old = ual_readl(dev, addr);
+	ual_writel(dev, addr, (old & ~mask) | (value & mask));
+	return old;
+}
+
+
 /**
  * It writes 16bit values at consecutive addresses starting from the given one
  *
@@ -67,6 +117,10 @@ void ual_writew_n(struct ual_bar_tkn *dev, uint32_t addr, uint16_t *data,
 	uint16_t value;
 	int i;
 
+	if (ual_bus_block(bar, 1)) {
+		bar->bus->op->write_n(bar, addr, data, n, UAL_DATA_WIDTH_16, 0);
+		return;
+	}
 	for (i = 0; i < n; ++i, ++data) {
 		value = *data;
 		if ((bar->flags & UAL_BAR_FLAGS_DEVICE_BE) !=
@@ -76,7 +130,11 @@ void ual_writew_n(struct ual_bar_tkn *dev, uint32_t addr, uint16_t *data,
 			value = ((value >> 8) & 0x00ff) |
 				((value << 8) & 0xff00);
 		}
-		*(volatile uint16_t *) (bar->ptr + addr + (i * 2)) = value;
+		if (bar->ptr)
+			*(volatile uint16_t *) (bar->ptr + addr + (i * 2)) = value;
+		else
+			bar->bus->op->write(bar, addr + (i * 2), value,
+					    UAL_DATA_WIDTH_16);
 	}
 }
 
@@ -109,9 +167,17 @@ void ual_writeb_n(struct ual_bar_tkn *dev, uint32_t addr, uint8_t *data,
 	uint8_t value;
 	int i;
 
+	if (ual_bus_block(bar, 1)) {
+		bar->bus->op->write_n(bar, addr, data, n, UAL_DATA_WIDTH_8, 0);
+		return;
+	}
 	for (i = 0; i < n; ++i, ++data) {
 		value = *data;
-		*(volatile uint8_t *) (bar->ptr + addr + i) = value;
+		if (bar->ptr)
+			*(volatile uint8_t *) (bar->ptr + addr + i) = value;
+		else
+			bar->bus->op->write(bar, addr + i, value,
+					    UAL_DATA_WIDTH_8);
 	}
 }
 
@@ -129,6 +195,8 @@ void ual_writeb(struct ual_bar_tkn *dev, uint32_t addr, uint8_t data)
 }
 
 
+UAL_PROBE_DEFINE(ual_readl_n_probe, "ual_readl_n");
+
 /**
  * It reads a given number of 32bit values
  *
@@ -141,10 +209,20 @@ void ual_readl_n(struct ual_bar_tkn *dev, uint32_t addr,
 		 uint32_t *data, unsigned int n)
 {
 	struct ual_bar *bar = (struct ual_bar *)dev;
+	struct ual_probe_mark mark;
 	int i;
 
+	UAL_PROBE_BEGIN(&ual_readl_n_probe, &mark);
+	if (ual_bus_block(bar, 0)) {
+		bar->bus->op->read_n(bar, addr, data, n, UAL_DATA_WIDTH_32, 0);
+		goto out;
+	}
 	for (i = 0; i < n; ++i, addr += 4) {
-		data[i] = *(volatile uint32_t *) (bar->ptr + addr);
+		if (bar->ptr)
+			data[i] = *(volatile uint32_t *) (bar->ptr + addr);
+		else
+			data[i] = bar->bus->op->read(bar, addr,
+						     UAL_DATA_WIDTH_32);
 
 		if ((bar->flags & UAL_BAR_FLAGS_DEVICE_BE) !=
 		    (bar->flags & UAL_BAR_FLAGS_HOST_BE)) {
@@ -156,6 +234,8 @@ void ual_readl_n(struct ual_bar_tkn *dev, uint32_t addr,
 				((data[i] << 24) & 0xff000000);
 		}
 	}
+out:
+	UAL_PROBE_END(&ual_readl_n_probe, &mark);
 }
 
 
@@ -190,8 +270,16 @@ void ual_readw_n(struct ual_bar_tkn *dev, uint32_t addr,
 	struct ual_bar *bar = (struct ual_bar *)dev;
 	int i;
 
+	if (ual_bus_block(bar, 0)) {
+		bar->bus->op->read_n(bar, addr, data, n, UAL_DATA_WIDTH_16, 0);
+		return;
+	}
 	for (i = 0; i < n; ++i, addr += 2) {
-		data[i] = *(volatile uint16_t *) (bar->ptr + addr);
+		if (bar->ptr)
+			data[i] = *(volatile uint16_t *) (bar->ptr + addr);
+		else
+			data[i] = bar->bus->op->read(bar, addr,
+						     UAL_DATA_WIDTH_16);
 
 		if ((bar->flags & UAL_BAR_FLAGS_DEVICE_BE) !=
 		    (bar->flags & UAL_BAR_FLAGS_HOST_BE)) {
@@ -235,8 +323,16 @@ void ual_readb_n(struct ual_bar_tkn *dev, uint32_t addr,
 	struct ual_bar *bar = (struct ual_bar *)dev;
 	int i;
 
+	if (ual_bus_block(bar, 0)) {
+		bar->bus->op->read_n(bar, addr, data, n, UAL_DATA_WIDTH_8, 0);
+		return;
+	}
 	for (i = 0; i < n; ++i, ++addr) {
-		data[i] = *(volatile uint8_t *) (bar->ptr + addr);
+		if (bar->ptr)
+			data[i] = *(volatile uint8_t *) (bar->ptr + addr);
+		else
+			data[i] = bar->bus->op->read(bar, addr,
+						     UAL_DATA_WIDTH_8);
 	}
 }
 
@@ -0,0 +1,489 @@
+/**
+ * @license: LGPLv3
+ */
+
+/*
+ * Burst access to streaming FIFOs: every word of a transfer goes to the
+ * same address. The mapped path is unrolled by 8 words with no barrier
+ * between them (device memory keeps the accesses in order anyway) and, on
+ * NEON, the words are collected into q registers so that the destination
+ * is written with full 16 byte stores.
+ */
+
+#include <stdint.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UAL_FIFO_NEON
+#endif
+
+#include "ual-int.h"
+
+
+static int ual_fifo_swap(struct ual_bar *bar)
+{
+	return (bar->flags & UAL_BAR_FLAGS_DEVICE_BE) !=
+		(bar->flags & UAL_BAR_FLAGS_HOST_BE);
+}
+
+/* Buses without a mapping may move the whole burst in one request */
+static int ual_fifo_block(struct ual_bar *bar, int write)
+{
+	if (bar->ptr)
+		return 0;
+	return write ? !!bar->bus->op->write_n : !!bar->bus->op->read_n;
+}
+
+/* Entries to transfer: n, or less if the level register says so */
+static unsigned int ual_fifo_level(struct ual_bar_tkn *dev,
+				   uint32_t level_addr, unsigned int n)
+{
+	uint32_t level;
+
+	if (level_addr == UAL_FIFO_NO_LEVEL)
+		return n;
+	level = ual_readl(dev, level_addr);
+	return level < n ? level : n;
+}
+
+/* A 64bit value as two 32bit words, low word first, and back */
+static uint64_t ual_fifo_join64(struct ual_bar *bar, uint64_t v)
+{
+	if (bar->flags & UAL_BAR_FLAGS_HOST_BE)
+		v = v << 32 | v >> 32;
+	return ual_fifo_swap(bar) ? __builtin_bswap64(v) : v;
+}
+
+/* Whether entries of size bytes moved as a block need converting */
+static int ual_fifo_convert(struct ual_bar *bar, unsigned int size)
+{
+	return ual_fifo_swap(bar) ||
+		(size == 8 && (bar->flags & UAL_BAR_FLAGS_HOST_BE));
+}
+
+/* Converts n entries of size bytes from src into dst, which may be src */
+static void ual_fifo_conv(struct ual_bar *bar, void *dst, const void *src,
+			  unsigned int n, unsigned int size)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (size == 8)
+			((uint64_t *)dst)[i] = ual_fifo_join64(bar,
+						((const uint64_t *)src)[i]);
+		else if (size == 4)
+			((uint32_t *)dst)[i] = __builtin_bswap32(
+						((const uint32_t *)src)[i]);
+		else
+			((uint16_t *)dst)[i] = __builtin_bswap16(
+						((const uint16_t *)src)[i]);
+	}
+}
+
+/* A burst in one read_n request; 64bit entries as 32bit word pairs, so
+   that one request pops both halves and nobody else in between */
+static void ual_fifo_read_block(struct ual_bar *bar, uint32_t addr,
+				void *data, unsigned int n, unsigned int size)
+{
+	if (size == 8)
+		bar->bus->op->read_n(bar, addr, data, 2 * n,
+				     UAL_DATA_WIDTH_32, 1);
+	else
+		bar->bus->op->read_n(bar, addr, data, n, size, 1);
+	if (ual_fifo_convert(bar, size))
+		ual_fifo_conv(bar, data, data, n, size);
+}
+
+#define UAL_FIFO_CHUNK 128 /* 64bit entries converted at a time */
+
+/* A burst through write_n, converted a chunk at a time when needed */
+static void ual_fifo_write_block(struct ual_bar *bar, uint32_t addr,
+				 const void *data, unsigned int n,
+				 unsigned int size)
+{
+	uint64_t tmp[UAL_FIFO_CHUNK];
+	unsigned int i, k, per = sizeof(tmp) / size;
+	const uint8_t *p = data;
+	int conv = ual_fifo_convert(bar, size);
+
+	for (i = 0; i < n; i += k, p += k * size) {
+		k = conv && n - i > per ? per : n - i;
+		if (conv)
+			ual_fifo_conv(bar, tmp, p, k, size);
+		if (size == 8)
+			bar->bus->op->write_n(bar, addr, conv ? tmp : (void *)p,
+					      2 * k, UAL_DATA_WIDTH_32, 1);
+		else
+			bar->bus->op->write_n(bar, addr, conv ? tmp : (void *)p,
+					      k, size, 1);
+	}
+}
+
+/* Buses without read_n or write_n: two 32bit accesses, low word first */
+static uint64_t ual_fifo_read64(struct ual_bar *bar, uint32_t addr)
+{
+	uint64_t v;
+
+	v = bar->bus->op->read(bar, addr, UAL_DATA_WIDTH_32);
+	v |= (uint64_t)bar->bus->op->read(bar, addr, UAL_DATA_WIDTH_32) << 32;
+	return v;
+}
+
+static void ual_fifo_write64(struct ual_bar *bar, uint32_t addr,
+			     uint64_t value)
+{
+	bar->bus->op->write(bar, addr, value, UAL_DATA_WIDTH_32);
+	bar->bus->op->write(bar, addr, value >> 32, UAL_DATA_WIDTH_32);
+}
+
+
+/**
+ * It reads 32bit values from a FIFO, always at the given address
+ *
+ * @param[in] dev UAL device token returned by ual_open()
+ * @param[in] addr offset of the FIFO within the selected BAR
+ * @param[out] data preallocated buffer where store data
+ * @param[in] n maximum number of values to read
+ * @param[in] level_addr offset of a register holding the number of values
+ *            available, read once before the burst, or UAL_FIFO_NO_LEVEL
+ * @return the number of values read
+ */
+unsigned int ual_readl_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+			    uint32_t *data, unsigned int n,
+			    uint32_t level_addr)
+{
+	struct ual_bar *bar = (struct ual_bar *)dev;
+	volatile uint32_t *p;
+	uint32_t v0, v1, v2, v3, v4, v5, v6, v7;
+	unsigned int i = 0;
+
+	n = ual_fifo_level(dev, level_addr, n);
+
+	if (ual_fifo_block(bar, 0)) {
+		ual_fifo_read_block(bar, addr, data, n, 4);
+		return n;
+	}
+	if (!bar->ptr) {
+		for (; i < n; ++i) {
+			v0 = bar->bus->op->read(bar, addr, UAL_DATA_WIDTH_32);
+			data[i] = ual_fifo_swap(bar) ? __builtin_bswap32(v0) : v0;
+		}
+		return n;
+	}
+	p = bar->ptr + addr;
+	if (ual_fifo_swap(bar)) {
+		for (; i < n; ++i)
+			data[i] = __builtin_bswap32(*p);
+		return n;
+	}
+
+	for (; i + 8 <= n; i += 8) {
+		v0 = *p; v1 = *p; v2 = *p; v3 = *p;
+		v4 = *p; v5 = *p; v6 = *p; v7 = *p;
+#ifdef UAL_FIFO_NEON
+		vst1q_u32(data + i,
+			  vcombine_u32(vcreate_u32(v0 | (uint64_t)v1 << 32),
+				       vcreate_u32(v2 | (uint64_t)v3 << 32)));
+		vst1q_u32(data + i + 4,
+			  vcombine_u32(vcreate_u32(v4 | (uint64_t)v5 << 32),
+				       vcreate_u32(v6 | (uint64_t)v7 << 32)));
+#else
+		data[i] = v0; data[i + 1] = v1; data[i + 2] = v2;
+		data[i + 3] = v3; data[i + 4] = v4; data[i + 5] = v5;
+		data[i + 6] = v6; data[i + 7] = v7;
+#endif
+	}
+	for (; i < n; ++i)
+		data[i] = *p;
+
+	return n;
+}
+
+
+/**
+ * It reads 16bit values from a FIFO, always at the given address
+ *
+ * @param[in] dev UAL device token returned by ual_open()
+ * @param[in] addr offset of the FIFO within the selected BAR
+ * @param[out] data preallocated buffer where store data
+ * @param[in] n maximum number of values to read
+ * @param[in] level_addr offset of a 32bit register holding the number of
+ *            values available, or UAL_FIFO_NO_LEVEL
+ * @return the number of values read
+ */
+unsigned int ual_readw_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+			    uint16_t *data, unsigned int n,
+			    uint32_t level_addr)
+{
+	struct ual_bar *bar = (struct ual_bar *)dev;
+	volatile uint16_t *p;
+	uint64_t lo, hi;
+	unsigned int i = 0;
+	uint16_t v;
+
+	n = ual_fifo_level(dev, level_addr, n);
+
+	if (ual_fifo_block(bar, 0)) {
+		ual_fifo_read_block(bar, addr, data, n, 2);
+		return n;
+	}
+	if (!bar->ptr) {
+		for (; i < n; ++i) {
+			v = bar->bus->op->read(bar, addr, UAL_DATA_WIDTH_16);
+			data[i] = ual_fifo_swap(bar) ? __builtin_bswap16(v) : v;
+		}
+		return n;
+	}
+	p = bar->ptr + addr;
+	if (ual_fifo_swap(bar)) {
+		for (; i < n; ++i)
+			data[i] = __builtin_bswap16(*p);
+		return n;
+	}
+
+	for (; i + 8 <= n; i += 8) {
+		lo = *p;
+		lo |= (uint64_t)*p << 16;
+		lo |= (uint64_t)*p << 32;
+		lo |= (uint64_t)*p << 48;
+		hi = *p;
+		hi |= (uint64_t)*p << 16;
+		hi |= (uint64_t)*p << 32;
+		hi |= (uint64_t)*p << 48;
+#ifdef UAL_FIFO_NEON
+		vst1q_u16(data + i, vcombine_u16(vcreate_u16(lo),
+						 vcreate_u16(hi)));
+#else
+		data[i] = lo; data[i + 1] = lo >> 16;
+		data[i + 2] = lo >> 32; data[i + 3] = lo >> 48;
+		data[i + 4] = hi; data[i + 5] = hi >> 16;
+		data[i + 6] = hi >> 32; data[i + 7] = hi >> 48;
+#endif
+	}
+	for (; i < n; ++i)
+		data[i] = *p;
+
+	return n;
+}
+
+
+/**
+ * It reads 64bit values from a FIFO, always at the given address. On
+ * buses without a mapping each value is read as two 32bit accesses at
+ * addr, low word first; where the bus moves blocks, the whole burst is
+ * one request, so that no other client pops a word between the halves.
+ *
+ * @param[in] dev UAL device token returned by ual_open()
+ * @param[in] addr offset of the FIFO within the selected BAR
+ * @param[out] data preallocated buffer where store data
+ * @param[in] n maximum number of values to read
+ * @param[in] level_addr offset of a 32bit register holding the number of
+ *            values available, or UAL_FIFO_NO_LEVEL
+ * @return the number of values read
+ */
+unsigned int ual_readq_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+			    uint64_t *data, unsigned int n,
+			    uint32_t level_addr)
+{
+	struct ual_bar *bar = (struct ual_bar *)dev;
+	volatile uint64_t *p;
+	uint64_t v0, v1, v2, v3;
+	unsigned int i = 0;
+
+	n = ual_fifo_level(dev, level_addr, n);
+
+	if (ual_fifo_block(bar, 0)) {
+		ual_fifo_read_block(bar, addr, data, n, 8);
+		return n;
+	}
+	if (!bar->ptr) {
+		for (; i < n; ++i) {
+			v0 = ual_fifo_read64(bar, addr);
+			data[i] = ual_fifo_swap(bar) ? __builtin_bswap64(v0) : v0;
+		}
+		return n;
+	}
+	p = bar->ptr + addr;
+	if (ual_fifo_swap(bar)) {
+		for (; i < n; ++i)
+			data[i] = __builtin_bswap64(*p);
+		return n;
+	}
+
+	for (; i + 4 <= n; i += 4) {
+		v0 = *p; v1 = *p; v2 = *p; v3 = *p;
+#ifdef UAL_FIFO_NEON
+		vst1q_u64(data + i, vcombine_u64(vcreate_u64(v0),
+						 vcreate_u64(v1)));
+		vst1q_u64(data + i + 2, vcombine_u64(vcreate_u64(v2),
+						     vcreate_u64(v3)));
+#else
+		data[i] = v0; data[i + 1] = v1;
+		data[i + 2] = v2; data[i + 3] = v3;
+#endif
+	}
+	for (; i < n; ++i)
+		data[i] = *p;
+
+	return n;
+}
+
+
+/**
+ * It writes 32bit values into a FIFO, always at the given address
+ *
+ * @param[in] dev UAL device token returned by ual_open()
+ * @param[in] addr offset of the FIFO within the selected BAR
+ * @param[in] data values to write
+ * @param[in] n maximum number of values to write
+ * @param[in] level_addr offset of a register holding the free space in
+ *            values, read once before the burst, or UAL_FIFO_NO_LEVEL
+ * @return the number of values written
+ */
+unsigned int ual_writel_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+			     const uint32_t *data, unsigned int n,
+			     uint32_t level_addr)
+{
+	struct ual_bar *bar = (struct ual_bar *)dev;
+	volatile uint32_t *p;
+	unsigned int i = 0;
+	uint32_t v;
+
+	n = ual_fifo_level(dev, level_addr, n);
+
+	if (ual_fifo_block(bar, 1)) {
+		ual_fifo_write_block(bar, addr, data, n, 4);
+		return n;
+	}
+	if (!bar->ptr) {
+		for (; i < n; ++i) {
+			v = ual_fifo_swap(bar) ? __builtin_bswap32(data[i]) :
+				data[i];
+			bar->bus->op->write(bar, addr, v, UAL_DATA_WIDTH_32);
+		}
+		return n;
+	}
+	p = bar->ptr + addr;
+	if (ual_fifo_swap(bar)) {
+		for (; i < n; ++i)
+			*p = __builtin_bswap32(data[i]);
+		return n;
+	}
+
+	for (; i + 8 <= n; i += 8) {
+		*p = data[i]; *p = data[i + 1];
+		*p = data[i + 2]; *p = data[i + 3];
+		*p = data[i + 4]; *p = data[i + 5];
+		*p = data[i + 6]; *p = data[i + 7];
+	}
+	for (; i < n; ++i)
+		*p = data[i];
+
+	return n;
+}
+
+
+/**
+ * It writes 16bit values into a FIFO, always at the given address
+ *
+ * @param[in] dev UAL device token returned by ual_open()
+ * @param[in] addr offset of the FIFO within the selected BAR
+ * @param[in] data values to write
+ * @param[in] n maximum number of values to write
+ * @param[in] level_addr offset of a 32bit register holding the free space
+ *            in values, or UAL_FIFO_NO_LEVEL
+ * @return the number of values written
+ */
+unsigned int ual_writew_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+			     const uint16_t *data, unsigned int n,
+			     uint32_t level_addr)
+{
+	struct ual_bar *bar = (struct ual_bar *)dev;
+	volatile uint16_t *p;
+	unsigned int i = 0;
+	uint16_t v;
+
+	n = ual_fifo_level(dev, level_addr, n);
+
+	if (ual_fifo_block(bar, 1)) {
+		ual_fifo_write_block(bar, addr, data, n, 2);
+		return n;
+	}
+	if (!bar->ptr) {
+		for (; i < n; ++i) {
+			v = ual_fifo_swap(bar) ? __builtin_bswap16(data[i]) :
+				data[i];
+			bar->bus->op->write(bar, addr, v, UAL_DATA_WIDTH_16);
+		}
+		return n;
+	}
+	p = bar->ptr + addr;
+	if (ual_fifo_swap(bar)) {
+		for (; i < n; ++i)
+			*p = __builtin_bswap16(data[i]);
+		return n;
+	}
+
+	for (; i + 8 <= n; i += 8) {
+		*p = data[i]; *p = data[i + 1];
+		*p = data[i + 2]; *p = data[i + 3];
+		*p = data[i + 4]; *p = data[i + 5];
+		*p = data[i + 6]; *p = data[i + 7];
+	}
+	for (; i < n; ++i)
+		*p = data[i];
+
+	return n;
+}
+
+
+/**
+ * It writes 64bit values into a FIFO, always at the given address. On
+ * buses without a mapping each value is written as two 32bit accesses at
+ * addr, low word first; where the bus moves blocks, the whole burst is
+ * one request.
+ *
+ * @param[in] dev UAL device token returned by ual_open()
+ * @param[in] addr offset of the FIFO within the selected BAR
+ * @param[in] data values to write
+ * @param[in] n maximum number of values to write
+ * @param[in] level_addr offset of a 32bit register holding the free space
+ *            in values, or UAL_FIFO_NO_LEVEL
+ * @return the number of values written
+ */
+unsigned int ual_writeq_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+			     const uint64_t *data, unsigned int n,
+			     uint32_t level_addr)
+{
+	struct ual_bar *bar = (struct ual_bar *)dev;
+	volatile uint64_t *p;
+	unsigned int i = 0;
+
+	n = ual_fifo_level(dev, level_addr, n);
+
+	if (ual_fifo_block(bar, 1)) {
+		ual_fifo_write_block(bar, addr, data, n, 8);
+		return n;
+	}
+	if (!bar->ptr) {
+		for (; i < n; ++i)
+			ual_fifo_write64(bar, addr, ual_fifo_swap(bar) ?
+					 __builtin_bswap64(data[i]) : data[i]);
+		return n;
+	}
+	p = bar->ptr + addr;
+	if (ual_fifo_swap(bar)) {
+		for (; i < n; ++i)
+			*p = __builtin_bswap64(data[i]);
+		return n;
+	}
+
+	for (; i + 4 <= n; i += 4) {
+		*p = data[i]; *p = data[i + 1];
+		*p = data[i + 2]; *p = data[i + 3];
+	}
+	for (; i < n; ++i)
+		*p = data[i];
+
+	return n;
+}
@@ -40,6 +40,9 @@ static int timespec_subtract(struct timespec *result,
 }
 
 
+UAL_PROBE_DEFINE(ual_event_wait_probe, "ual_event_wait");
+UAL_PROBE_DEFINE(ual_event_wait_periods, "ual_event_wait periods");
+
 /**
  * It waits for an event to happen in at a given memory offset.
  * An event is a bit changing within a bitmask.
@@ -57,7 +60,8 @@ uint64_t ual_event_wait(struct ual_bar_tkn *tkn, uint64_t addr, uint64_t mask,
 			struct timespec *period, struct timespec *timeout)
 {
 	struct timespec start, curr, diff, left;
-	uint64_t ret;
+	struct ual_probe_mark mark;
+	uint64_t ret, periods = 0;
 	int err;
 
 	if (!tkn) {
@@ -78,12 +82,13 @@ uint64_t ual_event_wait(struct ual_bar_tkn *tkn, uint64_t addr, uint64_t mask,
 	err = clock_gettime(CLOCK_REALTIME, &start);
 	if (err)
 		return 0;
+	UAL_PROBE_BEGIN(&ual_event_wait_probe, &mark);
 	memcpy(&left, timeout, sizeof(struct timespec));
 	while (1) {
 		ret = ual_readl(tkn, addr) & mask;
 		if (ret) {
 			memcpy(timeout, &left, sizeof(struct timespec));
-			return ret;
+			goto out;
 		}
 
 		err = clock_gettime(CLOCK_REALTIME, &curr);
@@ -95,9 +100,81 @@ uint64_t ual_event_wait(struct ual_bar_tkn *tkn, uint64_t addr, uint64_t mask,
 			break;
 
 		ret = nanosleep(period, NULL);
+		periods++;
 	}
 
 	memset(timeout, 0, sizeof(struct timespec));
-	errno = ETIME;
+	ret = 0;
+out:
+	UAL_PROBE_END(&ual_event_wait_probe, &mark);
+	ual_probe_count(&ual_event_wait_periods, periods);
+	if (!ret)
+		errno = ETIME;
+	return ret;
+}
+
+
+/**
+ * It reads a 32bit register until the masked value matches, without
+ * sleeping in between: for handshakes that complete in microseconds,
+ * where ual_event_wait() would oversleep. Buses that can run the loop
+ * next to the device (UAL_BUS_REMOTE) do so, and only the result travels.
+ *
+ * @param[in] tkn UAL BAR token
+ * @param[in] addr offset within the selected BAR
+ * @param[in] mask bitmask to apply on the read value
+ * @param[in] match expected value of the masked bits
+ * @param[in|out] timeout how long to try, NULL for ever. It will be
+ *                updated with the time left
+ * @param[out] value last value read (not masked), may be NULL
+ * @return 0 on match, -1 on error and errno is appropriately set
+ *         (ETIME on timeout, ETIMEDOUT when a remote bus got no answer)
+ */
+int ual_readl_poll(struct ual_bar_tkn *tkn, uint32_t addr, uint32_t mask,
+		   uint32_t match, struct timespec *timeout, uint32_t *value)
+{
+	struct ual_bar *bar = (struct ual_bar *)tkn;
+	struct timespec start, curr, diff, left;
+	unsigned int reads = 0;
+	uint32_t v;
+
+	if (!tkn) {
+		errno = UAL_ERR_INVALID_TKN;
+		return -1;
+	}
+
+	if (!bar->ptr && bar->bus->op->poll)
+		return bar->bus->op->poll(bar, addr, mask, match, timeout,
+					  value);
+
+	if (timeout && clock_gettime(CLOCK_MONOTONIC, &start))
+		return -1;
+	while (1) {
+		v = ual_readl(tkn, addr);
+		if ((v & mask) == match)
+			break;
+		/* the clock is cheap, but not as cheap as a register */
+		if (!timeout || ++reads % 64)
+			continue;
+		if (clock_gettime(CLOCK_MONOTONIC, &curr))
+			return -1;
+		timespec_subtract(&diff, &curr, &start);
+		if (timespec_subtract(&left, timeout, &diff)) {
+			memset(timeout, 0, sizeof(struct timespec));
+			if (value)
+				*value = v;
+			errno = ETIME;
+			return -1;
+		}
+	}
+	if (timeout) {
+		clock_gettime(CLOCK_MONOTONIC, &curr);
+		timespec_subtract(&diff, &curr, &start);
+		if (timespec_subtract(&left, timeout, &diff))
+			memset(&left, 0, sizeof(struct timespec));
+		memcpy(timeout, &left, sizeof(struct timespec));
+	}
+	if (value)
+		*value = v;
 	return 0;
 }
@@ -0,0 +1,441 @@
+/**
+ * @license: LGPLv3
+ */
+
+/*
+ * Probes: named code sections timed with whatever the CPU offers, for
+ * accesses too short for clock_gettime() to say anything about.
+ *
+ * A probe is a static struct ual_probe, given an index the first time
+ * it fires. Every thread records into a table of its own, allocated on
+ * first use and pushed on a list with a compare-and-swap; nothing on
+ * the recording side takes a lock or writes a cache line another thread
+ * writes. Dumping walks the list and sums the tables, so the numbers of
+ * threads still running are a snapshot, not a consistent cut.
+ * ual_probe_reset() only bumps a generation: each thread clears its own
+ * table the next time it records, tables of an older generation are
+ * left out of the sums.
+ *
+ * The sources:
+ *  - UAL_PROBE_CLOCK: CLOCK_MONOTONIC (vDSO, no system call), ns
+ *  - UAL_PROBE_CYCLES: the cycle counter, PMCCNTR on the Cortex-A9 once
+ *    the kernel allows user access (PMUSERENR.EN), the TSC on x86
+ *  - UAL_PROBE_PERF: a perf_event group per thread counting user-space
+ *    cycles, cache misses and branch misses; a read is a system call,
+ *    so keep it for sections of a microsecond or more
+ * With the probes off, the instrumented functions pay a load and a
+ * branch.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#include "ual-int.h"
+
+#define UAL_PROBE_MAX 128
+
+enum ual_probe_source ual_probe_source = UAL_PROBE_OFF;
+
+struct ual_probe_stat {
+	uint64_t count;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t cache_misses;
+	uint64_t branch_misses;
+};
+
+struct ual_probe_table {
+	struct ual_probe_table *next;
+	unsigned int gen;
+	int perf_fd[3]; /**< cycles (the group leader), cache, branch misses */
+	struct ual_probe_stat stat[UAL_PROBE_MAX];
+};
+
+static const char *ual_probe_names[UAL_PROBE_MAX];
+static atomic_int ual_probe_n = 1; /* 0: not registered yet */
+static _Atomic(struct ual_probe_table *) ual_probe_tables;
+static atomic_uint ual_probe_gen;
+static __thread struct ual_probe_table *ual_probe_self;
+static pthread_key_t ual_probe_key;
+static pthread_once_t ual_probe_once = PTHREAD_ONCE_INIT;
+
+
+static void ual_probe_perf_close(int *fd)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (fd[i] >= 0)
+			close(fd[i]);
+		fd[i] = -1;
+	}
+}
+
+static int ual_probe_perf_open(int *fd)
+{
+	static const uint64_t config[3] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES,
+	};
+	struct perf_event_attr attr;
+	int i, err;
+
+	for (i = 0; i < 3; i++)
+		fd[i] = -1;
+	for (i = 0; i < 3; i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = config[i];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, fd[0], 0);
+		if (fd[i] < 0) {
+			err = errno;
+			ual_probe_perf_close(fd);
+			errno = err;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* The perf counters of a thread that exits go with it */
+static void ual_probe_thread_exit(void *arg)
+{
+	struct ual_probe_table *t = arg;
+
+	ual_probe_perf_close(t->perf_fd);
+}
+
+static void ual_probe_key_init(void)
+{
+	pthread_key_create(&ual_probe_key, ual_probe_thread_exit);
+}
+
+static struct ual_probe_table *ual_probe_table(void)
+{
+	struct ual_probe_table *t = ual_probe_self;
+
+	if (t)
+		return t;
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->perf_fd[0] = t->perf_fd[1] = t->perf_fd[2] = -1;
+	t->gen = atomic_load(&ual_probe_gen);
+	pthread_once(&ual_probe_once, ual_probe_key_init);
+	pthread_setspecific(ual_probe_key, t);
+	t->next = atomic_load(&ual_probe_tables);
+	while (!atomic_compare_exchange_weak(&ual_probe_tables, &t->next, t))
+		;
+	ual_probe_self = t;
+	return t;
+}
+
+static uint64_t ual_probe_cycles(void)
+{
+#if defined(__arm__)
+	uint32_t v;
+
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c13, 0" : "=r"(v));
+	return v;
+#elif defined(__i386__) || defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* The cycle counter is there and user space may read it */
+static int ual_probe_cycles_ok(void)
+{
+#if defined(__arm__)
+	uint32_t v;
+
+	/* PMUSERENR reads from user space; the kernel sets EN, or not */
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c14, 0" : "=r"(v));
+	if (!(v & 1))
+		return 0;
+	/* PMCR.E, then PMCNTENSET.C */
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c12, 0" : "=r"(v));
+	v |= 1;
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 0" : : "r"(v));
+	__asm__ __volatile__("mcr p15, 0, %0, c9, c12, 1" : : "r"(1u << 31));
+	return 1;
+#elif defined(__i386__) || defined(__x86_64__)
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static void ual_probe_read(struct ual_probe_table *t, uint64_t *v)
+{
+	struct {
+		uint64_t nr;
+		uint64_t v[3];
+	} group;
+	struct timespec ts;
+
+	switch (ual_probe_source) {
+	case UAL_PROBE_CLOCK:
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		v[0] = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		break;
+	case UAL_PROBE_CYCLES:
+		v[0] = ual_probe_cycles();
+		break;
+	case UAL_PROBE_PERF:
+		/* -2: it failed once in this thread, it will again */
+		if (t->perf_fd[0] == -1 && ual_probe_perf_open(t->perf_fd))
+			t->perf_fd[0] = -2;
+		if (t->perf_fd[0] >= 0 &&
+		    read(t->perf_fd[0], &group, sizeof(group)) ==
+		    sizeof(group)) {
+			memcpy(v, group.v, sizeof(group.v));
+			break;
+		}
+		memset(v, 0, 3 * sizeof(*v));
+		break;
+	default:
+		break;
+	}
+}
+
+/* The probe's slot, registering it on first use */
+static int ual_probe_id(struct ual_probe *p)
+{
+	int id = atomic_load_explicit((atomic_int *)&p->id,
+				      memory_order_acquire), expect = 0;
+
+	if (id)
+		return id;
+	id = atomic_fetch_add(&ual_probe_n, 1);
+	if (id >= UAL_PROBE_MAX)
+		return -1;
+	ual_probe_names[id] = p->name;
+	/* two threads may race here: the loser's slot is never used */
+	if (!atomic_compare_exchange_strong((atomic_int *)&p->id, &expect, id))
+		return expect;
+	return id;
+}
+
+static struct ual_probe_stat *ual_probe_stat(struct ual_probe *p)
+{
+	struct ual_probe_table *t = ual_probe_table();
+	unsigned int gen = atomic_load_explicit(&ual_probe_gen,
+						memory_order_relaxed);
+	int id = ual_probe_id(p);
+
+	if (!t || id < 0)
+		return NULL;
+	if (t->gen != gen) {
+		memset(t->stat, 0, sizeof(t->stat));
+		t->gen = gen;
+	}
+	return &t->stat[id];
+}
+
+static void ual_probe_add(struct ual_probe_stat *s, uint64_t v)
+{
+	if (!s->count || v < s->min)
+		s->min = v;
+	if (v > s->max)
+		s->max = v;
+	s->count++;
+	s->total += v;
+}
+
+
+/**
+ * It selects what the probes measure, or turns them off.
+ *
+ * @param[in] source one of enum ual_probe_source
+ * @return 0 on success, -1 when the source is not available here and
+ *         errno is appropriately set
+ */
+int ual_probe_enable(enum ual_probe_source source)
+{
+	struct ual_probe_table *t;
+	int fd[3];
+
+	switch (source) {
+	case UAL_PROBE_OFF:
+	case UAL_PROBE_CLOCK:
+		break;
+	case UAL_PROBE_CYCLES:
+		if (!ual_probe_cycles_ok()) {
+			errno = EOPNOTSUPP;
+			return -1;
+		}
+		break;
+	case UAL_PROBE_PERF:
+		/* the other threads open theirs when they first record */
+		if (ual_probe_perf_open(fd))
+			return -1;
+		t = ual_probe_table();
+		if (!t) {
+			ual_probe_perf_close(fd);
+			return -1;
+		}
+		ual_probe_perf_close(t->perf_fd);
+		memcpy(t->perf_fd, fd, sizeof(fd));
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+	ual_probe_source = source;
+	return 0;
+}
+
+/**
+ * It starts timing a section; use UAL_PROBE_BEGIN() rather than this.
+ *
+ * @param[in] p probe
+ * @param[out] m the start, for ual_probe_end()
+ */
+void ual_probe_begin(struct ual_probe *p, struct ual_probe_mark *m)
+{
+	struct ual_probe_table *t = ual_probe_table();
+
+	m->source = ual_probe_source;
+	if (t)
+		ual_probe_read(t, m->v);
+}
+
+/**
+ * It ends a section started by ual_probe_begin() and records it.
+ *
+ * @param[in] p probe
+ * @param[in] m what ual_probe_begin() filled
+ */
+void ual_probe_end(struct ual_probe *p, struct ual_probe_mark *m)
+{
+	struct ual_probe_stat *s;
+	uint64_t v[3];
+
+	/* begun before a change of source, or not at all */
+	if (!m->source || m->source != ual_probe_source)
+		return;
+	s = ual_probe_stat(p);
+	if (!s)
+		return;
+	ual_probe_read(ual_probe_self, v);
+#if defined(__arm__)
+	/* PMCCNTR is 32 bits wide */
+	if (m->source == UAL_PROBE_CYCLES)
+		v[0] = (uint32_t)(v[0] - m->v[0]) + m->v[0];
+#endif
+	ual_probe_add(s, v[0] - m->v[0]);
+	if (m->source == UAL_PROBE_PERF) {
+		s->cache_misses += v[1] - m->v[1];
+		s->branch_misses += v[2] - m->v[2];
+	}
+}
+
+/**
+ * It records a quantity (bytes, retries...) instead of a duration: count
+ * is the number of calls and total the sum of n, as for a section.
+ *
+ * @param[in] p probe
+ * @param[in] n quantity
+ */
+void ual_probe_count(struct ual_probe *p, uint64_t n)
+{
+	struct ual_probe_stat *s;
+
+	if (!ual_probe_source)
+		return;
+	s = ual_probe_stat(p);
+	if (s)
+		ual_probe_add(s, n);
+}
+
+/**
+ * It clears the results of every thread.
+ */
+void ual_probe_reset(void)
+{
+	atomic_fetch_add(&ual_probe_gen, 1);
+}
+
+/**
+ * It returns the results of every probe that fired, summed over the
+ * threads.
+ *
+ * @param[out] r results
+ * @param[in] max room in r
+ * @return the number of results
+ */
+int ual_probe_results(struct ual_probe_result *r, int max)
+{
+	struct ual_probe_table *t;
+	struct ual_probe_stat *s;
+	unsigned int gen = atomic_load(&ual_probe_gen);
+	int id, n = 0, last = atomic_load(&ual_probe_n);
+
+	if (last > UAL_PROBE_MAX)
+		last = UAL_PROBE_MAX;
+	for (id = 1; id < last && n < max; id++) {
+		memset(&r[n], 0, sizeof(r[n]));
+		r[n].name = ual_probe_names[id];
+		for (t = atomic_load(&ual_probe_tables); t; t = t->next) {
+			s = &t->stat[id];
+			if (t->gen != gen || !s->count)
+				continue;
+			if (!r[n].count || s->min < r[n].min)
+				r[n].min = s->min;
+			if (s->max > r[n].max)
+				r[n].max = s->max;
+			r[n].count += s->count;
+			r[n].total += s->total;
+			r[n].cache_misses += s->cache_misses;
+			r[n].branch_misses += s->branch_misses;
+		}
+		if (r[n].count && r[n].name)
+			n++;
+	}
+	return n;
+}
+
+/**
+ * It prints the results on a file descriptor.
+ *
+ * @param[in] fd where to print, 2 for stderr
+ */
+void ual_probe_dump(int fd)
+{
+	static const char *const unit[] = {"", "ns", "cycles", "cycles"};
+	struct ual_probe_result r[UAL_PROBE_MAX];
+	int i, n = ual_probe_results(r, UAL_PROBE_MAX);
+
+	dprintf(fd, "%-28s %10s %12s %12s %12s  (%s)\n", "probe", "count",
+		"mean", "min", "max", unit[ual_probe_source]);
+	for (i = 0; i < n; i++) {
+		dprintf(fd, "%-28s %10llu %12.1f %12llu %12llu", r[i].name,
+			(unsigned long long)r[i].count,
+			(double)r[i].total / r[i].count,
+			(unsigned long long)r[i].min,
+			(unsigned long long)r[i].max);
+		if (ual_probe_source == UAL_PROBE_PERF)
+			dprintf(fd, "  %.2f cache, %.2f branch misses",
+				(double)r[i].cache_misses / r[i].count,
+				(double)r[i].branch_misses / r[i].count);
+		dprintf(fd, "\n");
+	}
+}
@@ -28,7 +28,10 @@ static const struct ual_bus *ual_bus[] = {
 #ifdef CONFIG_VME
 	[UAL_BUS_VME] = &ual_vme,
 #endif
-	[UAL_BUS_RAWMEM] = &ual_rawmem
+	[UAL_BUS_RAWMEM] = &ual_rawmem,
+	[UAL_BUS_SIM] = &ual_sim,
+	[UAL_BUS_REMOTE] = &ual_remote,
+	[UAL_BUS_BROKER] = &ual_broker,
 	/* add new boards here */
 };
 
@@ -66,6 +69,16 @@ struct ual_bar_tkn *ual_open(enum ual_bus_type type, void *desc)
 		memcpy(&bar->desc.rawmem, desc, sizeof(struct ual_desc_rawmem));
 		bar->flags = bar->desc.rawmem.flags;
 		break;
+	case UAL_BUS_SIM:
+		memcpy(&bar->desc.sim, desc, sizeof(struct ual_desc_sim));
+		bar->flags = bar->desc.sim.flags;
+		break;
+	case UAL_BUS_REMOTE:
+		memcpy(&bar->desc.remote, desc, sizeof(struct ual_desc_remote));
+		break;
+	case UAL_BUS_BROKER:
+		memcpy(&bar->desc.broker, desc, sizeof(struct ual_desc_broker));
+		break;
 	}
 
 	err = bar->bus->op->open(bar);
@@ -103,6 +116,21 @@ void ual_close(struct ual_bar_tkn *bar_tkn)
 }
 
 
+/**
+ * It returns the CPU pointer to the mapped address space, for users that
+ * need plain memory semantics (e.g. buffers shared with a DMA engine).
+ * Register accesses should keep using the ual_read/ual_write functions.
+ * @param[in] dev device token to identify a particular opened device
+ * @return the mapping, or NULL when the bus has no direct mapping
+ */
+void *ual_bar_ptr(struct ual_bar_tkn *dev)
+{
+	struct ual_bar *bar = (struct ual_bar *)dev;
+
+	return bar->ptr;
+}
+
+
 /**
  * Return string describing an error number. If the error number does
  * not belong to the UAL it will uses strerror() to try to get an error
@@ -0,0 +1,358 @@
+/**
+ * @license: LGPLv3
+ */
+
+/*
+ * Real-time runtime: what a thread draining a FIFO needs so that neither
+ * a page fault nor a Qt thread gets between it and the hardware.
+ *
+ * ual_rt_setup() applies a struct ual_rt_config to the calling thread:
+ *  - mlockall(MCL_CURRENT | MCL_FUTURE), once per process: everything
+ *    mapped now is faulted in and stays, and so is everything mapped
+ *    later, malloc() arenas and thread stacks included
+ *  - the stack of the thread touched down to config->stack, so that a
+ *    deep call does not fault on a page the lock could not see yet
+ *  - the thread pinned to a core; on the dual-core Zynq, the readout on
+ *    core 1 and the rest of the system left on core 0
+ *  - SCHED_FIFO at config->priority
+ * Every step is tried even when one fails: an unprivileged run gets the
+ * pinning without the priority, and says so through the return value.
+ *
+ * ual_rt_alloc() gives buffers backed by huge pages when the kernel has
+ * some reserved (vm.nr_hugepages), transparent huge pages otherwise,
+ * written once and locked: the first DMA or FIFO burst into them costs
+ * no fault and fewer TLB misses.
+ *
+ * ual_rt_jitter() measures what the setup bought: how late periodic
+ * wake-ups of the calling thread come, the number that matters for a
+ * FIFO drained every period.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "ual-int.h"
+
+#define UAL_RT_STACK (256 * 1024)
+
+static size_t ual_rt_huge_size(void)
+{
+	static size_t size;
+	char line[128];
+	unsigned long kb;
+	FILE *f;
+
+	if (size)
+		return size;
+	size = 2 * 1024 * 1024;
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		return size;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+			size = kb * 1024;
+			break;
+		}
+	fclose(f);
+	return size;
+}
+
+/* Buffers of a huge page or more go in huge pages, in alloc and free */
+static size_t ual_rt_round(size_t size, int *huge)
+{
+	size_t hs = ual_rt_huge_size(), ps = getpagesize();
+
+	*huge = size >= hs;
+	if (*huge)
+		return (size + hs - 1) & ~(hs - 1);
+	return (size + ps - 1) & ~(ps - 1);
+}
+
+static void __attribute__((noinline)) ual_rt_touch_stack(size_t size)
+{
+	char stack[size];
+
+	memset(stack, 0, size);
+	__asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+static uint64_t ual_rt_ns(const struct timespec *t)
+{
+	return t->tv_sec * 1000000000ULL + t->tv_nsec;
+}
+
+static int ual_rt_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+/**
+ * It fills a configuration from a command line specification,
+ * "<cpu>[:<priority>]": "1:80" pins to core 1 at SCHED_FIFO 80, "1" only
+ * pins, "-1:80" does not pin. Memory is locked in all cases.
+ *
+ * @param[out] c configuration for ual_rt_setup()
+ * @param[in] spec the specification
+ * @return 0 on success, -1 on a malformed specification and errno is
+ *         set to EINVAL
+ */
+int ual_rt_parse(struct ual_rt_config *c, const char *spec)
+{
+	int n, m;
+
+	memset(c, 0, sizeof(*c));
+	c->flags = UAL_RT_LOCK_MEMORY;
+	c->cpu = -1;
+	if (sscanf(spec, "%d%n", &c->cpu, &n) != 1)
+		goto err;
+	if (spec[n] == ':' && sscanf(spec + n + 1, "%d%n", &c->priority,
+				     &m) == 1)
+		n += m + 1;
+	if (spec[n] || c->cpu < -1 || c->priority < 0 || c->priority > 99)
+		goto err;
+	return 0;
+err:
+	errno = EINVAL;
+	return -1;
+}
+
+
+/**
+ * It makes the calling thread real-time as the configuration says:
+ * locked memory, prefaulted stack, core affinity and SCHED_FIFO.
+ *
+ * @param[in] c what to do
+ * @return 0 on success, -1 when a step failed and errno is the one of
+ *         the first failure (EPERM without CAP_SYS_NICE or
+ *         CAP_IPC_LOCK, EINVAL for a core that does not exist); the other
+ *         steps are applied anyway
+ */
+int ual_rt_setup(const struct ual_rt_config *c)
+{
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	static int locked;
+	struct sched_param sp = {.sched_priority = c->priority};
+	cpu_set_t set;
+	int err = 0, e = 0;
+
+	if (c->flags & UAL_RT_LOCK_MEMORY) {
+		pthread_mutex_lock(&lock);
+		if (!locked && mlockall(MCL_CURRENT | MCL_FUTURE))
+			err = errno;
+		else
+			locked = 1;
+		pthread_mutex_unlock(&lock);
+	}
+	ual_rt_touch_stack(c->stack ? c->stack : UAL_RT_STACK);
+
+	if (c->cpu >= CPU_SETSIZE) {
+		e = EINVAL;
+	} else if (c->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(c->cpu, &set);
+		/* these return the error, errno is untouched */
+		e = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+	err = err ? err : e;
+	if (c->priority) {
+		e = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+		err = err ? err : e;
+	}
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * It allocates a buffer prefaulted and locked, in huge pages when it is
+ * a huge page or more and the kernel has some to give.
+ *
+ * @param[in] size bytes
+ * @return the buffer, NULL on error and errno is appropriately set
+ */
+void *ual_rt_alloc(size_t size)
+{
+	size_t i, ps = getpagesize();
+	int huge;
+	char *p = MAP_FAILED;
+
+	size = ual_rt_round(size, &huge);
+	if (!size) {
+		errno = EINVAL;
+		return NULL;
+	}
+#ifdef MAP_HUGETLB
+	if (huge)
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (p == MAP_FAILED) {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		/* before the first touch, or the pages are small already */
+		if (huge)
+			madvise(p, size, MADV_HUGEPAGE);
+#endif
+	}
+	/* written, not read: a read maps the shared zero page */
+	for (i = 0; i < size; i += ps)
+		p[i] = 0;
+	/* without CAP_IPC_LOCK and a small RLIMIT_MEMLOCK it stays
+	   prefaulted but swappable; nothing a caller could do about it */
+	mlock(p, size);
+	return p;
+}
+
+
+/**
+ * It releases a buffer of ual_rt_alloc()
+ *
+ * @param[in] p the buffer
+ * @param[in] size the size given to ual_rt_alloc()
+ */
+void ual_rt_free(void *p, size_t size)
+{
+	int huge;
+
+	if (p)
+		munmap(p, ual_rt_round(size, &huge));
+}
+
+
+/**
+ * It measures how late the calling thread wakes up from periodic
+ * absolute sleeps, the way a thread draining a FIFO every period would.
+ * Call it after ual_rt_setup(), on the thread that will do the work.
+ *
+ * @param[in] period between wake-ups
+ * @param[in] loops wake-ups to measure
+ * @param[out] j the statistics, in ns
+ * @return 0 on success, -1 on error and errno is appropriately set
+ */
+int ual_rt_jitter(const struct timespec *period, unsigned int loops,
+		  struct ual_rt_jitter *j)
+{
+	struct timespec next, now;
+	struct rusage r0, r1;
+	uint64_t *late, p, total = 0;
+	unsigned int i;
+	int err;
+
+	p = ual_rt_ns(period);
+	if (!loops || !p) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* written now, so that recording does not fault later */
+	late = malloc(loops * sizeof(*late));
+	if (!late)
+		return -1;
+	memset(late, 0, loops * sizeof(*late));
+	memset(j, 0, sizeof(*j));
+
+	getrusage(RUSAGE_THREAD, &r0);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < loops; i++) {
+		next.tv_nsec += period->tv_nsec;
+		next.tv_sec += period->tv_sec + next.tv_nsec / 1000000000;
+		next.tv_nsec %= 1000000000;
+		do {
+			err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					      &next, NULL);
+		} while (err == EINTR);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late[i] = ual_rt_ns(&now) - ual_rt_ns(&next);
+		total += late[i];
+		/* a miss: sleep to the next period still ahead, and count
+		   the ones skipped, the drains that did not happen */
+		if (late[i] >= p) {
+			j->missed += late[i] / p;
+			next = now;
+		}
+	}
+	getrusage(RUSAGE_THREAD, &r1);
+
+	qsort(late, loops, sizeof(*late), ual_rt_cmp);
+	j->count = loops;
+	j->period = p;
+	j->min = late[0];
+	j->max = late[loops - 1];
+	j->mean = total / loops;
+	j->p99 = late[(uint64_t)loops * 99 / 100];
+	j->p999 = late[(uint64_t)loops * 999 / 1000];
+	j->minor_faults = r1.ru_minflt - r0.ru_minflt;
+	j->major_faults = r1.ru_majflt - r0.ru_majflt;
+	j->preempted = r1.ru_nivcsw - r0.ru_nivcsw;
+	free(late);
+	return 0;
+}
+
+
+/**
+ * It writes the real-time state of the calling thread and, when given,
+ * a jitter measurement.
+ *
+ * @param[in] fd where to write
+ * @param[in] j result of ual_rt_jitter(), or NULL
+ */
+void ual_rt_dump(int fd, const struct ual_rt_jitter *j)
+{
+	struct sched_param sp;
+	cpu_set_t set;
+	char line[128];
+	int policy, i, n = 0;
+	FILE *f;
+
+	if (!pthread_getschedparam(pthread_self(), &policy, &sp))
+		dprintf(fd, "policy %s, priority %d\n",
+			policy == SCHED_FIFO ? "SCHED_FIFO" :
+			policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER",
+			sp.sched_priority);
+	if (!pthread_getaffinity_np(pthread_self(), sizeof(set), &set)) {
+		dprintf(fd, "cpus");
+		for (i = 0; i < CPU_SETSIZE && n < CPU_COUNT(&set); i++)
+			if (CPU_ISSET(i, &set)) {
+				dprintf(fd, " %d", i);
+				n++;
+			}
+		dprintf(fd, "\n");
+	}
+	f = fopen("/proc/self/status", "r");
+	if (f) {
+		while (fgets(line, sizeof(line), f))
+			if (!strncmp(line, "VmLck:", 6) ||
+			    !strncmp(line, "VmRSS:", 6))
+				dprintf(fd, "%s", line);
+		fclose(f);
+	}
+	if (!j)
+		return;
+	dprintf(fd, "jitter over %llu wake-ups every %llu ns: min %llu, mean %llu, 99%% %llu, 99.9%% %llu, max %llu ns\n",
+		(unsigned long long)j->count, (unsigned long long)j->period,
+		(unsigned long long)j->min, (unsigned long long)j->mean,
+		(unsigned long long)j->p99, (unsigned long long)j->p999,
+		(unsigned long long)j->max);
+	dprintf(fd, "%llu periods missed, %llu minor and %llu major faults, %llu preemptions\n",
+		(unsigned long long)j->missed,
+		(unsigned long long)j->minor_faults,
+		(unsigned long long)j->major_faults,
+		(unsigned long long)j->preempted);
+}
@@ -9,6 +9,8 @@
 #ifndef __UAL_INT_H__
 #define __UAL_INT_H__
 
+#include <time.h>
+
 #include "ual.h"
 
 
@@ -25,6 +27,28 @@ struct ual_bus_operations {
 	int (*map)(struct ual_bar *bar); /**< map bus address space */
 	int (*unmap)(struct ual_bar *bar); /**< release resources taken
 					      by map()*/
+	uint32_t (*read)(struct ual_bar *bar, uint32_t addr,
+			 enum ual_data_width dw); /**< register read, used
+						     when map() does not
+						     provide a pointer */
+	void (*write)(struct ual_bar *bar, uint32_t addr, uint32_t value,
+		      enum ual_data_width dw); /**< register write, used
+						  when map() does not
+						  provide a pointer */
+	void (*read_n)(struct ual_bar *bar, uint32_t addr, void *data,
+		       unsigned int n, enum ual_data_width dw,
+		       int fifo); /**< optional block read, consecutive
+				     addresses or, with fifo, always addr */
+	void (*write_n)(struct ual_bar *bar, uint32_t addr, const void *data,
+			unsigned int n, enum ual_data_width dw,
+			int fifo); /**< optional block write, as read_n */
+	int (*poll)(struct ual_bar *bar, uint32_t addr, uint32_t mask,
+		    uint32_t match, struct timespec *timeout,
+		    uint32_t *value); /**< optional ual_readl_poll() done
+					 next to the device */
+	uint32_t (*rmw)(struct ual_bar *bar, uint32_t addr, uint32_t mask,
+			uint32_t value); /**< optional ual_rmwl() nobody
+					    else can interleave with */
 };
 
 
@@ -50,6 +74,9 @@ struct ual_bar {
 		struct ual_desc_vme vme; /**< VME address space descriptor */
 #endif
 		struct ual_desc_rawmem rawmem; /**< Raw memory address space descriptor */
+		struct ual_desc_sim sim; /**< Simulated address space descriptor */
+		struct ual_desc_remote remote; /**< Remote address space descriptor */
+		struct ual_desc_broker broker; /**< Broker address space descriptor */
 	} desc; /**< bus access descriptor  */
 	void *ptr; /**< mmap(2) pointer that point to the BAR */
 	void *bus_data; /**< private date in use by specific BUS */
@@ -58,6 +85,9 @@ struct ual_bar {
 };
 
 extern struct ual_bus ual_rawmem;
+extern struct ual_bus ual_sim;
+extern struct ual_bus ual_remote;
+extern struct ual_bus ual_broker;
 
 extern struct ual_bus ual_pci;
 #ifdef CONFIG_VME
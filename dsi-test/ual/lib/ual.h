@@ -17,13 +17,16 @@ extern "C" {
 #include <stdlib.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <sys/types.h>
 
 
 /**
  * @struct ual_bar_tkn
  * Anonymous structure used as token to identify a device address space
  * mapping instance. You can get the token with ual_open(); this token
- * is required by all UAL functions
+ * is required by all UAL functions. Threads may share a token on every
+ * bus: where accesses go through a socket or a broker, the token
+ * serializes them.
  */
 struct ual_bar_tkn;
 
@@ -75,6 +78,43 @@ struct ual_desc_rawmem {
 };
 
 
+/**
+ * Simulated memory map descriptor.
+ * Without hooks the BAR is backed by a plain in-memory register file.
+ * With hooks every access is forwarded to them, so that a software model
+ * of the device can react to reads and writes.
+ */
+struct ual_desc_sim {
+	uint64_t size; /**< number of bytes of the simulated address space */
+	uint64_t flags; /**< set of flags to driver the memory mapping */
+	void *priv; /**< model private data, passed to the hooks */
+	uint32_t (*read)(void *priv, uint32_t addr,
+			 enum ual_data_width dw); /**< read hook */
+	void (*write)(void *priv, uint32_t addr, uint32_t value,
+		      enum ual_data_width dw); /**< write hook */
+};
+
+
+/**
+ * Remote memory map descriptor: the BAR of a server (ual_remote_serve(),
+ * the ualsrv daemon) reached over a socket. Byte order is the server's
+ * business, so there are no flags.
+ */
+struct ual_desc_remote {
+	const char *address; /**< Unix socket path, or "a.b.c.d:port" */
+};
+
+
+/**
+ * Broker memory map descriptor: the BAR a broker (ual_broker_create(),
+ * the ualbroker daemon) on the same machine owns. Reads are loads from a
+ * read-only mapping, writes and ual_rmwl() go through the broker.
+ */
+struct ual_desc_broker {
+	const char *name; /**< broker name */
+};
+
+
 /**
  * It defines the device endianess:
  *     1 Big Endian, 0 Little Endian
@@ -100,7 +140,10 @@ enum ual_bus_type {
 #ifdef CONFIG_VME
 	UAL_BUS_VME, /**< VME bus support */
 #endif
-	UAL_BUS_RAWMEM /**< Raw memory i/o (busless) support */
+	UAL_BUS_RAWMEM, /**< Raw memory i/o (busless) support */
+	UAL_BUS_SIM, /**< Simulated device, no hardware access */
+	UAL_BUS_REMOTE, /**< Device served by another process or machine */
+	UAL_BUS_BROKER, /**< Device shared through a local broker */
 };
 
 
@@ -138,6 +181,7 @@ extern char *ual_strerror(int err);
  */
 extern struct ual_bar_tkn *ual_open(enum ual_bus_type type, void *desc);
 extern void ual_close(struct ual_bar_tkn *dev);
+extern void *ual_bar_ptr(struct ual_bar_tkn *dev);
 /** @} */
 
 
@@ -164,6 +208,31 @@ extern void ual_writeb_n(struct ual_bar_tkn *dev, uint32_t addr,
 extern void ual_writel(struct ual_bar_tkn *dev, uint32_t addr, uint32_t data);
 extern void ual_writew(struct ual_bar_tkn *dev, uint32_t addr, uint16_t data);
 extern void ual_writeb(struct ual_bar_tkn *dev, uint32_t addr, uint8_t data);
+extern uint32_t ual_rmwl(struct ual_bar_tkn *dev, uint32_t addr,
+			 uint32_t mask, uint32_t value);
+
+/**
+ * No fill-level register: the FIFO accessors transfer all the values
+ */
+#define UAL_FIFO_NO_LEVEL 0xffffffff
+extern unsigned int ual_readl_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+				   uint32_t *data, unsigned int n,
+				   uint32_t level_addr);
+extern unsigned int ual_readw_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+				   uint16_t *data, unsigned int n,
+				   uint32_t level_addr);
+extern unsigned int ual_readq_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+				   uint64_t *data, unsigned int n,
+				   uint32_t level_addr);
+extern unsigned int ual_writel_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+				    const uint32_t *data, unsigned int n,
+				    uint32_t level_addr);
+extern unsigned int ual_writew_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+				    const uint16_t *data, unsigned int n,
+				    uint32_t level_addr);
+extern unsigned int ual_writeq_fifo(struct ual_bar_tkn *dev, uint32_t addr,
+				    const uint64_t *data, unsigned int n,
+				    uint32_t level_addr);
 /** @} */
 
 
@@ -175,6 +244,187 @@ extern void ual_writeb(struct ual_bar_tkn *dev, uint32_t addr, uint8_t data);
 extern uint64_t ual_event_wait(struct ual_bar_tkn *tkn, uint64_t addr,
 			       uint64_t mask, struct timespec *period,
 			       struct timespec *timeout);
+extern int ual_readl_poll(struct ual_bar_tkn *tkn, uint32_t addr,
+			  uint32_t mask, uint32_t match,
+			  struct timespec *timeout, uint32_t *value);
+/** @} */
+
+
+/**
+ * @defgroup remote Remote access
+ * Serving a BAR to UAL_BUS_REMOTE clients
+ * @{
+ */
+extern int ual_remote_serve(struct ual_bar_tkn *dev, uint64_t size, int fd);
+/** @} */
+
+
+/**
+ * @defgroup broker Register broker
+ * Sharing a BAR with UAL_BUS_BROKER clients on the same machine
+ * @{
+ */
+struct ual_broker;
+
+/**
+ * Broker counters
+ */
+struct ual_broker_stats {
+	uint64_t commands; /**< commands executed */
+	uint64_t writes; /**< of which writes */
+	uint64_t rmws; /**< of which read-modify-writes */
+	uint64_t fifo_reads; /**< of which FIFO reads */
+	uint64_t sleeps; /**< times the broker waited for clients */
+	uint64_t wakeups; /**< clients woken up with an answer */
+	uint64_t reaped; /**< slots of dead clients taken back */
+	unsigned int clients; /**< clients attached now */
+};
+
+extern struct ual_broker *ual_broker_create(const char *name,
+					    const char *path,
+					    uint64_t offset, uint64_t size);
+extern int ual_broker_set_group(struct ual_broker *b, gid_t gid);
+extern int ual_broker_run(struct ual_broker *b);
+extern void ual_broker_stop(struct ual_broker *b);
+extern void ual_broker_destroy(struct ual_broker *b);
+extern void ual_broker_get_stats(struct ual_broker *b,
+				 struct ual_broker_stats *st);
+/** @} */
+
+
+/**
+ * @defgroup probe Instrumentation
+ * Per thread statistics of named code sections
+ * @{
+ */
+
+/**
+ * What the probes measure
+ */
+enum ual_probe_source {
+	UAL_PROBE_OFF = 0, /**< nothing, the default */
+	UAL_PROBE_CLOCK, /**< CLOCK_MONOTONIC, in ns */
+	UAL_PROBE_CYCLES, /**< CPU cycle counter (Cortex-A9 PMCCNTR, x86 TSC) */
+	UAL_PROBE_PERF, /**< perf_event cycles, cache and branch misses */
+};
+
+/**
+ * A named code section, or quantity; define it static with
+ * UAL_PROBE_DEFINE()
+ */
+struct ual_probe {
+	const char *name; /**< what ual_probe_dump() shows */
+	int id; /**< assigned on first use */
+};
+
+/**
+ * Start of a section, filled by ual_probe_begin()
+ */
+struct ual_probe_mark {
+	enum ual_probe_source source;
+	uint64_t v[3];
+};
+
+/**
+ * Results of a probe, summed over the threads
+ */
+struct ual_probe_result {
+	const char *name;
+	uint64_t count; /**< sections, or ual_probe_count() calls */
+	uint64_t total; /**< in the unit of the source, or the quantity */
+	uint64_t min;
+	uint64_t max;
+	uint64_t cache_misses; /**< UAL_PROBE_PERF only */
+	uint64_t branch_misses; /**< UAL_PROBE_PERF only */
+};
+
+extern enum ual_probe_source ual_probe_source;
+
+#define UAL_PROBE_DEFINE(_var, _name) \
+	static struct ual_probe _var = {.name = _name}
+#define ual_probe_on() __builtin_expect(ual_probe_source != UAL_PROBE_OFF, 0)
+#define UAL_PROBE_BEGIN(_p, _m) do {					\
+		(_m)->source = UAL_PROBE_OFF;				\
+		if (ual_probe_on())					\
+			ual_probe_begin(_p, _m);			\
+	} while (0)
+#define UAL_PROBE_END(_p, _m) do {					\
+		if (ual_probe_on())					\
+			ual_probe_end(_p, _m);				\
+	} while (0)
+
+extern int ual_probe_enable(enum ual_probe_source source);
+extern void ual_probe_begin(struct ual_probe *p, struct ual_probe_mark *m);
+extern void ual_probe_end(struct ual_probe *p, struct ual_probe_mark *m);
+extern void ual_probe_count(struct ual_probe *p, uint64_t n);
+extern void ual_probe_reset(void);
+extern int ual_probe_results(struct ual_probe_result *r, int max);
+extern void ual_probe_dump(int fd);
+
+/**
+ * A section that ends with the enclosing block
+ */
+struct ual_probe_scope {
+	struct ual_probe *p;
+	struct ual_probe_mark m;
+};
+
+static inline void ual_probe_scope_end(struct ual_probe_scope *s)
+{
+	UAL_PROBE_END(s->p, &s->m);
+}
+
+#define __UAL_PROBE_SCOPE(_p, _n)					\
+	struct ual_probe_scope _n					\
+	__attribute__((cleanup(ual_probe_scope_end))) = {.p = (_p)};	\
+	UAL_PROBE_BEGIN(_n.p, &_n.m)
+#define _UAL_PROBE_SCOPE(_p, _l) __UAL_PROBE_SCOPE(_p, __ual_probe_ ## _l)
+#define UAL_PROBE_SCOPE(_p) _UAL_PROBE_SCOPE(_p, __LINE__)
+/** @} */
+
+
+/**
+ * @defgroup rt Real-time runtime
+ * Locked memory, pinned SCHED_FIFO threads and prefaulted buffers
+ * @{
+ */
+
+#define UAL_RT_LOCK_MEMORY (1 << 0) /**< mlockall() current and future */
+
+/**
+ * What ual_rt_setup() does to the calling thread
+ */
+struct ual_rt_config {
+	int cpu; /**< core to pin to, -1 to leave the affinity alone */
+	int priority; /**< SCHED_FIFO priority 1-99, 0 to keep the policy */
+	unsigned long flags; /**< UAL_RT_* */
+	size_t stack; /**< bytes of stack to prefault, 0 for 256k */
+};
+
+/**
+ * Lateness of periodic wake-ups, measured by ual_rt_jitter()
+ */
+struct ual_rt_jitter {
+	uint64_t count; /**< wake-ups */
+	uint64_t period; /**< ns */
+	uint64_t min; /**< ns late */
+	uint64_t mean;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+	uint64_t missed; /**< whole periods slept through */
+	uint64_t minor_faults; /**< page faults during the measurement */
+	uint64_t major_faults;
+	uint64_t preempted; /**< involuntary context switches */
+};
+
+extern int ual_rt_parse(struct ual_rt_config *c, const char *spec);
+extern int ual_rt_setup(const struct ual_rt_config *c);
+extern void *ual_rt_alloc(size_t size);
+extern void ual_rt_free(void *p, size_t size);
+extern int ual_rt_jitter(const struct timespec *period, unsigned int loops,
+			 struct ual_rt_jitter *j);
+extern void ual_rt_dump(int fd, const struct ual_rt_jitter *j);
 /** @} */
 
 
@@ -0,0 +1,169 @@
+/*
+ * License: LGPLv3
+ */
+
+/*
+ * ualbroker - shares a local BAR with UAL_BUS_BROKER clients
+ *
+ * The daemon is the only process writing the registers: clients (ualmem
+ * --broker, or anything opening UAL_BUS_BROKER) post their writes and
+ * read-modify-writes into shared memory rings it executes one at a time,
+ * and read the registers directly through a read-only mapping.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <grp.h>
+#include <time.h>
+#include <ual.h>
+
+void help(char *name)
+{
+	fprintf(stderr, "Use: \"%s [OPTIONS]\"\n", name);
+
+	fprintf(stderr,
+		"\nIt shares a memory map with UAL_BUS_BROKER clients.\n");
+
+	fprintf(stderr, "\nOptions:\n");
+	fprintf(stderr, "\t--name, -n <name>: broker name clients open\n");
+	fprintf(stderr, "\t--rawmem 0x<number>: physical base address to map\n");
+	fprintf(stderr, "\t--file <path>: share a file instead, for testing\n");
+	fprintf(stderr, "\t--size <number>: bytes to map (default 64k)\n");
+	fprintf(stderr, "\t--group <name>: let this group attach too; its members can write the registers\n");
+	fprintf(stderr, "\t--rt <cpu>[:<priority>]: lock memory, pin to a core, SCHED_FIFO\n");
+	fprintf(stderr, "\t--verbose, -v: print the counters on exit\n");
+	exit(1);
+}
+
+enum ualbroker_option_index {
+	UO_NONE = 0,
+	UO_RAWMEM,
+	UO_FILE,
+	UO_SIZE,
+	UO_GROUP,
+	UO_RT,
+};
+
+static struct option long_options[] = {
+	{"name", required_argument, 0, 'n'},
+	{"rawmem", required_argument, 0, UO_RAWMEM},
+	{"file", required_argument, 0, UO_FILE},
+	{"size", required_argument, 0, UO_SIZE},
+	{"group", required_argument, 0, UO_GROUP},
+	{"rt", required_argument, 0, UO_RT},
+	{"verbose", no_argument, 0, 'v'},
+	{0, 0, 0, 0}
+};
+
+static struct ual_broker *broker;
+
+static void stop(int sig)
+{
+	ual_broker_stop(broker);
+}
+
+int main(int argc, char **argv)
+{
+	struct ual_broker_stats st;
+	struct ual_rt_config rt;
+	struct ual_rt_jitter jitter;
+	struct timespec period = {0, 1000000};
+	uint64_t address = 0, size = 0x10000;
+	char *name = NULL, *path = NULL;
+	struct group *group = NULL;
+	int c, i, option_index = 0, have_raw = 0, have_rt = 0, verbose = 0;
+
+	while ((c = getopt_long(argc, argv, "n:v", long_options,
+				&option_index)) != -1) {
+		switch (c) {
+		case UO_NONE:
+			break;
+		case 'n':
+			name = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case UO_RAWMEM:
+			i = sscanf(optarg, "0x%"SCNx64, &address);
+			if (i == 1) {
+				have_raw = 1;
+				break;
+			}
+			fprintf(stderr, "Invalid base address: it must be a hex value\n");
+			exit(1);
+		case UO_FILE:
+			path = optarg;
+			break;
+		case UO_SIZE:
+			i = sscanf(optarg, "0x%"SCNx64, &size);
+			if (i == 1)
+				break;
+			i = sscanf(optarg, "%"SCNu64, &size);
+			if (i == 1)
+				break;
+			fprintf(stderr, "Invalid size format '%s'\n", optarg);
+			exit(1);
+		case UO_GROUP:
+			group = getgrnam(optarg);
+			if (group)
+				break;
+			fprintf(stderr, "Unknown group '%s'\n", optarg);
+			exit(1);
+		case UO_RT:
+			if (!ual_rt_parse(&rt, optarg)) {
+				have_rt = 1;
+				break;
+			}
+			fprintf(stderr, "Invalid real-time setup '%s'\n", optarg);
+			exit(1);
+		default:
+			help(argv[0]);
+		}
+	}
+	if (!name || (!have_raw == !path))
+		help(argv[0]);
+
+	broker = ual_broker_create(name, have_raw ? "/dev/mem" : path,
+				   address, size);
+	if (!broker) {
+		fprintf(stderr, "Cannot create broker: %s\n",
+			ual_strerror(errno));
+		exit(1);
+	}
+	if (group && ual_broker_set_group(broker, group->gr_gid)) {
+		fprintf(stderr, "Cannot share with group %s: %s\n",
+			group->gr_name, strerror(errno));
+		ual_broker_destroy(broker);
+		exit(1);
+	}
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	if (have_rt) {
+		/* before serving: the mappings above get locked too */
+		if (ual_rt_setup(&rt))
+			fprintf(stderr, "Real-time setup incomplete: %s\n",
+				strerror(errno));
+		if (verbose && !ual_rt_jitter(&period, 500, &jitter))
+			ual_rt_dump(2, &jitter);
+	}
+
+	ual_broker_run(broker);
+
+	if (verbose) {
+		ual_broker_get_stats(broker, &st);
+		fprintf(stderr,
+			"%"PRIu64" commands (%"PRIu64" writes, %"PRIu64" rmw, %"PRIu64" fifo reads), %"PRIu64" sleeps, %"PRIu64" wakeups, %"PRIu64" dead clients\n",
+			st.commands, st.writes, st.rmws, st.fifo_reads,
+			st.sleeps, st.wakeups, st.reaped);
+	}
+	ual_broker_destroy(broker);
+	return 0;
+}
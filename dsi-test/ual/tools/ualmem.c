@@ -44,6 +44,9 @@ void help(char *name)
 	fprintf(stderr, "\t--vme: set bus type to VME\n");
 	fprintf(stderr, "\t--vme-am 0x<hex-number> : VME address-modifier\n");
 #endif
+	fprintf(stderr, "\nRemote Options:\n");
+	fprintf(stderr, "\t--remote <path|a.b.c.d:port>: access the map served by ualsrv\n");
+	fprintf(stderr, "\t--broker <name>: access the map shared by ualbroker\n");
 	fprintf(stderr, "\nEndianess Options:\n");
 	fprintf(stderr, "\t--device-be: the device is Big Endian\n");
 	fprintf(stderr, "\t--device-le: the device is Little Endian (default)\n");
@@ -69,6 +72,8 @@ enum ualmem_option_index {
 	UO_PCI_DEVID,
 	UO_PCI_BAR,
 	UO_VME_AM,
+	UO_REMOTE,
+	UO_BROKER,
 };
 
 static int wait = 0;
@@ -91,6 +96,9 @@ static struct option long_options[] = {
 	{"vme", no_argument, &bus_type, UAL_BUS_VME},
 	{"vme-am", required_argument, 0, UO_VME_AM},
 #endif
+	/* Remote options */
+	{"remote", required_argument, 0, UO_REMOTE},
+	{"broker", required_argument, 0, UO_BROKER},
 	/* Endianess options */
 	{"device-be", no_argument, &device_endianess, 1},
 	{"device-le", no_argument, &device_endianess, 0},
@@ -115,6 +123,8 @@ int main(int argc, char **argv)
 	int c, i, option_index = 0, val_idx = 0;
 	struct ual_desc_pci pci;
 	struct ual_desc_vme vme;
+	struct ual_desc_remote remote = {NULL};
+	struct ual_desc_broker broker = {NULL};
 
 	memset(&pci, 0, sizeof(struct ual_desc_pci));
 	memset(&vme, 0, sizeof(struct ual_desc_vme));
@@ -205,6 +215,14 @@ int main(int argc, char **argv)
 			fprintf(stderr, "VME address-modifier must be an hexadicimal number\n");
 			break;
 #endif
+		case UO_REMOTE:
+			remote.address = optarg;
+			bus_type = UAL_BUS_REMOTE;
+			break;
+		case UO_BROKER:
+			broker.name = optarg;
+			bus_type = UAL_BUS_BROKER;
+			break;
 		case 'a':
 			i = sscanf(optarg, "0x%"SCNx64, &address);
 			if (i == 1)
@@ -293,6 +311,12 @@ int main(int argc, char **argv)
 		ubar = ual_open(bus_type, &vme);
 		break;
 #endif
+	case UAL_BUS_REMOTE:
+		ubar = ual_open(bus_type, &remote);
+		break;
+	case UAL_BUS_BROKER:
+		ubar = ual_open(bus_type, &broker);
+		break;
 	default:
 		fprintf(stderr, "The BUS type options is mandatory\n");
 		exit(1);
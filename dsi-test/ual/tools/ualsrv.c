@@ -0,0 +1,249 @@
+/*
+ * License: LGPLv3
+ */
+
+/*
+ * ualsrv - serves a local BAR to UAL_BUS_REMOTE clients
+ *
+ * The daemon owns the mapping; clients (ualmem --remote, dsi-test -r, or
+ * anything opening UAL_BUS_REMOTE) connect to it over a Unix socket or
+ * TCP. Clients are served one at a time, in the order they connect, so
+ * that nobody's read-modify-write lands in the middle of somebody else's:
+ * a client holds the map until it disconnects, and the next ones wait in
+ * the listen queue. Polls run on the server a second at a time, so that
+ * a client gone in the middle of a long one is noticed.
+ *
+ * There is no authentication: a client gets the BAR, /dev/mem with
+ * --rawmem. TCP listens on the loopback unless --bind says otherwise.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <ual.h>
+
+void help(char *name)
+{
+	fprintf(stderr, "Use: \"%s [OPTIONS]\"\n", name);
+
+	fprintf(stderr,
+		"\nIt serves a memory map to UAL_BUS_REMOTE clients, one at a\n"
+		"time: a connected client, even an idle one, keeps the others\n"
+		"waiting until it disconnects.\n");
+
+	fprintf(stderr, "\nListen Options:\n");
+	fprintf(stderr, "\t--socket, -s <path>: Unix socket to listen on\n");
+	fprintf(stderr, "\t--port, -p <number>: TCP port to listen on\n");
+	fprintf(stderr, "\t--bind <a.b.c.d>: TCP address to listen on (default 127.0.0.1)\n");
+	fprintf(stderr, "\t\tWARNING: there is no authentication, anyone who reaches\n"
+		"\t\tthe address reads and writes the map, with --rawmem the\n"
+		"\t\tphysical memory behind it; bind elsewhere than the\n"
+		"\t\tloopback only on a network you trust\n");
+
+	fprintf(stderr, "\nMap Options:\n");
+	fprintf(stderr, "\t--rawmem 0x<number>: physical base address to map\n");
+	fprintf(stderr, "\t--sim: serve plain memory, for testing\n");
+	fprintf(stderr, "\t--size <number>: bytes to map (default 64k)\n");
+	fprintf(stderr, "\t--rt <cpu>[:<priority>]: lock memory, pin to a core, SCHED_FIFO\n");
+	fprintf(stderr, "\t--verbose, -v: report clients\n");
+	exit(1);
+}
+
+enum ualsrv_option_index {
+	UO_NONE = 0,
+	UO_RAWMEM,
+	UO_SIZE,
+	UO_RT,
+	UO_BIND,
+};
+
+static int sim = 0, verbose = 0;
+static struct option long_options[] = {
+	{"socket", required_argument, 0, 's'},
+	{"port", required_argument, 0, 'p'},
+	{"rawmem", required_argument, 0, UO_RAWMEM},
+	{"sim", no_argument, &sim, 1},
+	{"size", required_argument, 0, UO_SIZE},
+	{"rt", required_argument, 0, UO_RT},
+	{"bind", required_argument, 0, UO_BIND},
+	{"verbose", no_argument, 0, 'v'},
+	{0, 0, 0, 0}
+};
+
+static int listen_on(const char *path, struct in_addr *addr, int port)
+{
+	struct sockaddr_un su;
+	struct sockaddr_in si;
+	int fd, one = 1;
+
+	if (path) {
+		if (strlen(path) >= sizeof(su.sun_path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		memset(&su, 0, sizeof(su));
+		su.sun_family = AF_UNIX;
+		strcpy(su.sun_path, path);
+		unlink(path);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		if (bind(fd, (struct sockaddr *)&su, sizeof(su)))
+			goto err;
+	} else {
+		memset(&si, 0, sizeof(si));
+		si.sin_family = AF_INET;
+		si.sin_port = htons(port);
+		si.sin_addr = *addr;
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, (struct sockaddr *)&si, sizeof(si)))
+			goto err;
+	}
+	if (listen(fd, 8))
+		goto err;
+	return fd;
+err:
+	close(fd);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	struct ual_bar_tkn *ubar;
+	struct ual_desc_rawmem rawmem;
+	struct ual_desc_sim simmem;
+	struct ual_rt_config rt;
+	struct ual_rt_jitter jitter;
+	struct timespec period = {0, 1000000};
+	uint64_t address = 0, size = 0x10000;
+	struct in_addr addr = {htonl(INADDR_LOOPBACK)};
+	char *path = NULL;
+	int c, i, port = 0, lfd, fd, one = 1, option_index = 0, have_raw = 0;
+	int have_rt = 0, have_bind = 0;
+
+	while ((c = getopt_long(argc, argv, "s:p:v", long_options,
+				&option_index)) != -1) {
+		switch (c) {
+		case UO_NONE:
+			break;
+		case 's':
+			path = optarg;
+			break;
+		case 'p':
+			i = sscanf(optarg, "%d", &port);
+			if (i == 1 && port > 0 && port < 65536)
+				break;
+			fprintf(stderr, "Invalid port '%s'\n", optarg);
+			exit(1);
+		case 'v':
+			verbose = 1;
+			break;
+		case UO_RAWMEM:
+			i = sscanf(optarg, "0x%"SCNx64, &address);
+			if (i == 1) {
+				have_raw = 1;
+				break;
+			}
+			fprintf(stderr, "Invalid base address: it must be a hex value\n");
+			exit(1);
+		case UO_SIZE:
+			i = sscanf(optarg, "0x%"SCNx64, &size);
+			if (i == 1)
+				break;
+			i = sscanf(optarg, "%"SCNu64, &size);
+			if (i == 1)
+				break;
+			fprintf(stderr, "Invalid size format '%s'\n", optarg);
+			exit(1);
+		case UO_RT:
+			if (!ual_rt_parse(&rt, optarg)) {
+				have_rt = 1;
+				break;
+			}
+			fprintf(stderr, "Invalid real-time setup '%s'\n", optarg);
+			exit(1);
+		case UO_BIND:
+			if (inet_pton(AF_INET, optarg, &addr) == 1) {
+				have_bind = 1;
+				break;
+			}
+			fprintf(stderr, "Invalid address '%s'\n", optarg);
+			exit(1);
+		default:
+			help(argv[0]);
+		}
+	}
+	if ((!path == !port) || (!have_raw == !sim) || (have_bind && !port))
+		help(argv[0]);
+
+	if (sim) {
+		memset(&simmem, 0, sizeof(simmem));
+		simmem.size = size;
+		ubar = ual_open(UAL_BUS_SIM, &simmem);
+	} else {
+		memset(&rawmem, 0, sizeof(rawmem));
+		rawmem.offset = address;
+		rawmem.size = size;
+		ubar = ual_open(UAL_BUS_RAWMEM, &rawmem);
+	}
+	if (!ubar) {
+		fprintf(stderr, "Cannot open device: %s\n", ual_strerror(errno));
+		exit(1);
+	}
+
+	lfd = listen_on(path, &addr, port);
+	if (lfd < 0) {
+		fprintf(stderr, "Cannot listen: %s\n", strerror(errno));
+		exit(1);
+	}
+	/* a client that goes away must not take the daemon with it */
+	signal(SIGPIPE, SIG_IGN);
+	if (have_rt) {
+		/* before serving: the mappings above get locked too */
+		if (ual_rt_setup(&rt))
+			fprintf(stderr, "Real-time setup incomplete: %s\n",
+				strerror(errno));
+		if (verbose && !ual_rt_jitter(&period, 500, &jitter))
+			ual_rt_dump(2, &jitter);
+	}
+
+	while (1) {
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "accept: %s\n", strerror(errno));
+			break;
+		}
+		if (port)
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one,
+				   sizeof(one));
+		if (verbose)
+			fprintf(stderr, "client connected\n");
+		if (ual_remote_serve(ubar, size, fd) && verbose)
+			fprintf(stderr, "client dropped: %s\n",
+				strerror(errno));
+		else if (verbose)
+			fprintf(stderr, "client done\n");
+		close(fd);
+	}
+
+	close(lfd);
+	ual_close(ubar);
+	exit(1);
+}
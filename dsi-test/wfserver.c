@@ -0,0 +1,853 @@
+/*
+ * Binary waveform server for automated test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* wfserver.c - waveforms off the scope at socket speed.
+ *
+ * One thread polls the listening sockets, the clients and an eventfd
+ * that wfs_publish() kicks. Requests are fixed size, so everything a
+ * client has sent is handled in one go and its responses are queued:
+ * a header, and for samples a pointer into the published frame (which
+ * holds a reference until sent) or a file range. The queue goes out
+ * with one sendmsg() gathering as many headers and frame slices as fit
+ * in the socket, so a batch of requests costs one system call each way
+ * and samples are copied once, by the kernel, from capture memory into
+ * the socket. File ranges go with sendfile(), which splices the page
+ * cache to the socket without passing through user space.
+ *
+ * Sockets are non-blocking and a client's queue only drains as fast as
+ * it reads, so a slow client stalls nobody else. Pushed frames are
+ * skipped for a subscriber that still has two of them queued: it sees
+ * the latest data, not a growing backlog. SIGPIPE is blocked in the
+ * server thread, where a client that went away shows up as EPIPE. */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "wfserver.h"
+
+#define MAX_ITEMS 256           /* queued responses per client */
+#define MAX_FRAMES_QUEUED 2
+#define IN_REQS 64
+#define IOVS 64
+#define HDR sizeof(struct wfs_resp)
+
+struct frame {
+    const uint8_t *data;
+    uint64_t samples, seq;
+    int refs;
+    void (*release)(void *arg, const void *data);
+    void *arg;
+};
+
+struct item {
+    struct wfs_resp hdr;
+    size_t sent;                /* of header and payload */
+    size_t len;                 /* payload */
+    const uint8_t *data;        /* payload in memory, or */
+    int fd;                     /* ... in a file from off on, or -1 */
+    off_t off;
+    struct frame *frame;        /* held for data */
+    void *owned;                /* freed with the item */
+};
+
+struct client {
+    int fd;
+    uint8_t in[IN_REQS * sizeof(struct wfs_req)];
+    size_t in_len;
+    struct item q[MAX_ITEMS];   /* [tail, head) */
+    unsigned int head, tail;
+    uint32_t subs;              /* channel bits */
+    int frames;                 /* WFS_OP_FRAME items queued */
+};
+
+struct channel {
+    int bits;
+    double period;
+    struct frame *cur;
+    uint64_t seq, pushed;
+    int file_fd;
+    uint64_t file_off, file_samples;
+};
+
+struct wfs_server {
+    int lfd[2];                 /* Unix, TCP */
+    int evfd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    pthread_t thread;
+    atomic_int quit;
+
+    /* channels, frame references and stats */
+    pthread_mutex_t lock;
+    struct channel ch[WFS_MAX_CHANNELS];
+    int nch;
+    struct wfs_stats st;
+
+    /* server thread */
+    struct client *cl[WFS_MAX_CLIENTS];
+};
+
+static void unref(struct wfs_server *s, struct frame *f)
+{
+    int refs;
+
+    if (!f)
+        return;
+    pthread_mutex_lock(&s->lock);
+    refs = --f->refs;
+    pthread_mutex_unlock(&s->lock);
+    if (refs)
+        return;
+    if (f->release)
+        f->release(f->arg, f->data);
+    free(f);
+}
+
+static int queued(const struct client *c)
+{
+    return c->head - c->tail;
+}
+
+static struct item *new_item(struct client *c, const struct wfs_req *r,
+                             uint32_t op)
+{
+    struct item *it = &c->q[c->head % MAX_ITEMS];
+
+    memset(it, 0, sizeof(*it));
+    it->fd = -1;
+    it->hdr.op = op;
+    it->hdr.id = r ? r->id : 0;
+    it->hdr.channel = r ? r->channel : 0;
+    return it;
+}
+
+static void done_item(struct wfs_server *s, struct client *c)
+{
+    struct item *it = &c->q[c->tail % MAX_ITEMS];
+
+    if (it->hdr.op == WFS_OP_FRAME)
+        c->frames--;
+    unref(s, it->frame);
+    free(it->owned);
+    c->tail++;
+}
+
+static void handle(struct wfs_server *s, struct client *c,
+                   const struct wfs_req *r)
+{
+    struct item *it = new_item(c, r, r->op);
+    struct channel *ch = r->channel < (uint32_t)s->nch ? &s->ch[r->channel] :
+                         NULL;
+    struct wfs_info *info;
+    uint64_t n, avail;
+    struct frame *f;
+    int i, bytes = ch ? ch->bits / 8 : 0, st = 0;
+
+    pthread_mutex_lock(&s->lock);
+    switch (r->op) {
+    case WFS_OP_PING:
+        break;
+    case WFS_OP_INFO:
+        info = calloc(s->nch, sizeof(*info));
+        if (!info) {
+            st = -ENOMEM;
+            break;
+        }
+        for (i = 0; i < s->nch; i++) {
+            info[i].bits = s->ch[i].bits;
+            info[i].samples = s->ch[i].cur ? s->ch[i].cur->samples : 0;
+            info[i].seq = s->ch[i].seq;
+            info[i].file_samples = s->ch[i].file_samples;
+            info[i].sample_period = s->ch[i].period;
+        }
+        it->owned = info;
+        it->data = it->owned;
+        it->len = s->nch * sizeof(*info);
+        break;
+    case WFS_OP_READ:
+    case WFS_OP_READ_FILE:
+        if (!ch) {
+            st = -EINVAL;
+            break;
+        }
+        f = ch->cur;
+        if (r->op == WFS_OP_READ && !f) {
+            st = -ENODATA;
+            break;
+        }
+        if (r->op == WFS_OP_READ_FILE && ch->file_fd < 0) {
+            st = -ENOENT;
+            break;
+        }
+        avail = r->op == WFS_OP_READ ? f->samples : ch->file_samples;
+        if (r->first > avail) {
+            st = -ERANGE;
+            break;
+        }
+        n = r->count < avail - r->first ? r->count : avail - r->first;
+        it->hdr.first = r->first;
+        it->len = n * bytes;
+        if (r->op == WFS_OP_READ) {
+            f->refs++;
+            it->frame = f;
+            it->data = f->data + r->first * bytes;
+            it->hdr.seq = f->seq;
+        } else {
+            it->fd = ch->file_fd;
+            it->off = ch->file_off + r->first * bytes;
+        }
+        break;
+    case WFS_OP_SUBSCRIBE:
+    case WFS_OP_UNSUBSCRIBE:
+        if (!ch) {
+            st = -EINVAL;
+            break;
+        }
+        if (r->op == WFS_OP_SUBSCRIBE)
+            c->subs |= 1u << r->channel;
+        else
+            c->subs &= ~(1u << r->channel);
+        break;
+    default:
+        st = -EINVAL;
+        break;
+    }
+    s->st.requests++;
+    pthread_mutex_unlock(&s->lock);
+
+    it->hdr.status = st;
+    if (st)
+        it->len = 0;
+    it->hdr.bytes = it->len;
+    c->head++;
+}
+
+/* Handles the complete requests received, as long as responses fit */
+static void process(struct wfs_server *s, struct client *c)
+{
+    size_t used = 0;
+
+    while (c->in_len - used >= sizeof(struct wfs_req) &&
+           queued(c) < MAX_ITEMS) {
+        struct wfs_req r;
+
+        memcpy(&r, c->in + used, sizeof(r));
+        handle(s, c, &r);
+        used += sizeof(r);
+    }
+    memmove(c->in, c->in + used, c->in_len - used);
+    c->in_len -= used;
+}
+
+static void count_sent(struct wfs_server *s, size_t k)
+{
+    pthread_mutex_lock(&s->lock);
+    s->st.bytes_sent += k;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Sends what the socket takes; -1 when the client has to go */
+static int flush(struct wfs_server *s, struct client *c)
+{
+    struct iovec iov[IOVS];
+    struct msghdr msg;
+    struct item *it;
+    unsigned int i;
+    size_t p, q, total;
+    ssize_t k;
+    off_t off;
+    int n;
+
+    while (queued(c)) {
+        it = &c->q[c->tail % MAX_ITEMS];
+        if (it->fd >= 0 && it->sent >= HDR) {
+            /* a file payload whose header has gone */
+            p = it->sent - HDR;
+            off = it->off + p;
+            k = sendfile(c->fd, it->fd, &off, it->len - p);
+            if (k < 0)
+                return errno == EAGAIN || errno == EINTR ? 0 : -1;
+            if (!k)
+                return -1;      /* the file is shorter than attached */
+            count_sent(s, k);
+            it->sent += k;
+            if (it->sent < HDR + it->len)
+                return 0;
+            done_item(s, c);
+            continue;
+        }
+
+        /* headers and frame slices in one gather, up to a file payload */
+        n = 0;
+        total = 0;
+        for (i = c->tail; i != c->head && n < IOVS - 1; i++) {
+            it = &c->q[i % MAX_ITEMS];
+            if (it->sent < HDR) {
+                iov[n].iov_base = (uint8_t *)&it->hdr + it->sent;
+                iov[n].iov_len = HDR - it->sent;
+                total += iov[n++].iov_len;
+            }
+            if (it->fd >= 0 && it->len)
+                break;
+            p = it->sent > HDR ? it->sent - HDR : 0;
+            if (it->len > p) {
+                iov[n].iov_base = (void *)(it->data + p);
+                iov[n].iov_len = it->len - p;
+                total += iov[n++].iov_len;
+            }
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        k = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (k < 0)
+            return errno == EAGAIN || errno == EINTR ? 0 : -1;
+        count_sent(s, k);
+
+        /* k bytes of the items, in the order gathered */
+        for (p = k; queued(c); ) {
+            it = &c->q[c->tail % MAX_ITEMS];
+            q = (it->fd >= 0 ? HDR : HDR + it->len) - it->sent;
+            if (q > p) {
+                it->sent += p;
+                break;
+            }
+            it->sent += q;
+            p -= q;
+            if (it->sent < HDR + it->len)
+                break;
+            done_item(s, c);
+        }
+        if ((size_t)k < total)
+            return 0;           /* the socket is full */
+    }
+    return 0;
+}
+
+static void drop_client(struct wfs_server *s, int i)
+{
+    struct client *c = s->cl[i];
+
+    while (queued(c))
+        done_item(s, c);
+    close(c->fd);
+    free(c);
+    s->cl[i] = NULL;
+    pthread_mutex_lock(&s->lock);
+    s->st.clients--;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void accept_client(struct wfs_server *s, int lfd)
+{
+    int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC), i, one = 1;
+    struct client *c;
+
+    if (fd < 0)
+        return;
+    for (i = 0; i < WFS_MAX_CLIENTS && s->cl[i]; i++)
+        ;
+    c = i < WFS_MAX_CLIENTS ? calloc(1, sizeof(*c)) : NULL;
+    if (!c) {
+        close(fd);
+        return;
+    }
+    if (lfd == s->lfd[1])
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->fd = fd;
+    s->cl[i] = c;
+    pthread_mutex_lock(&s->lock);
+    s->st.clients++;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Queues the new frames of subscribed channels */
+static void push_frames(struct wfs_server *s)
+{
+    struct client *c;
+    struct item *it;
+    struct frame *f;
+    int ch, i;
+
+    pthread_mutex_lock(&s->lock);
+    for (ch = 0; ch < s->nch; ch++) {
+        f = s->ch[ch].cur;
+        if (!f || s->ch[ch].pushed == f->seq)
+            continue;
+        s->ch[ch].pushed = f->seq;
+        for (i = 0; i < WFS_MAX_CLIENTS; i++) {
+            c = s->cl[i];
+            if (!c || !(c->subs & 1u << ch))
+                continue;
+            if (c->frames >= MAX_FRAMES_QUEUED || queued(c) == MAX_ITEMS) {
+                s->st.frames_skipped++;
+                continue;
+            }
+            it = new_item(c, NULL, WFS_OP_FRAME);
+            it->hdr.channel = ch;
+            it->hdr.seq = f->seq;
+            it->len = f->samples * (s->ch[ch].bits / 8);
+            it->hdr.bytes = it->len;
+            it->data = f->data;
+            it->frame = f;
+            f->refs++;
+            c->frames++;
+            c->head++;
+            s->st.frames_pushed++;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Queues responses, sends, and takes more requests as room frees up */
+static int serve_client(struct wfs_server *s, struct client *c)
+{
+    do {
+        process(s, c);
+        if (flush(s, c))
+            return -1;
+    } while (c->in_len >= sizeof(struct wfs_req) && queued(c) < MAX_ITEMS);
+    return 0;
+}
+
+static void *serve(void *arg)
+{
+    struct wfs_server *s = arg;
+    struct pollfd pfd[3 + WFS_MAX_CLIENTS];
+    int map[3 + WFS_MAX_CLIENTS], n, i, k;
+    struct client *c;
+    uint64_t v;
+    ssize_t r;
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    while (!atomic_load(&s->quit)) {
+        n = 0;
+        pfd[n].fd = s->evfd;
+        pfd[n++].events = POLLIN;
+        for (i = 0; i < 2; i++) {
+            if (s->lfd[i] < 0)
+                continue;
+            pfd[n].fd = s->lfd[i];
+            pfd[n++].events = POLLIN;
+        }
+        k = n;
+        for (i = 0; i < WFS_MAX_CLIENTS; i++) {
+            c = s->cl[i];
+            if (!c)
+                continue;
+            pfd[n].fd = c->fd;
+            pfd[n].events = (c->in_len < sizeof(c->in) ? POLLIN : 0) |
+                            (queued(c) ? POLLOUT : 0);
+            map[n++] = i;
+        }
+        if (poll(pfd, n, -1) < 0)
+            continue;
+
+        if (pfd[0].revents & POLLIN) {
+            r = read(s->evfd, &v, sizeof(v));
+            (void)r;
+            push_frames(s);
+        }
+        for (i = 1; i < k; i++)
+            if (pfd[i].revents & POLLIN)
+                accept_client(s, pfd[i].fd);
+        for (i = k; i < n; i++) {
+            c = s->cl[map[i]];
+            if (pfd[i].revents & POLLIN) {
+                r = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+                if (!r || (r < 0 && errno != EAGAIN && errno != EINTR)) {
+                    drop_client(s, map[i]);
+                    continue;
+                }
+                if (r > 0)
+                    c->in_len += r;
+            } else if (pfd[i].revents & (POLLHUP | POLLERR)) {
+                drop_client(s, map[i]);
+                continue;
+            }
+            if (serve_client(s, c))
+                drop_client(s, map[i]);
+        }
+    }
+    return NULL;
+}
+
+static int listen_unix(const char *path)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, 8)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_tcp(const char *addr, int port)
+{
+    struct sockaddr_in sa;
+    int fd, one = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (addr && inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, 8)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct wfs_server *wfs_create(const char *path, const char *addr, int port)
+{
+    struct wfs_server *s = calloc(1, sizeof(*s));
+    int i, err;
+
+    if (!s)
+        return NULL;
+    s->lfd[0] = s->lfd[1] = s->evfd = -1;
+    for (i = 0; i < WFS_MAX_CHANNELS; i++)
+        s->ch[i].file_fd = -1;
+    if (path && (s->lfd[0] = listen_unix(path)) < 0)
+        goto fail;
+    if (path)
+        strcpy(s->path, path);
+    if (port && (s->lfd[1] = listen_tcp(addr, port)) < 0)
+        goto fail;
+    s->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s->evfd < 0)
+        goto fail;
+    atomic_init(&s->quit, 0);
+    pthread_mutex_init(&s->lock, NULL);
+    if (pthread_create(&s->thread, NULL, serve, s)) {
+        pthread_mutex_destroy(&s->lock);
+        errno = EAGAIN;
+        goto fail;
+    }
+    return s;
+
+fail:
+    err = errno;
+    for (i = 0; i < 2; i++)
+        if (s->lfd[i] >= 0)
+            close(s->lfd[i]);
+    if (s->lfd[0] >= 0)
+        unlink(path);
+    if (s->evfd >= 0)
+        close(s->evfd);
+    free(s);
+    errno = err;
+    return NULL;
+}
+
+static void kick(struct wfs_server *s)
+{
+    uint64_t one = 1;
+    ssize_t r = write(s->evfd, &one, sizeof(one));
+
+    (void)r;
+}
+
+void wfs_destroy(struct wfs_server *s)
+{
+    int i;
+
+    if (!s)
+        return;
+    atomic_store(&s->quit, 1);
+    kick(s);
+    pthread_join(s->thread, NULL);
+    for (i = 0; i < WFS_MAX_CLIENTS; i++)
+        if (s->cl[i])
+            drop_client(s, i);
+    for (i = 0; i < s->nch; i++) {
+        unref(s, s->ch[i].cur);
+        if (s->ch[i].file_fd >= 0)
+            close(s->ch[i].file_fd);
+    }
+    for (i = 0; i < 2; i++)
+        if (s->lfd[i] >= 0)
+            close(s->lfd[i]);
+    if (s->lfd[0] >= 0)
+        unlink(s->path);
+    close(s->evfd);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+int wfs_add_channel(struct wfs_server *s, int bits, double sample_period)
+{
+    int ch;
+
+    if (bits != 8 && bits != 16) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&s->lock);
+    ch = s->nch;
+    if (ch < WFS_MAX_CHANNELS) {
+        s->ch[ch].bits = bits;
+        s->ch[ch].period = sample_period;
+        s->nch++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (ch == WFS_MAX_CHANNELS) {
+        errno = ENOSPC;
+        return -1;
+    }
+    return ch;
+}
+
+int wfs_publish(struct wfs_server *s, int ch, const void *data,
+                uint64_t samples, void (*release)(void *arg, const void *data),
+                void *arg)
+{
+    struct frame *f, *old;
+
+    if (ch < 0 || ch >= s->nch) {
+        errno = EINVAL;
+        return -1;
+    }
+    f = malloc(sizeof(*f));
+    if (!f)
+        return -1;
+    f->data = data;
+    f->samples = samples;
+    f->refs = 1;
+    f->release = release;
+    f->arg = arg;
+    pthread_mutex_lock(&s->lock);
+    old = s->ch[ch].cur;
+    f->seq = ++s->ch[ch].seq;
+    s->ch[ch].cur = f;
+    pthread_mutex_unlock(&s->lock);
+    unref(s, old);
+    kick(s);
+    return 0;
+}
+
+int wfs_attach_file(struct wfs_server *s, int ch, const char *path,
+                    uint64_t offset, uint64_t samples)
+{
+    int fd, ret = 0;
+
+    if (ch < 0 || ch >= s->nch) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    pthread_mutex_lock(&s->lock);
+    /* queued responses may still refer to the one attached */
+    if (s->ch[ch].file_fd >= 0) {
+        ret = -1;
+    } else {
+        s->ch[ch].file_fd = fd;
+        s->ch[ch].file_off = offset;
+        s->ch[ch].file_samples = samples;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (ret) {
+        close(fd);
+        errno = EBUSY;
+    }
+    return ret;
+}
+
+void wfs_get_stats(struct wfs_server *s, struct wfs_stats *st)
+{
+    pthread_mutex_lock(&s->lock);
+    *st = s->st;
+    pthread_mutex_unlock(&s->lock);
+}
+
+struct wfs_client {
+    int fd;
+};
+
+static struct wfs_client *client_new(int fd)
+{
+    struct wfs_client *c;
+
+    if (fd < 0)
+        return NULL;
+    c = malloc(sizeof(*c));
+    if (!c) {
+        close(fd);
+        return NULL;
+    }
+    c->fd = fd;
+    return c;
+}
+
+struct wfs_client *wfs_connect(const char *path)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+        close(fd);
+        return NULL;
+    }
+    return client_new(fd);
+}
+
+struct wfs_client *wfs_connect_tcp(const char *host, int port)
+{
+    struct sockaddr_in sa;
+    int fd, one = 1;
+
+    /* no resolver: it does not link statically */
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+        close(fd);
+        return NULL;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return client_new(fd);
+}
+
+void wfs_disconnect(struct wfs_client *c)
+{
+    if (!c)
+        return;
+    close(c->fd);
+    free(c);
+}
+
+int wfs_send(struct wfs_client *c, const struct wfs_req *req, int n)
+{
+    const uint8_t *p = (const uint8_t *)req;
+    size_t len = n * sizeof(*req);
+    ssize_t k;
+
+    while (len) {
+        k = send(c->fd, p, len, MSG_NOSIGNAL);
+        if (k < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += k;
+        len -= k;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    ssize_t k;
+
+    while (len) {
+        k = recv(fd, p, len, MSG_WAITALL);
+        if (k < 0 && errno == EINTR)
+            continue;
+        if (k <= 0) {
+            if (!k)
+                errno = ECONNRESET;
+            return -1;
+        }
+        p += k;
+        len -= k;
+    }
+    return 0;
+}
+
+long wfs_recv(struct wfs_client *c, struct wfs_resp *resp, void *buf,
+              size_t max)
+{
+    uint8_t skip[4096];
+    uint64_t rest;
+    size_t k;
+
+    if (recv_all(c->fd, resp, sizeof(*resp)))
+        return -1;
+    k = resp->bytes < max ? resp->bytes : max;
+    if (recv_all(c->fd, buf, k))
+        return -1;
+    for (rest = resp->bytes - k; rest; rest -= k) {
+        k = rest < sizeof(skip) ? rest : sizeof(skip);
+        if (recv_all(c->fd, skip, k))
+            return -1;
+    }
+    return resp->bytes;
+}
@@ -0,0 +1,122 @@
+/*
+ * Binary waveform server for automated test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __WFSERVER_H
+#define __WFSERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WFS_MAX_CHANNELS 8
+#define WFS_MAX_CLIENTS 16
+
+/*
+ * Protocol, native little endian. A client sends any number of requests
+ * back to back; each gets one response, in order, with its payload
+ * right after it. Subscribed channels also send a WFS_OP_FRAME response
+ * for every published frame, between the others.
+ */
+enum wfs_op {
+    WFS_OP_PING = 0,            /* no payload */
+    WFS_OP_INFO,                /* payload: struct wfs_info per channel */
+    WFS_OP_READ,                /* samples first .. of the current frame */
+    WFS_OP_READ_FILE,           /* samples first .. of the attached file */
+    WFS_OP_SUBSCRIBE,           /* no payload, then WFS_OP_FRAME pushes */
+    WFS_OP_UNSUBSCRIBE,
+    WFS_OP_FRAME
+};
+
+struct wfs_req {
+    uint32_t op;
+    uint32_t id;                /* echoed in the response */
+    uint32_t channel;
+    uint32_t reserved;
+    uint64_t first, count;      /* samples */
+};
+
+struct wfs_resp {
+    uint32_t op, id;
+    int32_t status;             /* 0 or -errno */
+    uint32_t channel;
+    uint64_t first;             /* samples, of the payload */
+    uint64_t seq;               /* frame the payload comes from */
+    uint64_t bytes;             /* of payload */
+};
+
+struct wfs_info {
+    uint32_t bits;
+    uint32_t reserved;
+    uint64_t samples;           /* in the current frame */
+    uint64_t seq;
+    uint64_t file_samples;
+    double sample_period;
+};
+
+struct wfs_stats {
+    int clients;
+    uint64_t requests;
+    uint64_t bytes_sent;
+    uint64_t frames_pushed;
+    uint64_t frames_skipped;    /* subscribers too far behind */
+};
+
+/*
+ * Server, serving path (a Unix socket) and, when port is not 0, TCP on
+ * that port, from a thread of its own. Returns NULL with errno.
+ * The TCP socket is bound to addr, a dotted IPv4 address, or to the
+ * loopback when addr is NULL: clients read samples and files without
+ * authentication, so "0.0.0.0" exposes them to the whole network.
+ */
+struct wfs_server;
+
+struct wfs_server *wfs_create(const char *path, const char *addr, int port);
+void wfs_destroy(struct wfs_server *s);
+
+/* Returns the channel number or -1 */
+int wfs_add_channel(struct wfs_server *s, int bits, double sample_period);
+
+/* Makes data the current frame of ch. Responses are sent from it
+   without copying, so it must stay unchanged until release(arg, data)
+   is called, from any thread, once the last of them has gone out and a
+   newer frame has been published (or the server destroyed). */
+int wfs_publish(struct wfs_server *s, int ch, const void *data,
+                uint64_t samples, void (*release)(void *arg, const void *data),
+                void *arg);
+
+/* Serves WFS_OP_READ_FILE for ch from samples stored raw at offset of
+   path; the kernel moves them from the page cache to the socket */
+int wfs_attach_file(struct wfs_server *s, int ch, const char *path,
+                    uint64_t offset, uint64_t samples);
+
+void wfs_get_stats(struct wfs_server *s, struct wfs_stats *st);
+
+/*
+ * Blocking client. wfs_recv() stores up to max bytes of the payload in
+ * buf, skips the rest and returns the payload size, or -1 with errno.
+ * wfs_connect_tcp() takes a dotted IPv4 address.
+ */
+struct wfs_client;
+
+struct wfs_client *wfs_connect(const char *path);
+struct wfs_client *wfs_connect_tcp(const char *host, int port);
+void wfs_disconnect(struct wfs_client *c);
+int wfs_send(struct wfs_client *c, const struct wfs_req *req, int n);
+long wfs_recv(struct wfs_client *c, struct wfs_resp *resp, void *buf,
+              size_t max);
+
+#endif